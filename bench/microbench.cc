@@ -0,0 +1,441 @@
+// Component-level microbenchmarks of the lexer and its scanner, parser, number arithmetic and interpreter primitives.
+//
+// Each benchmark is warmed up and calibrated so that a repetition takes about --min-time seconds, then repeated
+// --repetitions times.  The process is pinned to one CPU so that migrations don't add noise.  Results are written to
+// standard output as JSON.
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include <sched.h>
+#include <unistd.h>
+
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "../src/lexer.hh"
+#include "../src/scanner.hh"
+#include "../src/parser.hh"
+#include "../src/number.hh"
+#include "../src/interpreter.hh"
+#include "../src/statements.hh"
+#include "../src/timer.hh"
+
+namespace {
+
+// Run the measured operation iterations times and return the number of items (bytes, lines, operations) processed.
+typedef boost::uint64_t (*benchmark_function_t)(std::size_t iterations, int parameter);
+
+struct benchmark {
+    std::string             name;
+    char const*             unit;           // What the items are.
+    benchmark_function_t    function;
+    int                     parameter;
+};
+
+struct options {
+    std::size_t     repetitions;
+    double          min_time;
+    int             cpu;
+    std::string     filter;
+
+    options()
+        : repetitions(10)
+        , min_time(0.05)
+        , cpu(-1)
+    { }
+};
+
+struct result {
+    std::size_t             iterations;     // Per repetition.
+    std::vector<double>     seconds;        // Of each repetition.
+    boost::uint64_t         items;          // Per repetition.
+};
+
+volatile int sink;  // Results are stored here so that the compiler can't throw the work away.
+
+// A program exercising most of the syntax, repeated to make the lexer and parser inputs.
+char const SAMPLE_PROGRAM[] =
+    "REM Sample program for the front-end benchmarks\n"
+    "let total = 0\n"
+    "for i = 1 to 100\n"
+    "    if i mod 15 = 0 then\n"
+    "        print \"fizzbuzz \", i\n"
+    "    elseif i mod 3 = 0 then\n"
+    "        let total = total + i * 2 - (i / 3)\n"
+    "    else\n"
+    "        let name$ = \"value\" & \" \" & \"text\"\n"
+    "    end if\n"
+    "next i\n"
+    "let n = 10\n"
+    "do while n > 0\n"
+    "    let n = n - 1\n"
+    "loop\n";
+
+std::string const& get_source() {
+    static std::string source;
+    if (source.empty()) {
+        while (source.size() < (1 << 20))
+            source += SAMPLE_PROGRAM;
+    }
+    return source;
+}
+
+boost::uint64_t bench_lexer(std::size_t iterations, int) {
+    std::string const& source = get_source();
+    boost::uint64_t tokens = 0;
+
+    for (std::size_t i = 0; i < iterations; ++i)
+        tokens += token_stream(source).size();
+
+    sink = static_cast<int>(tokens);
+    return iterations * source.size();
+}
+
+// The scanner benchmarks run a scanning function over runs of characters that it goes past, each ended by a character
+// that stops it.  Run lengths are random, averaging run_length.
+typedef char const* (*scan_function_t)(char const* begin, char const* end);
+
+struct scanner_benchmark {
+    char const*     name;
+    scan_function_t simd;
+    scan_function_t scalar;
+    char            inside;         // Character of the runs.
+    char            stop;           // Character ending a run.
+    int             run_length;
+};
+
+scanner_benchmark const SCANNER_BENCHMARKS[] = {
+    { "blanks/run_8", &skip_blanks, &skip_blanks_scalar, ' ', 'x', 8 },
+    { "identifier/run_8", &skip_identifier_chars, &skip_identifier_chars_scalar, 'a', ' ', 8 },
+    { "identifier/run_64", &skip_identifier_chars, &skip_identifier_chars_scalar, 'a', ' ', 64 },
+    { "digits/run_8", &skip_digits, &skip_digits_scalar, '7', ' ', 8 },
+    { "string/run_64", &find_string_end, &find_string_end_scalar, 'a', '"', 64 },
+    { "line/run_64", &find_line_end, &find_line_end_scalar, 'a', '\n', 64 }
+};
+std::size_t const SCANNER_BENCHMARKS_COUNT = sizeof(SCANNER_BENCHMARKS) / sizeof(*SCANNER_BENCHMARKS);
+
+std::string const& get_scanner_input(std::size_t benchmark) {
+    static std::vector<std::string> inputs(SCANNER_BENCHMARKS_COUNT);
+    std::string& input = inputs[benchmark];
+
+    if (input.empty()) {
+        scanner_benchmark const& b = SCANNER_BENCHMARKS[benchmark];
+        std::srand(1);
+        while (input.size() < (1 << 20)) {
+            input.append(1 + std::rand() % (2 * b.run_length - 1), b.inside);
+            input += b.stop;
+        }
+    }
+
+    return input;
+}
+
+// parameter is twice the index into SCANNER_BENCHMARKS, plus one for the SIMD version.
+boost::uint64_t bench_scanner(std::size_t iterations, int parameter) {
+    scanner_benchmark const& b = SCANNER_BENCHMARKS[parameter / 2];
+    scan_function_t const scan = parameter % 2 ? b.simd : b.scalar;
+    std::string const& input = get_scanner_input(parameter / 2);
+    char const* const end = input.data() + input.size();
+
+    std::size_t runs = 0;
+    for (std::size_t i = 0; i < iterations; ++i) {
+        for (char const* position = input.data(); position != end; ++runs) {
+            position = scan(position, end);
+            if (position != end)
+                ++position;
+        }
+    }
+
+    sink = static_cast<int>(runs);
+    return iterations * input.size();
+}
+
+boost::uint64_t bench_parse(std::size_t iterations, int) {
+    std::string const& source = get_source();
+    boost::uint64_t const lines = std::count(source.begin(), source.end(), '\n');
+
+    token_stream const tokens(source);
+
+    for (std::size_t i = 0; i < iterations; ++i) {
+        block b = parse(tokens);
+        sink = static_cast<int>(b.statements.size());
+    }
+
+    return iterations * lines;
+}
+
+// parameter is the percentage of floating-point operands.
+std::vector<number> make_operands(int float_percent) {
+    std::vector<number> operands;
+    for (int i = 0; i < 1024; ++i) {
+        if (i % 100 < float_percent)
+            operands.push_back(number(i + 1.5));
+        else
+            operands.push_back(number(i + 1));
+    }
+    return operands;
+}
+
+boost::uint64_t bench_arithmetic(std::size_t iterations, int float_percent) {
+    std::vector<number> const operands = make_operands(float_percent);
+    number accumulator = 1;
+
+    for (std::size_t i = 0; i < iterations; ++i) {
+        for (std::size_t j = 0; j < operands.size(); ++j) {
+            accumulator += operands[j];
+            accumulator *= operands[j];
+            accumulator -= operands[j];
+            accumulator /= operands[j];
+        }
+    }
+
+    sink = accumulator.get_integral_value();
+    return iterations * operands.size() * 4;
+}
+
+boost::uint64_t bench_comparison(std::size_t iterations, int float_percent) {
+    std::vector<number> const operands = make_operands(float_percent);
+    int trues = 0;
+
+    for (std::size_t i = 0; i < iterations; ++i) {
+        for (std::size_t j = 1; j < operands.size(); ++j) {
+            trues += operands[j - 1] < operands[j];
+            trues += operands[j - 1] == operands[j];
+            trues += operands[j - 1] >= operands[j];
+        }
+    }
+
+    sink = trues;
+    return iterations * (operands.size() - 1) * 3;
+}
+
+// Enter depth - 1 blocks on top of the program and define the variable in the outermost one, so that every lookup
+// walks the whole stack.
+void enter_blocks(interpreter& interpreter, std::vector<block>& blocks) {
+    for (std::size_t i = 0; i < blocks.size(); ++i)
+        interpreter.enter_block(blocks[i]);
+}
+
+boost::uint64_t bench_get_var(std::size_t iterations, int depth) {
+    symbol_id const name = symbols.intern("x");
+    block program;
+    interpreter interpreter(program);
+    interpreter.set_var_numeric(name, 42);
+    std::vector<block> blocks(depth - 1);
+    enter_blocks(interpreter, blocks);
+
+    int total = 0;
+    for (std::size_t i = 0; i < iterations; ++i)
+        total += interpreter.get_var_numeric(name).get_integral_value();
+
+    sink = total;
+    return iterations;
+}
+
+boost::uint64_t bench_set_var(std::size_t iterations, int depth) {
+    symbol_id const name = symbols.intern("x");
+    block program;
+    interpreter interpreter(program);
+    interpreter.set_var_numeric(name, 0);
+    std::vector<block> blocks(depth - 1);
+    enter_blocks(interpreter, blocks);
+
+    for (std::size_t i = 0; i < iterations; ++i)
+        interpreter.set_var_numeric(name, static_cast<int>(i));
+
+    return iterations;
+}
+
+boost::uint64_t bench_jump(std::size_t iterations, int labels) {
+    block program;
+    std::vector<symbol_id> names;
+    for (int i = 0; i < labels; ++i) {
+        names.push_back(symbols.intern(boost::lexical_cast<std::string>(i * 10)));
+        block::statement_list::iterator s = program.statements.insert(
+            program.statements.end(), boost::shared_ptr<statement>(new empty_stmt));
+        program.jump_table.insert(std::make_pair(names.back(), s));
+    }
+
+    interpreter interpreter(program);
+    for (std::size_t i = 0; i < iterations; ++i)
+        interpreter.jump(names[(i * 7919) % names.size()]);
+
+    return iterations;
+}
+
+double elapsed_seconds(benchmark const& b, std::size_t iterations, boost::uint64_t& items) {
+    boost::uint64_t const start = read_nanoseconds();
+    items = b.function(iterations, b.parameter);
+    return (read_nanoseconds() - start) / 1e9;
+}
+
+result run(benchmark const& b, options const& opts) {
+    result r;
+
+    // Warm up and calibrate: grow the iteration count until one repetition takes long enough.
+    r.iterations = 1;
+    for (;;) {
+        double const seconds = elapsed_seconds(b, r.iterations, r.items);
+        if (seconds >= opts.min_time)
+            break;
+
+        double const factor = seconds > 0 ? std::min(10.0, 1.4 * opts.min_time / seconds) : 10.0;
+        r.iterations = std::max<std::size_t>(r.iterations + 1, static_cast<std::size_t>(r.iterations * factor));
+    }
+
+    for (std::size_t i = 0; i < opts.repetitions; ++i)
+        r.seconds.push_back(elapsed_seconds(b, r.iterations, r.items));
+
+    return r;
+}
+
+void write_json(std::ostream& os, benchmark const& b, result const& r, bool last) {
+    std::vector<double> sorted(r.seconds);
+    std::sort(sorted.begin(), sorted.end());
+
+    double mean = 0;
+    for (std::size_t i = 0; i < sorted.size(); ++i)
+        mean += sorted[i];
+    mean /= sorted.size();
+
+    double variance = 0;
+    for (std::size_t i = 0; i < sorted.size(); ++i)
+        variance += (sorted[i] - mean) * (sorted[i] - mean);
+    variance /= sorted.size();
+
+    double const median = sorted[sorted.size() / 2];
+
+    os << "    {\"name\": \"" << b.name << "\", \"unit\": \"" << b.unit << "\""
+       << ", \"iterations\": " << r.iterations << ", \"repetitions\": " << sorted.size()
+       << ", \"items_per_iteration\": " << r.items / r.iterations
+       << ", \"median_ns\": " << median * 1e9 / r.iterations
+       << ", \"min_ns\": " << sorted.front() * 1e9 / r.iterations
+       << ", \"mean_ns\": " << mean * 1e9 / r.iterations
+       << ", \"stddev_ns\": " << std::sqrt(variance) * 1e9 / r.iterations
+       << ", \"items_per_second\": " << r.items / median << "}" << (last ? "" : ",") << '\n';
+}
+
+bool parse_options(std::vector<std::string> const& parameters, options& opts) {
+    for (std::size_t i = 1; i < parameters.size(); ++i) {
+        std::string const& p = parameters[i];
+        std::string::size_type const equals = p.find('=');
+        std::string const name = p.substr(0, equals);
+        std::string const value = equals == std::string::npos ? std::string() : p.substr(equals + 1);
+
+        try {
+            if (name == "--repetitions")
+                opts.repetitions = std::max(1u, boost::lexical_cast<unsigned>(value));
+            else if (name == "--min-time")
+                opts.min_time = boost::lexical_cast<double>(value);
+            else if (name == "--cpu")
+                opts.cpu = boost::lexical_cast<int>(value);
+            else if (name == "--filter")
+                opts.filter = value;
+            else {
+                std::cerr << "Usage: " << parameters[0]
+                          << " [--repetitions=N] [--min-time=SECONDS] [--cpu=N] [--filter=SUBSTRING]\n";
+                return false;
+            }
+        } catch (boost::bad_lexical_cast const&) {
+            std::cerr << "Invalid value for " << name << ": " << value << '\n';
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Pin ourselves to the given CPU, or the one we're running on.  Returns the CPU, or -1 if pinning failed.
+int pin(int cpu) {
+    if (cpu < 0)
+        cpu = sched_getcpu();
+    if (cpu < 0)
+        return -1;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0 ? cpu : -1;
+}
+
+std::vector<benchmark> get_benchmarks() {
+    std::vector<benchmark> benchmarks;
+
+    benchmark const fixed[] = {
+        { "lexer/tokenize", "bytes", &bench_lexer, 0 },
+        { "parser/parse", "lines", &bench_parse, 0 },
+        { "number/arithmetic/integral", "operations", &bench_arithmetic, 0 },
+        { "number/arithmetic/float_10", "operations", &bench_arithmetic, 10 },
+        { "number/arithmetic/float_100", "operations", &bench_arithmetic, 100 },
+        { "number/comparison/integral", "operations", &bench_comparison, 0 },
+        { "number/comparison/float_10", "operations", &bench_comparison, 10 },
+        { "number/comparison/float_100", "operations", &bench_comparison, 100 }
+    };
+    benchmarks.assign(fixed, fixed + sizeof(fixed) / sizeof(*fixed));
+
+    for (std::size_t i = 0; i < SCANNER_BENCHMARKS_COUNT; ++i) {
+        std::string const name = std::string("scanner/") + SCANNER_BENCHMARKS[i].name;
+        benchmark const scalar = { name + "/scalar", "bytes", &bench_scanner, static_cast<int>(2 * i) };
+        benchmark const simd = { name + "/simd", "bytes", &bench_scanner, static_cast<int>(2 * i + 1) };
+        benchmarks.push_back(scalar);
+        benchmarks.push_back(simd);
+    }
+
+    int const depths[] = { 1, 4, 16, 64 };
+    for (std::size_t i = 0; i < sizeof(depths) / sizeof(*depths); ++i) {
+        std::string const suffix = "/depth_" + boost::lexical_cast<std::string>(depths[i]);
+        benchmark const get = { "interpreter/get_var_numeric" + suffix, "lookups", &bench_get_var, depths[i] };
+        benchmark const set = { "interpreter/set_var_numeric" + suffix, "assignments", &bench_set_var, depths[i] };
+        benchmarks.push_back(get);
+        benchmarks.push_back(set);
+    }
+
+    int const labels[] = { 1, 100, 10000 };
+    for (std::size_t i = 0; i < sizeof(labels) / sizeof(*labels); ++i) {
+        benchmark const jump = {
+            "interpreter/jump/labels_" + boost::lexical_cast<std::string>(labels[i]), "jumps", &bench_jump, labels[i]
+        };
+        benchmarks.push_back(jump);
+    }
+
+    return benchmarks;
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> parameters(argv, argv + argc);
+    options opts;
+    if (!parse_options(parameters, opts))
+        return 1;
+
+    int const cpu = pin(opts.cpu);
+    if (cpu < 0)
+        std::cerr << "Warning: couldn't pin to a CPU, results may be noisy\n";
+
+    std::vector<benchmark> benchmarks = get_benchmarks();
+    std::vector<benchmark> selected;
+    for (std::size_t i = 0; i < benchmarks.size(); ++i) {
+        if (benchmarks[i].name.find(opts.filter) != std::string::npos)
+            selected.push_back(benchmarks[i]);
+    }
+
+    std::cout << "{\n  \"context\": {\"cpu\": " << cpu << ", \"repetitions\": " << opts.repetitions
+              << ", \"min_time\": " << opts.min_time << "},\n"
+              << "  \"benchmarks\": [\n";
+    try {
+        for (std::size_t i = 0; i < selected.size(); ++i) {
+            std::cerr << selected[i].name << "...\n";
+            write_json(std::cout, selected[i], run(selected[i], opts), i + 1 == selected.size());
+        }
+    } catch (std::exception const& error) {
+        std::cerr << "Benchmark failed: " << error.what() << '\n';
+        return 1;
+    }
+    std::cout << "  ]\n}\n";
+}
@@ -0,0 +1,51 @@
+#!/bin/sh
+# Measure how the front end and the interpreter scale with program size.
+#
+# For each size in $SIZES (lines), generate a program with tools/basgen and run it with --stats, then print a table of
+# parse and run time and peak memory.  Extra options for basgen can be given in $BASGEN_FLAGS, e.g. to stress deep
+# expressions with BASGEN_FLAGS='--expr-width=20000'.  Options for the interpreter go in $BASIC_FLAGS; to see how the
+# front end scales with threads, compare e.g. BASIC_FLAGS=--jobs=1 and BASIC_FLAGS=--jobs=8.
+
+BASIC=${BASIC:-./basic}
+BASGEN=${BASGEN:-./tools/basgen}
+SIZES=${SIZES:-"1000 10000 100000 1000000"}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+printf '%10s %12s %12s %12s %12s %10s  %s\n' lines bytes parse_s run_s lines_per_s max_rss_kb status
+for size in $SIZES; do
+    "$BASGEN" --lines="$size" $BASGEN_FLAGS > "$WORK/program.bas" || exit 1
+    bytes=$(wc -c < "$WORK/program.bas")
+    lines=$(wc -l < "$WORK/program.bas")
+
+    if [ -x /usr/bin/time ]; then
+        /usr/bin/time -f '%M' -o "$WORK/rss" \
+            "$BASIC" $BASIC_FLAGS --stats=json --stats-file="$WORK/stats.json" "$WORK/program.bas" > /dev/null 2> "$WORK/stderr"
+        status=$?
+        rss=$(tail -n 1 "$WORK/rss")
+    else
+        "$BASIC" $BASIC_FLAGS --stats=json --stats-file="$WORK/stats.json" "$WORK/program.bas" > /dev/null 2> "$WORK/stderr"
+        status=$?
+        rss=-
+    fi
+
+    [ "$status" = 0 ] && status=ok
+    if [ -s "$WORK/stats.json" ]; then
+        parse_ns=$(sed -n 's/.*"parse_nanoseconds": \([0-9]*\).*/\1/p' "$WORK/stats.json")
+        run_ns=$(sed -n 's/.*"run_nanoseconds": \([0-9]*\).*/\1/p' "$WORK/stats.json")
+    else
+        parse_ns=0
+        run_ns=0
+        status="crashed($status)"
+    fi
+    if grep -q error "$WORK/stderr"; then
+        status="$(head -n 1 "$WORK/stderr")"
+    fi
+
+    awk -v lines="$lines" -v bytes="$bytes" -v p="$parse_ns" -v r="$run_ns" -v rss="$rss" -v status="$status" '
+        BEGIN {
+            rate = p > 0 ? lines / (p / 1e9) : 0
+            printf "%10d %12d %12.3f %12.3f %12.0f %10s  %s\n", lines, bytes, p / 1e9, r / 1e9, rate, rss, status
+        }'
+    rm -f "$WORK/stats.json"
+done
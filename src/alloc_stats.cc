@@ -0,0 +1,244 @@
+#include <new>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "alloc_stats.hh"
+#include "statements.hh"
+
+namespace {
+
+alloc_tracker* active_tracker = 0;
+
+// How much memory a block really takes.  Without a way to ask the allocator, frees can't be measured.
+std::size_t usable_size(void* p) {
+#if defined(__GLIBC__)
+    return malloc_usable_size(p);
+#else
+    (void) p;
+    return 0;
+#endif
+}
+
+void* allocate(std::size_t size) {
+    void* p = std::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+
+    if (active_tracker)
+        active_tracker->allocated(size, usable_size(p));
+    return p;
+}
+
+void deallocate(void* p) {
+    if (p && active_tracker)
+        active_tracker->freed(usable_size(p));
+    std::free(p);
+}
+
+bool more_bytes(alloc_tracker::entry const* lhs, alloc_tracker::entry const* rhs) {
+    return lhs->bytes > rhs->bytes;
+}
+
+}
+
+void* operator new (std::size_t size) throw (std::bad_alloc) {
+    return allocate(size);
+}
+
+void* operator new[] (std::size_t size) throw (std::bad_alloc) {
+    return allocate(size);
+}
+
+void* operator new (std::size_t size, std::nothrow_t const&) throw () {
+    try {
+        return allocate(size);
+    } catch (std::bad_alloc const&) {
+        return 0;
+    }
+}
+
+void* operator new[] (std::size_t size, std::nothrow_t const&) throw () {
+    try {
+        return allocate(size);
+    } catch (std::bad_alloc const&) {
+        return 0;
+    }
+}
+
+void operator delete (void* p) throw () {
+    deallocate(p);
+}
+
+void operator delete[] (void* p) throw () {
+    deallocate(p);
+}
+
+void operator delete (void* p, std::nothrow_t const&) throw () {
+    deallocate(p);
+}
+
+void operator delete[] (void* p, std::nothrow_t const&) throw () {
+    deallocate(p);
+}
+
+alloc_tracker::alloc_tracker(bool strict)
+    : strict(strict)
+    , running(false)
+    , table(static_cast<entry*>(std::calloc(table_size, sizeof(entry))))
+    , current(&interpreter_entry)
+    , statement_growth(0)
+    , live_bytes(0)
+    , peak_live_bytes(0)
+    , loops(max_depth)
+    , iterations(max_depth)
+    , steady(max_depth)
+    , in_steady_state(false)
+{
+    if (!table)
+        throw std::bad_alloc();
+
+    interpreter_entry.statement = 0;
+    interpreter_entry.count = interpreter_entry.bytes = interpreter_entry.peak = interpreter_entry.steady_count = 0;
+}
+
+alloc_tracker::~alloc_tracker() {
+    stop();
+    std::free(table);
+}
+
+void alloc_tracker::start() {
+    if (running)
+        return;
+    if (active_tracker)
+        throw std::logic_error("Another allocation tracker is already running");
+
+    active_tracker = this;
+    running = true;
+}
+
+void alloc_tracker::stop() {
+    if (running) {
+        active_tracker = 0;
+        running = false;
+    }
+}
+
+void alloc_tracker::before_statement(interpreter& interpreter, statement& statement) {
+    std::size_t const depth = std::min<std::size_t>(interpreter.get_block_depth(), max_depth - 1);
+    in_steady_state = steady[depth];
+
+    current = find_entry(&statement);
+    statement_growth = 0;
+}
+
+void alloc_tracker::after_statement(interpreter&, statement&) {
+    if (statement_growth > 0 && static_cast<boost::uint64_t>(statement_growth) > current->peak)
+        current->peak = statement_growth;
+
+    current = &interpreter_entry;
+}
+
+void alloc_tracker::entered_block(interpreter& interpreter, block&, block_statement* statement) {
+    std::size_t const depth = interpreter.get_block_depth();
+    if (depth == 0 || depth >= max_depth)
+        return;
+
+    if (statement && loops[depth] == statement)
+        ++iterations[depth];
+    else {
+        loops[depth] = statement;
+        iterations[depth] = 1;
+    }
+
+    steady[depth] = steady[depth - 1] || (statement && iterations[depth] >= 3);
+    in_steady_state = steady[depth];
+}
+
+void alloc_tracker::report(std::ostream& os, std::size_t top_lines) const {
+    std::vector<entry const*> entries;
+    for (std::size_t i = 0; i < table_size; ++i) {
+        if (table[i].count)
+            entries.push_back(&table[i]);
+    }
+    if (interpreter_entry.count)
+        entries.push_back(&interpreter_entry);
+    std::sort(entries.begin(), entries.end(), &more_bytes);
+
+    os << "Allocations: live " << live_bytes << " bytes, peak " << peak_live_bytes << " bytes\n"
+       << std::setw(12) << "count" << std::setw(14) << "bytes" << std::setw(12) << "peak"
+       << std::setw(12) << "steady" << "  location\n";
+
+    for (std::size_t i = 0; i < entries.size() && i < top_lines; ++i) {
+        entry const& e = *entries[i];
+        os << std::setw(12) << e.count << std::setw(14) << e.bytes << std::setw(12) << e.peak
+           << std::setw(12) << e.steady_count << "  ";
+        if (e.statement == 0)
+            os << "(interpreter)";
+        else if (&e == &table[table_size - 1])
+            os << "(other statements)";
+        else {
+            os << e.statement->get_location().filename << ':' << e.statement->get_location().line << ' '
+               << e.statement->get_type_name();
+        }
+        os << '\n';
+    }
+
+    if (failed())
+        os << "Allocation in steady-state loop detected\n";
+}
+
+bool alloc_tracker::failed() const {
+    if (!strict)
+        return false;
+
+    if (interpreter_entry.steady_count)
+        return true;
+    for (std::size_t i = 0; i < table_size; ++i) {
+        if (table[i].steady_count)
+            return true;
+    }
+    return false;
+}
+
+void alloc_tracker::allocated(std::size_t size, std::size_t usable_size) {
+    ++current->count;
+    current->bytes += size;
+    if (in_steady_state)
+        ++current->steady_count;
+
+    statement_growth += usable_size;
+    live_bytes += usable_size;
+    if (live_bytes > peak_live_bytes)
+        peak_live_bytes = live_bytes;
+}
+
+void alloc_tracker::freed(std::size_t usable_size) {
+    statement_growth -= usable_size;
+
+    // Blocks allocated before tracking started may be freed during it.
+    live_bytes = usable_size < live_bytes ? live_bytes - usable_size : 0;
+}
+
+alloc_tracker::entry* alloc_tracker::find_entry(statement const* statement) {
+    std::size_t const overflow = table_size - 1;
+    std::size_t i = (reinterpret_cast<std::size_t>(statement) >> 4) % overflow;
+
+    for (std::size_t probes = 0; probes < overflow; ++probes, i = (i + 1) % overflow) {
+        if (table[i].statement == statement)
+            return &table[i];
+        if (table[i].statement == 0) {
+            table[i].statement = statement;
+            return &table[i];
+        }
+    }
+
+    table[overflow].statement = statement;
+    return &table[overflow];
+}
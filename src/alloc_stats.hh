@@ -0,0 +1,78 @@
+#ifndef ALLOC_STATS_HH
+#define ALLOC_STATS_HH
+
+#include <vector>
+#include <ostream>
+
+#include <boost/cstdint.hpp>
+#include <boost/utility.hpp>
+
+#include "interpreter.hh"
+
+// Heap allocation tracking.  Linking alloc_stats.cc replaces the global operator new and delete with versions that,
+// while an alloc_tracker is active, count allocations and charge them to the statement being executed.  Allocations
+// made by the interpreter between statements are charged to the interpreter itself.
+//
+// A loop is considered to be in steady state from the third time its body is entered on; in strict mode, any
+// allocation made while some enclosing loop is in steady state is a violation.  Only one tracker may be active at a
+// time.
+class alloc_tracker : public interpreter_observer, boost::noncopyable {
+public:
+    explicit alloc_tracker(bool strict = false);
+    ~alloc_tracker();
+
+    void start();
+    void stop();
+
+    virtual void before_statement(interpreter& interpreter, statement& statement);
+    virtual void after_statement(interpreter&, statement&);
+    virtual void entered_block(interpreter& interpreter, block&, block_statement* statement);
+
+    // Print allocation count, bytes and peak per line, sorted by bytes.  Shall be called while the program is still
+    // alive.
+    void report(std::ostream& os, std::size_t top_lines = 20) const;
+
+    // Whether strict mode was requested and steady-state allocations were seen.
+    bool failed() const;
+
+    // Per-statement counters.  Public only so that operator new can get at it.
+    struct entry {
+        ::statement const*  statement;      // 0 for the interpreter itself.
+        boost::uint64_t     count;
+        boost::uint64_t     bytes;
+        boost::uint64_t     peak;           // The most a single execution grew the heap by.
+        boost::uint64_t     steady_count;   // Allocations made in steady-state loops.
+    };
+
+    // Called by operator new and delete.
+    void allocated(std::size_t size, std::size_t usable_size);
+    void freed(std::size_t usable_size);
+
+private:
+    enum { table_size = 1 << 16, max_depth = 256 };
+
+    bool const          strict;
+    bool                running;
+
+    // Open-addressed hash table of entries keyed by statement, allocated with malloc so that filling it doesn't
+    // recurse into operator new.  The last slot holds statements that didn't fit.
+    entry*              table;
+    entry               interpreter_entry;
+    entry*              current;
+
+    // Heap growth during the current statement.
+    boost::int64_t      statement_growth;
+    boost::uint64_t     live_bytes;
+    boost::uint64_t     peak_live_bytes;
+
+    // For each block depth, the loop statement that last entered a block at that depth, how many times in a row it
+    // did, and whether the block at that depth runs in steady state.  Sized up front, for the same reason.
+    std::vector<block_statement const*> loops;
+    std::vector<unsigned>               iterations;
+    std::vector<bool>                   steady;
+    bool                                in_steady_state;
+
+    entry* find_entry(::statement const* statement);
+};
+
+#endif
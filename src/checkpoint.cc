@@ -0,0 +1,279 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "checkpoint.hh"
+#include "program_cache.hh"
+#include "metrics.hh"
+#include "symbols.hh"
+
+namespace {
+
+// Bump whenever the format changes.
+boost::uint32_t const FORMAT_VERSION = 2;
+
+char const MAGIC[4] = { 'B', 'A', 'S', 'K' };
+
+// A checkpoint is this header, then the frames from the top level up, then the interpreter's temporaries as a count and
+// numbers.  A frame is which body of its statement it is, its position, its numeric variables as a count and (name,
+// value) pairs, its string variables likewise, and the final value and step of its FOR loop.  A name or string is its
+// length and characters; a number is whether it's an integer, then both its integral and its floating-point value,
+// which differ once the former has wrapped around.
+struct checkpoint_header {
+    char            magic[4];
+    boost::uint32_t version;
+    boost::uint64_t program_key;
+    boost::uint64_t input_offset;
+    boost::uint64_t output_offset;
+    boost::uint32_t frame_count;
+    boost::uint32_t reserved;
+};
+
+class state_writer {
+public:
+    void write(boost::uint32_t value) { append(&value, sizeof(value)); }
+
+    void write(std::string const& s) {
+        write(static_cast<boost::uint32_t>(s.size()));
+        data += s;
+    }
+
+    void write(number const& n) {
+        write(static_cast<boost::uint32_t>(n.is_integral()));
+        boost::int32_t const integral_value = n.get_integral_value();
+        append(&integral_value, sizeof(integral_value));
+        double const floating_point_value = n.get_floating_point_value();
+        append(&floating_point_value, sizeof(floating_point_value));
+    }
+
+    void append(void const* bytes, std::size_t size) { data.append(static_cast<char const*>(bytes), size); }
+
+    std::string const& get_data() const { return data; }
+
+private:
+    std::string data;
+};
+
+class state_reader {
+public:
+    state_reader(std::string const& data, std::size_t position) : data(data), position(position) { }
+
+    boost::uint32_t read_word() {
+        boost::uint32_t result;
+        read(&result, sizeof(result));
+        return result;
+    }
+
+    std::string read_string() {
+        std::size_t const size = read_word();
+        check(size);
+        std::string const result = data.substr(position, size);
+        position += size;
+        return result;
+    }
+
+    number read_number() {
+        bool const integral = read_word();
+        boost::int32_t integral_value;
+        read(&integral_value, sizeof(integral_value));
+        double floating_point_value;
+        read(&floating_point_value, sizeof(floating_point_value));
+        return number(static_cast<int>(integral_value), floating_point_value, integral);
+    }
+
+    void read(void* bytes, std::size_t size) {
+        check(size);
+        std::memcpy(bytes, data.data() + position, size);
+        position += size;
+    }
+
+private:
+    std::string const&  data;
+    std::size_t         position;
+
+    void check(std::size_t size) const {
+        if (size > data.size() - position)
+            throw checkpoint_error("Checkpoint is cut short");
+    }
+};
+
+bool write_checkpoint(std::string const& filename, boost::uint64_t program_key, interpreter_state const& state) {
+    checkpoint_header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.program_key = program_key;
+    header.input_offset = metrics.input_bytes;
+    header.output_offset = metrics.output_bytes;
+    header.frame_count = state.frames.size();
+    header.reserved = 0;
+
+    state_writer writer;
+    writer.append(&header, sizeof(header));
+
+    typedef std::vector<interpreter_state::frame>::const_iterator frame_iterator;
+    for (frame_iterator frame = state.frames.begin(); frame != state.frames.end(); ++frame) {
+        writer.write(static_cast<boost::uint32_t>(frame->body));
+        writer.write(static_cast<boost::uint32_t>(frame->position));
+
+        writer.write(static_cast<boost::uint32_t>(frame->numeric_variables.size()));
+        typedef std::map<symbol_id, number>::const_iterator numeric_iterator;
+        for (numeric_iterator v = frame->numeric_variables.begin(); v != frame->numeric_variables.end(); ++v) {
+            writer.write(symbols.get_name(v->first));
+            writer.write(v->second);
+        }
+
+        writer.write(static_cast<boost::uint32_t>(frame->string_variables.size()));
+        typedef std::map<symbol_id, std::string>::const_iterator string_iterator;
+        for (string_iterator v = frame->string_variables.begin(); v != frame->string_variables.end(); ++v) {
+            writer.write(symbols.get_name(v->first));
+            writer.write(v->second);
+        }
+
+        writer.write(frame->final_value);
+        writer.write(frame->step);
+    }
+
+    writer.write(static_cast<boost::uint32_t>(state.temporaries.size()));
+    for (std::vector<number>::const_iterator t = state.temporaries.begin(); t != state.temporaries.end(); ++t)
+        writer.write(*t);
+
+    std::ostringstream temporary_name;
+    temporary_name << filename << ".tmp" << getpid();
+
+    std::ofstream out(temporary_name.str().c_str(), std::ios::binary);
+    out.write(writer.get_data().data(), writer.get_data().size());
+    out.close();
+
+    if (!out || std::rename(temporary_name.str().c_str(), filename.c_str()) != 0) {
+        std::remove(temporary_name.str().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+}
+
+checkpoint_error::checkpoint_error(std::string const& what)
+    : std::runtime_error(what)
+{ }
+
+checkpointer::checkpointer(std::string const& filename, boost::uint64_t interval, block const& program)
+    : filename(filename)
+    , interval(interval)
+    , countdown(interval)
+    , program_key(hash_program(program))
+    , writer(0)
+{ }
+
+checkpointer::~checkpointer() {
+    reap_writer(true);
+}
+
+void checkpointer::after_statement(interpreter& interpreter, statement&) {
+    if (--countdown != 0)
+        return;
+    countdown = interval;
+
+    // If the last checkpoint is still being written, this one is skipped.
+    if (reap_writer(false))
+        save(interpreter);
+}
+
+void checkpointer::save(interpreter const& interpreter) {
+    // So that the output offset is where the output really ends.
+    std::cout.flush();
+
+    pid_t const child = fork();
+    if (child == 0)
+        _exit(write_checkpoint(filename, program_key, interpreter.get_state()) ? 0 : 1);
+    else if (child > 0)
+        writer = child;
+    else if (!write_checkpoint(filename, program_key, interpreter.get_state()))
+        std::cerr << "Can't write checkpoint to " << filename << '\n';
+}
+
+bool checkpointer::reap_writer(bool wait) {
+    if (writer <= 0)
+        return true;
+
+    int status;
+    pid_t result;
+    do
+        result = waitpid(writer, &status, wait ? 0 : WNOHANG);
+    while (result < 0 && errno == EINTR);
+
+    if (result == 0)
+        return false;
+
+    if (result == writer && !(WIFEXITED(status) && WEXITSTATUS(status) == 0))
+        std::cerr << "Can't write checkpoint to " << filename << '\n';
+    writer = 0;
+    return true;
+}
+
+void restore_checkpoint(std::string const& filename, block& program, interpreter& interpreter) {
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in)
+        throw checkpoint_error("Can't open " + filename + " for reading");
+    std::string const data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    checkpoint_header header;
+    state_reader reader(data, 0);
+    reader.read(&header, sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != FORMAT_VERSION)
+        throw checkpoint_error(filename + " is not a checkpoint");
+    if (header.program_key != hash_program(program))
+        throw checkpoint_error(filename + " is a checkpoint of another program");
+
+    interpreter_state state;
+    for (boost::uint32_t i = 0; i < header.frame_count; ++i) {
+        interpreter_state::frame frame;
+        frame.body = reader.read_word();
+        frame.position = reader.read_word();
+
+        for (boost::uint32_t count = reader.read_word(); count > 0; --count) {
+            symbol_id const name = symbols.intern(reader.read_string());
+            frame.numeric_variables[name] = reader.read_number();
+        }
+
+        for (boost::uint32_t count = reader.read_word(); count > 0; --count) {
+            symbol_id const name = symbols.intern(reader.read_string());
+            frame.string_variables[name] = reader.read_string();
+        }
+
+        frame.final_value = reader.read_number();
+        frame.step = reader.read_number();
+        state.frames.push_back(frame);
+    }
+
+    for (boost::uint32_t count = reader.read_word(); count > 0; --count)
+        state.temporaries.push_back(reader.read_number());
+
+    try {
+        interpreter.set_state(program, state);
+    } catch (runtime_error const& error) {
+        throw checkpoint_error(filename + ": " + error.what());
+    }
+
+    // Skip the input the run had read, and cut off the output it wrote after the checkpoint.
+    std::cin.ignore(header.input_offset);
+    metrics.input_bytes = header.input_offset;
+    metrics.output_bytes = header.output_offset;
+
+    struct stat output;
+    if (fstat(STDOUT_FILENO, &output) == 0 && S_ISREG(output.st_mode)
+        && static_cast<boost::uint64_t>(output.st_size) >= header.output_offset) {
+        if (ftruncate(STDOUT_FILENO, header.output_offset) != 0
+            || lseek(STDOUT_FILENO, header.output_offset, SEEK_SET) < 0)
+            throw checkpoint_error(std::string("Can't cut back the output: ") + std::strerror(errno));
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef CHECKPOINT_HH
+#define CHECKPOINT_HH
+
+#include <string>
+#include <stdexcept>
+
+#include <boost/cstdint.hpp>
+#include <sys/types.h>
+
+#include "interpreter.hh"
+
+struct checkpoint_error : std::runtime_error {
+    explicit checkpoint_error(std::string const& what);
+};
+
+// Saves the state of a run to a file every so many statements: the entered blocks and where in them the run is, the
+// variables, the bounds of running FOR loops, and how much input and output the run has read and written.  The file is
+// written by a forked child from its copy-on-write image of the interpreter, so the run only stops for as long as the
+// fork takes, and under a temporary name that's then renamed, so that a crash while writing it leaves the last one.
+class checkpointer : public interpreter_observer {
+public:
+    // program is what's being run; checkpoints are only restored into the same program.  It shall have been parsed
+    // whole.
+    checkpointer(std::string const& filename, boost::uint64_t interval, block const& program);
+
+    // Waits for the last checkpoint to be written.
+    ~checkpointer();
+
+    virtual void after_statement(interpreter& interpreter, statement&);
+
+private:
+    std::string const       filename;
+    boost::uint64_t const   interval;
+    boost::uint64_t         countdown;
+    boost::uint64_t const   program_key;
+    pid_t                   writer;         // The child writing the last checkpoint, if it may still be running.
+
+    void save(interpreter const& interpreter);
+
+    // Wait for the writer to finish, if it has or if asked to, and report if it failed.  Return whether it's done.
+    bool reap_writer(bool wait);
+};
+
+// Continue a run of program saved by a checkpointer.  The input shall be the same as the saved run's; what the run has
+// read of it is skipped.  If standard output is a file at least as long as the output the run had written, it is cut
+// back to that length, so that output written after the checkpoint isn't repeated.  Throws checkpoint_error.
+void restore_checkpoint(std::string const& filename, block& program, interpreter& interpreter);
+
+#endif
@@ -0,0 +1,376 @@
+#include <map>
+#include <set>
+#include <vector>
+#include <utility>
+
+#include <boost/optional.hpp>
+#include <boost/next_prior.hpp>
+
+#include "eliminator.hh"
+#include "statements.hh"
+#include "folder.hh"
+
+namespace {
+
+typedef block::statement_list::iterator iterator;
+
+// The labels a program jumps to, by the block they're found in, and the variables it reads.
+class reference_collector : private statement_visitor, private expr_visitor {
+public:
+    std::set<std::pair<block const*, symbol_id> >   labels;
+    std::set<symbol_id>                             variables;
+
+    void collect(block const& program);
+
+    // Whether an expression reads any variables, without collecting them.
+    bool reads_variables(printable_expr const& expr);
+
+private:
+    std::vector<block const*>           scopes;     // Blocks the statement being looked at is in, outermost first.
+    std::vector<printable_expr const*>  pending;
+
+    void add_block(block const& b);
+    void add_jump(symbol_id label);
+    void add_reads(printable_expr const& expr);
+
+    virtual void visit(if_goto_stmt const& statement);
+    virtual void visit(if_block_stmt const& statement);
+    virtual void visit(do_stmt const& statement);
+    virtual void visit(for_stmt const& statement);
+    virtual void visit(print_stmt const& statement);
+    virtual void visit(input_stmt const&) { }
+    virtual void visit(let_stmt const& statement);
+    virtual void visit(goto_stmt const& statement);
+    virtual void visit(stop_stmt const&) { }
+    virtual void visit(exit_stmt const&) { }
+    virtual void visit(include_stmt const&) { }
+    virtual void visit(empty_stmt const&) { }
+
+    virtual void visit(string_concat_expr const& expr);
+    virtual void visit(string_variable_expr const& expr);
+    virtual void visit(string_literal_expr const&) { }
+    virtual void visit(arith_expr const& expr);
+    virtual void visit(variable_expr const& expr);
+    virtual void visit(constant_expr const&) { }
+    virtual void visit(relational_expr const& expr);
+    virtual void visit(boolean_expr const& expr);
+    virtual void visit(save_expr const& expr);
+    virtual void visit(temporary_expr const& expr);
+};
+
+void reference_collector::collect(block const& program) {
+    labels.clear();
+    variables.clear();
+    add_block(program);
+}
+
+bool reference_collector::reads_variables(printable_expr const& expr) {
+    std::set<symbol_id> read;
+    read.swap(variables);
+    add_reads(expr);
+    read.swap(variables);
+    return !read.empty();
+}
+
+void reference_collector::add_block(block const& b) {
+    scopes.push_back(&b);
+    for (block::statement_list::const_iterator s = b.statements.begin(); s != b.statements.end(); ++s)
+        (*s)->accept(*this);
+    scopes.pop_back();
+}
+
+void reference_collector::add_jump(symbol_id label) {
+    // Jumps look for the label in the innermost block first.
+    for (std::vector<block const*>::const_reverse_iterator scope = scopes.rbegin(); scope != scopes.rend(); ++scope)
+        if ((*scope)->jump_table.count(label)) {
+            labels.insert(std::make_pair(*scope, label));
+            return;
+        }
+}
+
+void reference_collector::add_reads(printable_expr const& expr) {
+    pending.push_back(&expr);
+    while (!pending.empty()) {
+        printable_expr const* const e = pending.back();
+        pending.pop_back();
+        e->accept(*this);
+    }
+}
+
+void reference_collector::visit(if_goto_stmt const& statement) {
+    add_reads(statement.get_condition());
+    add_jump(statement.get_then_label());
+    if (statement.get_else_label())
+        add_jump(*statement.get_else_label());
+}
+
+void reference_collector::visit(if_block_stmt const& statement) {
+    if_block_stmt::conditions_cont const& conditions = statement.get_conditions();
+    for (if_block_stmt::conditions_cont::const_iterator c = conditions.begin(); c != conditions.end(); ++c)
+        add_reads(**c);
+
+    std::vector<block> const& blocks = statement.get_blocks();
+    for (std::vector<block>::const_iterator b = blocks.begin(); b != blocks.end(); ++b)
+        add_block(*b);
+}
+
+void reference_collector::visit(do_stmt const& statement) {
+    add_reads(statement.get_condition());
+    add_block(statement.get_body());
+}
+
+void reference_collector::visit(for_stmt const& statement) {
+    variables.insert(statement.get_variable_name());   // NEXT reads it back.
+    add_reads(statement.get_initial_value());
+    add_reads(statement.get_final_value());
+    add_reads(statement.get_step());
+    add_block(statement.get_body());
+}
+
+void reference_collector::visit(print_stmt const& statement) {
+    print_stmt::expressions_cont const& expressions = statement.get_expressions();
+    for (print_stmt::expressions_cont::const_iterator e = expressions.begin(); e != expressions.end(); ++e)
+        add_reads(**e);
+}
+
+void reference_collector::visit(let_stmt const& statement) {
+    if (statement.get_numeric_value())
+        add_reads(*statement.get_numeric_value());
+    else
+        add_reads(*statement.get_string_value());
+}
+
+void reference_collector::visit(goto_stmt const& statement) {
+    add_jump(statement.get_label());
+}
+
+void reference_collector::visit(string_concat_expr const& expr) {
+    pending.push_back(&expr.get_right());
+    pending.push_back(&expr.get_left());
+}
+
+void reference_collector::visit(string_variable_expr const& expr) {
+    variables.insert(expr.get_name());
+}
+
+void reference_collector::visit(arith_expr const& expr) {
+    pending.push_back(&expr.get_right_side());
+    pending.push_back(&expr.get_left_side());
+}
+
+void reference_collector::visit(variable_expr const& expr) {
+    variables.insert(expr.get_name());
+}
+
+void reference_collector::visit(relational_expr const& expr) {
+    pending.push_back(&expr.get_right_side());
+    pending.push_back(&expr.get_left_side());
+}
+
+void reference_collector::visit(boolean_expr const& expr) {
+    if (expr.get_right_side())
+        pending.push_back(expr.get_right_side());
+    pending.push_back(&expr.get_left_side());
+}
+
+void reference_collector::visit(save_expr const& expr) {
+    pending.push_back(&expr.get_operand());
+}
+
+// A temporary reads what the expression it stands for does.
+void reference_collector::visit(temporary_expr const& expr) {
+    pending.push_back(&expr.get_original());
+}
+
+class dead_code_eliminator : boost::noncopyable {
+public:
+    explicit dead_code_eliminator(block& program);
+
+    void run();
+
+private:
+    block&              program;
+    reference_collector references;
+    constant_folder     folder;
+    bool                changed;
+
+    // The value of an expression that doesn't depend on any variables and doesn't fail or trap.
+    boost::optional<bool> get_constant_condition(numeric_expr const& condition);
+    bool is_constant(printable_expr const& expr);
+
+    // Replace the statements of a block, and those in its blocks, whose conditions are constant by what they do.
+    void simplify(block& b);
+    void simplify(boost::shared_ptr<statement>& s);
+
+    // Remove what isn't needed of a block and its blocks, as far as the references collected tell.
+    void prune(block& b);
+    bool is_dead(statement const& s);
+};
+
+dead_code_eliminator::dead_code_eliminator(block& program)
+    : program(program)
+    , changed(false)
+{ }
+
+void dead_code_eliminator::run() {
+    simplify(program);
+
+    // Removing code can leave labels it jumped to and variables it read unused, and so more code dead.
+    do {
+        changed = false;
+        references.collect(program);
+        prune(program);
+    } while (changed);
+}
+
+boost::optional<bool> dead_code_eliminator::get_constant_condition(numeric_expr const& condition) {
+    if (boost::optional<number> const value = folder.fold(condition))
+        return value->is_true();
+    return boost::optional<bool>();
+}
+
+bool dead_code_eliminator::is_constant(printable_expr const& expr) {
+    if (numeric_expr const* const number = dynamic_cast<numeric_expr const*>(&expr))
+        return folder.fold(*number).is_initialized();
+
+    return !references.reads_variables(expr);    // Joining strings doesn't fail.
+}
+
+void dead_code_eliminator::simplify(block& b) {
+    for (iterator s = b.statements.begin(); s != b.statements.end(); ++s)
+        simplify(*s);
+}
+
+void dead_code_eliminator::simplify(boost::shared_ptr<statement>& s) {
+    // Statements are replaced where they are in the list, so that their labels still lead to them.  Those that do
+    // nothing become empty statements, which prune removes.
+    boost::shared_ptr<statement> replacement;
+
+    if (if_goto_stmt const* const branch = dynamic_cast<if_goto_stmt const*>(s.get())) {
+        if (boost::optional<bool> const value = get_constant_condition(branch->get_condition())) {
+            if (*value)
+                replacement.reset(new goto_stmt(branch->get_then_label()));
+            else if (branch->get_else_label())
+                replacement.reset(new goto_stmt(*branch->get_else_label()));
+            else
+                replacement.reset(new empty_stmt);
+        }
+    } else if (if_block_stmt* const if_block = dynamic_cast<if_block_stmt*>(s.get())) {
+        if_block_stmt::conditions_cont const& conditions = if_block->get_conditions();
+        std::vector<block>& blocks = if_block->get_blocks();
+        for (std::vector<block>::iterator b = blocks.begin(); b != blocks.end(); ++b)
+            simplify(*b);
+
+        // Branches whose conditions are false are never taken, and neither are those after one that's true.
+        if_block_stmt::conditions_cont kept_conditions;
+        std::vector<block> kept_blocks;
+        bool taken = false;
+        for (std::size_t i = 0; i < conditions.size() && !taken; ++i) {
+            boost::optional<bool> const value = get_constant_condition(*conditions[i]);
+            if (!value || *value) {
+                kept_conditions.push_back(conditions[i]);
+                kept_blocks.push_back(blocks[i]);
+                taken = value && *value;
+            }
+        }
+
+        if (!taken && blocks.size() > conditions.size()) {
+            if (kept_conditions.empty())
+                kept_conditions.push_back(boost::shared_ptr<numeric_expr>(new constant_expr(1)));
+            kept_blocks.push_back(blocks.back());
+        }
+
+        if (kept_blocks.empty())
+            replacement.reset(new empty_stmt);
+        else if (kept_blocks.size() != blocks.size())
+            replacement.reset(new if_block_stmt(kept_conditions, kept_blocks));
+    } else if (do_stmt* const loop = dynamic_cast<do_stmt*>(s.get())) {
+        boost::optional<bool> const value = get_constant_condition(loop->get_condition());
+        if (value && !*value)
+            replacement.reset(new empty_stmt);
+        else
+            simplify(loop->get_body());
+    } else if (for_stmt* const loop = dynamic_cast<for_stmt*>(s.get()))
+        simplify(loop->get_body());
+
+    if (replacement) {
+        replacement->set_location(s->get_location());
+        s = replacement;
+    }
+}
+
+void dead_code_eliminator::prune(block& b) {
+    for (iterator s = b.statements.begin(); s != b.statements.end(); ++s) {
+        if (if_block_stmt* const if_block = dynamic_cast<if_block_stmt*>(s->get())) {
+            std::vector<block>& blocks = if_block->get_blocks();
+            for (std::vector<block>::iterator body = blocks.begin(); body != blocks.end(); ++body)
+                prune(*body);
+        } else if (do_stmt* const loop = dynamic_cast<do_stmt*>(s->get()))
+            prune(loop->get_body());
+        else if (for_stmt* const loop = dynamic_cast<for_stmt*>(s->get()))
+            prune(loop->get_body());
+    }
+
+    // Labels nothing jumps to go; the statements of those that stay can be reached.
+    std::set<statement const*> jumped_to;
+    for (block::jump_table_t::iterator label = b.jump_table.begin(); label != b.jump_table.end(); ) {
+        if (references.labels.count(std::make_pair(&b, label->first))) {
+            if (label->second != b.statements.end())
+                jumped_to.insert(label->second->get());
+            ++label;
+        } else {
+            b.jump_table.erase(label++);
+            changed = true;
+        }
+    }
+
+    bool reached = true;    // The beginning of the block is.
+    for (iterator s = b.statements.begin(); s != b.statements.end(); ) {
+        bool const labelled = jumped_to.count(s->get());
+        reached = reached || labelled;
+
+        statement const& current = **s;
+        bool falls_through = true;
+        if (dynamic_cast<goto_stmt const*>(&current) || dynamic_cast<stop_stmt const*>(&current)
+            || dynamic_cast<exit_stmt const*>(&current))
+            falls_through = false;
+        else if (if_goto_stmt const* const branch = dynamic_cast<if_goto_stmt const*>(&current))
+            falls_through = !branch->get_else_label();
+
+        // A jump to the next statement is as good as going on to it.
+        bool jumps_to_next = false;
+        if (goto_stmt const* const jump = dynamic_cast<goto_stmt const*>(&current)) {
+            block::jump_table_t::const_iterator const target = b.jump_table.find(jump->get_label());
+            jumps_to_next = target != b.jump_table.end() && target->second == boost::next(s);
+        }
+
+        if (!reached || (!labelled && (jumps_to_next || is_dead(current)))) {
+            b.statements.erase(s++);
+            changed = true;
+        } else
+            ++s;
+
+        reached = reached && falls_through;
+    }
+}
+
+bool dead_code_eliminator::is_dead(statement const& s) {
+    if (dynamic_cast<empty_stmt const*>(&s))
+        return true;
+
+    if (let_stmt const* const assignment = dynamic_cast<let_stmt const*>(&s)) {
+        if (references.variables.count(assignment->get_variable_name()))
+            return false;
+        if (assignment->get_numeric_value())
+            return is_constant(*assignment->get_numeric_value());
+        return is_constant(*assignment->get_string_value());
+    }
+
+    return false;
+}
+
+}
+
+void eliminate_dead_code(block& program) {
+    dead_code_eliminator(program).run();
+}
@@ -0,0 +1,16 @@
+#ifndef ELIMINATOR_HH
+#define ELIMINATOR_HH
+
+#include "parser.hh"
+
+// Remove what a wholly parsed program does in vain:
+//
+//  - Statements that can't be reached: those after a GOTO, STOP or EXIT up to the next label something jumps to.
+//  - Labels nothing jumps to, and GOTOs to the statement after them.
+//  - IF ... THEN, IF and ELSEIF branches, and DO loops, whose conditions are constant and false; branches after a
+//    constant true one go too.
+//  - LETs of variables that are never read, if working the value out can't fail -- that is, it doesn't depend on any
+//    variables and constant_folder works it out -- as well as REMs and blank lines.
+void eliminate_dead_code(block& program);
+
+#endif
@@ -0,0 +1,141 @@
+#include <limits>
+#include <memory>
+
+#include "folder.hh"
+
+namespace {
+
+std::auto_ptr<numeric_expr> make_constant(number const& value) {
+    return std::auto_ptr<numeric_expr>(new constant_expr(value));
+}
+
+// Whether doing op on the values traps: integer division isn't checked for the one quotient that overflows, nor the
+// modulo for a zero divisor.
+bool traps(arith_expr::e_operator op, number const& left, number const& right) {
+    if (op != arith_expr::operator_divides && op != arith_expr::operator_modulo)
+        return false;
+
+    int const divisor = right.get_integral_value();
+    return (op == arith_expr::operator_modulo && divisor == 0)
+           || (divisor == -1 && left.get_integral_value() == std::numeric_limits<int>::min());
+}
+
+}
+
+constant_folder::constant_folder()
+    : operands_done(false)
+    , failed(false)
+{ }
+
+boost::optional<number> constant_folder::fold(numeric_expr const& expr) {
+    pending.assign(1, std::make_pair(&expr, false));
+    values.clear();
+    failed = false;
+
+    while (!pending.empty() && !failed) {
+        numeric_expr const* const e = pending.back().first;
+        operands_done = pending.back().second;
+        pending.pop_back();
+        e->accept(*this);
+    }
+
+    pending.clear();
+    if (failed)
+        return boost::optional<number>();
+    return values.back();
+}
+
+bool constant_folder::have_operands(numeric_expr const& expr, numeric_expr const& left, numeric_expr const* right) {
+    if (operands_done)
+        return true;
+
+    pending.push_back(std::make_pair(&expr, true));
+    if (right)
+        pending.push_back(std::make_pair(right, false));
+    pending.push_back(std::make_pair(&left, false));
+    return false;
+}
+
+void constant_folder::push(numeric_expr const& operation) {
+    try {
+        values.push_back(operation.evaluate(scratch));
+    } catch (runtime_error const&) {
+        failed = true;
+    }
+}
+
+// Strings aren't operands of numeric operations.
+void constant_folder::visit(string_concat_expr const&) {
+    failed = true;
+}
+
+void constant_folder::visit(string_variable_expr const&) {
+    failed = true;
+}
+
+void constant_folder::visit(string_literal_expr const&) {
+    failed = true;
+}
+
+void constant_folder::visit(arith_expr const& expr) {
+    if (!have_operands(expr, expr.get_left_side(), &expr.get_right_side()))
+        return;
+
+    number const right = values.back();
+    values.pop_back();
+    number const left = values.back();
+    values.pop_back();
+
+    if (traps(expr.get_operator(), left, right)) {
+        failed = true;
+        return;
+    }
+
+    push(arith_expr(make_constant(left), make_constant(right), expr.get_operator()));
+}
+
+void constant_folder::visit(variable_expr const&) {
+    failed = true;
+}
+
+void constant_folder::visit(constant_expr const& expr) {
+    values.push_back(expr.get_value());
+}
+
+void constant_folder::visit(relational_expr const& expr) {
+    if (!have_operands(expr, expr.get_left_side(), &expr.get_right_side()))
+        return;
+
+    number const right = values.back();
+    values.pop_back();
+    number const left = values.back();
+    values.pop_back();
+
+    push(relational_expr(make_constant(left), make_constant(right), expr.get_operator()));
+}
+
+// Both operands of AND and OR are worked out, even where the run wouldn't get to the right one; if that fails, so
+// does folding the whole.
+void constant_folder::visit(boolean_expr const& expr) {
+    if (!have_operands(expr, expr.get_left_side(), expr.get_right_side()))
+        return;
+
+    std::auto_ptr<numeric_expr> right;
+    if (expr.get_right_side()) {
+        right = make_constant(values.back());
+        values.pop_back();
+    }
+    number const left = values.back();
+    values.pop_back();
+
+    push(boolean_expr(make_constant(left), right, expr.get_operator()));
+}
+
+// Saving is left to the run, and so what a temporary would read.
+void constant_folder::visit(save_expr const&) {
+    failed = true;
+}
+
+void constant_folder::visit(temporary_expr const&) {
+    failed = true;
+}
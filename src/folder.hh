@@ -0,0 +1,52 @@
+#ifndef FOLDER_HH
+#define FOLDER_HH
+
+#include <vector>
+#include <utility>
+
+#include <boost/optional.hpp>
+#include <boost/utility.hpp>
+
+#include "statements.hh"
+#include "interpreter.hh"
+
+// Works out the values of numeric expressions that read no variables, as running them would, for the optimizer and the
+// specializer to put in their place.  An expression that fails when it's run has no value here, and neither has one
+// that would trap rather than fail -- the modulo by zero, and dividing the least integer by -1 or taking its modulo --
+// since working it out would kill the process doing it; both are left to the run.
+class constant_folder : private expr_visitor, boost::noncopyable {
+public:
+    constant_folder();
+
+    // The value of expr, or none if it reads a variable or a temporary, or fails or traps.
+    boost::optional<number> fold(numeric_expr const& expr);
+
+private:
+    interpreter scratch;    // Operations are done in it, on constants; they don't look at any variables.
+
+    // Like in program_writer, operands still to be worked out are kept on a stack, rather than recursed into, so that
+    // long chains of operators can be.  Their values are kept on values.
+    std::vector<std::pair<numeric_expr const*, bool> >  pending;
+    std::vector<number>                                 values;
+    bool                                                operands_done;
+    bool                                                failed;
+
+    // If the operands of expr have been worked out, return true; otherwise queue them to be, before expr again.
+    bool have_operands(numeric_expr const& expr, numeric_expr const& left, numeric_expr const* right);
+
+    // Do an operation whose operands have been replaced by their values, and push its value.
+    void push(numeric_expr const& operation);
+
+    virtual void visit(string_concat_expr const& expr);
+    virtual void visit(string_variable_expr const& expr);
+    virtual void visit(string_literal_expr const& expr);
+    virtual void visit(arith_expr const& expr);
+    virtual void visit(variable_expr const& expr);
+    virtual void visit(constant_expr const& expr);
+    virtual void visit(relational_expr const& expr);
+    virtual void visit(boolean_expr const& expr);
+    virtual void visit(save_expr const& expr);
+    virtual void visit(temporary_expr const& expr);
+};
+
+#endif
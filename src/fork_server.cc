@@ -0,0 +1,146 @@
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "fork_server.hh"
+#include "interpreter.hh"
+
+namespace {
+
+// Children are reaped as they exit, so that a long-running server doesn't collect zombies.
+extern "C" void handle_sigchld(int) {
+    int const saved_errno = errno;
+    while (waitpid(-1, 0, WNOHANG) > 0)
+        ;
+    errno = saved_errno;
+}
+
+server_error system_error(std::string const& what) {
+    return server_error(what + ": " + std::strerror(errno));
+}
+
+}
+
+server_error::server_error(std::string const& what)
+    : std::runtime_error(what)
+{ }
+
+fork_server::fork_server(block& program, std::string const& path)
+    : program(program)
+    , path(path)
+    , owner(getpid())
+    , listener(-1)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    if (path.size() >= sizeof(address.sun_path))
+        throw server_error("Socket path " + path + " is too long");
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, path.c_str());
+
+    // Only a socket, most likely left by an earlier server, is replaced; any other file is left alone.
+    struct stat info;
+    if (lstat(path.c_str(), &info) == 0) {
+        if (!S_ISSOCK(info.st_mode))
+            throw server_error("Can't listen at " + path + ": it exists and isn't a socket");
+        if (unlink(path.c_str()) != 0)
+            throw system_error("Can't remove the old socket at " + path);
+    } else if (errno != ENOENT)
+        throw system_error("Can't listen at " + path);
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0)
+        throw system_error("Can't create socket");
+
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+        || listen(listener, SOMAXCONN) != 0) {
+        server_error const error = system_error("Can't listen at " + path);
+        close(listener);
+        throw error;
+    }
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = &handle_sigchld;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &action, &old_action);
+}
+
+fork_server::~fork_server() {
+    sigaction(SIGCHLD, &old_action, 0);
+    close(listener);
+
+    // A child that gets here anyway mustn't take the socket away from the server.
+    if (getpid() == owner)
+        unlink(path.c_str());
+}
+
+void fork_server::run() {
+    // Whatever is buffered now would be written once by every child.
+    std::cout << std::flush;
+    std::cerr << std::flush;
+    std::fflush(0);
+
+    for (;;) {
+        int const connection = accept(listener, 0, 0);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            throw system_error("Can't accept a connection");
+        }
+
+        pid_t const child = fork();
+        if (child == 0) {
+            close(listener);
+            sigaction(SIGCHLD, &old_action, 0);
+            serve(connection);
+        }
+
+        if (child < 0)
+            std::cerr << "Can't fork: " << std::strerror(errno) << '\n';
+        close(connection);
+    }
+}
+
+void fork_server::serve(int connection) {
+    dup2(connection, STDIN_FILENO);
+    dup2(connection, STDOUT_FILENO);
+    close(connection);
+
+    // The server may have read its program from standard input to the end.
+    std::clearerr(stdin);
+    std::cin.clear();
+
+    int status = 0;
+    try {
+        interpreter interpreter(program);
+        interpreter.run();
+    } catch (syntax_error const& error) {
+        std::cerr << "Syntax error: " << error.what() << '\n';
+        status = 1;
+    } catch (runtime_error const& error) {
+        std::cerr << "Runtime error: " << error.what() << '\n';
+        status = 1;
+    } catch (std::exception const& error) {
+        std::cerr << "Internal error: " << error.what() << '\n';
+        status = 1;
+    } catch (...) {
+        std::cerr << "Internal error\n";
+        status = 1;
+    }
+
+    std::cout << std::flush;
+    std::fflush(0);
+
+    // The parent's objects are the parent's to destroy.
+    _exit(status);
+}
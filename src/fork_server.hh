@@ -0,0 +1,42 @@
+#ifndef FORK_SERVER_HH
+#define FORK_SERVER_HH
+
+#include <string>
+#include <stdexcept>
+#include <signal.h>
+#include <sys/types.h>
+
+#include <boost/utility.hpp>
+
+#include "parser.hh"
+
+struct server_error : std::runtime_error {
+    explicit server_error(std::string const& what);
+};
+
+// Runs a program once per connection to a Unix socket, each time in a process of its own.  The program is compiled
+// before the server starts; a child forked for a connection inherits it ready to run and runs it with the connection
+// as its standard input and output.  A client writes the program's input, shuts down its end for writing, and reads the
+// output until the child closes the connection.  Errors go to the server's standard error.
+class fork_server : boost::noncopyable {
+public:
+    // Listen at path, replacing any socket that's there; any other file there is an error.  The program shall outlive
+    // the server.  Throws server_error.
+    fork_server(block& program, std::string const& path);
+    ~fork_server();
+
+    // Serve connections until accepting one fails.  Throws server_error then.
+    void run();
+
+private:
+    block&              program;
+    std::string const   path;
+    pid_t const         owner;      // The server's process, whose socket it is.
+    int                 listener;
+    struct sigaction    old_action;
+
+    // The child's side of a connection.  Doesn't return.
+    void serve(int connection);
+};
+
+#endif
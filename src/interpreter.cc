@@ -1,21 +1,68 @@
 #include <iostream>
+#include <iterator>
 
 #include <cassert>
+
+#include <boost/next_prior.hpp>
+
 #include "interpreter.hh"
+#include "metrics.hh"
 
 runtime_error::runtime_error(std::string const& what)
     : std::runtime_error(what)
 { }
 
 interpreter::interpreter(block& block)
-    : should_stop(false)
+    : kept_blocks(0)
+    , should_stop(false)
     , numeric_variables(&execution_block::numeric_variables)
     , string_variables(&execution_block::string_variables)
 {
     enter_block(block);
 }
 
+interpreter::interpreter()
+    : kept_blocks(0)
+    , should_stop(false)
+    , numeric_variables(&execution_block::numeric_variables)
+    , string_variables(&execution_block::string_variables)
+{ }
+
+void interpreter::add_observer(interpreter_observer& observer) {
+    observers.push_back(&observer);
+
+    for (execution_block_stack_t::reverse_iterator b = blocks.rbegin(); b != blocks.rend(); ++b)
+        observer.entered_block(*this, *b->block, b->statement);
+}
+
 void interpreter::run() {
+    if (observers.empty())
+        run_statements<false>();
+    else
+        run_statements<true>();
+}
+
+void interpreter::run(block& code) {
+    code.materialize();
+
+    while (blocks.size() > 1)
+        exit_block();
+
+    if (blocks.empty())
+        enter_block(code);
+    else {
+        execution_block& top_level = blocks.front();
+        top_level.statement = 0;
+        top_level.block = &code;
+        top_level.current_statement = code.statements.begin();
+    }
+
+    kept_blocks = 1;
+    run();
+}
+
+template <bool Observed>
+void interpreter::run_statements() {
     should_stop = false;
 
     while (!blocks.empty() && !should_stop) {
@@ -23,9 +70,21 @@ void interpreter::run() {
             execution_block& current_block = blocks.front();
             block::statement_list::iterator current = current_block.current_statement;
             ++current_block.current_statement;
-            (*current)->execute(*this);
+
+            if (Observed) {
+                statement& s = **current;
+                for (observers_cont::iterator o = observers.begin(); o != observers.end(); ++o)
+                    (*o)->before_statement(*this, s);
+                s.execute(*this);
+                for (observers_cont::reverse_iterator o = observers.rbegin(); o != observers.rend(); ++o)
+                    (*o)->after_statement(*this, s);
+            } else
+                (*current)->execute(*this);
         }
 
+        if (blocks.size() <= kept_blocks)
+            break;
+
         block_statement* statement = blocks.front().statement;
         exit_block();
         if (statement)
@@ -33,74 +92,179 @@ void interpreter::run() {
     }
 }
 
-void interpreter::jump(std::string const& label) {
+void interpreter::jump(symbol_id label) {
+    for (observers_cont::iterator o = observers.begin(); o != observers.end(); ++o)
+        (*o)->jumped(*this, label);
+
     while (!blocks.empty()) {
         block::jump_table_t::iterator target = blocks.front().block->jump_table.find(label);
         if (target != blocks.front().block->jump_table.end()) {
             blocks.front().current_statement = target->second;
             return;
-        } else
+        } else if (blocks.size() <= kept_blocks)
+            break;
+        else
             exit_block();
     }
 
-    throw runtime_error(std::string("Jump to undefined label ") + label);
+    throw runtime_error(std::string("Jump to undefined label ") + symbols.get_name(label));
 }
 
 void interpreter::enter_block(block& block, block_statement* statement) {
+    block.materialize();
+
     execution_block temp;
     temp.statement = statement;
     temp.block = &block;
     temp.current_statement = block.statements.begin();
 
     blocks.push_front(temp);
+
+    for (observers_cont::iterator o = observers.begin(); o != observers.end(); ++o)
+        (*o)->entered_block(*this, block, statement);
 }
 
 void interpreter::exit_block() {
-    if (!blocks.empty())
+    if (!blocks.empty()) {
+        ::block& block = *blocks.front().block;
         blocks.pop_front();
+
+        for (observers_cont::reverse_iterator o = observers.rbegin(); o != observers.rend(); ++o)
+            (*o)->exited_block(*this, block);
+    }
 }
 
-void interpreter::exit_block(std::string const& name) {
-    while (!blocks.empty()) {
-        std::string popped_name;  // Name of the just-popped block.
-        if (blocks.front().statement)
-            popped_name = blocks.front().statement->get_name();
+void interpreter::exit_block(symbol_id name) {
+    while (blocks.size() > kept_blocks) {
+        block_statement* const popped = blocks.front().statement;  // The just-popped block's statement.
 
-        blocks.pop_front();
-        if (popped_name == name)
+        exit_block();
+        if (popped && popped->get_name() == name)
             return;
     }
 
-    throw runtime_error(std::string("Cannot EXIT ") + name + ": No such block");
+    throw runtime_error(std::string("Cannot EXIT ") + symbols.get_name(name) + ": No such block");
 }
 
 void interpreter::stop() {
-    blocks.clear();
+    while (blocks.size() > kept_blocks)
+        exit_block();
     should_stop = true;
 }
 
-void interpreter::set_var_numeric(std::string const& name, number value) {
+std::size_t interpreter::get_block_depth() const {
+    return blocks.size();
+}
+
+interpreter_state interpreter::get_state() const {
+    interpreter_state result;
+
+    for (execution_block_stack_t::const_reverse_iterator b = blocks.rbegin(); b != blocks.rend(); ++b) {
+        interpreter_state::frame frame;
+        frame.body = 0;
+        frame.position = std::distance(b->block->statements.begin(), b->current_statement);
+        frame.numeric_variables = b->numeric_variables;
+        frame.string_variables = b->string_variables;
+
+        if (b != blocks.rbegin()) {
+            execution_block const& below = *boost::prior(b);
+            statement const* const owner = boost::prior(below.current_statement)->get();
+            if (if_block_stmt const* const choice = dynamic_cast<if_block_stmt const*>(owner))
+                frame.body = b->block - &choice->get_blocks()[0];
+        }
+
+        if (for_stmt const* const loop = dynamic_cast<for_stmt const*>(b->statement)) {
+            frame.final_value = loop->get_current_final_value();
+            frame.step = loop->get_current_step();
+        }
+
+        result.frames.push_back(frame);
+    }
+
+    result.temporaries = temporaries;
+    return result;
+}
+
+void interpreter::set_state(block& program, interpreter_state const& state) {
+    runtime_error const mismatch("The saved state doesn't fit the program");
+
+    while (!blocks.empty())
+        exit_block();
+
+    typedef std::vector<interpreter_state::frame>::const_iterator frame_iterator;
+    for (frame_iterator frame = state.frames.begin(); frame != state.frames.end(); ++frame) {
+        ::block* block = &program;
+        block_statement* owner = 0;
+
+        if (frame != state.frames.begin()) {
+            execution_block const& below = blocks.front();
+            if (below.current_statement == below.block->statements.begin())
+                throw mismatch;
+
+            statement* const last = boost::prior(below.current_statement)->get();
+            if (if_block_stmt* const choice = dynamic_cast<if_block_stmt*>(last)) {
+                if (frame->body >= choice->get_blocks().size())
+                    throw mismatch;
+                block = &choice->get_blocks()[frame->body];
+            } else if (do_stmt* const loop = dynamic_cast<do_stmt*>(last)) {
+                block = &loop->get_body();
+                owner = loop;
+            } else if (for_stmt* const loop = dynamic_cast<for_stmt*>(last)) {
+                block = &loop->get_body();
+                owner = loop;
+                loop->set_current_bounds(frame->final_value, frame->step);
+            } else
+                throw mismatch;
+        }
+
+        enter_block(*block, owner);
+        if (frame->position > block->statements.size())
+            throw mismatch;
+
+        execution_block& entered = blocks.front();
+        std::advance(entered.current_statement, frame->position);
+        entered.numeric_variables = frame->numeric_variables;
+        entered.string_variables = frame->string_variables;
+    }
+
+    temporaries = state.temporaries;
+}
+
+void interpreter::set_var_numeric(symbol_id name, number value) {
     set_var(name, numeric_variables, value);
 }
 
-void interpreter::set_var_string(std::string const& name, std::string const& value) {
+void interpreter::set_var_string(symbol_id name, std::string const& value) {
     set_var(name, string_variables, value);
 }
 
-number interpreter::get_var_numeric(std::string const& name) {
+number interpreter::get_var_numeric(symbol_id name) {
     return get_var(name, numeric_variables);
 }
 
-std::string interpreter::get_var_string(std::string const& name) {
+std::string interpreter::get_var_string(symbol_id name) {
     return get_var(name, string_variables);
 }
 
+void interpreter::set_temporary(std::size_t slot, number value) {
+    if (slot >= temporaries.size())
+        temporaries.resize(slot + 1);
+    temporaries[slot] = value;
+}
+
+number interpreter::get_temporary(std::size_t slot) const {
+    assert(slot < temporaries.size());
+    return temporaries[slot];
+}
+
 template <typename VariablesMapT>
 bool interpreter::find_var(
-    std::string const& name,
+    symbol_id name,
     VariablesMapT (execution_block::*variables),
     typename VariablesMapT::iterator& result
 ) {
+    ++metrics.variable_lookups;
+
     for (execution_block_stack_t::iterator block = blocks.begin(); block != blocks.end(); ++block) {
         typename VariablesMapT::iterator var = ((*block).*variables).find(name);
         if (var != ((*block).*variables).end()) {
@@ -109,12 +273,13 @@ bool interpreter::find_var(
         }
     }
 
+    ++metrics.variable_misses;
     return false;
 }
 
 template <typename VariablesMapT>
 void interpreter::set_var(
-    std::string const& name,
+    symbol_id name,
     VariablesMapT (execution_block::*variables),
     typename VariablesMapT::mapped_type value
 ) {
@@ -127,12 +292,12 @@ void interpreter::set_var(
 
 template <typename VariablesMapT>
 typename VariablesMapT::mapped_type interpreter::get_var(
-    std::string const& name,
+    symbol_id name,
     VariablesMapT (execution_block::*variables)
 ) {
     typename VariablesMapT::iterator var;
     if (find_var(name, variables, var))
         return var->second;
     else
-        throw runtime_error(std::string("Variable ") + name + " undefined");
+        throw runtime_error(std::string("Variable ") + symbols.get_name(name) + " undefined");
 }
@@ -4,6 +4,7 @@
 #include <string>
 #include <map>
 #include <deque>
+#include <vector>
 #include <stdexcept>
 
 #include <boost/optional.hpp>
@@ -12,36 +13,104 @@
 #include "parser.hh"
 #include "statements.hh"
 #include "number.hh"
+#include "symbols.hh"
 
 struct runtime_error : std::runtime_error {
     runtime_error(std::string const& what);
 };
 
+class interpreter;
+
+// Interface for tools that watch the program being run -- profilers and the like.  Hooks do nothing by default.
+class interpreter_observer {
+public:
+    virtual ~interpreter_observer() { }
+
+    virtual void before_statement(interpreter&, statement&) { }
+    virtual void after_statement(interpreter&, statement&) { }
+
+    // statement is the one whose body is being entered, if any; it's 0 for the top level and for IF blocks.
+    virtual void entered_block(interpreter&, block&, block_statement* /* statement */) { }
+    virtual void exited_block(interpreter&, block&) { }
+
+    // Called before the jump is made, that is, before any blocks are exited because of it.
+    virtual void jumped(interpreter&, symbol_id /* label */) { }
+};
+
+// Where a run is and what it has set, by positions in the program rather than pointers into it, so that the run can be
+// saved and continued by another interpreter, possibly in another process.
+struct interpreter_state {
+    struct frame {
+        // The statement a block belongs to is the one the block below ran last; this is which of its blocks it is.  It's
+        // 0 for the top level and the bodies of loops.
+        std::size_t                         body;
+
+        std::size_t                         position;       // Index of the next statement to run.
+        std::map<symbol_id, number>         numeric_variables;
+        std::map<symbol_id, std::string>    string_variables;
+
+        // Of the body of a FOR, the final value and step the loop is running with.
+        number                              final_value;
+        number                              step;
+    };
+
+    std::vector<frame> frames;  // From the top level up.
+    std::vector<number> temporaries;
+};
+
 class interpreter : boost::noncopyable {
 public:
     // Construct an interpreter for a given program.
     explicit interpreter(block& block);
 
+    // Construct an interpreter with nothing to run yet; see run(block&).
+    interpreter();
+
+    // Register an observer for the next run().  The observer is not owned by the interpreter and shall outlive it.
+    // It is told about the blocks that have already been entered right away.  With no observers registered, the run
+    // loop doesn't pay for the statement hooks at all.
+    void add_observer(interpreter_observer& observer);
+
     // Run the program.
     void run();
 
-    void jump(std::string const& label);
+    // Run code as the top level of the program, in place of whatever ran there before, keeping the variables that
+    // earlier code set at the top level.  Blocks left entered by an earlier run that failed are exited first.
+    void run(block& code);
+
+    void jump(symbol_id label);
+
+    // Enter a block, parsing its statements first if they haven't been.  Throws syntax_error if they don't parse.
     void enter_block(block& block, block_statement* statement = 0);
     void exit_block();
-    void exit_block(std::string const& name);
+    void exit_block(symbol_id name);
     void stop();
 
-    void set_var_numeric(std::string const& name, number value);
-    void set_var_string(std::string const& name, std::string const& value);
+    // Number of blocks currently entered -- 1 when running the top level of the program.
+    std::size_t get_block_depth() const;
+
+    // The state of the run, between two statements.
+    interpreter_state get_state() const;
+
+    // Continue a run of program from a state got from an interpreter of the same program, in place of whatever this
+    // one was running.  Throws ::runtime_error if the state doesn't fit the program.
+    void set_state(block& program, interpreter_state const& state);
+
+    void set_var_numeric(symbol_id name, number value);
+    void set_var_string(symbol_id name, std::string const& value);
 
     // Throws ::runtime_error if no variable of the given name exists.
-    number get_var_numeric(std::string const& name);
-    std::string get_var_string(std::string const& name);
+    number get_var_numeric(symbol_id name);
+    std::string get_var_string(symbol_id name);
+
+    // Values save_exprs have kept for temporary_exprs.
+    void set_temporary(std::size_t slot, number value);
+    number get_temporary(std::size_t slot) const;
 
 private:
     struct execution_block {
-        typedef std::map<std::string, number> numeric_variables_map_t;
-        typedef std::map<std::string, std::string> string_variables_map_t;
+        typedef std::map<symbol_id, number> numeric_variables_map_t;
+        typedef std::map<symbol_id, std::string> string_variables_map_t;
 
         block_statement*                statement;          // May be 0.
         ::block*                        block;              // Shall not be 0.
@@ -52,8 +121,18 @@ private:
 
     typedef std::deque<execution_block> execution_block_stack_t;
 
+    typedef std::vector<interpreter_observer*> observers_cont;
+
     execution_block_stack_t blocks;
+    std::vector<number>     temporaries;
+    std::size_t             kept_blocks;    // How many blocks at the bottom of the stack running to their end keeps.
     bool                    should_stop;
+    observers_cont          observers;
+
+    // The body of run().  Instantiated once with observer hooks and once without, so that an unobserved run doesn't
+    // check for observers on every statement.
+    template <bool Observed>
+    void run_statements();
 
     // Helpers -- just pass these as the second param to find_var.
     execution_block::numeric_variables_map_t execution_block::*numeric_variables;
@@ -63,19 +142,19 @@ private:
     // iterator to it and return value is true; if the variable has not been found, result is left unmodified and return
     // value is false.
     template <typename VariablesMapT>
-    bool find_var(std::string const& name,
+    bool find_var(symbol_id name,
                   VariablesMapT (execution_block::*variables),
                   typename VariablesMapT::iterator& result);
 
     // Helper for set_var_* functions.
     template <typename VariablesMapT>
-    void set_var(std::string const& name,
+    void set_var(symbol_id name,
                  VariablesMapT (execution_block::*variables),
                  typename VariablesMapT::mapped_type value);
 
     // Helper for get_var_* functions.
     template <typename VariablesMapT>
-    typename VariablesMapT::mapped_type get_var(std::string const& name, VariablesMapT (execution_block::*variables));
+    typename VariablesMapT::mapped_type get_var(symbol_id name, VariablesMapT (execution_block::*variables));
 };
 
 #endif
@@ -1,179 +1,371 @@
-#include <vector>
-#include <iterator>
 #include <algorithm>
-#include <functional>
-#include <istream>
 #include <sstream>
+#include <cstring>
 #include <cctype>
+#include <cassert>
 
-#include <iostream>
-
-#include <boost/optional.hpp>
 #include <boost/algorithm/string/case_conv.hpp>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
 
 #include "lexer.hh"
+#include "symbols.hh"
+#include "scanner.hh"
+#include "parallel.hh"
 
 namespace {
 
-char const          WHITESPACE[] = { ' ', '\t' };
-char const* const   WHITESPACE_END = WHITESPACE + sizeof(WHITESPACE);
+struct keyword {
+    char const* name;
+    e_token     kind;
+};
+
+std::size_t const MAX_KEYWORD_LENGTH = 7;
+
+// Keywords by perfect hash; see keyword_hash.  The multipliers in the hash were found by a brute-force search for ones
+// that give every keyword its own slot -- when adding a keyword, the search has to be redone and the table rebuilt.
+keyword const KEYWORD_TABLE[] = {
+    { 0, token_identifier }, { 0, token_identifier }, { "do", token_do }, { "loop", token_loop },
+    { 0, token_identifier }, { 0, token_identifier }, { 0, token_identifier }, { 0, token_identifier },
+    { "next", token_next }, { "elseif", token_elseif }, { 0, token_identifier }, { 0, token_identifier },
+    { 0, token_identifier }, { "if", token_if }, { "for", token_for }, { 0, token_identifier },
+    { "rem", token_rem }, { "stop", token_stop }, { 0, token_identifier }, { "and", token_and },
+    { 0, token_identifier }, { "else", token_else }, { 0, token_identifier }, { 0, token_identifier },
+    { "let", token_let }, { "include", token_include }, { "goto", token_goto }, { "end", token_end },
+    { 0, token_identifier }, { 0, token_identifier }, { 0, token_identifier }, { "or", token_or },
+    { 0, token_identifier }, { "then", token_then }, { 0, token_identifier }, { 0, token_identifier },
+    { "input", token_input }, { 0, token_identifier }, { 0, token_identifier }, { 0, token_identifier },
+    { 0, token_identifier }, { 0, token_identifier }, { 0, token_identifier }, { 0, token_identifier },
+    { 0, token_identifier }, { 0, token_identifier }, { 0, token_identifier }, { "exit", token_exit },
+    { 0, token_identifier }, { 0, token_identifier }, { "to", token_to }, { "print", token_print },
+    { "mod", token_mod }, { 0, token_identifier }, { "not", token_not }, { "step", token_step },
+    { 0, token_identifier }, { 0, token_identifier }, { 0, token_identifier }, { "while", token_while },
+    { 0, token_identifier }, { 0, token_identifier }, { 0, token_identifier }, { 0, token_identifier }
+};
+std::size_t const KEYWORD_TABLE_SIZE = sizeof(KEYWORD_TABLE) / sizeof(*KEYWORD_TABLE);
+
+unsigned to_lower(char c) {
+    return static_cast<unsigned>(tolower(static_cast<unsigned char>(c)));
+}
 
-// Symbols that can be lexed without seeing what follows them.
-char const          SIMPLE_SYMBOLS[] = { '+', '-', '*', '/', '&', '=', ':', ',', '(', ')' };
-char const* const   SIMPLE_SYMBOLS_END = SIMPLE_SYMBOLS + sizeof(SIMPLE_SYMBOLS);
+// Slot in KEYWORD_TABLE of a word of at least two characters.
+std::size_t keyword_hash(char const* word, std::size_t length) {
+    return (2 * to_lower(word[0]) + 9 * to_lower(word[length - 2]) + 12 * to_lower(word[length - 1]) + length)
+        % KEYWORD_TABLE_SIZE;
+}
 
-// Helpers.
-std::pointer_to_unary_function<int, int> is_digit = std::ptr_fun(&isdigit);
+// The keyword spelled, in any case, by [word, word + length), or token_identifier if it's not one.
+e_token find_keyword(char const* word, std::size_t length) {
+    if (length < 2 || length > MAX_KEYWORD_LENGTH)
+        return token_identifier;
 
-// Basically the same as C's isalnum, but also accepts _ and $ as a valid character.
-int isalphanum(int c) {
-    return isalnum(c) || c == '_' || c == '$';
+    keyword const& candidate = KEYWORD_TABLE[keyword_hash(word, length)];
+    if (!candidate.name)
+        return token_identifier;
+
+    for (std::size_t i = 0; i < length; ++i)
+        if (to_lower(word[i]) != static_cast<unsigned char>(candidate.name[i]))
+            return token_identifier;
+
+    return candidate.name[length] == '\0' ? candidate.kind : token_identifier;
 }
 
-std::pointer_to_unary_function<int, int> is_alphanum = std::ptr_fun(&isalphanum);
+// Spellings of the operators, in the order of e_token.
+char const* const OPERATORS[] = {
+    "+", "-", "*", "/", "&", "=", "<>", "<", "<=", ">", ">=", ":", ",", "(", ")"
+};
+
+// Symbols that can be lexed without seeing what follows them, and their tokens.
+char const          SIMPLE_SYMBOLS[] = { '+', '-', '*', '/', '&', '=', ':', ',', '(', ')' };
+char const* const   SIMPLE_SYMBOLS_END = SIMPLE_SYMBOLS + sizeof(SIMPLE_SYMBOLS);
+e_token const       SIMPLE_SYMBOL_TOKENS[] = {
+    token_plus, token_minus, token_times, token_divides, token_ampersand, token_equals, token_colon, token_comma,
+    token_open_parenthesis, token_close_parenthesis
+};
 
-std::unary_negate<std::pointer_to_unary_function<int, int> > is_not_digit = std::not1(is_digit);
-std::unary_negate<std::pointer_to_unary_function<int, int> > is_not_alnum = std::not1(is_alphanum);
+// Sources are only split into pieces at least this large, so that threads have enough to do.
+std::size_t const MIN_CHUNK_SIZE = 256 * 1024;
 
+bool is_whitespace(char c) {
+    return c == ' ' || c == '\t';
 }
 
-lexeme::lexeme(e_type type, std::string const& value, std::string const& filename, int line, int column)
-    : type(type)
-    , value(value)
-{
-    physical_location.filename = filename;
-    physical_location.line = line;
-    physical_location.column = column;
+}
 
-    if (type == lexeme::type_word)
-        boost::algorithm::to_lower(this->value);
-    else if (type == lexeme::type_number) {
-        // Remove leading zeroes from integers.
-        if (value[0] == '0' && value.length() > 1) {
-            std::string::size_type first_nonzero = value.find_first_not_of('0');
-            if (first_nonzero != value.npos)
-                this->value = value.substr(first_nonzero);
-        }
+char const* to_string(e_token kind) {
+    switch (kind) {
+    case token_end_of_line:     return "end of line";
+    case token_end_of_input:    return "end of input";
+    case token_identifier:      return "identifier";
+    case token_number:          return "numeric literal";
+    case token_string:          return "string literal";
+    default:                    break;
     }
+
+    if (kind >= token_plus)
+        return OPERATORS[kind - token_plus];
+
+    for (std::size_t i = 0; i < KEYWORD_TABLE_SIZE; ++i)
+        if (KEYWORD_TABLE[i].name && KEYWORD_TABLE[i].kind == kind)
+            return KEYWORD_TABLE[i].name;
+
+    return "";
+}
+
+bool is_word(e_token kind) {
+    return kind == token_identifier || (kind >= token_and && kind <= token_while);
 }
 
 lexer_error::lexer_error(std::string const& what)
     : std::runtime_error(what)
 { }
 
-lexer::lexer(std::istream& source, std::string const& filename)
+token_stream::token_stream(std::string const& source, std::string const& filename, std::size_t jobs)
     : source(source)
     , filename(filename)
-    , line(1)
-    , column(0)
-{ }
+{
+    if (source.size() >= 0xFFFFFFFFu)
+        throw lexer_error(filename + ": Source is too large");
+
+    // Split the source into pieces of at least MIN_CHUNK_SIZE bytes, each ending with a line break.
+    std::size_t const count = std::max<std::size_t>(1, std::min(jobs, source.size() / MIN_CHUNK_SIZE));
+    char const* const data = source.data();
+
+    std::vector<chunk> chunks;
+    std::size_t begin = 0;
+    for (std::size_t i = 1; i < count && begin < source.size(); ++i) {
+        std::size_t const end = find_line_end(data + std::max(begin, source.size() / count * i), data + source.size())
+            - data;
+        if (end >= source.size())
+            break;
+
+        chunks.push_back(chunk());
+        chunks.back().begin = begin;
+        chunks.back().end = end + 1;
+        begin = end + 1;
+    }
+    chunks.push_back(chunk());
+    chunks.back().begin = begin;
+    chunks.back().end = source.size();
+
+    tokens.line_starts.push_back(0);
+
+    if (chunks.size() == 1)
+        lex(0, source.size(), symbols, tokens);
+    else {
+        run_in_parallel(chunks.size(), boost::bind(&token_stream::lex_chunk, this, boost::ref(chunks), _1));
+
+        // Report the first error in the source, as lexing it whole would.
+        for (std::vector<chunk>::const_iterator c = chunks.begin(); c != chunks.end(); ++c)
+            if (!c->error.empty())
+                throw lexer_error(c->error);
+
+        for (std::vector<chunk>::const_iterator c = chunks.begin(); c != chunks.end(); ++c)
+            append(*c);
+    }
+
+    // Make every statement end with an end of line, even the last one in a file without a trailing newline.
+    if (tokens.last_kind() != token_end_of_line)
+        tokens.add(token_end_of_line, source.size(), 0);
+    tokens.add(token_end_of_input, source.size(), 0);
+}
+
+std::size_t token_stream::size() const {
+    return tokens.kinds.size();
+}
+
+e_token token_stream::get_kind(std::size_t token) const {
+    return static_cast<e_token>(tokens.kinds[token]);
+}
+
+symbol_id token_stream::get_symbol(std::size_t token) const {
+    assert(get_kind(token) == token_identifier);
+    return tokens.values[token];
+}
 
-boost::optional<lexeme> lexer::get_lexeme() {
-    skip_whitespace();
+std::string token_stream::get_text(std::size_t token) const {
+    if (get_kind(token) == token_identifier)
+        return symbols.get_name(tokens.values[token]);
 
-    char next_char;
-    if (source && (next_char = source.peek()) != std::istream::traits_type::eof()) {
-        if (isdigit(next_char)) {
-            std::string const whole_part = extract_until(is_not_digit);
-            if (source.peek() == '.') {
+    std::string text(source, tokens.offsets[token], tokens.values[token]);
+
+    if (is_word(get_kind(token)))
+        boost::algorithm::to_lower(text);
+    else if (get_kind(token) == token_number && text.length() > 1 && text[0] == '0') {
+        // Remove leading zeroes from integers.
+        std::string::size_type const first_nonzero = text.find_first_not_of('0');
+        if (first_nonzero != std::string::npos)
+            text.erase(0, first_nonzero);
+    }
+
+    return text;
+}
+
+source_location token_stream::get_location(std::size_t token) const {
+    source_location result;
+    result.filename = filename;
+    result.line = get_line(tokens.offsets[token]);
+    result.column = tokens.offsets[token] - tokens.line_starts[result.line - 1] + 1;
+    return result;
+}
+
+std::string const& token_stream::get_source() const {
+    return source;
+}
+
+std::string const& token_stream::get_filename() const {
+    return filename;
+}
+
+void token_stream::lex(std::size_t begin, std::size_t end, symbol_table& symbols, token_arrays& result) const {
+    char const* const data = source.data();
+    std::size_t position = begin;
+
+    while (position < end) {
+        char const c = source[position];
+        std::size_t const start = position;
+
+        if (is_whitespace(c)) {
+            position = skip_blanks(data + position, data + end) - data;
+
+        } else if (c == '\n') {
+            // Runs of blank lines are a single end of line, which belongs to the line it terminates.
+            if (result.last_kind() != token_end_of_line)
+                result.add(token_end_of_line, position, 0);
+            ++position;
+            result.line_starts.push_back(position);
+
+        } else if (isdigit(static_cast<unsigned char>(c))) {
+            position = skip_digits(data + position, data + end) - data;
+            if (position < end && source[position] == '.') {
                 // This is a decimal number.
-                source.get();
-                ++column;
-                std::string const decimal_part = extract_until(is_not_digit);
-                return lexeme(lexeme::type_number, whole_part + '.' + decimal_part, filename, line, column);
-            } else {
-                return lexeme(lexeme::type_number, whole_part, filename, line, column);
+                position = skip_digits(data + position + 1, data + end) - data;
             }
-
-        } else if (next_char == '"') {
-            source.get();  // Consume the starting ".
-            ++column;
-            std::string const value = extract_until('"');
-            lexeme result(lexeme::type_string, value, filename, line, column);
-
-            source.get();  // Consume the trailing ".
-            ++column;
-            return result;
-
-        } else if (std::find(SIMPLE_SYMBOLS, SIMPLE_SYMBOLS_END, next_char) != SIMPLE_SYMBOLS_END) {
-            // Next character is a simple symbol.
-            return lexeme(lexeme::type_symbol, std::string(1, source.get()), filename, line, ++column);
-
-        } else if ((next_char == '<' || next_char == '>')) {
-            source.get();  // Discard the current one.
-            ++column;
-
-            if (source.peek() == '>' || source.peek() == '=') {
-                // We've got a two-character lexeme.
-                char const second_char = source.get();
-                ++column;
-
-                if (second_char == '=' || (next_char == '<' && second_char == '>'))
-                    return lexeme(lexeme::type_symbol, std::string() + next_char + second_char, filename, line, column);
-                else
-                    throw lexer_error(std::string("Invalid operator: ") + next_char + second_char);
+            result.add(token_number, start, position - start);
+
+        } else if (c == '"') {
+            std::size_t const closing = find_string_end(data + start + 1, data + end) - data;
+            if (closing == end || source[closing] != '"')
+                throw error("Unterminated string literal", start);
+            result.add(token_string, start + 1, closing - start - 1);
+            position = closing + 1;
+
+        } else if (std::find(SIMPLE_SYMBOLS, SIMPLE_SYMBOLS_END, c) != SIMPLE_SYMBOLS_END) {
+            result.add(SIMPLE_SYMBOL_TOKENS[std::find(SIMPLE_SYMBOLS, SIMPLE_SYMBOLS_END, c) - SIMPLE_SYMBOLS], start, 1);
+            ++position;
+
+        } else if (c == '<' || c == '>') {
+            char const second = position + 1 < end ? source[position + 1] : '\0';
+            if (second == '=') {
+                result.add(c == '<' ? token_less_equal : token_greater_equal, start, 2);
+                position += 2;
+            } else if (second == '>') {
+                if (c != '<')
+                    throw error(std::string("Invalid operator: ") + c + second, start);
+                result.add(token_doesnt_equal, start, 2);
+                position += 2;
             } else {
-                // A single-charactrer lexeme.
-                return lexeme(lexeme::type_symbol, std::string(1, next_char), filename, line, column);
+                result.add(c == '<' ? token_less_than : token_greater_than, start, 1);
+                ++position;
             }
 
-        } else if (next_char == '\n') {
-            // Discard any consecutive blank lines.
-            while (source.peek() == '\n') {
-                source.get();
-                ++line;
-                column = 0;
-                skip_whitespace();
+        } else if (isalpha(static_cast<unsigned char>(c))) {
+            position = skip_identifier_chars(data + position, data + end) - data;
+
+            char const* const word = data + start;
+            std::size_t const length = position - start;
+            e_token kind = find_keyword(word, length);
+
+            if (kind == token_rem) {
+                // REM starts a comment only where a statement could; anywhere else it's just an identifier.  The
+                // comment runs to the end of the line, whatever characters are in it.
+                if (result.at_statement_start()) {
+                    result.add(token_rem, start, length);
+                    position = find_line_end(data + position, data + end) - data;
+                    continue;
+                } else
+                    kind = token_identifier;
             }
 
-            return lexeme(lexeme::type_end, "", filename, line, column);
-
-        } else if (isalpha(next_char)) {
-            std::string const value = extract_until(is_not_alnum);
-            return lexeme(lexeme::type_word, value, filename, line, column);
+            if (kind == token_identifier)
+                result.add(token_identifier, start, symbols.intern(word, word + length));
+            else
+                result.add(kind, start, length);
 
         } else {
             std::ostringstream os;
-            os << "Invalid character at input: '" << static_cast<char>(source.peek())
-               << "' (" << static_cast<int> (source.peek()) << ")";
-            throw lexer_error(os.str());
+            os << "Invalid character at input: '" << c << "' (" << static_cast<int>(c) << ")";
+            throw error(os.str(), start);
         }
     }
-
-    return boost::optional<lexeme>();
 }
 
-void lexer::ignore_line() {
-    while (source && source.peek() != '\n') {
-        source.get();
-        ++column;
+void token_stream::lex_chunk(std::vector<chunk>& chunks, std::size_t index) const {
+    chunk& c = chunks[index];
+    c.symbols.reset(new symbol_table);
+
+    try {
+        lex(c.begin, c.end, *c.symbols, c.tokens);
+    } catch (lexer_error const& e) {
+        c.error = e.what();
     }
 }
 
-void lexer::skip_whitespace() {
-    while (source) {
-        char next = source.peek();
-        if (std::find(WHITESPACE, WHITESPACE_END, next) == WHITESPACE_END)
-            break;
-        else {
-            source.get();
-            ++column;
-        }
+void token_stream::append(chunk const& chunk) {
+    // The chunk's symbols become ours in the order they were first seen, which is the order lexing the source whole
+    // would have interned them in.
+    std::vector<symbol_id> global_symbols(chunk.symbols->size());
+    for (symbol_id s = 0; s < global_symbols.size(); ++s)
+        global_symbols[s] = symbols.intern(chunk.symbols->get_name(s));
+
+    token_arrays const& t = chunk.tokens;
+    for (std::size_t i = 0; i < t.kinds.size(); ++i) {
+        e_token const kind = static_cast<e_token>(t.kinds[i]);
+
+        // Blank lines at the beginning of a chunk continue a run from the previous one.
+        if (i == 0 && kind == token_end_of_line && tokens.last_kind() == token_end_of_line)
+            continue;
+
+        tokens.add(kind, t.offsets[i], kind == token_identifier ? global_symbols[t.values[i]] : t.values[i]);
     }
+
+    tokens.line_starts.insert(tokens.line_starts.end(), t.line_starts.begin(), t.line_starts.end());
 }
 
-std::string lexer::extract_until(char what) {
-    return extract_until(std::bind2nd(std::equal_to<char>(), what));
+e_token token_stream::token_arrays::last_kind() const {
+    // Anything but an end of line will do when there are no tokens.
+    return kinds.empty() ? token_end_of_input : static_cast<e_token>(kinds.back());
 }
 
-template <typename UnaryFunction>
-std::string lexer::extract_until(UnaryFunction pred) {
-    std::string result;
+void token_stream::token_arrays::add(e_token kind, std::size_t offset, std::size_t value) {
+    kinds.push_back(static_cast<unsigned char>(kind));
+    offsets.push_back(static_cast<boost::uint32_t>(offset));
+    values.push_back(static_cast<boost::uint32_t>(value));
+}
 
-    while (source && !pred(source.peek())) {
-        result += source.get();
-        ++column;
-    }
+// Whether the next token would be the first one of a statement, after its label if it has one.
+bool token_stream::token_arrays::at_statement_start() const {
+    std::size_t first = kinds.size();
+    while (first > 0 && kinds[first - 1] != token_end_of_line)
+        --first;
 
-    return result;
+    std::size_t const count = kinds.size() - first;
+    return count == 0
+        || (count == 1 && kinds[first] == token_number)
+        || (count == 2 && kinds[first] == token_identifier && kinds[first + 1] == token_colon);
+}
+
+int token_stream::get_line(std::size_t offset) const {
+    return std::upper_bound(tokens.line_starts.begin(), tokens.line_starts.end(), offset) - tokens.line_starts.begin();
+}
+
+// Errors are made while the line table is still being built, so this finds the line the slow way.
+lexer_error token_stream::error(std::string const& what, std::size_t offset) const {
+    std::size_t const line_start = source.rfind('\n', offset == 0 ? 0 : offset - 1);
+    std::size_t const column = line_start == std::string::npos || offset == 0 ? offset + 1 : offset - line_start;
+
+    std::ostringstream os;
+    os << filename << ", line " << std::count(source.begin(), source.begin() + offset, '\n') + 1 << ", column "
+       << column << ": " << what;
+    return lexer_error(os.str());
 }
@@ -3,62 +3,110 @@
 
 #include <string>
 #include <vector>
-#include <istream>
 #include <stdexcept>
 
-#include <boost/optional.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
 
-struct lexeme {
-    enum e_type {
-        type_word,
-        type_symbol,
-        type_number,
-        type_string,
-        type_end        // End of statement (logical line).
-    };
-
-    struct physical_location_t {
-        std::string filename;
-        int line;
-        int column;
-    } physical_location;
+#include "symbols.hh"
 
-    e_type      type;
-    std::string value;
+// Where in the source a token or statement begins.
+struct source_location {
+    std::string filename;
+    int line;
+    int column;
+};
 
-    lexeme(e_type type, std::string const& value, std::string const& filename, int line, int column);
+enum e_token {
+    token_end_of_line,      // End of statement (logical line).
+    token_end_of_input,
+    token_identifier,
+    token_number,
+    token_string,
+
+    // Keywords.
+    token_and, token_do, token_else, token_elseif, token_end, token_exit, token_for, token_goto, token_if, token_include,
+    token_input, token_let, token_loop, token_mod, token_next, token_not, token_or, token_print, token_rem, token_step,
+    token_stop, token_then, token_to, token_while,
+
+    // Operators and punctuation.
+    token_plus, token_minus, token_times, token_divides, token_ampersand, token_equals, token_doesnt_equal,
+    token_less_than, token_less_equal, token_greater_than, token_greater_equal, token_colon, token_comma,
+    token_open_parenthesis, token_close_parenthesis
 };
 
+// The spelling of a keyword or operator, or a description of the other kinds of token.
+char const* to_string(e_token kind);
+
+// Keywords are words too; they can be used where the grammar wants any word: to name variables, labels and blocks.
+bool is_word(e_token kind);
+
 struct lexer_error : std::runtime_error {
     explicit lexer_error(std::string const& what);
 };
 
-class lexer {
+// A whole source file split into tokens.  Tokens are kept in parallel arrays of their kind and where their text is in
+// the source; the text itself is only extracted when the parser asks for it.  Identifiers are interned into symbols as
+// they are lexed, and keywords are told apart from them by a perfect hash.  A comment is a single REM token, runs of
+// blank lines are a single end of line, and the last two tokens are always an end of line and the end of input.
+class token_stream {
 public:
-    explicit lexer(std::istream& source, std::string const& filename = "<input>");
+    // A large source is split at line breaks into up to jobs pieces, which are lexed in parallel.  The tokens and
+    // symbols are the same however many jobs there are.
+    explicit token_stream(std::string const& source, std::string const& filename = "<input>", std::size_t jobs = 1);
 
-    // Return the next lexeme that is in the lexer.  If end of the stream has been encountered, return none.
-    boost::optional<lexeme> get_lexeme();
+    std::size_t size() const;
 
-    // Discard all input until the end of the line.
-    void ignore_line();
+    e_token get_kind(std::size_t token) const;
 
-private:
-    std::istream& source;
+    // Symbol of an identifier token.
+    symbol_id get_symbol(std::size_t token) const;
 
-    void skip_whitespace();
+    // Text of a token: the lowercase name of an identifier or keyword, a number without leading zeroes, or the
+    // contents of a string literal without the quotes.
+    std::string get_text(std::size_t token) const;
 
-    // Read characters from source until 'what' has been seen, and return the read portion.  'What' is not
-    // extracted from the stream and it is not a part of the return value.
-    std::string extract_until(char what);
+    source_location get_location(std::size_t token) const;
 
-    // Same as above, but stop on any character for which pred(char) == true.
-    template <typename UnaryFunction>
-    std::string extract_until(UnaryFunction pred);
+    std::string const& get_source() const;
+    std::string const& get_filename() const;
 
+private:
+    std::string const source;
     std::string const filename;
-    int line;
-    int column;
+
+    // Tokens of the source, or of a piece of it.
+    struct token_arrays {
+        std::vector<unsigned char>      kinds;
+        std::vector<boost::uint32_t>    offsets;
+        std::vector<boost::uint32_t>    values;         // Length of the text, or for identifiers, their symbol.
+        std::vector<boost::uint32_t>    line_starts;    // Offset of the first character of every line.
+
+        e_token last_kind() const;
+        void add(e_token kind, std::size_t offset, std::size_t value);
+        bool at_statement_start() const;
+    };
+
+    // A piece of the source being lexed on its own, with symbols of its own.
+    struct chunk {
+        std::size_t                     begin;
+        std::size_t                     end;
+        token_arrays                    tokens;
+        boost::shared_ptr<symbol_table> symbols;
+        std::string                     error;          // Message of the lexer_error it gave, if any.
+    };
+
+    token_arrays tokens;
+
+    // Lex the lines in [begin, end) of the source, interning identifiers into symbols.
+    void lex(std::size_t begin, std::size_t end, symbol_table& symbols, token_arrays& result) const;
+    void lex_chunk(std::vector<chunk>& chunks, std::size_t index) const;
+
+    // Append the tokens of a chunk lexed with its own symbols.
+    void append(chunk const& chunk);
+
+    int get_line(std::size_t offset) const;
+    lexer_error error(std::string const& what, std::size_t offset) const;
 };
 
 #endif
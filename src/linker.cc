@@ -0,0 +1,115 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <climits>
+#include <cstdlib>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/next_prior.hpp>
+
+#include "linker.hh"
+#include "lexer.hh"
+#include "statements.hh"
+#include "program_cache.hh"
+
+namespace {
+
+std::string get_directory(std::string const& path) {
+    std::string::size_type const slash = path.rfind('/');
+    if (slash == std::string::npos)
+        return ".";
+    else if (slash == 0)
+        return "/";
+    else
+        return path.substr(0, slash);
+}
+
+// The absolute path, without symlinks, of the file at path relative to directory, or an empty string if there's no
+// such file.
+std::string get_real_path(std::string const& directory, std::string const& path) {
+    std::string const joined = !path.empty() && path[0] == '/' ? path : directory + '/' + path;
+    char result[PATH_MAX];
+    return realpath(joined.c_str(), result) ? std::string(result) : std::string();
+}
+
+}
+
+link_error::link_error(std::string const& what)
+    : std::runtime_error(what)
+{ }
+
+linker::linker(program_cache const* cache, std::size_t jobs, bool lazy)
+    : cache(cache)
+    , jobs(jobs)
+    , lazy(lazy)
+{ }
+
+void linker::link(block& program, std::string const& filename) {
+    std::string const directory = get_directory(filename);
+
+    // Including the program itself does nothing.
+    std::string const path = get_real_path(".", filename);
+    if (!path.empty())
+        included.insert(path);
+
+    link_includes(program, directory);
+}
+
+void linker::link_includes(block& code, std::string const& directory) {
+    block::statement_list::iterator s = code.statements.begin();
+    while (s != code.statements.end()) {
+        include_stmt const* const include = dynamic_cast<include_stmt const*>(s->get());
+        if (!include) {
+            ++s;
+            continue;
+        }
+
+        std::string const path = get_real_path(directory, include->get_path());
+        if (path.empty()) {
+            std::ostringstream os;
+            os << include->get_location().filename << ", line " << include->get_location().line << ": Can't open "
+               << include->get_path();
+            throw link_error(os.str());
+        }
+
+        block unit;
+        if (included.insert(path).second) {
+            unit = load_unit(path);
+            link_includes(unit, get_directory(path));
+        }
+
+        // Labels of the INCLUDE now label the first statement of the unit, or what follows if the unit is empty.
+        block::statement_list::iterator const next = boost::next(s);
+        block::statement_list::iterator const first = unit.statements.empty() ? next : unit.statements.begin();
+        for (block::jump_table_t::iterator label = code.jump_table.begin(); label != code.jump_table.end(); ++label)
+            if (label->second == s)
+                label->second = first;
+
+        // Splicing keeps the iterators in the unit's jump table valid.
+        code.jump_table.insert(unit.jump_table.begin(), unit.jump_table.end());
+        code.statements.splice(next, unit.statements);
+        code.statements.erase(s);
+        s = next;
+    }
+}
+
+block linker::load_unit(std::string const& path) {
+    std::ifstream file(path.c_str());
+    if (!file)
+        throw link_error("Can't open " + path + " for reading");
+    std::string const source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    block unit;
+    if (cache && cache->load(source, path, unit))
+        return unit;
+
+    std::string const label_prefix = path + ':';
+    boost::shared_ptr<token_stream const> const tokens(new token_stream(source, path, jobs));
+    unit = lazy ? parse_lazily(tokens, jobs, label_prefix) : parse(*tokens, jobs, label_prefix);
+
+    if (cache && !lazy && !cache->store(source, path, unit))
+        std::cerr << "Can't write compiled unit " << path << " to the cache\n";
+
+    return unit;
+}
@@ -0,0 +1,43 @@
+#ifndef LINKER_HH
+#define LINKER_HH
+
+#include <string>
+#include <set>
+#include <stdexcept>
+
+#include <boost/utility.hpp>
+
+#include "parser.hh"
+
+class program_cache;
+
+struct link_error : std::runtime_error {
+    explicit link_error(std::string const& what);
+};
+
+// Puts the files a program INCLUDEs into it.  Every file is compiled on its own into a unit, whose labels are prefixed
+// by the file's path so that they can't clash with those of the program or of other units, and the unit's statements
+// and labels are then spliced into the program in place of the INCLUDE.  A file is included only once; later INCLUDEs
+// of it are dropped.  With a cache, units are loaded from and stored in it like whole programs, so only the files that
+// changed are parsed again.
+class linker : boost::noncopyable {
+public:
+    // cache may be 0.  Units are parsed with up to jobs threads, and lazily if asked to.
+    linker(program_cache const* cache, std::size_t jobs, bool lazy);
+
+    // Link the INCLUDEs at the top level of a program read from filename, and those of the files they include.  Paths
+    // are relative to the directory of the file that includes them.  Throws link_error if a file can't be read, and
+    // lexer_error or syntax_error if it doesn't compile.
+    void link(block& program, std::string const& filename);
+
+private:
+    program_cache const* const  cache;
+    std::size_t const           jobs;
+    bool const                  lazy;
+    std::set<std::string>       included;   // Real paths of the files in the program so far.
+
+    void link_includes(block& code, std::string const& directory);
+    block load_unit(std::string const& path);
+};
+
+#endif
@@ -1,11 +1,121 @@
 #include <iostream>
+#include <algorithm>
 #include <fstream>
+#include <iterator>
 #include <vector>
 #include <string>
 
+#include <unistd.h>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/optional.hpp>
+#include <boost/lexical_cast.hpp>
+
 #include "lexer.hh"
 #include "parser.hh"
 #include "interpreter.hh"
+#include "profiler.hh"
+#include "sampler.hh"
+#include "tracer.hh"
+#include "metrics.hh"
+#include "timer.hh"
+#include "alloc_stats.hh"
+#include "parallel.hh"
+#include "program_cache.hh"
+#include "linker.hh"
+#include "fork_server.hh"
+#include "result_cache.hh"
+#include "checkpoint.hh"
+#include "repl.hh"
+#include "specializer.hh"
+#include "optimizer.hh"
+#include "unparser.hh"
+
+namespace {
+
+void print_usage(std::string const& program_name) {
+    std::cout << "Usage: " << program_name << " [-h] [--profile] [--sample-profile[=FILE]] [--sample-rate=HZ]\n"
+              << "       [--trace=FILE] [--stats=json|prom] [--stats-file=FILE]\n"
+              << "       [--alloc-stats[=strict]] [--jobs=N]\n"
+              << "       [--cache-dir=DIR] [--lazy] [--check] [--repl]\n"
+              << "       [--fork-server --socket=PATH] [--result-cache=DIR]\n"
+              << "       [--checkpoint-every=N] [--checkpoint-file=FILE] [--restore]\n"
+              << "       [--optimize] [--unroll=N] [--specialize[=N,...]] [file]\n"
+              << '\n'
+              << "If given a filename, execute program contained in the file.  Othwerise, execute\n"
+              << "standard input terminated by end-of-file.\n"
+              << '\n'
+              << "Options:\n"
+              << "\t-h, --help\tPrint this text and exit\n"
+              << "\t--profile\tCount and time the execution of every line, print a report to\n"
+              << "\t\t\tstandard error when the program ends\n"
+              << "\t--sample-profile[=FILE]\n"
+              << "\t\t\tSample the running program and write the samples as folded stacks\n"
+              << "\t\t\tfor flame graph tools to FILE, or standard error\n"
+              << "\t--sample-rate=HZ\tSamples per second of CPU time (default 1000)\n"
+              << "\t--trace=FILE\tRecord block entries and exits, jumps, PRINTs and INPUTs and write\n"
+              << "\t\t\tthem to FILE in the Chrome trace-event format\n"
+              << "\t--stats=json|prom\tCollect runtime counters and write them as JSON or in the\n"
+              << "\t\t\tPrometheus text format when the program ends, and whenever the\n"
+              << "\t\t\tprocess receives SIGUSR1\n"
+              << "\t--stats-file=FILE\tWhere to write the counters; standard error by default\n"
+              << "\t--alloc-stats[=strict]\n"
+              << "\t\t\tCount heap allocations made by each line and print a report to\n"
+              << "\t\t\tstandard error when the program ends.  With strict, fail if a\n"
+              << "\t\t\tloop allocates after its first two iterations\n"
+              << "\t--jobs=N\tLex and parse a large program with up to N threads (default: the\n"
+              << "\t\t\tnumber of processors)\n"
+              << "\t--cache-dir=DIR\tKeep compiled programs in DIR, and load the program from there\n"
+              << "\t\t\tinstead of parsing it if it has been compiled before\n"
+              << "\t--lazy\t\tParse the bodies of IF, FOR and DO only when they are first run;\n"
+              << "\t\t\tsyntax errors in them are reported then, or not at all\n"
+              << "\t--check\t\tParse the whole program and report any errors without running it\n"
+              << "\t--repl\t\tRead statements and numbered program lines one at a time and run\n"
+              << "\t\t\tthem as they come; RUN runs the program, LIST lists it and NEW\n"
+              << "\t\t\tclears it.  Changing a line recompiles only its statement\n"
+              << "\t--fork-server\tCompile the program, then run it once for every connection to\n"
+              << "\t\t\tthe socket given by --socket, in a forked process whose standard\n"
+              << "\t\t\tinput and output are the connection\n"
+              << "\t--socket=PATH\tUnix socket for --fork-server to listen at\n"
+              << "\t--result-cache=DIR\n"
+              << "\t\t\tKeep the output of runs in DIR, and if the program is deterministic\n"
+              << "\t\t\tand has been run on the same input before, print that output\n"
+              << "\t\t\tinstead of running it.  The input is read whole before the run\n"
+              << "\t--checkpoint-every=N\n"
+              << "\t\t\tSave the state of the run every N statements\n"
+              << "\t--checkpoint-file=FILE\n"
+              << "\t\t\tWhere to save it (default basic.checkpoint)\n"
+              << "\t--restore\tContinue the run saved in the checkpoint file.  Give it the same\n"
+              << "\t\t\tinput; if the output goes to a file, append to it\n"
+              << "\t--optimize\tRewrite the program into one that runs faster before running it:\n"
+              << "\t\t\tloops and branches made of GOTOs become DO and IF blocks, code\n"
+              << "\t\t\tthat's never run or does nothing is left out, operations on the\n"
+              << "\t\t\tsame values are only worked out once, and arithmetic that can't\n"
+              << "\t\t\tfail or leave integers runs unchecked\n"
+              << "\t--unroll=N\tUnder --optimize, unroll FOR loops with constant bounds N times over\n"
+              << "\t\t\t(default 4); short ones are unrolled whole, whatever N is\n"
+              << "\t--specialize[=N,...]\n"
+              << "\t\t\tPrint the program partially evaluated for the given values of its\n"
+              << "\t\t\tfirst INPUTs, instead of running it: what's known is worked out,\n"
+              << "\t\t\tbranches never taken are left out and short loops are unrolled\n";
+}
+
+// If parameter is "name=value", return value; if it's just "name", return default_value; otherwise none.
+boost::optional<std::string> get_option(
+    std::string const& parameter,
+    std::string const& name,
+    boost::optional<std::string> default_value = boost::optional<std::string>()
+) {
+    if (parameter == name)
+        return default_value;
+    else if (parameter.compare(0, name.size() + 1, name + '=') == 0)
+        return parameter.substr(name.size() + 1);
+    else
+        return boost::optional<std::string>();
+}
+
+}
 
 int main(int argc, char** argv) {
     std::vector<std::string> parameters(argv, argv + argc);
@@ -13,43 +123,342 @@ int main(int argc, char** argv) {
     std::ifstream file;
     std::string filename = "<stdin>";
     std::istream* input = &std::cin;
-    if (parameters.size() > 1) {
-        if (parameters[1] == "-h" || parameters[1] == "--help") {
-            std::cout << "Usage: " << parameters[0] << " [-h] [file]\n"
-                      << '\n'
-                      << "If given a filename, execute program contained in the file.  Othwerise, execute\n"
-                      << "standard input terminated by end-of-file.\n"
-                      << '\n'
-                      << "Options:\n"
-                      << "\t-h, --help\tPrint this text and exit\n";
+    boost::scoped_ptr<profiler> line_profiler;
+    boost::optional<std::string> sample_profile_file;
+    unsigned sample_rate = 1000;
+    boost::optional<std::string> trace_file;
+    boost::optional<e_metrics_format> stats_format;
+    std::string stats_file;
+    boost::optional<std::string> alloc_stats_mode;
+    std::size_t jobs = get_hardware_concurrency();
+    boost::optional<std::string> cache_dir;
+    bool lazy = false;
+    bool check = false;
+    bool interactive = false;
+    bool serve = false;
+    boost::optional<std::string> socket_path;
+    boost::optional<std::string> result_cache_dir;
+    boost::uint64_t checkpoint_interval = 0;
+    std::string checkpoint_file = "basic.checkpoint";
+    bool restore = false;
+    bool optimize_program = false;
+    std::size_t unroll_factor = 4;
+    boost::optional<std::vector<int> > specialize_inputs;
+
+    for (std::size_t i = 1; i < parameters.size(); ++i) {
+        boost::optional<std::string> value;
+
+        if (parameters[i] == "-h" || parameters[i] == "--help") {
+            print_usage(parameters[0]);
             return 0;
+        } else if (parameters[i] == "--profile") {
+            line_profiler.reset(new profiler);
+        } else if ((value = get_option(parameters[i], "--sample-profile", std::string()))) {
+            sample_profile_file = value;
+        } else if ((value = get_option(parameters[i], "--sample-rate"))) {
+            // Parsed as signed, since lexical_cast would wrap a negative rate around into a large unsigned one.
+            long rate;
+            try {
+                rate = boost::lexical_cast<long>(*value);
+            } catch (boost::bad_lexical_cast const&) {
+                rate = 0;
+            }
+            if (rate <= 0 || rate > 1000000) {
+                std::cerr << "Invalid sample rate " << *value << '\n';
+                return 1;
+            }
+            sample_rate = static_cast<unsigned>(rate);
+        } else if ((value = get_option(parameters[i], "--trace"))) {
+            trace_file = value;
+        } else if ((value = get_option(parameters[i], "--stats", std::string("json")))) {
+            if (*value == "json")
+                stats_format = metrics_format_json;
+            else if (*value == "prom")
+                stats_format = metrics_format_prometheus;
+            else {
+                std::cerr << "Unknown statistics format " << *value << '\n';
+                return 1;
+            }
+        } else if ((value = get_option(parameters[i], "--stats-file"))) {
+            stats_file = *value;
+        } else if ((value = get_option(parameters[i], "--alloc-stats", std::string()))) {
+            if (!value->empty() && *value != "strict") {
+                std::cerr << "Unknown allocation tracking mode " << *value << '\n';
+                return 1;
+            }
+            alloc_stats_mode = value;
+        } else if ((value = get_option(parameters[i], "--jobs"))) {
+            try {
+                jobs = boost::lexical_cast<std::size_t>(*value);
+            } catch (boost::bad_lexical_cast const&) {
+                jobs = 0;
+            }
+            if (jobs == 0) {
+                std::cerr << "Invalid number of jobs " << *value << '\n';
+                return 1;
+            }
+        } else if ((value = get_option(parameters[i], "--cache-dir"))) {
+            cache_dir = value;
+        } else if (parameters[i] == "--lazy") {
+            lazy = true;
+        } else if (parameters[i] == "--check") {
+            check = true;
+        } else if (parameters[i] == "--repl") {
+            interactive = true;
+        } else if (parameters[i] == "--fork-server") {
+            serve = true;
+        } else if ((value = get_option(parameters[i], "--socket"))) {
+            socket_path = value;
+        } else if ((value = get_option(parameters[i], "--result-cache"))) {
+            result_cache_dir = value;
+        } else if ((value = get_option(parameters[i], "--checkpoint-every"))) {
+            try {
+                checkpoint_interval = boost::lexical_cast<boost::uint64_t>(*value);
+            } catch (boost::bad_lexical_cast const&) {
+                checkpoint_interval = 0;
+            }
+            if (checkpoint_interval == 0) {
+                std::cerr << "Invalid checkpoint interval " << *value << '\n';
+                return 1;
+            }
+        } else if ((value = get_option(parameters[i], "--checkpoint-file"))) {
+            checkpoint_file = *value;
+        } else if (parameters[i] == "--restore") {
+            restore = true;
+        } else if (parameters[i] == "--optimize") {
+            optimize_program = true;
+        } else if ((value = get_option(parameters[i], "--unroll"))) {
+            try {
+                unroll_factor = boost::lexical_cast<std::size_t>(*value);
+            } catch (boost::bad_lexical_cast const&) {
+                unroll_factor = 0;
+            }
+            if (unroll_factor == 0) {
+                std::cerr << "Invalid unroll factor " << *value << '\n';
+                return 1;
+            }
+        } else if ((value = get_option(parameters[i], "--specialize", std::string()))) {
+            specialize_inputs = std::vector<int>();
+            for (std::string::size_type begin = 0; begin < value->size(); ) {
+                std::string::size_type const end = std::min(value->find(',', begin), value->size());
+                std::string const item = value->substr(begin, end - begin);
+                try {
+                    specialize_inputs->push_back(boost::lexical_cast<int>(item));
+                } catch (boost::bad_lexical_cast const&) {
+                    std::cerr << "Invalid input value " << item << '\n';
+                    return 1;
+                }
+                begin = end + 1;
+            }
+        } else if (parameters[i].size() > 1 && parameters[i][0] == '-') {
+            std::cerr << "Unknown option " << parameters[i] << '\n';
+            return 1;
         } else {
-            filename = parameters[1];
+            filename = parameters[i];
             file.open(filename.c_str());
             if (file)
                 input = &file;
             else {
-                std::cerr << "Can't open " << parameters[1] << " for reading\n";
+                std::cerr << "Can't open " << parameters[i] << " for reading\n";
                 return 1;
             }
         }
     }
 
+    if (serve != bool(socket_path)) {
+        std::cerr << "--fork-server and --socket go together\n";
+        return 1;
+    }
+
+    // Every child would parse the bodies it runs again, checkpoints need the whole program to be identified by, and
+    // the optimizer and the specializer need it to rewrite it.
+    if (serve || checkpoint_interval || restore || optimize_program || specialize_inputs)
+        lazy = false;
+
+    if (interactive) {
+        repl session;
+        session.run(*input, input == &std::cin && isatty(STDIN_FILENO));
+        return 0;
+    }
+
+    // Keep the text of the program around for the tools that annotate it.
+    std::string const source((std::istreambuf_iterator<char>(*input)), std::istreambuf_iterator<char>());
+
+    boost::scoped_ptr<sampling_profiler> sampler;
+    boost::scoped_ptr<tracer> event_tracer;
+    boost::scoped_ptr<metrics_collector> collector;
+    boost::scoped_ptr<alloc_tracker> allocations;
+    block program;  // Outlives the interpreter so the tools can still look at its statements afterwards.
+    boost::scoped_ptr<result_cache> results;
+    boost::uint64_t result_key = 0;
+    boost::scoped_ptr<run_recorder> recorder;
+    boost::scoped_ptr<checkpointer> checkpoints;
+
     try {
-        lexer lexer(*input, filename);
-        block program = parse(lexer);
+        if (sample_profile_file)
+            sampler.reset(new sampling_profiler(sample_rate));
+        if (trace_file)
+            event_tracer.reset(new tracer);
+
+        if (stats_format)
+            collector.reset(new metrics_collector(stats_file, *stats_format));
+        if (alloc_stats_mode)
+            allocations.reset(new alloc_tracker(*alloc_stats_mode == "strict"));
+
+        if (check) {
+            program = parse(token_stream(source, filename, jobs), jobs);
+            linker(0, jobs, false).link(program, filename);
+            return 0;
+        }
+
+        boost::uint64_t const parse_start = read_nanoseconds();
+        boost::scoped_ptr<program_cache> cache;
+        if (cache_dir)
+            cache.reset(new program_cache(*cache_dir));
+
+        if (!cache || !cache->load(source, filename, program)) {
+            boost::shared_ptr<token_stream const> const tokens(new token_stream(source, filename, jobs));
+            program = lazy ? parse_lazily(tokens, jobs) : parse(*tokens, jobs);
+            metrics.parse_nanoseconds = read_nanoseconds() - parse_start;
+
+            // Storing a lazily parsed program would mean parsing all of it after all.
+            if (cache && !lazy && !cache->store(source, filename, program))
+                std::cerr << "Can't write compiled program to " << *cache_dir << '\n';
+        } else
+            metrics.parse_nanoseconds = read_nanoseconds() - parse_start;
+
+        boost::uint64_t const link_start = read_nanoseconds();
+        linker(cache.get(), jobs, lazy).link(program, filename);
+        if (optimize_program)
+            optimize(program, unroll_factor);
+        metrics.parse_nanoseconds += read_nanoseconds() - link_start;
+
+        if (specialize_inputs) {
+            std::size_t inputs_used;
+            unparse(specialize(program, *specialize_inputs, inputs_used), std::cout);
+            if (inputs_used < specialize_inputs->size())
+                std::cerr << "Only " << inputs_used << " of the " << specialize_inputs->size()
+                          << " input values could be given to the program\n";
+            return 0;
+        }
+
+        if (serve) {
+            fork_server server(program, *socket_path);
+            server.run();
+        }
+
+        // A deterministic program prints the same whenever it's given the same input, so its runs can be replayed.  Runs
+        // with tools aren't, as the tools would have nothing to report.
+        bool const observed = line_profiler || sampler || event_tracer || collector || allocations
+                              || checkpoint_interval || restore;
+        if (result_cache_dir && !observed && is_deterministic(program)) {
+            std::string const input_text((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+            results.reset(new result_cache(*result_cache_dir));
+            result_key = result_cache::get_key(program, input_text);
+
+            std::string output;
+            int exit_status;
+            if (results->load(result_key, output, exit_status)) {
+                std::cout << output << std::flush;
+                return exit_status;
+            }
+
+            recorder.reset(new run_recorder(input_text));
+        }
+
         interpreter interpreter(program);
+        if (restore)
+            restore_checkpoint(checkpoint_file, program, interpreter);
+        if (checkpoint_interval) {
+            checkpoints.reset(new checkpointer(checkpoint_file, checkpoint_interval, program));
+            interpreter.add_observer(*checkpoints);
+        }
+        if (collector) {
+            interpreter.add_observer(*collector);
+            collector->start_run();
+        }
+        if (line_profiler)
+            interpreter.add_observer(*line_profiler);
+        if (event_tracer)
+            interpreter.add_observer(*event_tracer);
+        if (allocations) {
+            interpreter.add_observer(*allocations);
+            allocations->start();
+        }
+        if (sampler) {
+            interpreter.add_observer(*sampler);
+            sampler->start();
+        }
         interpreter.run();
 
         std::cout << std::flush;
 
+        // Only runs that end without an error are kept, with the exit status of such a run.
+        if (recorder && !results->store(result_key, recorder->get_output(), 0))
+            std::cerr << "Can't write result to " << *result_cache_dir << '\n';
+
     } catch (lexer_error const& error) {
         std::cerr << "Lexer error: " << error.what() << '\n';
     } catch (syntax_error const& error) {
         std::cerr << "Syntax error: " << error.what() << '\n';
+    } catch (link_error const& error) {
+        std::cerr << "Link error: " << error.what() << '\n';
+    } catch (server_error const& error) {
+        std::cerr << "Server error: " << error.what() << '\n';
+    } catch (checkpoint_error const& error) {
+        std::cerr << "Checkpoint error: " << error.what() << '\n';
     } catch (runtime_error const& error) {
         std::cerr << "Runtime error: " << error.what() << '\n';
     } catch (std::exception const& error) {
         std::cerr << "Internal error: " << error.what() << '\n';
     }
+
+    if (check)
+        return 1;  // Only errors get here.
+
+    int exit_status = 0;
+
+    if (allocations) {
+        allocations->stop();
+        allocations->report(std::cerr);
+        if (allocations->failed())
+            exit_status = 1;
+    }
+
+    if (collector) {
+        collector->end_run();
+        if (!collector->write())
+            std::cerr << "Can't write metrics to " << stats_file << '\n';
+    }
+
+    if (line_profiler)
+        line_profiler->report(std::cerr, filename, source);
+
+    if (sampler) {
+        sampler->stop();
+        if (sample_profile_file->empty())
+            sampler->write_folded(std::cerr);
+        else {
+            std::ofstream out(sample_profile_file->c_str());
+            sampler->write_folded(out);
+            if (!out)
+                std::cerr << "Can't write samples to " << *sample_profile_file << '\n';
+        }
+
+        if (sampler->get_dropped() || sampler->get_truncated()) {
+            std::cerr << "Sampling profiler: " << sampler->get_dropped() << " samples dropped, "
+                      << sampler->get_truncated() << " stacks truncated\n";
+        }
+    }
+
+    if (event_tracer) {
+        std::ofstream out(trace_file->c_str());
+        event_tracer->write_chrome_json(out);
+        if (!out)
+            std::cerr << "Can't write trace to " << *trace_file << '\n';
+        if (event_tracer->get_overwritten())
+            std::cerr << "Tracer: " << event_tracer->get_overwritten() << " oldest events overwritten\n";
+    }
+
+    return exit_status;
 }
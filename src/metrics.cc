@@ -0,0 +1,160 @@
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <unistd.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include "metrics.hh"
+#include "timer.hh"
+
+runtime_metrics metrics;
+
+namespace {
+
+volatile sig_atomic_t write_requested = 0;
+
+extern "C" void handle_sigusr1(int) {
+    write_requested = 1;
+}
+
+struct metric_description {
+    char const*                     name;
+    char const*                     help;
+    char const*                     type;
+    boost::uint64_t runtime_metrics::*  value;
+};
+
+metric_description const METRICS[] = {
+    { "statements_executed", "Statements executed.", "counter", &runtime_metrics::statements_executed },
+    { "variable_lookups", "Variable lookups.", "counter", &runtime_metrics::variable_lookups },
+    { "variable_misses", "Variable lookups that found no such variable.", "counter", &runtime_metrics::variable_misses },
+    { "blocks_entered", "Blocks pushed on the block stack.", "counter", &runtime_metrics::blocks_entered },
+    { "blocks_exited", "Blocks popped off the block stack.", "counter", &runtime_metrics::blocks_exited },
+    { "jumps", "Jumps to labels.", "counter", &runtime_metrics::jumps },
+    { "float_promotions", "Integer arithmetic with a floating-point result.", "counter",
+      &runtime_metrics::float_promotions },
+    { "string_bytes_allocated", "Bytes of strings produced by string expressions.", "counter",
+      &runtime_metrics::string_bytes_allocated },
+    { "output_bytes", "Bytes written by PRINT and INPUT.", "counter", &runtime_metrics::output_bytes },
+    { "input_bytes", "Bytes read by INPUT.", "counter", &runtime_metrics::input_bytes },
+    { "parse_nanoseconds", "Time spent lexing and parsing.", "gauge", &runtime_metrics::parse_nanoseconds },
+    { "run_nanoseconds", "Time spent running the program.", "gauge", &runtime_metrics::run_nanoseconds }
+};
+metric_description const* const METRICS_END = METRICS + sizeof(METRICS) / sizeof(*METRICS);
+
+}
+
+runtime_metrics::runtime_metrics()
+    : statements_executed(0)
+    , variable_lookups(0)
+    , variable_misses(0)
+    , blocks_entered(0)
+    , blocks_exited(0)
+    , jumps(0)
+    , float_promotions(0)
+    , string_bytes_allocated(0)
+    , output_bytes(0)
+    , input_bytes(0)
+    , parse_nanoseconds(0)
+    , run_nanoseconds(0)
+{ }
+
+void write_metrics(std::ostream& os, runtime_metrics const& metrics, e_metrics_format format) {
+    if (format == metrics_format_json) {
+        os << "{";
+        for (metric_description const* m = METRICS; m != METRICS_END; ++m)
+            os << (m == METRICS ? "" : ",") << "\n  \"" << m->name << "\": " << metrics.*(m->value);
+        os << "\n}\n";
+    } else {
+        for (metric_description const* m = METRICS; m != METRICS_END; ++m) {
+            std::string name = std::string("basic_") + m->name;
+            if (std::strcmp(m->type, "counter") == 0)
+                name += "_total";
+
+            os << "# HELP " << name << ' ' << m->help << '\n'
+               << "# TYPE " << name << ' ' << m->type << '\n'
+               << name << ' ' << metrics.*(m->value) << '\n';
+        }
+    }
+}
+
+bool write_metrics_file(std::string const& filename, runtime_metrics const& metrics, e_metrics_format format) {
+    if (filename.empty()) {
+        write_metrics(std::cerr, metrics, format);
+        return std::cerr.good();
+    }
+
+    std::string const temp_name = filename + ".tmp." + boost::lexical_cast<std::string>(getpid());
+    {
+        std::ofstream out(temp_name.c_str());
+        write_metrics(out, metrics, format);
+        if (!out) {
+            std::remove(temp_name.c_str());
+            return false;
+        }
+    }
+
+    return std::rename(temp_name.c_str(), filename.c_str()) == 0;
+}
+
+metrics_collector::metrics_collector(std::string const& filename, e_metrics_format format)
+    : filename(filename)
+    , format(format)
+    , run_start(0)
+    , running(false)
+{
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = &handle_sigusr1;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, &old_action);
+}
+
+metrics_collector::~metrics_collector() {
+    sigaction(SIGUSR1, &old_action, 0);
+}
+
+void metrics_collector::before_statement(interpreter&, statement&) {
+    ++metrics.statements_executed;
+
+    if (write_requested) {
+        write_requested = 0;
+        if (!write())
+            std::cerr << "Can't write metrics to " << filename << '\n';
+    }
+}
+
+void metrics_collector::entered_block(interpreter&, block&, block_statement*) {
+    ++metrics.blocks_entered;
+}
+
+void metrics_collector::exited_block(interpreter&, block&) {
+    ++metrics.blocks_exited;
+}
+
+void metrics_collector::jumped(interpreter&, symbol_id) {
+    ++metrics.jumps;
+}
+
+void metrics_collector::start_run() {
+    run_start = read_nanoseconds();
+    running = true;
+}
+
+void metrics_collector::end_run() {
+    update_run_time();
+    running = false;
+}
+
+bool metrics_collector::write() {
+    update_run_time();
+    return write_metrics_file(filename, metrics, format);
+}
+
+void metrics_collector::update_run_time() {
+    if (running)
+        metrics.run_nanoseconds = read_nanoseconds() - run_start;
+}
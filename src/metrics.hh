@@ -0,0 +1,70 @@
+#ifndef METRICS_HH
+#define METRICS_HH
+
+#include <string>
+#include <ostream>
+#include <csignal>
+
+#include <boost/cstdint.hpp>
+
+#include "interpreter.hh"
+
+// Counters describing what the interpreter has been up to.  The cheap ones are kept always; statements, blocks and
+// jumps are only counted while a metrics_collector is watching.
+struct runtime_metrics {
+    boost::uint64_t statements_executed;
+    boost::uint64_t variable_lookups;
+    boost::uint64_t variable_misses;        // Lookups that found no variable of the given name.
+    boost::uint64_t blocks_entered;
+    boost::uint64_t blocks_exited;
+    boost::uint64_t jumps;
+    boost::uint64_t float_promotions;       // Arithmetic on an integer that gave a floating-point result.
+    boost::uint64_t string_bytes_allocated; // Total length of strings produced by string expressions.
+    boost::uint64_t output_bytes;
+    boost::uint64_t input_bytes;
+    boost::uint64_t parse_nanoseconds;
+    boost::uint64_t run_nanoseconds;
+
+    runtime_metrics();
+};
+
+extern runtime_metrics metrics;
+
+enum e_metrics_format { metrics_format_json, metrics_format_prometheus };
+
+void write_metrics(std::ostream& os, runtime_metrics const& metrics, e_metrics_format format);
+
+// Write metrics to the file named filename, replacing it atomically so that whoever reads it never sees half of it.
+// An empty filename means standard error.  Returns false if the file couldn't be written.
+bool write_metrics_file(std::string const& filename, runtime_metrics const& metrics, e_metrics_format format);
+
+// Counts statements, blocks and jumps into ::metrics, and keeps run_nanoseconds up to date.  While a collector is
+// alive, SIGUSR1 makes it write the metrics out, the next time a statement is executed.
+class metrics_collector : public interpreter_observer {
+public:
+    metrics_collector(std::string const& filename, e_metrics_format format);
+    ~metrics_collector();
+
+    virtual void before_statement(interpreter&, statement&);
+    virtual void entered_block(interpreter&, block&, block_statement*);
+    virtual void exited_block(interpreter&, block&);
+    virtual void jumped(interpreter&, symbol_id);
+
+    // Mark the beginning and end of the run, for run_nanoseconds.
+    void start_run();
+    void end_run();
+
+    // Write the metrics now.
+    bool write();
+
+private:
+    std::string const       filename;
+    e_metrics_format const  format;
+    boost::uint64_t         run_start;
+    bool                    running;
+    struct sigaction        old_action;
+
+    void update_run_time();
+};
+
+#endif
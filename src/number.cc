@@ -1,9 +1,11 @@
 #include <limits>
 #include <cmath>
 #include <iomanip>
+#include <cstring>
 
 #include "interpreter.hh"
 #include "number.hh"
+#include "metrics.hh"
 
 number::number()
     : integral_value(0)
@@ -29,6 +31,12 @@ number::number(double value)
     , integral(false)
 { }
 
+number::number(int integral_value, double floating_point_value, bool integral)
+    : integral_value(integral_value)
+    , floating_point_value(floating_point_value)
+    , integral(integral)
+{ }
+
 number& number::operator = (number const& rhs) {
     if (this != &rhs) {
         integral_value = rhs.integral_value;
@@ -83,6 +91,8 @@ number& number::operator /= (number const& rhs) {
         if (is_integral() && rhs.is_integral() && integral_value % rhs.integral_value == 0) {
             integral = true;
         } else {
+            if (is_integral())
+                ++metrics.float_promotions;
             integral = false;
         }
 
@@ -105,10 +115,46 @@ number& number::operator %= (number const& rhs) {
     return *this;
 }
 
+number& number::unchecked_add(number const& rhs) {
+    integral_value += rhs.integral_value;
+    floating_point_value += rhs.floating_point_value;
+    return *this;
+}
+
+number& number::unchecked_subtract(number const& rhs) {
+    integral_value -= rhs.integral_value;
+    floating_point_value -= rhs.floating_point_value;
+    return *this;
+}
+
+number& number::unchecked_multiply(number const& rhs) {
+    integral_value *= rhs.integral_value;
+    floating_point_value *= rhs.floating_point_value;
+    return *this;
+}
+
+number& number::unchecked_divide(number const& rhs) {
+    integral = integral_value % rhs.integral_value == 0;
+    if (!integral)
+        ++metrics.float_promotions;
+
+    integral_value /= rhs.integral_value;
+    floating_point_value /= rhs.floating_point_value;
+    return *this;
+}
+
+number& number::unchecked_modulo(number const& rhs) {
+    integral_value %= rhs.integral_value;
+    floating_point_value = integral_value;
+    return *this;
+}
+
 void number::check_and_promote(number const& other) {
     if (is_integral() && other.is_integral()) {
         integral = true;
     } else {
+        if (is_integral())
+            ++metrics.float_promotions;
         integral = false;
     }
 }
@@ -178,6 +224,13 @@ bool operator >= (number const& lhs, number const& rhs) {
     return !(lhs < rhs);
 }
 
+bool is_identical(number const& lhs, number const& rhs) {
+    double const lhs_value = lhs.get_floating_point_value();
+    double const rhs_value = rhs.get_floating_point_value();
+    return lhs.is_integral() == rhs.is_integral() && lhs.get_integral_value() == rhs.get_integral_value()
+           && std::memcmp(&lhs_value, &rhs_value, sizeof(double)) == 0;
+}
+
 std::ostream& operator << (std::ostream& stream, number const& num) {
     if (num.is_integral()) {
         return stream << num.get_integral_value();
@@ -15,6 +15,10 @@ public:
     number(int value);
     number(double value);
 
+    // A number exactly as it was, from what the getters below returned for it.  An integral number's floating-point
+    // value is kept apart from its integral value, since the latter wraps around and the former doesn't.
+    number(int integral_value, double floating_point_value, bool integral);
+
     number& operator = (number const& rhs);
 
     int     get_integral_value() const;
@@ -32,6 +36,14 @@ public:
     number& operator %= (number const& rhs);  // Will throw ::runtime_error if either argument is not integral.
     // (See interpreter.hh for definition of ::runtime_error.)
 
+    // Like the above, for operands known to be integers -- and when dividing, a divisor whose integral value is known not
+    // to be zero -- so without checking for either.  The results are the same as the operators'.
+    number& unchecked_add(number const& rhs);
+    number& unchecked_subtract(number const& rhs);
+    number& unchecked_multiply(number const& rhs);
+    number& unchecked_divide(number const& rhs);
+    number& unchecked_modulo(number const& rhs);
+
 private:
     int     integral_value;
     double  floating_point_value;
@@ -55,6 +67,10 @@ bool operator <= (number const& lhs, number const& rhs);
 bool operator > (number const& lhs, number const& rhs);
 bool operator >= (number const& lhs, number const& rhs);
 
+// Whether two numbers are the same in every respect -- type and both values, bit for bit -- rather than equal as
+// numbers, like ==.
+bool is_identical(number const& lhs, number const& rhs);
+
 std::ostream& operator << (std::ostream& stream, number const& number);
 
 #endif
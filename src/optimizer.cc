@@ -0,0 +1,22 @@
+#include "optimizer.hh"
+#include "structurer.hh"
+#include "eliminator.hh"
+#include "unroller.hh"
+#include "range_analyzer.hh"
+#include "value_numberer.hh"
+
+void optimize(block& program, std::size_t unroll_factor) {
+    // Dead code in the way of the jumps around it would keep them from being structured, and structuring them leaves
+    // labels unused.
+    eliminate_dead_code(program);
+    structure_jumps(program);
+    eliminate_dead_code(program);
+
+    // Unrolled loops leave branches on constants, and assignments that nothing reads.
+    unroll_loops(program, unroll_factor);
+    eliminate_dead_code(program);
+    remove_unneeded_checks(program);
+
+    // Last, as the temporaries it makes are only good for the runs of statements it found them in.
+    eliminate_common_subexpressions(program);
+}
@@ -0,0 +1,13 @@
+#ifndef OPTIMIZER_HH
+#define OPTIMIZER_HH
+
+#include <cstddef>
+
+#include "parser.hh"
+
+// Rewrite a wholly parsed and linked program into one that prints the same for the same input, but runs faster.  Runs
+// that fail fail with the same error.  FOR loops with constant bounds are unrolled unroll_factor times over; see
+// unroller.hh.
+void optimize(block& program, std::size_t unroll_factor);
+
+#endif
@@ -0,0 +1,63 @@
+#include <vector>
+#include <stdexcept>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "parallel.hh"
+
+namespace {
+
+struct task_call {
+    boost::function<void (std::size_t)> const*  task;
+    std::size_t                                 index;
+    bool                                        failed;
+};
+
+void call(task_call& c) {
+    try {
+        (*c.task)(c.index);
+    } catch (...) {
+        c.failed = true;
+    }
+}
+
+extern "C" void* thread_main(void* argument) {
+    call(*static_cast<task_call*>(argument));
+    return 0;
+}
+
+}
+
+void run_in_parallel(std::size_t count, boost::function<void (std::size_t)> const& task) {
+    std::vector<task_call> calls(count);
+    std::vector<pthread_t> threads(count);
+    std::vector<bool> started(count, false);
+
+    for (std::size_t i = 0; i < count; ++i) {
+        calls[i].task = &task;
+        calls[i].index = i;
+        calls[i].failed = false;
+    }
+
+    for (std::size_t i = 1; i < count; ++i)
+        started[i] = pthread_create(&threads[i], 0, &thread_main, &calls[i]) == 0;
+
+    // Do our share, and the share of any thread that couldn't be started.
+    call(calls[0]);
+    for (std::size_t i = 1; i < count; ++i) {
+        if (started[i])
+            pthread_join(threads[i], 0);
+        else
+            call(calls[i]);
+    }
+
+    for (std::size_t i = 0; i < count; ++i)
+        if (calls[i].failed)
+            throw std::runtime_error("A parallel task failed");
+}
+
+std::size_t get_hardware_concurrency() {
+    long const processors = sysconf(_SC_NPROCESSORS_ONLN);
+    return processors > 0 ? static_cast<std::size_t>(processors) : 1;
+}
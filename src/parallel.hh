@@ -0,0 +1,16 @@
+#ifndef PARALLEL_HH
+#define PARALLEL_HH
+
+#include <cstddef>
+
+#include <boost/function.hpp>
+
+// Call task(0) to task(count - 1), each on its own thread; task(0) runs on the calling thread.  Returns when all of
+// them have finished.  Tasks shall report their own errors; one that throws anyway makes this throw
+// std::runtime_error once every task is done.
+void run_in_parallel(std::size_t count, boost::function<void (std::size_t)> const& task);
+
+// How many threads are worth running: the number of online processors.
+std::size_t get_hardware_concurrency();
+
+#endif
@@ -3,516 +3,908 @@
 #include <map>
 #include <cassert>
 #include <memory>
+#include <vector>
+#include <algorithm>
 
-#include <iostream>
-
-#include <boost/function.hpp>
+#include <boost/optional.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
 
 #include "lexer.hh"
 #include "statements.hh"
 #include "number.hh"
 #include "parser.hh"
+#include "parallel.hh"
 
 namespace {
 
 struct line {
-    std::string label;
+    boost::optional<symbol_id> label;
     std::auto_ptr< ::statement > statement;
 
     line& copy() { return *this; }  // Hack around auto_ptr's uglyness by adding more uglyness.
 };
 
-// Keywords that terminate a block.
-std::string const BLOCK_TERMINATORS[] = { "end", "else", "elseif", "next", "loop" };
-std::string const* const BLOCK_TERMINATORS_END
-    = BLOCK_TERMINATORS + sizeof(BLOCK_TERMINATORS) / sizeof(*BLOCK_TERMINATORS);
+// Where the parser is in the token stream, or in the part of it [begin, end) that it's been given to parse.
+struct cursor {
+    token_stream const& tokens;
+    std::size_t         position;
+    std::size_t         end;
+
+    // When parsing lazily, the token stream, which unparsed blocks keep alive.
+    boost::shared_ptr<token_stream const> lazy_source;
+
+    // What the names of labels are prefixed with.
+    std::string         label_prefix;
+
+    // How many blocks the statement being parsed is in; 0 at the top level.
+    std::size_t         depth;
+
+    cursor(token_stream const& tokens, std::size_t begin, std::size_t end,
+           boost::shared_ptr<token_stream const> const& lazy_source = boost::shared_ptr<token_stream const>(),
+           std::string const& label_prefix = std::string())
+        : tokens(tokens)
+        , position(begin)
+        , end(end)
+        , lazy_source(lazy_source)
+        , label_prefix(label_prefix)
+        , depth(0)
+    { }
+
+    // The end of the part reads as the end of input.
+    e_token kind(std::size_t ahead = 0) const {
+        return position + ahead < end ? tokens.get_kind(position + ahead) : token_end_of_input;
+    }
+    symbol_id symbol() const { return tokens.get_symbol(position); }
+    std::string text() const { return tokens.get_text(position); }
+    source_location location() const { return tokens.get_location(position); }
+
+    // Move to the next token.  The end of input is never consumed, so there is always a current token.
+    void advance() {
+        if (kind() != token_end_of_input)
+            ++position;
+    }
+};
 
-// Function type that's supposed to extract a whole statement from the parser.
-typedef boost::function<std::auto_ptr< ::statement >(lexer&)> statement_parser_t;
+// Programs are only split into parts at least this many tokens long, so that threads have enough to do.
+std::size_t const MIN_CHUNK_TOKENS = 64 * 1024;
 
-// Mapping of keywords to their respective parsers.
-typedef std::map<std::string, statement_parser_t> parsers_map_t;
+}
 
-parsers_map_t parsers_map;
-boost::optional<lexeme> next_symbol;
+// The tokens of a block body that has been skimmed over but not parsed yet.
+struct unparsed_block {
+    boost::shared_ptr<token_stream const>   tokens;
+    std::size_t                             begin;
+    std::size_t                             end;
+    std::string                             label_prefix;
+};
 
-std::string to_string(lexeme::e_type type) {
-    switch (type) {
-    case lexeme::type_end:          return "end of line";
-    case lexeme::type_number:      return "integral literal";
-    case lexeme::type_string:       return "string literal";
-    case lexeme::type_symbol:       return "operator";
-    case lexeme::type_word:         return "identifier or keyword";
-    }
-    assert(!"Never gets here");
-    return "";  // Stupid compiler.
-}
+namespace {
 
-// Unconditionally accept what's in the stream.
-boost::optional<lexeme> accept(lexer& lexer) {
-    boost::optional<lexeme> result = next_symbol;
-    next_symbol = lexer.get_lexeme();
-    return result;
-}
+// A part of the program parsed on its own.
+struct program_chunk {
+    std::size_t begin;
+    std::size_t end;
+    bool        last;       // Whether it's the end of the program.
+    block       body;
+    bool        parsed;     // Whether it parsed as a sequence of whole statements.
+};
 
-// If the next symbol in the lexer is of the given type (and, optionally, contains the given value), return the symbol
-// and read the next one.
-boost::optional<lexeme> accept(
-    lexer& lexer,
-    lexeme::e_type what,
-    boost::optional<std::string> value = boost::optional<std::string>()
-) {
+// Keywords that terminate a block.
+e_token const BLOCK_TERMINATORS[] = { token_end, token_else, token_elseif, token_next, token_loop };
+e_token const* const BLOCK_TERMINATORS_END
+    = BLOCK_TERMINATORS + sizeof(BLOCK_TERMINATORS) / sizeof(*BLOCK_TERMINATORS);
 
-    if (next_symbol && next_symbol->type == what && (!value || next_symbol->value == value))
-        return accept(lexer);
+// How a line changes the nesting of blocks, judged by its first keyword after any label, the token after that, and
+// its last token: 1 if it opens a block, -1 if it closes one, 0 otherwise.
+int get_nesting_change(e_token keyword, e_token next, e_token last) {
+    if (keyword == token_do || keyword == token_for || (keyword == token_if && last == token_then))
+        return 1;
+    else if (keyword == token_next || keyword == token_loop || (keyword == token_end && next == token_if))
+        return -1;
     else
-        return boost::optional<lexeme>();
+        return 0;
 }
 
-syntax_error error(std::string const& what, boost::optional<lexeme> where = boost::optional<lexeme>()) {
+// Function type that's supposed to extract a whole statement from the parser.
+typedef std::auto_ptr< ::statement > (*statement_parser_t)(cursor&);
+
+// Parsers of statements, indexed by the keyword that begins them; null for other tokens.
+statement_parser_t parsers[token_close_parenthesis + 1];
+
+// If the current token is of the given kind, consume it and return true.
+bool accept(cursor& input, e_token kind) {
+    if (input.kind() == kind) {
+        input.advance();
+        return true;
+    } else
+        return false;
+}
+
+syntax_error error(std::string const& what, cursor const& where) {
+    source_location const location = where.location();
+
     std::ostringstream os;
-    if (where) {
-        os << where->physical_location.filename << ", line " << where->physical_location.line << ", column "
-           << where->physical_location.column << ": ";
-    }
-    os << what;
+    os << location.filename << ", line " << location.line << ", column " << location.column << ": " << what;
     return syntax_error(os.str());
 }
 
-lexeme expect(
-    lexer& lexer,
-    lexeme::e_type type,
-    boost::optional<std::string> value = boost::optional<std::string>()
-) {
-    boost::optional<lexeme> lexeme;
-    if ((lexeme = accept(lexer, type, value)))
-        return *lexeme;
-    else {
-        std::ostringstream os;
-        os << "Expected ";
-        if (value)
-            os << *value;
-        else
-            os << to_string(type);
-        os << ", got ";
-        if ((lexeme = accept(lexer))) {
-            if (value)
-                os << lexeme->value;
-            else
-                os << to_string(lexeme->type);
-        } else
-            os << "end of input";
-        throw error(os.str(), lexeme);
-    }
+// Describe the current token for an error message.
+std::string describe(cursor const& input) {
+    if (input.kind() == token_identifier || input.kind() == token_number)
+        return input.text();
+    else
+        return to_string(input.kind());
 }
 
+// Consume a token of the given kind and return its index, or throw.
+std::size_t expect(cursor& input, e_token kind) {
+    std::size_t const token = input.position;
+    if (accept(input, kind))
+        return token;
+    else
+        throw error(std::string("Expected ") + to_string(kind) + ", got " + describe(input), input);
+}
 
+bool is_string_variable(cursor const& input) {
+    return input.kind() == token_identifier && is_string_identifier(symbols.get_name(input.symbol()));
+}
 
-std::auto_ptr<numeric_expr> parse_numeric_expr(lexer&);
-
-std::auto_ptr<numeric_expr> parse_factor(lexer& lexer) {
-    boost::optional<lexeme> lexeme;
-
-    int sign = 1;
-    if (accept(lexer, lexeme::type_symbol, std::string("-")))
-        sign = -1;
+// The symbol of the current word.  Keywords can still name variables and labels, as they could before they were
+// tokens of their own; such a name is the keyword's spelling.
+symbol_id get_word_symbol(cursor const& input) {
+    return input.kind() == token_identifier ? input.symbol() : symbols.intern(to_string(input.kind()));
+}
 
-    if ((lexeme = accept(lexer, lexeme::type_number))) {
-        // Parse an numeric constant.
-        std::istringstream is(lexeme->value);
-        if (lexeme->value.find('.') == std::string::npos) {
-            // An integer.
-            int value;
-            is >> value;
-            return std::auto_ptr<numeric_expr>(new constant_expr(sign * value));
-        } else {
-            // Floating-point value.
-            double value;
-            is >> value;
-            return std::auto_ptr<numeric_expr>(new constant_expr(sign * value));
-        }
+// Consume an identifier, or a keyword used as one, and return its symbol.
+symbol_id expect_identifier(cursor& input) {
+    if (!is_word(input.kind()))
+        throw error(std::string("Expected ") + to_string(token_identifier) + ", got " + describe(input), input);
 
-    } else if ((lexeme = accept(lexer, lexeme::type_word))) {
-        // Parse a variable name.
-        if (!is_string_identifier(lexeme->value)) {
-            if (sign > 0)
-                return std::auto_ptr<numeric_expr>(new variable_expr(lexeme->value));
-            else
-                return std::auto_ptr<numeric_expr>(new arith_expr(
-                    std::auto_ptr<numeric_expr>(new constant_expr(-1)),
-                    std::auto_ptr<numeric_expr>(new variable_expr(lexeme->value)),
-                    arith_expr::operator_times));
-        } else {
-            throw error("String identifier in numeric expression", lexeme);
-        }
-    } else if ((lexeme = accept(lexer, lexeme::type_symbol, std::string("(")))) {
-        std::auto_ptr<numeric_expr> sub_expression = parse_numeric_expr(lexer);
-        expect(lexer, lexeme::type_symbol, std::string(")"));
-        return sub_expression;
-    } else if ((lexeme = accept(lexer, lexeme::type_string))) {
-        // Special-case strings so that we can produce nicer error messages.
-        throw error("String literal in numeric expression", lexeme);
-    } else
-        throw error("Expected an integral constant, a variable name, or an opening parenthesis", accept(lexer));
-}
-
-std::auto_ptr<numeric_expr> parse_term(lexer& lexer) {
-    std::auto_ptr<numeric_expr> left_side = parse_factor(lexer);
-
-    boost::optional<lexeme> lexeme;
-    if ((lexeme = accept(lexer, lexeme::type_symbol, std::string("*")))) {
-        std::auto_ptr<numeric_expr> right_side = parse_factor(lexer);
-        return std::auto_ptr<numeric_expr>(new arith_expr(left_side, right_side, arith_expr::operator_times));
-    } else if ((lexeme = accept(lexer, lexeme::type_symbol, std::string("/")))) {
-        std::auto_ptr<numeric_expr> right_side = parse_factor(lexer);
-        return std::auto_ptr<numeric_expr>(new arith_expr(left_side, right_side, arith_expr::operator_divides));
-    } else if ((lexeme = accept(lexer, lexeme::type_word, std::string("mod")))) {
-        std::auto_ptr<numeric_expr> right_side = parse_factor(lexer);
-        return std::auto_ptr<numeric_expr>(new arith_expr(left_side, right_side, arith_expr::operator_modulo));
-    } else
-        return left_side;
+    symbol_id const result = get_word_symbol(input);
+    input.advance();
+    return result;
 }
 
-std::auto_ptr<numeric_expr> parse_integer_expr(lexer& lexer) {
-    std::auto_ptr<numeric_expr> left_side = parse_term(lexer);
+// Consume a label -- a word or a number -- if there is one.
+boost::optional<symbol_id> accept_label(cursor& input) {
+    if (!is_word(input.kind()) && input.kind() != token_number)
+        return boost::optional<symbol_id>();
 
-    boost::optional<lexeme> lexeme;
-    if ((lexeme = accept(lexer, lexeme::type_symbol, std::string("+")))) {
-        std::auto_ptr<numeric_expr> right_side = parse_integer_expr(lexer);
-        return std::auto_ptr<numeric_expr>(new arith_expr(left_side, right_side, arith_expr::operator_plus));
-    } else if ((lexeme = accept(lexer, lexeme::type_symbol, std::string("-")))) {
-        std::auto_ptr<numeric_expr> right_side = parse_integer_expr(lexer);
-        return std::auto_ptr<numeric_expr>(new arith_expr(left_side, right_side, arith_expr::operator_minus));
-    } else
-        return left_side;
-}
-
-std::auto_ptr<numeric_expr> parse_relational_expr(lexer& lexer) {
-    std::auto_ptr<numeric_expr> left_side = parse_integer_expr(lexer);
-
-    boost::optional<lexeme> lexeme;
-    relational_expr::e_operator op;
-
-    if (accept(lexer, lexeme::type_symbol, std::string("=")))
-        op = relational_expr::operator_equals;
-    else if (accept(lexer, lexeme::type_symbol, std::string("<>")))
-        op = relational_expr::operator_doesnt_equal;
-    else if (accept(lexer, lexeme::type_symbol, std::string("<")))
-        op = relational_expr::operator_less_than;
-    else if (accept(lexer, lexeme::type_symbol, std::string("<=")))
-        op = relational_expr::operator_less_equal;
-    else if (accept(lexer, lexeme::type_symbol, std::string(">")))
-        op = relational_expr::operator_greater_than;
-    else if (accept(lexer, lexeme::type_symbol, std::string(">=")))
-        op = relational_expr::operator_greater_equal;
+    symbol_id label;
+    if (!input.label_prefix.empty())
+        label = symbols.intern(input.label_prefix + input.text());
+    else if (input.kind() == token_number)
+        label = symbols.intern(input.text());
     else
-        return left_side;  // Not a relational expression.
+        label = get_word_symbol(input);
+    input.advance();
+    return label;
+}
 
-    std::auto_ptr<numeric_expr> right_side = parse_integer_expr(lexer);
-    return std::auto_ptr<numeric_expr>(new relational_expr(left_side, right_side, op));
+symbol_id expect_label(cursor& input) {
+    boost::optional<symbol_id> const label = accept_label(input);
+    if (!label)
+        throw error("Expected a label", input);
+    return *label;
 }
 
-std::auto_ptr<string_expr> parse_string_expr(lexer& lexer);
+// An operator waiting on the stack of the numeric expression parser for its right operand.
+struct pending_operator {
+    enum e_kind { kind_arith, kind_relational, kind_boolean, kind_negate, kind_not, kind_parenthesis };
 
-std::auto_ptr<string_expr> parse_string_atom(lexer& lexer) {
-    boost::optional<lexeme> lexeme;
+    e_kind  kind;
+    int     precedence;
+    int     op;             // arith_expr::e_operator, relational_expr::e_operator or boolean_expr::e_operator.
+};
 
-    if ((lexeme = accept(lexer, lexeme::type_string))) {
-        return std::auto_ptr<string_expr>(new string_literal_expr(lexeme->value));
-    } else if ((lexeme = accept(lexer, lexeme::type_word))) {
-        if (is_string_identifier(lexeme->value)) {
-            return std::auto_ptr<string_expr>(new string_variable_expr(lexeme->value));
-        } else {
-            throw error("Expected a string identifier", lexeme);
-        }
-    } else if (accept(lexer, lexeme::type_symbol, std::string("("))) {
-        std::auto_ptr<string_expr> sub_expression = parse_string_expr(lexer);
-        expect(lexer, lexeme::type_symbol, std::string(")"));
-        return sub_expression;
-    } else {
-        throw error("Expected a string literal, string identifier or opening parenthesis", next_symbol);
-    }
+// Binding strength of operators.  NOT binds loosest of all, so that, as it always has, it takes the rest of the
+// expression or of the parentheses it's in: NOT a = b AND c means NOT (a = b AND c).
+int const PRECEDENCE_NOT = 0;
+int const PRECEDENCE_OR = 1;
+int const PRECEDENCE_AND = 2;
+int const PRECEDENCE_RELATIONAL = 4;
+int const PRECEDENCE_ADDITIVE = 5;
+int const PRECEDENCE_MULTIPLICATIVE = 6;
+int const PRECEDENCE_NEGATE = 7;
+
+// If the current token is a binary numeric operator, fill op in and return true without consuming the token.
+bool peek_binary_operator(cursor const& input, pending_operator& op) {
+    pending_operator::e_kind const arith = pending_operator::kind_arith;
+    pending_operator::e_kind const relational = pending_operator::kind_relational;
+    pending_operator::e_kind const boolean = pending_operator::kind_boolean;
+
+    pending_operator const operators[] = {
+        { arith, PRECEDENCE_ADDITIVE, arith_expr::operator_plus },
+        { arith, PRECEDENCE_ADDITIVE, arith_expr::operator_minus },
+        { arith, PRECEDENCE_MULTIPLICATIVE, arith_expr::operator_times },
+        { arith, PRECEDENCE_MULTIPLICATIVE, arith_expr::operator_divides },
+        { arith, PRECEDENCE_MULTIPLICATIVE, arith_expr::operator_modulo },
+        { relational, PRECEDENCE_RELATIONAL, relational_expr::operator_equals },
+        { relational, PRECEDENCE_RELATIONAL, relational_expr::operator_doesnt_equal },
+        { relational, PRECEDENCE_RELATIONAL, relational_expr::operator_less_than },
+        { relational, PRECEDENCE_RELATIONAL, relational_expr::operator_less_equal },
+        { relational, PRECEDENCE_RELATIONAL, relational_expr::operator_greater_than },
+        { relational, PRECEDENCE_RELATIONAL, relational_expr::operator_greater_equal },
+        { boolean, PRECEDENCE_AND, boolean_expr::operator_and },
+        { boolean, PRECEDENCE_OR, boolean_expr::operator_or }
+    };
+    e_token const tokens[] = {
+        token_plus, token_minus, token_times, token_divides, token_mod, token_equals, token_doesnt_equal,
+        token_less_than, token_less_equal, token_greater_than, token_greater_equal, token_and, token_or
+    };
+
+    e_token const* const tokens_end = tokens + sizeof(tokens) / sizeof(*tokens);
+    e_token const* const token = std::find(tokens, tokens_end, input.kind());
+    if (token != tokens_end) {
+        op = operators[token - tokens];
+        return true;
+    } else
+        return false;
 }
 
-std::auto_ptr<string_expr> parse_string_expr(lexer& lexer) {
-    std::auto_ptr<string_expr> left_side = parse_string_atom(lexer);
+// Apply the operator on top of operators to the operands it needs.
+void reduce(std::vector<pending_operator>& operators, expr_stack<numeric_expr>& operands) {
+    pending_operator const op = operators.back();
+    operators.pop_back();
+
+    std::auto_ptr<numeric_expr> right_side = operands.pop();
+    switch (op.kind) {
+    case pending_operator::kind_negate:
+        operands.push(std::auto_ptr<numeric_expr>(new arith_expr(
+            std::auto_ptr<numeric_expr>(new constant_expr(-1)), right_side, arith_expr::operator_times)));
+        break;
+    case pending_operator::kind_not:
+        operands.push(std::auto_ptr<numeric_expr>(new boolean_expr(
+            right_side, std::auto_ptr<numeric_expr>(), boolean_expr::operator_not)));
+        break;
+    case pending_operator::kind_arith: {
+        std::auto_ptr<numeric_expr> left_side = operands.pop();
+        operands.push(std::auto_ptr<numeric_expr>(new arith_expr(
+            left_side, right_side, static_cast<arith_expr::e_operator>(op.op))));
+        break;
+    }
+    case pending_operator::kind_relational: {
+        std::auto_ptr<numeric_expr> left_side = operands.pop();
+        operands.push(std::auto_ptr<numeric_expr>(new relational_expr(
+            left_side, right_side, static_cast<relational_expr::e_operator>(op.op))));
+        break;
+    }
+    case pending_operator::kind_boolean: {
+        std::auto_ptr<numeric_expr> left_side = operands.pop();
+        operands.push(std::auto_ptr<numeric_expr>(new boolean_expr(
+            left_side, right_side, static_cast<boolean_expr::e_operator>(op.op))));
+        break;
+    }
+    case pending_operator::kind_parenthesis:
+        assert(!"Parentheses are never reduced");
+    }
+}
 
-    if (accept(lexer, lexeme::type_symbol, std::string("&"))) {
-        std::auto_ptr<string_expr> right_side = parse_string_expr(lexer);
-        return std::auto_ptr<string_expr>(new string_concat_expr(left_side, right_side));
+std::auto_ptr<numeric_expr> parse_numeric_literal(std::string const& text, bool negative) {
+    std::istringstream is(text);
+    if (text.find('.') == std::string::npos) {
+        // An integer.
+        int value;
+        is >> value;
+        return std::auto_ptr<numeric_expr>(new constant_expr(negative ? -value : value));
     } else {
-        return left_side;
+        // Floating-point value.
+        double value;
+        is >> value;
+        return std::auto_ptr<numeric_expr>(new constant_expr(negative ? -value : value));
     }
 }
 
-std::auto_ptr<numeric_expr> parse_numeric_expr(lexer& lexer) {
-    // Parse a boolean expression.
-    if (accept(lexer, lexeme::type_word, std::string("not"))) {
-        std::auto_ptr<numeric_expr> left_side = parse_numeric_expr(lexer);
-        return std::auto_ptr<numeric_expr>(new boolean_expr(left_side, std::auto_ptr<numeric_expr>(),
-            boolean_expr::operator_not));
-    } else {
-        std::auto_ptr<numeric_expr> left_side = parse_relational_expr(lexer);
-
-        boolean_expr::e_operator op;
-        if (accept(lexer, lexeme::type_word, std::string("and")))
-            op = boolean_expr::operator_and;
-        else if (accept(lexer, lexeme::type_word, std::string("or")))
-            op = boolean_expr::operator_or;
-        else  // Not a boolean expression
-            return left_side;
-
-        std::auto_ptr<numeric_expr> right_side = parse_integer_expr(lexer);
-        return std::auto_ptr<numeric_expr>(new boolean_expr(left_side, right_side, op));
+// Parse a numeric expression by precedence climbing with explicit stacks, so that neither long chains of operators
+// nor deeply nested parentheses use up the C stack.  Binary operators are left-associative.
+std::auto_ptr<numeric_expr> parse_numeric_expr(cursor& input) {
+    std::vector<pending_operator> operators;
+    expr_stack<numeric_expr> operands;
+    std::size_t open_parentheses = 0;
+
+    for (;;) {
+        // Expecting an operand, possibly preceded by prefix operators and opening parentheses.
+        if (accept(input, token_minus)) {
+            if (input.kind() == token_number) {
+                operands.push(parse_numeric_literal(input.text(), true));
+                input.advance();
+            } else {
+                pending_operator const negate = { pending_operator::kind_negate, PRECEDENCE_NEGATE, 0 };
+                operators.push_back(negate);
+                continue;
+            }
+        } else if (accept(input, token_not)) {
+            pending_operator const not_ = { pending_operator::kind_not, PRECEDENCE_NOT, 0 };
+            operators.push_back(not_);
+            continue;
+        } else if (accept(input, token_open_parenthesis)) {
+            pending_operator const parenthesis = { pending_operator::kind_parenthesis, 0, 0 };
+            operators.push_back(parenthesis);
+            ++open_parentheses;
+            continue;
+        } else if (input.kind() == token_number) {
+            operands.push(parse_numeric_literal(input.text(), false));
+            input.advance();
+        } else if (is_word(input.kind())) {
+            if (is_string_variable(input))
+                throw error("String identifier in numeric expression", input);
+            operands.push(std::auto_ptr<numeric_expr>(new variable_expr(get_word_symbol(input))));
+            input.advance();
+        } else if (input.kind() == token_string) {
+            // Special-case strings so that we can produce nicer error messages.
+            throw error("String literal in numeric expression", input);
+        } else
+            throw error("Expected an integral constant, a variable name, or an opening parenthesis", input);
+
+        // Got an operand; now close any parentheses and see if an operator follows.
+        pending_operator op;
+        for (;;) {
+            if (open_parentheses > 0 && accept(input, token_close_parenthesis)) {
+                while (operators.back().kind != pending_operator::kind_parenthesis)
+                    reduce(operators, operands);
+                operators.pop_back();
+                --open_parentheses;
+            } else if (peek_binary_operator(input, op)) {
+                input.advance();
+                while (!operators.empty() && operators.back().kind != pending_operator::kind_parenthesis
+                       && operators.back().precedence >= op.precedence)
+                    reduce(operators, operands);
+                operators.push_back(op);
+                break;
+            } else {
+                // End of the expression.
+                if (open_parentheses > 0)
+                    expect(input, token_close_parenthesis);  // Will throw.
+                while (!operators.empty())
+                    reduce(operators, operands);
+                return operands.pop();
+            }
+        }
     }
 }
 
-std::auto_ptr<printable_expr> parse_expression(lexer& lexer) {
-    if (next_symbol && (next_symbol->type == lexeme::type_string
-        || (next_symbol->type == lexeme::type_word && is_string_identifier(next_symbol->value))))
-    {
-        return std::auto_ptr<printable_expr>(parse_string_expr(lexer));
-    } else {
-        return std::auto_ptr<printable_expr>(parse_numeric_expr(lexer));
+// Parse a string expression: string literals and variables joined by &, with parentheses.  Like numeric expressions,
+// it's parsed without recursion and & is left-associative.
+std::auto_ptr<string_expr> parse_string_expr(cursor& input) {
+    // For each level of parentheses, what's been parsed of it so far; null when nothing has been yet.
+    expr_stack<string_expr> levels;
+    levels.push(std::auto_ptr<string_expr>());
+
+    for (;;) {
+        std::auto_ptr<string_expr> atom;
+
+        if (accept(input, token_open_parenthesis)) {
+            levels.push(std::auto_ptr<string_expr>());
+            continue;
+        } else if (input.kind() == token_string) {
+            atom.reset(new string_literal_expr(input.text()));
+            input.advance();
+        } else if (input.kind() == token_identifier) {
+            if (is_string_variable(input))
+                atom.reset(new string_variable_expr(input.symbol()));
+            else
+                throw error("Expected a string identifier", input);
+            input.advance();
+        } else {
+            throw error("Expected a string literal, string identifier or opening parenthesis", input);
+        }
+
+        for (;;) {
+            // Append the atom to the current level.
+            std::auto_ptr<string_expr> left_side = levels.pop();
+            if (left_side.get())
+                levels.push(std::auto_ptr<string_expr>(new string_concat_expr(left_side, atom)));
+            else
+                levels.push(atom);
+
+            if (levels.items.size() > 1 && accept(input, token_close_parenthesis))
+                atom = levels.pop();  // The parenthesised expression is an atom of the enclosing level.
+            else
+                break;
+        }
+
+        if (!accept(input, token_ampersand)) {
+            if (levels.items.size() > 1)
+                expect(input, token_close_parenthesis);  // Will throw.
+            return levels.pop();
+        }
     }
 }
 
-// If line contains a BLOCK_TERMINATOR, the terminator will be extracted from the lexer, terminating_statement
-// set to the apropriate keyword, and the .statement of the return value will be null.
-line parse_line(lexer& lexer, std::string& terminating_keyword) {
+std::auto_ptr<printable_expr> parse_expression(cursor& input) {
+    if (input.kind() == token_string || is_string_variable(input))
+        return std::auto_ptr<printable_expr>(parse_string_expr(input));
+    else
+        return std::auto_ptr<printable_expr>(parse_numeric_expr(input));
+}
+
+// If line begins with a BLOCK_TERMINATOR, the terminator will be consumed, terminator set to it, and the .statement
+// of the return value will be null.
+line parse_line(cursor& input, e_token& terminator) {
     line result;
-    boost::optional<lexeme> symbol;
+    source_location const start = input.location();  // Where the line begins, including any label.
 
-do_parse:
     // Accept integral label at the beginning.
-    if ((symbol = accept(lexer, lexeme::type_number)))
-        result.label = symbol->value;
-
-    if ((symbol = accept(lexer, lexeme::type_word))) {
-        if (symbol->value != "rem") {
-            // First word can be either a keyword or label.
-            if (next_symbol && next_symbol->type == lexeme::type_symbol && next_symbol->value == ":") {
-                result.label = symbol->value;
-                accept(lexer);  // Consume the ':'.
+    if (input.kind() == token_number)
+        result.label = accept_label(input);
 
-                // Allow newlines between the label and the actual statement.
-                while (next_symbol && next_symbol->type == lexeme::type_end)
-                    accept(lexer);
-
-                symbol = expect(lexer, lexeme::type_word);
-            }
+    if (is_word(input.kind()) && input.kind(1) == token_colon) {
+        // A word followed by a colon is a label, even if it's a keyword.
+        result.label = accept_label(input);
+        input.advance();  // Consume the ':'.
 
-            if (symbol->value != "rem") {
-                parsers_map_t::const_iterator parser = parsers_map.find(symbol->value);
-                if (parser != parsers_map.end())
-                    result.statement = (parser->second)(lexer);
-                else if (std::find(BLOCK_TERMINATORS, BLOCK_TERMINATORS_END, symbol->value) != BLOCK_TERMINATORS_END) {
-                    terminating_keyword = symbol->value;
-                    return result;
-                } else
-                    throw error(std::string("Unrecognised keyword: ") + symbol->value, symbol);
-            } else {
-                // It's a comment, just like below!
-                lexer.ignore_line();
-                next_symbol = lexer.get_lexeme();
-                goto do_parse;
-            }
-        } else {
-            // It's a comment!
-            lexer.ignore_line();
-            next_symbol = lexer.get_lexeme();
-            goto do_parse;  // And go around, parse the next line, pretending the comment never happened.
-        }
+        // Allow newlines between the label and the actual statement.
+        while (accept(input, token_end_of_line))
+            ;
+    }
 
-        expect(lexer, lexeme::type_end);
-    } else {
+    if (accept(input, token_end_of_line)) {
         // This must be an empty line.
-        expect(lexer, lexeme::type_end);
         result.statement.reset(new empty_stmt);
+        result.statement->set_location(start);
+        return result;
     }
 
+    if (statement_parser_t const parser = parsers[input.kind()]) {
+        input.advance();
+        result.statement = parser(input);
+        result.statement->set_location(start);
+    } else if (std::find(BLOCK_TERMINATORS, BLOCK_TERMINATORS_END, input.kind()) != BLOCK_TERMINATORS_END) {
+        terminator = input.kind();
+        input.advance();
+        return result;
+    } else if (input.kind() == token_end_of_input) {
+        throw error("Expected a statement, got end of input", input);
+    } else
+        throw error(std::string("Unrecognised keyword: ") + describe(input), input);
+
+    expect(input, token_end_of_line);
     return result;
 }
 
-// Extract a block from the stream.  Upon exit, terminating_keyword will be set to the keyword that ended the block, if
-// the block ended due to end of input, it will be .empty().
-block parse_block(lexer& lexer, std::string& terminating_keyword) {
+// Extract a block from the stream.  Upon exit, terminator will be set to the keyword that ended the block, or to
+// token_end_of_input if the block ended due to end of input.
+block parse_block(cursor& input, e_token& terminator) {
     block result;
 
-    while (next_symbol) {
-        line l = parse_line(lexer, terminating_keyword).copy();
+    while (input.kind() != token_end_of_input) {
+        line l = parse_line(input, terminator).copy();
         block::statement_list::iterator statement;
         if (l.statement.get())
             statement = result.statements.insert(result.statements.end(), boost::shared_ptr< ::statement>(l.statement));
         else
             return result;
 
-        if (!l.label.empty())
-            result.jump_table.insert(std::make_pair(l.label, statement));
+        if (l.label)
+            result.jump_table.insert(std::make_pair(*l.label, statement));
+    }
+
+    terminator = token_end_of_input;
+    return result;
+}
+
+// Skip the label at the beginning of a line, if there is one.
+void skip_label(cursor& input) {
+    if (input.kind() == token_number)
+        input.advance();
+    else if (is_word(input.kind()) && input.kind(1) == token_colon) {
+        input.advance();
+        input.advance();
+        while (accept(input, token_end_of_line))
+            ;
+    }
+}
+
+// Skip the rest of a line, after any label, and return how it changes the nesting of blocks.
+int skip_line(cursor& input) {
+    e_token const keyword = input.kind();
+    e_token const next = input.kind(1);
+    e_token last = keyword;
+    while (input.kind() != token_end_of_line && input.kind() != token_end_of_input) {
+        last = input.kind();
+        input.advance();
     }
 
-    terminating_keyword.clear();
+    accept(input, token_end_of_line);
+    return get_nesting_change(keyword, next, last);
+}
+
+// Like parse_block, but only find where the block ends, following the nesting of blocks in it by the first keyword of
+// every line, and leave its statements to be parsed when it's first entered.
+block skim_block(cursor& input, e_token& terminator) {
+    std::size_t const begin = input.position;
+    int depth = 0;
+
+    for (;;) {
+        skip_label(input);
+
+        e_token const keyword = input.kind();
+        if (keyword == token_end_of_input
+            || (depth == 0
+                && std::find(BLOCK_TERMINATORS, BLOCK_TERMINATORS_END, keyword) != BLOCK_TERMINATORS_END))
+            break;
+
+        depth += skip_line(input);
+    }
+
+    block result;
+    result.unparsed.reset(new unparsed_block);
+    result.unparsed->tokens = input.lazy_source;
+    result.unparsed->begin = begin;
+    result.unparsed->end = input.position;
+    result.unparsed->label_prefix = input.label_prefix;
+
+    terminator = input.kind();
+    input.advance();
     return result;
 }
 
-std::auto_ptr<statement> parse_if(lexer& lexer) {
-    std::auto_ptr<numeric_expr> condition = parse_numeric_expr(lexer);
-    expect(lexer, lexeme::type_word, std::string("then"));
+// Parse or skim the body of a block statement.
+block parse_body(cursor& input, e_token& terminator) {
+    if (input.lazy_source)
+        return skim_block(input, terminator);
+
+    ++input.depth;
+    block result = parse_block(input, terminator);
+    --input.depth;
+    return result;
+}
 
-    boost::optional<lexeme> lexeme;
-    if ((lexeme = accept(lexer, lexeme::type_number)) || (lexeme = accept(lexer, lexeme::type_word))) {
+std::auto_ptr<statement> parse_if(cursor& input) {
+    std::auto_ptr<numeric_expr> condition = parse_numeric_expr(input);
+    expect(input, token_then);
+
+    if (boost::optional<symbol_id> const then_label = accept_label(input)) {
         // There is a label after THEN -- that means this is an expression of the form IF <cond> THEN <label> [ELSE <label>]
-        std::string const then_label = lexeme->value;
-        std::string else_label = "";
+        boost::optional<symbol_id> else_label;
 
         // See if there is any ELSE part.
-        if ((lexeme = accept(lexer, lexeme::type_word, std::string("else")))) {
-            if ((lexeme = accept(lexer, lexeme::type_number)))
-                else_label = lexeme->value;
-            else
-                else_label = expect(lexer, lexeme::type_word).value;
-        }
+        if (accept(input, token_else))
+            else_label = expect_label(input);
 
-        return std::auto_ptr<statement>(new if_goto_stmt(condition, then_label, else_label));
-    } else if (next_symbol && next_symbol->type == lexeme::type_end) {
+        return std::auto_ptr<statement>(new if_goto_stmt(condition, *then_label, else_label));
+    } else if (accept(input, token_end_of_line)) {
         // THEN is followed by the end of line, we have the block form of IF.
-        accept(lexer);  // Eat the newline.
-
         if_block_stmt::conditions_cont conditions;
         std::vector<block> blocks;
 
         conditions.push_back(boost::shared_ptr<numeric_expr>(condition));
 
-        std::string keyword = "if";
+        e_token terminator = token_if;
 
         do {
-            block clause = parse_block(lexer, keyword);
+            block clause = parse_body(input, terminator);
             blocks.push_back(clause);
 
-            if (keyword == "elseif") {
-                condition = parse_numeric_expr(lexer);
-                expect(lexer, lexeme::type_word, std::string("then"));
-                expect(lexer, lexeme::type_end);
+            if (terminator == token_elseif) {
+                condition = parse_numeric_expr(input);
+                expect(input, token_then);
+                expect(input, token_end_of_line);
                 conditions.push_back(boost::shared_ptr<numeric_expr>(condition));
-            } else if (keyword != "end" && keyword != "else") {
+            } else if (terminator == token_else) {
+                expect(input, token_end_of_line);
+            } else if (terminator != token_end) {
                 std::ostringstream os;
                 os << "Unexpected ";
-                if (!keyword.empty())
-                    os << "keyword " << keyword;
+                if (terminator != token_end_of_input)
+                    os << "keyword " << to_string(terminator);
                 else
                     os << "end of input";
                 os << ", expected ELSE, ELSEIF or END IF";
-                throw error(os.str());
+                throw error(os.str(), input);
             }
-        } while (keyword != "end");
-        expect(lexer, lexeme::type_word, std::string("if"));  // The whole thing ends with an END IF.
+        } while (terminator != token_end);
+        expect(input, token_if);  // The whole thing ends with an END IF.
 
         return std::auto_ptr<statement>(new if_block_stmt(conditions, blocks));
     } else
-        throw error("Expected a label or newline after THEN");
+        throw error("Expected a label or newline after THEN", input);
 }
 
-std::auto_ptr<statement> parse_do(lexer& lexer) {
-    expect(lexer, lexeme::type_word, std::string("while"));
-    std::auto_ptr<numeric_expr> condition = parse_numeric_expr(lexer);
-    std::string terminator;
-    block body = parse_block(lexer, terminator);
+std::auto_ptr<statement> parse_do(cursor& input) {
+    expect(input, token_while);
+    std::auto_ptr<numeric_expr> condition = parse_numeric_expr(input);
+    expect(input, token_end_of_line);
+
+    e_token terminator;
+    block body = parse_body(input, terminator);
 
-    if (terminator != "loop")
-        throw error(std::string("Expected LOOP, got ") + terminator);
+    if (terminator != token_loop)
+        throw error(std::string("Expected LOOP, got ") + to_string(terminator), input);
 
     return std::auto_ptr<statement>(new do_stmt(condition, body));
 }
 
-std::auto_ptr<statement> parse_for(lexer& lexer) {
-    std::string const variable_name = expect(lexer, lexeme::type_word).value;
-    expect(lexer, lexeme::type_symbol, std::string("="));
-    std::auto_ptr<numeric_expr> initial_value = parse_numeric_expr(lexer);
-    expect(lexer, lexeme::type_word, std::string("to"));
-    std::auto_ptr<numeric_expr> final_value = parse_numeric_expr(lexer);
+std::auto_ptr<statement> parse_for(cursor& input) {
+    symbol_id const variable_name = expect_identifier(input);
+    expect(input, token_equals);
+    std::auto_ptr<numeric_expr> initial_value = parse_numeric_expr(input);
+    expect(input, token_to);
+    std::auto_ptr<numeric_expr> final_value = parse_numeric_expr(input);
 
     std::auto_ptr<numeric_expr> step_value;
 
-    if (accept(lexer, lexeme::type_word, std::string("step")))
-        step_value = parse_numeric_expr(lexer);
+    if (accept(input, token_step))
+        step_value = parse_numeric_expr(input);
     else
         step_value = std::auto_ptr<numeric_expr>(new constant_expr(1));
-
-    std::string terminator;
-    block body = parse_block(lexer, terminator);
-    if (terminator == "next") {
-        expect(lexer, lexeme::type_word, variable_name);
+    expect(input, token_end_of_line);
+
+    e_token terminator;
+    block body = parse_body(input, terminator);
+    if (terminator == token_next) {
+        if (!is_word(input.kind()) || get_word_symbol(input) != variable_name)
+            throw error(std::string("Expected ") + symbols.get_name(variable_name) + ", got " + describe(input), input);
+        input.advance();
         return std::auto_ptr<statement>(new for_stmt(variable_name, initial_value, final_value, step_value, body));
     } else
-        throw error(std::string("Expected NEXT ") + variable_name + std::string(", got ") + terminator);
+        throw error(std::string("Expected NEXT ") + symbols.get_name(variable_name) + ", got " + to_string(terminator),
+                    input);
 }
 
-std::auto_ptr<statement> parse_print(lexer& lexer) {
+std::auto_ptr<statement> parse_print(cursor& input) {
     print_stmt::expressions_cont expressions;
-    if (next_symbol && next_symbol->type != lexeme::type_end) {
+    if (input.kind() != token_end_of_line) {
         do {
-            expressions.push_back(boost::shared_ptr<printable_expr>(parse_expression(lexer)));
-        } while (accept(lexer, lexeme::type_symbol, std::string(",")));
+            expressions.push_back(boost::shared_ptr<printable_expr>(parse_expression(input)));
+        } while (accept(input, token_comma));
     }
 
     return std::auto_ptr<statement>(new print_stmt(expressions));
 }
 
-std::auto_ptr<statement> parse_input(lexer& lexer) {
-    std::string const var_name = expect(lexer, lexeme::type_word).value;
+std::auto_ptr<statement> parse_input(cursor& input) {
+    symbol_id const var_name = expect_identifier(input);
     return std::auto_ptr<statement>(new input_stmt(var_name));
 }
 
-std::auto_ptr<statement> parse_let(lexer& lexer) {
-    std::string const var_name = expect(lexer, lexeme::type_word).value;
-    expect(lexer, lexeme::type_symbol, std::string("="));
+std::auto_ptr<statement> parse_let(cursor& input) {
+    symbol_id const var_name = expect_identifier(input);
+    expect(input, token_equals);
 
-    if (!is_string_identifier(var_name)) {
-        std::auto_ptr<numeric_expr> value = parse_numeric_expr(lexer);
+    if (!is_string_identifier(symbols.get_name(var_name))) {
+        std::auto_ptr<numeric_expr> value = parse_numeric_expr(input);
         return std::auto_ptr<statement>(new let_stmt(var_name, value));
     } else {
-        std::auto_ptr<string_expr> value = parse_string_expr(lexer);
+        std::auto_ptr<string_expr> value = parse_string_expr(input);
         return std::auto_ptr<statement>(new let_stmt(var_name, value));
     }
 }
 
-std::auto_ptr<statement> parse_goto(lexer& lexer) {
-    std::string label;
-    boost::optional<lexeme> lexeme;
-
-    if ((lexeme = accept(lexer, lexeme::type_word)) || (lexeme = accept(lexer, lexeme::type_number)))
-        label = lexeme->value;
-    else
-        throw error(std::string("Expected a label"));
+std::auto_ptr<statement> parse_goto(cursor& input) {
+    return std::auto_ptr<statement>(new goto_stmt(expect_label(input)));
+}
 
-    return std::auto_ptr<statement>(new goto_stmt(label));
+// The lexer has already skipped the text of the comment.
+std::auto_ptr<statement> parse_rem(cursor&) {
+    return std::auto_ptr<statement>(new empty_stmt);
 }
 
-std::auto_ptr<statement> parse_stop(lexer& lexer) {
+std::auto_ptr<statement> parse_stop(cursor&) {
     return std::auto_ptr<statement>(new stop_stmt);
 }
 
-std::auto_ptr<statement> parse_exit(lexer& lexer) {
-    std::string const what = expect(lexer, lexeme::type_word).value;
+std::auto_ptr<statement> parse_include(cursor& input) {
+    if (input.depth > 0)
+        throw error("INCLUDE is only allowed at the top level of a program", input);
+    if (input.kind() != token_string)
+        throw error("Expected the name of a file in quotes, got " + describe(input), input);
+
+    std::string const path = input.text();
+    input.advance();
+    return std::auto_ptr<statement>(new include_stmt(path));
+}
+
+std::auto_ptr<statement> parse_exit(cursor& input) {
+    symbol_id const what = expect_identifier(input);
     return std::auto_ptr<statement>(new exit_stmt(what));
 }
 
 // Helper object to fill the map of parsers.
 struct init_parsers_table {
     init_parsers_table() {
-        parsers_map["if"] = &parse_if;
-        parsers_map["do"] = &parse_do;
-        parsers_map["for"] = &parse_for;
-        parsers_map["print"] = &parse_print;
-        parsers_map["input"] = &parse_input;
-        parsers_map["let"] = &parse_let;
-        parsers_map["goto"] = &parse_goto;
-        parsers_map["stop"] = &parse_stop;
-        parsers_map["exit"] = &parse_exit;
+        parsers[token_if] = &parse_if;
+        parsers[token_do] = &parse_do;
+        parsers[token_for] = &parse_for;
+        parsers[token_print] = &parse_print;
+        parsers[token_input] = &parse_input;
+        parsers[token_let] = &parse_let;
+        parsers[token_goto] = &parse_goto;
+        parsers[token_rem] = &parse_rem;
+        parsers[token_stop] = &parse_stop;
+        parsers[token_exit] = &parse_exit;
+        parsers[token_include] = &parse_include;
     }
 } init_parsers_table_;
 
+// Parse a whole program, or the last part of it, which may end with an END as long as nothing follows it.
+block parse_program(cursor& input) {
+    e_token terminator;
+    block b = parse_block(input, terminator);
+
+    if (terminator != token_end_of_input) {
+        accept(input, token_end_of_line);
+        if (terminator != token_end || input.kind() != token_end_of_input) {
+            std::ostringstream os;
+            os << "Unexpected " << to_string(terminator) << ", expected END or end-of-file";
+            throw error(os.str(), input);
+        }
+    }
+
+    return b;
+}
+
+// Split a program into about jobs parts of whole lines, each of which is hopefully outside any block, and return
+// where every part begins.  Also intern the labels the parser would, and the spellings of keywords, which may name
+// variables, labels and blocks, so that parsing the parts in parallel, with the symbol table frozen, never needs to add
+// a symbol.
+std::vector<std::size_t> prepare(token_stream const& tokens, std::size_t jobs, std::string const& label_prefix) {
+    std::size_t const count = std::max<std::size_t>(1, std::min(jobs, tokens.size() / MIN_CHUNK_TOKENS));
+    std::vector<std::size_t> result(1, 0);
+
+    for (int keyword = token_and; keyword <= token_while; ++keyword)
+        symbols.intern(to_string(static_cast<e_token>(keyword)));
+
+    int depth = 0;
+    std::size_t line_start = 0;
+    for (std::size_t i = 0; i < tokens.size(); ++i) {
+        e_token const kind = tokens.get_kind(i);
+        e_token const previous = i > 0 ? tokens.get_kind(i - 1) : token_end_of_line;
+
+        // Labels to intern: numbers starting a line or after GOTO, THEN and ELSE, and with a prefix, words after those
+        // and before a colon.  Other words are interned already: identifiers by the lexer, and keywords above.
+        bool const after_jump = previous == token_goto || previous == token_then || previous == token_else;
+        if ((kind == token_number && (i == line_start || after_jump))
+            || (is_word(kind) && after_jump && !label_prefix.empty())
+            || (is_word(kind) && !label_prefix.empty() && i + 1 < tokens.size() && tokens.get_kind(i + 1) == token_colon))
+            symbols.intern(label_prefix + tokens.get_text(i));
+
+        if (kind != token_end_of_line)
+            continue;
+
+        // Guess how the line changes the nesting of blocks from its first keyword, after any label.
+        std::size_t first = line_start;
+        if (tokens.get_kind(first) == token_number)
+            ++first;
+        else if (is_word(tokens.get_kind(first)) && first + 1 < i && tokens.get_kind(first + 1) == token_colon)
+            first += 2;
+        while (first < i && tokens.get_kind(first) == token_end_of_line)
+            ++first;
+
+        if (first >= i) {
+            // Only a label; the statement it labels is on a following line.
+            if (first > line_start && tokens.get_kind(first - 1) == token_colon)
+                continue;
+        } else
+            depth += get_nesting_change(tokens.get_kind(first), tokens.get_kind(first + 1), previous);
+
+        line_start = i + 1;
+        if (depth == 0 && result.size() < count && line_start < tokens.size() - 1
+            && line_start >= tokens.size() / count * result.size())
+            result.push_back(line_start);
+    }
+
+    return result;
+}
+
+void parse_chunk(token_stream const& tokens, boost::shared_ptr<token_stream const> const& lazy_source,
+                 std::string const& label_prefix, std::vector<program_chunk>& chunks, std::size_t index) {
+    program_chunk& chunk = chunks[index];
+    cursor input(tokens, chunk.begin, chunk.end, lazy_source, label_prefix);
+
+    try {
+        if (chunk.last)
+            chunk.body = parse_program(input);
+        else {
+            e_token terminator;
+            chunk.body = parse_block(input, terminator);
+            if (terminator != token_end_of_input)
+                return;
+        }
+        chunk.parsed = true;
+    } catch (syntax_error const&) {
+        // The whole program will be parsed again to report the error.
+    } catch (symbol_table_frozen const&) {
+        // prepare() missed a label; the whole program will be parsed again, and the label added then.
+    }
+}
+
+block parse_tokens(token_stream const& tokens, std::size_t jobs,
+                   boost::shared_ptr<token_stream const> const& lazy_source, std::string const& label_prefix) {
+    std::vector<std::size_t> const chunk_starts = prepare(tokens, jobs, label_prefix);
+
+    if (chunk_starts.size() > 1) {
+        std::vector<program_chunk> chunks(chunk_starts.size());
+        for (std::size_t i = 0; i < chunks.size(); ++i) {
+            chunks[i].begin = chunk_starts[i];
+            chunks[i].end = i + 1 < chunks.size() ? chunk_starts[i + 1] : tokens.size();
+            chunks[i].last = i + 1 == chunks.size();
+            chunks[i].parsed = false;
+        }
+
+        {
+            symbol_table::freezer const frozen(symbols);
+            run_in_parallel(chunks.size(), boost::bind(&parse_chunk, boost::cref(tokens), boost::cref(lazy_source),
+                                                       boost::cref(label_prefix), boost::ref(chunks), _1));
+        }
+
+        bool parsed = true;
+        for (std::vector<program_chunk>::const_iterator c = chunks.begin(); c != chunks.end(); ++c)
+            parsed = parsed && c->parsed;
+
+        if (parsed) {
+            block result;
+            for (std::vector<program_chunk>::iterator c = chunks.begin(); c != chunks.end(); ++c) {
+                // Splicing keeps the iterators in the chunk's jump table valid.  Of duplicate labels, the first one
+                // counts, as it does when parsing the whole program at once.
+                result.jump_table.insert(c->body.jump_table.begin(), c->body.jump_table.end());
+                result.statements.splice(result.statements.end(), c->body.statements);
+            }
+            return result;
+        }
+
+        // A chunk didn't parse.  Either the program is wrong, or a split was made inside a block; either way, parsing
+        // it whole gives the right error, or the right program.
+    }
+
+    cursor input(tokens, 0, tokens.size(), lazy_source, label_prefix);
+    return parse_program(input);
+}
+
+}
+
+block::block() { }
+
+block::block(block const& other)
+    : statements(other.statements)
+    , unparsed(other.unparsed)
+{
+    if (other.jump_table.empty())
+        return;
+
+    // Find where each labelled statement ended up in our list.
+    std::map<statement const*, statement_list::iterator> positions;
+    for (statement_list::iterator s = statements.begin(); s != statements.end(); ++s)
+        positions.insert(std::make_pair(s->get(), s));
+
+    for (jump_table_t::const_iterator label = other.jump_table.begin(); label != other.jump_table.end(); ++label)
+        jump_table.insert(std::make_pair(label->first, positions[label->second->get()]));
+}
+
+block& block::operator = (block const& other) {
+    block temp(other);
+    swap(temp);
+    return *this;
+}
+
+void block::swap(block& other) {
+    // Swapping lists doesn't invalidate iterators, so the jump tables stay valid.
+    statements.swap(other.statements);
+    jump_table.swap(other.jump_table);
+    unparsed.swap(other.unparsed);
+}
+
+bool block::is_parsed() const {
+    return !unparsed;
+}
+
+void block::materialize() {
+    if (!unparsed)
+        return;
+
+    cursor input(*unparsed->tokens, unparsed->begin, unparsed->end, unparsed->tokens, unparsed->label_prefix);
+    input.depth = 1;  // Only the bodies of block statements are left unparsed.
+    e_token terminator;
+    block parsed = parse_block(input, terminator);
+    if (terminator != token_end_of_input)
+        throw error(std::string("Unexpected keyword ") + to_string(terminator), input);
+
+    statements.swap(parsed.statements);
+    jump_table.swap(parsed.jump_table);
+    unparsed.reset();
 }
 
 syntax_error::syntax_error(std::string const& what)
@@ -523,15 +915,23 @@ bool is_string_identifier(std::string const& identifier) {
     return !identifier.empty() && *identifier.rbegin() == '$';
 }
 
-block parse(lexer& lexer) {
-    next_symbol = lexer.get_lexeme();
-    std::string terminator;
-    block b = parse_block(lexer, terminator);
-    if (!terminator.empty() && (terminator != "end" || (next_symbol))) {
-        std::ostringstream os;
-        os << "Unexpected " << terminator << ", expected END or end-of-file";
-        throw error(os.str(), next_symbol);
+block parse(token_stream const& tokens, std::size_t jobs, std::string const& label_prefix) {
+    return parse_tokens(tokens, jobs, boost::shared_ptr<token_stream const>(), label_prefix);
+}
+
+block parse_lazily(boost::shared_ptr<token_stream const> const& tokens, std::size_t jobs,
+                   std::string const& label_prefix) {
+    return parse_tokens(*tokens, jobs, tokens, label_prefix);
+}
+
+int get_nesting_change(token_stream const& tokens) {
+    cursor input(tokens, 0, tokens.size());
+    int result = 0;
+
+    while (input.kind() != token_end_of_input) {
+        skip_label(input);
+        result += skip_line(input);
     }
 
-    return b;
+    return result;
 }
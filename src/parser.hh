@@ -9,15 +9,34 @@
 
 #include <boost/shared_ptr.hpp>
 
+#include "symbols.hh"
+
 struct statement;
-struct lexer;
+class token_stream;
+struct unparsed_block;
 
 struct block {
     typedef std::list<boost::shared_ptr<statement> > statement_list;
-    typedef std::map<std::string, statement_list::iterator> jump_table_t;
+    typedef std::map<symbol_id, statement_list::iterator> jump_table_t;
 
     statement_list statements;
     jump_table_t jump_table;
+
+    // Where the statements are in the source, if they haven't been parsed yet; see parse_lazily.
+    boost::shared_ptr<unparsed_block> unparsed;
+
+    block();
+
+    // Copies share the statements, but the jump table of a copy points into its own statement list.
+    block(block const& other);
+    block& operator = (block const& other);
+
+    void swap(block& other);
+
+    bool is_parsed() const;
+
+    // Parse the statements if they haven't been yet.  Throws syntax_error.
+    void materialize();
 };
 
 struct syntax_error : std::runtime_error {
@@ -26,7 +45,18 @@ struct syntax_error : std::runtime_error {
 
 bool is_string_identifier(std::string const& ident);
 
-// Parse the stream of lexemes inside the given lexer.
-block parse(lexer& lexer);
+// Parse a whole program.  A long one is split into up to jobs parts, which are parsed in parallel; the result is the
+// same however many jobs there are.  The names of labels, both where they're defined and where they're jumped to, are
+// prefixed by label_prefix -- the labels of an included file are kept apart from the program's that way.
+block parse(token_stream const& tokens, std::size_t jobs = 1, std::string const& label_prefix = std::string());
+
+// Like parse, but only skim over the bodies of IF, FOR and DO blocks; they are parsed when they're materialized, which
+// the interpreter does when it first enters them.  Errors in a body are only found then.
+block parse_lazily(boost::shared_ptr<token_stream const> const& tokens, std::size_t jobs = 1,
+                   std::string const& label_prefix = std::string());
+
+// How many more IF, FOR and DO blocks the tokens open than they close, judged by the first keyword of every line like
+// lazy parsing does.  Used to tell when a statement typed a line at a time is complete.
+int get_nesting_change(token_stream const& tokens);
 
 #endif
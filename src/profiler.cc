@@ -0,0 +1,143 @@
+#include <vector>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "profiler.hh"
+#include "statements.hh"
+#include "timer.hh"
+
+namespace {
+
+// Profile data aggregated over all statements on one source line.
+struct line_profile {
+    std::string     filename;
+    int             line;
+    boost::uint64_t count;
+    boost::uint64_t ticks;
+};
+
+bool hotter(line_profile const& lhs, line_profile const& rhs) {
+    return lhs.ticks > rhs.ticks;
+}
+
+double percent(boost::uint64_t part, boost::uint64_t whole) {
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+}
+
+
+profiler::entry::entry()
+    : type_name(0)
+    , count(0)
+    , ticks(0)
+{ }
+
+profiler::profiler()
+    : last_statement(0)
+    , last_entry(0)
+    , start(0)
+{ }
+
+void profiler::before_statement(interpreter&, statement& statement) {
+    if (&statement != last_statement) {
+        last_statement = &statement;
+        last_entry = &get_entry(statement);
+    }
+
+    start = read_ticks();
+}
+
+void profiler::after_statement(interpreter&, statement& statement) {
+    boost::uint64_t const end = read_ticks();
+
+    entry& e = &statement == last_statement ? *last_entry : get_entry(statement);
+    ++e.count;
+    e.ticks += end - start;
+}
+
+profiler::entry& profiler::get_entry(statement& statement) {
+    entry& e = statements[&statement];
+    if (!e.type_name) {
+        e.location = statement.get_location();
+        e.type_name = statement.get_type_name();
+    }
+    return e;
+}
+
+void profiler::report(
+    std::ostream& os,
+    std::string const& filename,
+    std::string const& source,
+    std::size_t top_lines
+) const {
+    typedef std::map<std::pair<std::string, int>, line_profile> lines_map_t;
+    typedef std::map<std::string, entry> types_map_t;
+
+    lines_map_t lines;
+    types_map_t types;
+    boost::uint64_t total_ticks = 0;
+    boost::uint64_t total_count = 0;
+
+    for (statements_map_t::const_iterator s = statements.begin(); s != statements.end(); ++s) {
+        source_location const& location = s->second.location;
+        line_profile& l = lines[std::make_pair(location.filename, location.line)];
+        l.filename = location.filename;
+        l.line = location.line;
+        l.count += s->second.count;
+        l.ticks += s->second.ticks;
+
+        entry& t = types[s->second.type_name];
+        t.count += s->second.count;
+        t.ticks += s->second.ticks;
+
+        total_count += s->second.count;
+        total_ticks += s->second.ticks;
+    }
+
+    std::vector<line_profile> hot;
+    for (lines_map_t::const_iterator l = lines.begin(); l != lines.end(); ++l)
+        hot.push_back(l->second);
+    std::sort(hot.begin(), hot.end(), &hotter);
+    if (hot.size() > top_lines)
+        hot.resize(top_lines);
+
+    std::ios::fmtflags const flags = os.flags();
+    os << std::fixed << std::setprecision(1);
+
+    os << "Profile: " << total_count << " statements executed in " << total_ticks << " ticks\n"
+       << '\n'
+       << "Top lines by self time:\n"
+       << std::setw(7) << "% time" << std::setw(16) << "ticks" << std::setw(12) << "count" << "  location\n";
+    for (std::vector<line_profile>::const_iterator l = hot.begin(); l != hot.end(); ++l) {
+        os << std::setw(6) << percent(l->ticks, total_ticks) << '%' << std::setw(16) << l->ticks
+           << std::setw(12) << l->count << "  " << l->filename << ':' << l->line << '\n';
+    }
+
+    os << '\n'
+       << "By node type:\n"
+       << std::setw(7) << "% time" << std::setw(16) << "ticks" << std::setw(12) << "count" << "  type\n";
+    for (types_map_t::const_iterator t = types.begin(); t != types.end(); ++t) {
+        os << std::setw(6) << percent(t->second.ticks, total_ticks) << '%' << std::setw(16) << t->second.ticks
+           << std::setw(12) << t->second.count << "  " << t->first << '\n';
+    }
+
+    if (!source.empty()) {
+        os << '\n'
+           << "Annotated listing:\n";
+        std::istringstream is(source);
+        std::string text;
+        for (int line = 1; std::getline(is, text); ++line) {
+            lines_map_t::const_iterator l = lines.find(std::make_pair(filename, line));
+            if (l != lines.end()) {
+                os << std::setw(6) << percent(l->second.ticks, total_ticks) << '%'
+                   << std::setw(12) << l->second.count << " | ";
+            } else
+                os << std::setw(7) << "" << std::setw(12) << "" << " | ";
+            os << text << '\n';
+        }
+    }
+
+    os.flags(flags);
+}
@@ -0,0 +1,53 @@
+#ifndef PROFILER_HH
+#define PROFILER_HH
+
+#include <map>
+#include <string>
+#include <ostream>
+
+#include <boost/cstdint.hpp>
+
+#include "interpreter.hh"
+#include "lexer.hh"
+
+// Instrumenting profiler: counts executions of each statement and the ticks (see timer.hh) spent in it.  Since block
+// bodies are run by the interpreter loop rather than from within the statement that opened them, the time of a
+// statement is its self time.
+class profiler : public interpreter_observer {
+public:
+    profiler();
+
+    virtual void before_statement(interpreter&, statement& statement);
+    virtual void after_statement(interpreter&, statement& statement);
+
+    // Print the top_lines hottest lines, a per-node-type summary, and the source annotated with line counts and ticks.
+    // source is the text of the file named filename; if it's empty, the annotated listing is left out.
+    void report(
+        std::ostream& os,
+        std::string const& filename,
+        std::string const& source,
+        std::size_t top_lines = 20) const;
+
+private:
+    // What we know about a statement.  Its location and type are copied so that a report can be made even after the
+    // program is gone.
+    struct entry {
+        source_location location;
+        char const*     type_name;
+        boost::uint64_t count;
+        boost::uint64_t ticks;
+
+        entry();
+    };
+
+    entry& get_entry(statement& statement);
+
+    typedef std::map<statement const*, entry> statements_map_t;
+
+    statements_map_t    statements;
+    statement const*    last_statement;     // Cache for the most recent lookup.
+    entry*              last_entry;
+    boost::uint64_t     start;
+};
+
+#endif
@@ -0,0 +1,778 @@
+#include <vector>
+#include <map>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include <cassert>
+
+#include <boost/cstdint.hpp>
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "program_cache.hh"
+#include "statements.hh"
+#include "symbols.hh"
+
+namespace {
+
+// Bump whenever the format changes, or the parser would build a different program from the same source.
+boost::uint32_t const FORMAT_VERSION = 3;
+
+char const MAGIC[4] = { 'B', 'A', 'S', 'C' };
+
+// A compiled program is this header, then the offset and length in the strings of every symbol's name, then the
+// program's words, then the strings.  Words are in the byte order of the machine; one with the other order has a
+// different magic.  The checksum is a hash of everything after the header, so that a damaged file is parsed again rather
+// than read.
+struct file_header {
+    char            magic[4];
+    boost::uint32_t version;
+    boost::uint64_t key;
+    boost::uint64_t source_size;
+    boost::uint32_t symbol_count;
+    boost::uint32_t program_words;
+    boost::uint32_t string_bytes;
+    boost::uint32_t reserved;
+    boost::uint64_t checksum;
+};
+
+// A block is its statement count, label count, a symbol and statement index for each label, and its statements.  A
+// statement is its line and column, one of these, and what its type needs.
+enum e_record {
+    record_if_goto, record_if_block, record_do, record_for, record_print, record_input, record_let, record_goto,
+    record_stop, record_exit, record_include, record_empty
+};
+
+// An expression is the number of operations, then the operations in postfix order.  Saves and temporaries, whose
+// operand is the expression they stand for, are only in optimized programs; those are hashed, but never stored.
+enum e_operation {
+    operation_integer, operation_real, operation_variable, operation_arith, operation_relational, operation_boolean,
+    operation_string, operation_string_variable, operation_concat, operation_save, operation_temporary
+};
+
+struct bad_compiled_program : std::runtime_error {
+    bad_compiled_program() : std::runtime_error("Bad compiled program") { }
+};
+
+// 64-bit FNV-1a.  The constants are put together from halves, as C++98 has no long long literals.
+boost::uint64_t const FNV_OFFSET_BASIS = (static_cast<boost::uint64_t>(0xcbf29ce4u) << 32) | 0x84222325u;
+boost::uint64_t const FNV_PRIME = (static_cast<boost::uint64_t>(0x100u) << 32) | 0x1b3u;
+
+boost::uint64_t hash(boost::uint64_t result, char const* begin, char const* end) {
+    for (char const* c = begin; c != end; ++c) {
+        result ^= static_cast<unsigned char>(*c);
+        result *= FNV_PRIME;
+    }
+    return result;
+}
+
+boost::uint64_t get_key(std::string const& source, std::string const& filename) {
+    char const* const version = reinterpret_cast<char const*>(&FORMAT_VERSION);
+    boost::uint64_t result = hash(FNV_OFFSET_BASIS, version, version + sizeof(FORMAT_VERSION));
+    result = hash(result, filename.c_str(), filename.c_str() + filename.size() + 1);
+    return hash(result, source.data(), source.data() + source.size());
+}
+
+class program_writer : private statement_visitor, private expr_visitor {
+public:
+    program_writer();
+
+    void write_block(block const& b);
+
+    // The whole compiled program.
+    std::string get_contents(boost::uint64_t key, std::size_t source_size) const;
+
+private:
+    std::vector<boost::uint32_t> words;
+    std::string strings;
+
+    // Expressions still to be written, and whether their operands have been.
+    std::vector<std::pair<printable_expr const*, bool> > pending;
+    bool operands_written;
+    boost::uint32_t operations;
+
+    void write(boost::uint32_t word);
+    void write_string(std::string const& s);
+    void write_expr(printable_expr const& expr);
+    void write_operation(printable_expr const& expr, e_operation operation, boost::uint32_t op,
+                         printable_expr const& left, printable_expr const* right);
+
+    virtual void visit(if_goto_stmt const& statement);
+    virtual void visit(if_block_stmt const& statement);
+    virtual void visit(do_stmt const& statement);
+    virtual void visit(for_stmt const& statement);
+    virtual void visit(print_stmt const& statement);
+    virtual void visit(input_stmt const& statement);
+    virtual void visit(let_stmt const& statement);
+    virtual void visit(goto_stmt const& statement);
+    virtual void visit(stop_stmt const& statement);
+    virtual void visit(exit_stmt const& statement);
+    virtual void visit(include_stmt const& statement);
+    virtual void visit(empty_stmt const& statement);
+
+    virtual void visit(string_concat_expr const& expr);
+    virtual void visit(string_variable_expr const& expr);
+    virtual void visit(string_literal_expr const& expr);
+    virtual void visit(arith_expr const& expr);
+    virtual void visit(variable_expr const& expr);
+    virtual void visit(constant_expr const& expr);
+    virtual void visit(relational_expr const& expr);
+    virtual void visit(boolean_expr const& expr);
+    virtual void visit(save_expr const& expr);
+    virtual void visit(temporary_expr const& expr);
+};
+
+program_writer::program_writer()
+    : operands_written(false)
+    , operations(0)
+{ }
+
+void program_writer::write_block(block const& b) {
+    assert(b.is_parsed());
+
+    write(b.statements.size());
+    write(b.jump_table.size());
+
+    if (!b.jump_table.empty()) {
+        std::map<statement const*, boost::uint32_t> indices;
+        boost::uint32_t index = 0;
+        for (block::statement_list::const_iterator s = b.statements.begin(); s != b.statements.end(); ++s)
+            indices.insert(std::make_pair(s->get(), index++));
+
+        for (block::jump_table_t::const_iterator label = b.jump_table.begin(); label != b.jump_table.end(); ++label) {
+            write(label->first);
+            write(indices[label->second->get()]);
+        }
+    }
+
+    for (block::statement_list::const_iterator s = b.statements.begin(); s != b.statements.end(); ++s) {
+        write((*s)->get_location().line);
+        write((*s)->get_location().column);
+        (*s)->accept(*this);
+    }
+}
+
+std::string program_writer::get_contents(boost::uint64_t key, std::size_t source_size) const {
+    file_header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.key = key;
+    header.source_size = source_size;
+    header.symbol_count = symbols.size();
+    header.program_words = words.size();
+    header.reserved = 0;
+
+    // Symbol names go after the program's strings.
+    std::string all_strings = strings;
+    std::vector<boost::uint32_t> names;
+    for (symbol_id s = 0; s < symbols.size(); ++s) {
+        names.push_back(all_strings.size());
+        names.push_back(symbols.get_name(s).size());
+        all_strings += symbols.get_name(s);
+    }
+    header.string_bytes = all_strings.size();
+
+    std::string body;
+    if (!names.empty())
+        body.append(reinterpret_cast<char const*>(&names[0]), names.size() * sizeof(boost::uint32_t));
+    if (!words.empty())
+        body.append(reinterpret_cast<char const*>(&words[0]), words.size() * sizeof(boost::uint32_t));
+    body += all_strings;
+    header.checksum = hash(FNV_OFFSET_BASIS, body.data(), body.data() + body.size());
+
+    return std::string(reinterpret_cast<char const*>(&header), sizeof(header)) + body;
+}
+
+void program_writer::write(boost::uint32_t word) {
+    words.push_back(word);
+}
+
+void program_writer::write_string(std::string const& s) {
+    write(strings.size());
+    write(s.size());
+    strings += s;
+}
+
+// Operands waiting to be written are kept on a stack, rather than recursed into, so that long chains of operators
+// can be written.
+void program_writer::write_expr(printable_expr const& expr) {
+    std::size_t const count = words.size();
+    write(0);
+    operations = 0;
+
+    pending.push_back(std::make_pair(&expr, false));
+    while (!pending.empty()) {
+        printable_expr const* const e = pending.back().first;
+        operands_written = pending.back().second;
+        pending.pop_back();
+        e->accept(*this);
+    }
+
+    words[count] = operations;
+}
+
+// Write an operation whose operands have been written, or else queue its operands to be written before it.
+void program_writer::write_operation(printable_expr const& expr, e_operation operation, boost::uint32_t op,
+                                     printable_expr const& left, printable_expr const* right) {
+    if (operands_written) {
+        write(operation);
+        write(op);
+        ++operations;
+    } else {
+        pending.push_back(std::make_pair(&expr, true));
+        if (right)
+            pending.push_back(std::make_pair(right, false));
+        pending.push_back(std::make_pair(&left, false));
+    }
+}
+
+void program_writer::visit(if_goto_stmt const& statement) {
+    write(record_if_goto);
+    write_expr(statement.get_condition());
+    write(statement.get_then_label());
+    write(statement.get_else_label() ? 1 : 0);
+    write(statement.get_else_label() ? *statement.get_else_label() : 0);
+}
+
+void program_writer::visit(if_block_stmt const& statement) {
+    write(record_if_block);
+    write(statement.get_conditions().size());
+    write(statement.get_blocks().size());
+    for (std::size_t i = 0; i < statement.get_conditions().size(); ++i)
+        write_expr(*statement.get_conditions()[i]);
+    for (std::size_t i = 0; i < statement.get_blocks().size(); ++i)
+        write_block(statement.get_blocks()[i]);
+}
+
+void program_writer::visit(do_stmt const& statement) {
+    write(record_do);
+    write_expr(statement.get_condition());
+    write_block(statement.get_body());
+}
+
+void program_writer::visit(for_stmt const& statement) {
+    write(record_for);
+    write(statement.get_variable_name());
+    write_expr(statement.get_initial_value());
+    write_expr(statement.get_final_value());
+    write_expr(statement.get_step());
+    write_block(statement.get_body());
+}
+
+void program_writer::visit(print_stmt const& statement) {
+    write(record_print);
+    write(statement.get_expressions().size());
+    for (std::size_t i = 0; i < statement.get_expressions().size(); ++i)
+        write_expr(*statement.get_expressions()[i]);
+}
+
+void program_writer::visit(input_stmt const& statement) {
+    write(record_input);
+    write(statement.get_variable_name());
+}
+
+void program_writer::visit(let_stmt const& statement) {
+    write(record_let);
+    write(statement.get_variable_name());
+    if (statement.get_numeric_value())
+        write_expr(*statement.get_numeric_value());
+    else
+        write_expr(*statement.get_string_value());
+}
+
+void program_writer::visit(goto_stmt const& statement) {
+    write(record_goto);
+    write(statement.get_label());
+}
+
+void program_writer::visit(stop_stmt const&) {
+    write(record_stop);
+}
+
+void program_writer::visit(exit_stmt const& statement) {
+    write(record_exit);
+    write(statement.get_block_name());
+}
+
+void program_writer::visit(include_stmt const& statement) {
+    write(record_include);
+    write_string(statement.get_path());
+}
+
+void program_writer::visit(empty_stmt const&) {
+    write(record_empty);
+}
+
+void program_writer::visit(string_concat_expr const& expr) {
+    write_operation(expr, operation_concat, 0, expr.get_left(), &expr.get_right());
+}
+
+void program_writer::visit(string_variable_expr const& expr) {
+    write(operation_string_variable);
+    write(expr.get_name());
+    ++operations;
+}
+
+void program_writer::visit(string_literal_expr const& expr) {
+    write(operation_string);
+    write_string(expr.get_value());
+    ++operations;
+}
+
+void program_writer::visit(arith_expr const& expr) {
+    write_operation(expr, operation_arith, expr.get_operator(), expr.get_left_side(), &expr.get_right_side());
+}
+
+void program_writer::visit(variable_expr const& expr) {
+    write(operation_variable);
+    write(expr.get_name());
+    ++operations;
+}
+
+void program_writer::visit(constant_expr const& expr) {
+    if (expr.get_value().is_integral()) {
+        write(operation_integer);
+        write(static_cast<boost::uint32_t>(expr.get_value().get_integral_value()));
+    } else {
+        double const value = expr.get_value().get_floating_point_value();
+        boost::uint32_t halves[2];
+        std::memcpy(halves, &value, sizeof(halves));
+
+        write(operation_real);
+        write(halves[0]);
+        write(halves[1]);
+    }
+    ++operations;
+}
+
+void program_writer::visit(relational_expr const& expr) {
+    write_operation(expr, operation_relational, expr.get_operator(), expr.get_left_side(), &expr.get_right_side());
+}
+
+void program_writer::visit(boolean_expr const& expr) {
+    write_operation(expr, operation_boolean, expr.get_operator(), expr.get_left_side(), expr.get_right_side());
+}
+
+void program_writer::visit(save_expr const& expr) {
+    write_operation(expr, operation_save, expr.get_slot(), expr.get_operand(), 0);
+}
+
+void program_writer::visit(temporary_expr const& expr) {
+    write_operation(expr, operation_temporary, expr.get_slot(), expr.get_original(), 0);
+}
+
+// Rebuilds a program from a mapped compiled program, checking everything it reads so that a damaged file is rejected
+// rather than trusted.
+class program_reader {
+public:
+    program_reader(char const* data, std::size_t size, std::string const& filename);
+
+    block read_block();
+
+    // Whether all of the program has been read.
+    bool at_end() const;
+
+private:
+    boost::uint32_t const*          words;
+    boost::uint32_t const*          words_end;
+    char const*                     strings;
+    std::size_t                     string_bytes;
+    std::vector<symbol_id>          symbol_map;     // Symbols in the file to symbols of ours.
+    source_location                 location;
+
+    boost::uint32_t read();
+    boost::uint32_t read(boost::uint32_t limit);
+    symbol_id read_symbol();
+    std::string read_string();
+
+    std::auto_ptr<statement> read_statement();
+    std::auto_ptr<printable_expr> read_expr();
+    std::auto_ptr<numeric_expr> read_numeric_expr();
+};
+
+template <typename ExprT>
+std::auto_ptr<ExprT> pop(expr_stack<ExprT>& stack) {
+    if (stack.items.empty())
+        throw bad_compiled_program();
+    return stack.pop();
+}
+
+program_reader::program_reader(char const* data, std::size_t size, std::string const& filename) {
+    file_header const& header = *reinterpret_cast<file_header const*>(data);
+    std::size_t const word_count = header.symbol_count * 2 + header.program_words;
+    if (size != sizeof(header) + word_count * sizeof(boost::uint32_t) + header.string_bytes)
+        throw bad_compiled_program();
+
+    words = reinterpret_cast<boost::uint32_t const*>(data + sizeof(header));
+    words_end = words + word_count;
+    strings = reinterpret_cast<char const*>(words_end);
+    string_bytes = header.string_bytes;
+
+    for (boost::uint32_t s = 0; s < header.symbol_count; ++s) {
+        std::string const name = read_string();
+        symbol_map.push_back(symbols.intern(name));
+    }
+
+    location.filename = filename;
+}
+
+block program_reader::read_block() {
+    block result;
+
+    boost::uint32_t const count = read();
+    boost::uint32_t const label_count = read();
+
+    std::vector<std::pair<symbol_id, boost::uint32_t> > labels;
+    for (boost::uint32_t i = 0; i < label_count; ++i) {
+        symbol_id const label = read_symbol();
+        labels.push_back(std::make_pair(label, read(count)));
+    }
+
+    std::vector<block::statement_list::iterator> positions;
+    for (boost::uint32_t i = 0; i < count; ++i) {
+        std::auto_ptr<statement> s = read_statement();
+        positions.push_back(result.statements.insert(result.statements.end(), boost::shared_ptr<statement>(s)));
+    }
+
+    for (std::size_t i = 0; i < labels.size(); ++i)
+        result.jump_table.insert(std::make_pair(labels[i].first, positions[labels[i].second]));
+
+    return result;
+}
+
+bool program_reader::at_end() const {
+    return words == words_end;
+}
+
+boost::uint32_t program_reader::read() {
+    if (words == words_end)
+        throw bad_compiled_program();
+    return *words++;
+}
+
+// Read a word that shall be less than limit.
+boost::uint32_t program_reader::read(boost::uint32_t limit) {
+    boost::uint32_t const result = read();
+    if (result >= limit)
+        throw bad_compiled_program();
+    return result;
+}
+
+symbol_id program_reader::read_symbol() {
+    return symbol_map.at(read(symbol_map.size()));
+}
+
+std::string program_reader::read_string() {
+    boost::uint32_t const offset = read();
+    boost::uint32_t const length = read();
+    if (offset > string_bytes || length > string_bytes - offset)
+        throw bad_compiled_program();
+    return std::string(strings + offset, length);
+}
+
+std::auto_ptr<statement> program_reader::read_statement() {
+    location.line = read();
+    location.column = read();
+
+    std::auto_ptr<statement> result;
+    switch (read()) {
+    case record_if_goto: {
+        std::auto_ptr<numeric_expr> condition = read_numeric_expr();
+        symbol_id const then_label = read_symbol();
+        boost::optional<symbol_id> else_label;
+        bool const has_else = read(2);
+        symbol_id const else_symbol = has_else ? read_symbol() : read();
+        if (has_else)
+            else_label = else_symbol;
+        result.reset(new if_goto_stmt(condition, then_label, else_label));
+        break;
+    }
+    case record_if_block: {
+        boost::uint32_t const condition_count = read();
+        boost::uint32_t const block_count = read();
+        if (condition_count == 0 || block_count < condition_count || block_count > condition_count + 1)
+            throw bad_compiled_program();
+
+        if_block_stmt::conditions_cont conditions;
+        for (boost::uint32_t i = 0; i < condition_count; ++i)
+            conditions.push_back(boost::shared_ptr<numeric_expr>(read_numeric_expr()));
+
+        std::vector<block> blocks;
+        for (boost::uint32_t i = 0; i < block_count; ++i)
+            blocks.push_back(read_block());
+
+        result.reset(new if_block_stmt(conditions, blocks));
+        break;
+    }
+    case record_do: {
+        std::auto_ptr<numeric_expr> condition = read_numeric_expr();
+        result.reset(new do_stmt(condition, read_block()));
+        break;
+    }
+    case record_for: {
+        symbol_id const variable = read_symbol();
+        if (is_string_identifier(symbols.get_name(variable)))
+            throw bad_compiled_program();
+        std::auto_ptr<numeric_expr> initial_value = read_numeric_expr();
+        std::auto_ptr<numeric_expr> final_value = read_numeric_expr();
+        std::auto_ptr<numeric_expr> step = read_numeric_expr();
+        result.reset(new for_stmt(variable, initial_value, final_value, step, read_block()));
+        break;
+    }
+    case record_print: {
+        boost::uint32_t const count = read();
+        print_stmt::expressions_cont expressions;
+        for (boost::uint32_t i = 0; i < count; ++i)
+            expressions.push_back(boost::shared_ptr<printable_expr>(read_expr()));
+        result.reset(new print_stmt(expressions));
+        break;
+    }
+    case record_input:
+        result.reset(new input_stmt(read_symbol()));
+        break;
+    case record_let: {
+        symbol_id const variable = read_symbol();
+        std::auto_ptr<printable_expr> value = read_expr();
+        bool const string_variable = is_string_identifier(symbols.get_name(variable));
+
+        if (string_expr* const string_value = dynamic_cast<string_expr*>(value.get())) {
+            if (!string_variable)
+                throw bad_compiled_program();
+            value.release();
+            result.reset(new let_stmt(variable, std::auto_ptr<string_expr>(string_value)));
+        } else {
+            if (string_variable)
+                throw bad_compiled_program();
+            result.reset(new let_stmt(variable, std::auto_ptr<numeric_expr>(
+                static_cast<numeric_expr*>(value.release()))));
+        }
+        break;
+    }
+    case record_goto:
+        result.reset(new goto_stmt(read_symbol()));
+        break;
+    case record_stop:
+        result.reset(new stop_stmt);
+        break;
+    case record_exit:
+        result.reset(new exit_stmt(read_symbol()));
+        break;
+    case record_include:
+        result.reset(new include_stmt(read_string()));
+        break;
+    case record_empty:
+        result.reset(new empty_stmt);
+        break;
+    default:
+        throw bad_compiled_program();
+    }
+
+    result->set_location(location);
+    return result;
+}
+
+// Evaluate the postfix operations of an expression into expressions, like the parser reduces its operator stack.
+std::auto_ptr<printable_expr> program_reader::read_expr() {
+    expr_stack<numeric_expr> numbers;
+    expr_stack<string_expr> strings;
+
+    for (boost::uint32_t count = read(); count > 0; --count) {
+        switch (read()) {
+        case operation_integer:
+            numbers.push(std::auto_ptr<numeric_expr>(new constant_expr(static_cast<int>(read()))));
+            break;
+        case operation_real: {
+            boost::uint32_t halves[2];
+            halves[0] = read();
+            halves[1] = read();
+            double value;
+            std::memcpy(&value, halves, sizeof(value));
+            numbers.push(std::auto_ptr<numeric_expr>(new constant_expr(value)));
+            break;
+        }
+        case operation_variable: {
+            symbol_id const name = read_symbol();
+            if (is_string_identifier(symbols.get_name(name)))
+                throw bad_compiled_program();
+            numbers.push(std::auto_ptr<numeric_expr>(new variable_expr(name)));
+            break;
+        }
+        case operation_arith: {
+            arith_expr::e_operator const op = static_cast<arith_expr::e_operator>(read(arith_expr::operator_modulo + 1));
+            std::auto_ptr<numeric_expr> right = pop(numbers);
+            std::auto_ptr<numeric_expr> left = pop(numbers);
+            numbers.push(std::auto_ptr<numeric_expr>(new arith_expr(left, right, op)));
+            break;
+        }
+        case operation_relational: {
+            relational_expr::e_operator const op
+                = static_cast<relational_expr::e_operator>(read(relational_expr::operator_greater_equal + 1));
+            std::auto_ptr<numeric_expr> right = pop(numbers);
+            std::auto_ptr<numeric_expr> left = pop(numbers);
+            numbers.push(std::auto_ptr<numeric_expr>(new relational_expr(left, right, op)));
+            break;
+        }
+        case operation_boolean: {
+            boolean_expr::e_operator const op
+                = static_cast<boolean_expr::e_operator>(read(boolean_expr::operator_not + 1));
+            std::auto_ptr<numeric_expr> right;
+            if (op != boolean_expr::operator_not)
+                right = pop(numbers);
+            std::auto_ptr<numeric_expr> left = pop(numbers);
+            numbers.push(std::auto_ptr<numeric_expr>(new boolean_expr(left, right, op)));
+            break;
+        }
+        case operation_string:
+            strings.push(std::auto_ptr<string_expr>(new string_literal_expr(read_string())));
+            break;
+        case operation_string_variable: {
+            symbol_id const name = read_symbol();
+            if (!is_string_identifier(symbols.get_name(name)))
+                throw bad_compiled_program();
+            strings.push(std::auto_ptr<string_expr>(new string_variable_expr(name)));
+            break;
+        }
+        case operation_concat: {
+            read();
+            std::auto_ptr<string_expr> right = pop(strings);
+            std::auto_ptr<string_expr> left = pop(strings);
+            strings.push(std::auto_ptr<string_expr>(new string_concat_expr(left, right)));
+            break;
+        }
+        default:
+            throw bad_compiled_program();
+        }
+    }
+
+    if (numbers.items.size() + strings.items.size() != 1)
+        throw bad_compiled_program();
+    else if (numbers.items.empty())
+        return std::auto_ptr<printable_expr>(strings.pop());
+    else
+        return std::auto_ptr<printable_expr>(numbers.pop());
+}
+
+std::auto_ptr<numeric_expr> program_reader::read_numeric_expr() {
+    std::auto_ptr<printable_expr> result = read_expr();
+    if (!dynamic_cast<numeric_expr*>(result.get()))
+        throw bad_compiled_program();
+    return std::auto_ptr<numeric_expr>(static_cast<numeric_expr*>(result.release()));
+}
+
+// A file mapped into memory for reading.
+struct mapped_file : boost::noncopyable {
+    void const* data;
+    std::size_t size;
+
+    explicit mapped_file(std::string const& path)
+        : data(0)
+        , size(0)
+    {
+        int const fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* const mapping = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                data = mapping;
+                size = info.st_size;
+            }
+        }
+        close(fd);
+    }
+
+    ~mapped_file() {
+        if (data)
+            munmap(const_cast<void*>(data), size);
+    }
+};
+
+}
+
+program_cache::program_cache(std::string const& directory)
+    : directory(directory)
+{ }
+
+bool program_cache::load(std::string const& source, std::string const& filename, block& program) const {
+    boost::uint64_t const key = get_key(source, filename);
+    mapped_file const file(get_path(key));
+    if (!file.data || file.size < sizeof(file_header))
+        return false;
+
+    file_header const& header = *static_cast<file_header const*>(file.data);
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != FORMAT_VERSION
+        || header.key != key || header.source_size != source.size())
+        return false;
+
+    char const* const body = static_cast<char const*>(file.data) + sizeof(header);
+    if (hash(FNV_OFFSET_BASIS, body, static_cast<char const*>(file.data) + file.size) != header.checksum)
+        return false;
+
+    try {
+        program_reader reader(static_cast<char const*>(file.data), file.size, filename);
+        block result = reader.read_block();
+        if (!reader.at_end())
+            return false;
+
+        program.swap(result);
+        return true;
+    } catch (bad_compiled_program const&) {
+        return false;
+    }
+}
+
+bool program_cache::store(std::string const& source, std::string const& filename, block const& program) const {
+    boost::uint64_t const key = get_key(source, filename);
+
+    program_writer writer;
+    writer.write_block(program);
+    std::string const contents = writer.get_contents(key, source.size());
+
+    mkdir(directory.c_str(), 0777);  // Most likely it exists already.
+
+    std::string const path = get_path(key);
+    std::ostringstream temporary_path;
+    temporary_path << path << ".tmp" << getpid();
+
+    std::ofstream out(temporary_path.str().c_str(), std::ios::binary);
+    out.write(contents.data(), contents.size());
+    out.close();
+
+    if (!out || std::rename(temporary_path.str().c_str(), path.c_str()) != 0) {
+        std::remove(temporary_path.str().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+boost::uint64_t hash_program(block const& program) {
+    program_writer writer;
+    writer.write_block(program);
+    std::string const contents = writer.get_contents(0, 0);
+    return hash(FNV_OFFSET_BASIS, contents.data(), contents.data() + contents.size());
+}
+
+boost::uint64_t hash_more(boost::uint64_t result, std::string const& data) {
+    return hash(result, data.data(), data.data() + data.size());
+}
+
+std::string program_cache::get_path(boost::uint64_t key) const {
+    std::ostringstream os;
+    os << directory << '/';
+    os.width(16);
+    os.fill('0');
+    os << std::hex << key << ".basc";
+    return os.str();
+}
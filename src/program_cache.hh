@@ -0,0 +1,39 @@
+#ifndef PROGRAM_CACHE_HH
+#define PROGRAM_CACHE_HH
+
+#include <string>
+
+#include <boost/cstdint.hpp>
+
+#include "parser.hh"
+
+// A directory of compiled programs.  A compiled program (a .basc file) is the parsed program written out as a flat
+// array of words -- postfix for expressions, so that reading it needs no recursion -- with symbol names and string
+// literals in a table at its end.  Offsets in it are relative to the file, so it can be mapped anywhere.  Files are
+// named by a hash of the source, its filename and the format version; one that doesn't match, or whose contents don't
+// match the checksum in it, is ignored.
+class program_cache {
+public:
+    explicit program_cache(std::string const& directory);
+
+    // If the program compiled from source is in the cache, put it in program and return true.
+    bool load(std::string const& source, std::string const& filename, block& program) const;
+
+    // Add a compiled program, which shall have been parsed whole.  The file is written under a temporary name and renamed, so that a concurrent load never
+    // sees half of it.  Return false if it couldn't be written.
+    bool store(std::string const& source, std::string const& filename, block const& program) const;
+
+private:
+    std::string const directory;
+
+    std::string get_path(boost::uint64_t key) const;
+};
+
+// Hash of a compiled program, such as it would be written to the cache.  Programs that parse to the same statements, on
+// the same lines, with the same symbols, hash the same.  The program shall have been parsed whole.
+boost::uint64_t hash_program(block const& program);
+
+// Continue a hash with more data.
+boost::uint64_t hash_more(boost::uint64_t hash, std::string const& data);
+
+#endif
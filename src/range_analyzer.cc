@@ -0,0 +1,742 @@
+#include <map>
+#include <set>
+#include <vector>
+#include <limits>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+
+#include <boost/cstdint.hpp>
+#include <boost/optional.hpp>
+
+#include "range_analyzer.hh"
+#include "statements.hh"
+
+namespace {
+
+typedef block::statement_list::iterator iterator;
+
+boost::int64_t const LOWEST = std::numeric_limits<int>::min();
+boost::int64_t const HIGHEST = std::numeric_limits<int>::max();
+
+// How many times round a loop to go before giving up on the bounds that still change, so that it's done with.
+std::size_t const WIDENING_DELAY = 2;
+
+// What's known of a number.  Bounds are only kept for integers, and are on their integral values, which wrap around
+// within the range of int rather than leave it.
+struct range {
+    bool            integral;   // Whether it's certainly an integer.
+    bool            nonzero;    // Whether it's certainly an integer other than zero, whatever the bounds.
+    boost::int64_t  lowest, highest;
+
+    // Any number at all.
+    range();
+
+    // An integer from lowest to highest -- or any integer, if it may have wrapped around getting out of that.
+    range(boost::int64_t lowest, boost::int64_t highest);
+
+    bool excludes_zero() const;
+};
+
+range::range()
+    : integral(false)
+    , nonzero(false)
+    , lowest(LOWEST)
+    , highest(HIGHEST)
+{ }
+
+range::range(boost::int64_t lowest, boost::int64_t highest)
+    : integral(true)
+    , nonzero(false)
+    , lowest(lowest)
+    , highest(highest)
+{
+    if (lowest < LOWEST || highest > HIGHEST) {
+        this->lowest = LOWEST;
+        this->highest = HIGHEST;
+    }
+}
+
+bool range::excludes_zero() const {
+    return integral && (nonzero || lowest > 0 || highest < 0);
+}
+
+bool operator == (range const& lhs, range const& rhs) {
+    return lhs.integral == rhs.integral && lhs.nonzero == rhs.nonzero && lhs.lowest == rhs.lowest
+           && lhs.highest == rhs.highest;
+}
+
+range join(range const& lhs, range const& rhs) {
+    if (!lhs.integral || !rhs.integral)
+        return range();
+
+    range result(std::min(lhs.lowest, rhs.lowest), std::max(lhs.highest, rhs.highest));
+    result.nonzero = lhs.excludes_zero() && rhs.excludes_zero();
+    return result;
+}
+
+range add(range const& lhs, range const& rhs) {
+    if (!lhs.integral || !rhs.integral)
+        return range();
+    return range(lhs.lowest + rhs.lowest, lhs.highest + rhs.highest);
+}
+
+range subtract(range const& lhs, range const& rhs) {
+    if (!lhs.integral || !rhs.integral)
+        return range();
+    return range(lhs.lowest - rhs.highest, lhs.highest - rhs.lowest);
+}
+
+range multiply(range const& lhs, range const& rhs) {
+    if (!lhs.integral || !rhs.integral)
+        return range();
+
+    boost::int64_t const corners[] = {
+        lhs.lowest * rhs.lowest, lhs.lowest * rhs.highest, lhs.highest * rhs.lowest, lhs.highest * rhs.highest
+    };
+    return range(*std::min_element(corners, corners + 4), *std::max_element(corners, corners + 4));
+}
+
+// Of integers known to divide, so that the quotient is one too.
+range divide(range const& lhs, range const& rhs) {
+    if (rhs.lowest > 0 || rhs.highest < 0) {
+        boost::int64_t const corners[] = {
+            lhs.lowest / rhs.lowest, lhs.lowest / rhs.highest, lhs.highest / rhs.lowest, lhs.highest / rhs.highest
+        };
+        return range(*std::min_element(corners, corners + 4), *std::max_element(corners, corners + 4));
+    }
+
+    // The divisor isn't zero, but may be either side of it.
+    boost::int64_t const largest = std::max(-lhs.lowest, lhs.highest);
+    return range(-largest, largest);
+}
+
+// MOD only gives a value if both operands are integers, so its value always is one.  It has the sign of the dividend and
+// is smaller than the divisor.
+range modulo(range const& lhs, range const& rhs) {
+    boost::int64_t const largest = rhs.integral ? std::max<boost::int64_t>(std::max(-rhs.lowest, rhs.highest) - 1, 0)
+                                                : HIGHEST;
+    if (!lhs.integral)
+        return range(-largest, largest);
+    return range(std::max(-largest, std::min<boost::int64_t>(lhs.lowest, 0)),
+                 std::min(largest, std::max<boost::int64_t>(lhs.highest, 0)));
+}
+
+// Narrow the bounds of a range known not to be zero.  Returns false if that leaves none.
+bool settle(range& r) {
+    if (r.nonzero) {
+        if (r.lowest == 0)
+            ++r.lowest;
+        if (r.highest == 0)
+            --r.highest;
+    }
+    return r.lowest <= r.highest;
+}
+
+relational_expr::e_operator negate(relational_expr::e_operator op) {
+    switch (op) {
+    case relational_expr::operator_equals:          return relational_expr::operator_doesnt_equal;
+    case relational_expr::operator_doesnt_equal:    return relational_expr::operator_equals;
+    case relational_expr::operator_less_than:       return relational_expr::operator_greater_equal;
+    case relational_expr::operator_less_equal:      return relational_expr::operator_greater_than;
+    case relational_expr::operator_greater_than:    return relational_expr::operator_less_equal;
+    case relational_expr::operator_greater_equal:   return relational_expr::operator_less_than;
+    }
+    return op;
+}
+
+// The operator that compares the operands the other way round.
+relational_expr::e_operator mirror(relational_expr::e_operator op) {
+    switch (op) {
+    case relational_expr::operator_less_than:       return relational_expr::operator_greater_than;
+    case relational_expr::operator_less_equal:      return relational_expr::operator_greater_equal;
+    case relational_expr::operator_greater_than:    return relational_expr::operator_less_than;
+    case relational_expr::operator_greater_equal:   return relational_expr::operator_less_equal;
+    default:                                        return op;
+    }
+}
+
+boost::optional<symbol_id> get_variable(numeric_expr const& expr) {
+    if (variable_expr const* const variable = dynamic_cast<variable_expr const*>(&expr))
+        return variable->get_name();
+    return boost::optional<symbol_id>();
+}
+
+// What's known at a point of a program.  Nothing is known at points control can't get to, not even that.
+struct facts {
+    bool                                        reachable;
+    std::map<symbol_id, range>                  variables;  // Integers; the others may be anything.
+    std::set<std::pair<symbol_id, symbol_id> >  divisible;  // (a, b) where a MOD b was found to be zero.
+
+    explicit facts(bool reachable = true) : reachable(reachable) { }
+};
+
+bool operator == (facts const& lhs, facts const& rhs) {
+    return lhs.reachable == rhs.reachable && lhs.variables == rhs.variables && lhs.divisible == rhs.divisible;
+}
+
+facts join(facts const& lhs, facts const& rhs) {
+    if (!lhs.reachable)
+        return rhs;
+    if (!rhs.reachable)
+        return lhs;
+
+    facts result;
+    std::map<symbol_id, range>::const_iterator v;
+    for (v = lhs.variables.begin(); v != lhs.variables.end(); ++v) {
+        std::map<symbol_id, range>::const_iterator const other = rhs.variables.find(v->first);
+        if (other != rhs.variables.end()) {
+            range const joined = join(v->second, other->second);
+            if (joined.integral)
+                result.variables.insert(result.variables.end(), std::make_pair(v->first, joined));
+        }
+    }
+
+    std::set_intersection(lhs.divisible.begin(), lhs.divisible.end(), rhs.divisible.begin(), rhs.divisible.end(),
+                          std::inserter(result.divisible, result.divisible.end()));
+    return result;
+}
+
+// next, which includes earlier, with the bounds that have grown since let go of.
+facts widen(facts const& earlier, facts const& next) {
+    facts result = next;
+    for (std::map<symbol_id, range>::iterator v = result.variables.begin(); v != result.variables.end(); ++v) {
+        std::map<symbol_id, range>::const_iterator const before = earlier.variables.find(v->first);
+        if (before != earlier.variables.end()) {
+            if (v->second.lowest < before->second.lowest)
+                v->second.lowest = LOWEST;
+            if (v->second.highest > before->second.highest)
+                v->second.highest = HIGHEST;
+        }
+    }
+    return result;
+}
+
+class range_analyzer : private expr_visitor, private expr_substitution {
+public:
+    range_analyzer();
+
+    void run(block& program);
+
+private:
+    facts known;    // At the statement being analysed.
+
+    // The loops being analysed, innermost last, and what's known where the EXITs out of them go.
+    std::vector<std::pair<symbol_id, facts> > loops;
+
+    // Whether each operation looked at needn't check, every time it was looked at; statements are looked at again
+    // while the loops they're in are gone round.
+    std::map<numeric_expr const*, bool> verdicts;
+    std::vector<iterator>               analysed;   // Every statement looked at, in the order it first was.
+    std::set<statement const*>          seen;
+    std::set<statement const*>          changed;    // Statements with operations that needn't check.
+
+    // Like elsewhere, operands are worked out from a stack rather than by recursion.  Those in the right operand of an
+    // AND or OR are conditional: they may not be worked out.
+    struct operand {
+        numeric_expr const* expr;
+        bool                operands_done;
+        bool                conditional;
+    };
+    std::vector<operand>    pending;
+    bool                    operands_done;
+    bool                    conditional;
+    bool                    recording;      // Whether to record verdicts, rather than only work the value out.
+    bool                    found_unchecked;
+    std::vector<range>      values;
+
+    // Variables that are known to be integers, and ones known not to be zero, once the expression has been worked out:
+    // the operands of MOD, which fails otherwise, and divisors, which do.  Modulo by zero doesn't come back either.
+    std::vector<symbol_id>  integers;
+    std::vector<symbol_id>  divisors;
+
+    void analyse(block& b);
+    void analyse(iterator s);
+    void analyse_if(if_block_stmt& statement);
+    void analyse_do(do_stmt& loop);
+    void analyse_for(for_stmt& loop);
+
+    // Work an expression out as the statement owner does, and learn what doing so tells.
+    range evaluate(numeric_expr const& expr, statement const& owner);
+    range work_out(numeric_expr const& expr, bool record);
+
+    void assign(symbol_id variable, range const& value);
+
+    // Learn from a condition having been found true or false.
+    void refine(numeric_expr const& condition, bool truth);
+    void compare(relational_expr const& comparison, bool truth);
+    void constrain(symbol_id variable, relational_expr::e_operator op, range const& other);
+
+    bool have_operands(numeric_expr const& expr, numeric_expr const& left, numeric_expr const* right,
+                       bool right_conditional);
+    range pop();
+    void record(arith_expr const& expr, bool unchecked);
+
+    virtual void visit(string_concat_expr const&) { }  // Numeric expressions have no string operands.
+    virtual void visit(string_variable_expr const&) { }
+    virtual void visit(string_literal_expr const&) { }
+    virtual void visit(arith_expr const& expr);
+    virtual void visit(variable_expr const& expr);
+    virtual void visit(constant_expr const& expr);
+    virtual void visit(relational_expr const& expr);
+    virtual void visit(boolean_expr const& expr);
+    virtual void visit(save_expr const& expr);
+    virtual void visit(temporary_expr const& expr);
+
+    virtual std::auto_ptr<numeric_expr> replace(numeric_expr const&) { return std::auto_ptr<numeric_expr>(); }
+    virtual std::auto_ptr<numeric_expr> wrap(numeric_expr const& expr, std::auto_ptr<numeric_expr> copy);
+};
+
+range_analyzer::range_analyzer()
+    : operands_done(false)
+    , conditional(false)
+    , recording(false)
+    , found_unchecked(false)
+{ }
+
+void range_analyzer::run(block& program) {
+    analyse(program);
+
+    // Statements are replaced where they are in the list, so that their labels still lead to them -- those in blocks
+    // before the statements of the blocks, which copy them.
+    for (std::vector<iterator>::reverse_iterator s = analysed.rbegin(); s != analysed.rend(); ++s)
+        if (changed.count((*s)->get()))
+            **s = clone(***s, *this);
+}
+
+void range_analyzer::analyse(block& b) {
+    std::set<statement const*> labelled;
+    for (block::jump_table_t::const_iterator label = b.jump_table.begin(); label != b.jump_table.end(); ++label)
+        if (label->second != b.statements.end())
+            labelled.insert(label->second->get());
+
+    for (iterator s = b.statements.begin(); s != b.statements.end(); ++s) {
+        if (labelled.count(s->get()))
+            known = facts();
+        if (known.reachable)
+            analyse(s);
+    }
+}
+
+void range_analyzer::analyse(iterator s) {
+    if (seen.insert(s->get()).second)
+        analysed.push_back(s);
+
+    statement& current = **s;
+    if (let_stmt const* const let = dynamic_cast<let_stmt const*>(&current)) {
+        if (let->get_numeric_value())
+            assign(let->get_variable_name(), evaluate(*let->get_numeric_value(), current));
+    } else if (print_stmt const* const print = dynamic_cast<print_stmt const*>(&current)) {
+        print_stmt::expressions_cont const& expressions = print->get_expressions();
+        for (print_stmt::expressions_cont::const_iterator e = expressions.begin(); e != expressions.end(); ++e)
+            if (numeric_expr const* const expr = dynamic_cast<numeric_expr const*>(e->get()))
+                evaluate(*expr, current);
+    } else if (input_stmt const* const input = dynamic_cast<input_stmt const*>(&current))
+        assign(input->get_variable_name(), range(LOWEST, HIGHEST));
+    else if (if_goto_stmt const* const branch = dynamic_cast<if_goto_stmt const*>(&current)) {
+        evaluate(branch->get_condition(), current);
+        if (branch->get_else_label())
+            known.reachable = false;
+        else
+            refine(branch->get_condition(), false);
+    } else if (if_block_stmt* const if_block = dynamic_cast<if_block_stmt*>(&current))
+        analyse_if(*if_block);
+    else if (do_stmt* const loop = dynamic_cast<do_stmt*>(&current))
+        analyse_do(*loop);
+    else if (for_stmt* const loop = dynamic_cast<for_stmt*>(&current))
+        analyse_for(*loop);
+    else if (exit_stmt const* const exit = dynamic_cast<exit_stmt const*>(&current)) {
+        for (std::vector<std::pair<symbol_id, facts> >::reverse_iterator l = loops.rbegin(); l != loops.rend(); ++l)
+            if (l->first == exit->get_block_name()) {
+                l->second = join(l->second, known);
+                break;
+            }
+        known.reachable = false;
+    } else if (dynamic_cast<goto_stmt const*>(&current) || dynamic_cast<stop_stmt const*>(&current))
+        known.reachable = false;
+}
+
+void range_analyzer::analyse_if(if_block_stmt& statement) {
+    if_block_stmt::conditions_cont const& conditions = statement.get_conditions();
+    std::vector<block>& blocks = statement.get_blocks();
+
+    // What's known when none of the conditions so far were true, and after the statement.
+    facts otherwise = known;
+    facts after(false);
+    for (std::size_t i = 0; i < conditions.size() && otherwise.reachable; ++i) {
+        known = otherwise;
+        evaluate(*conditions[i], statement);
+        otherwise = known;
+
+        refine(*conditions[i], true);
+        if (i < blocks.size() && known.reachable)
+            analyse(blocks[i]);
+        after = join(after, known);
+
+        known = otherwise;
+        refine(*conditions[i], false);
+        otherwise = known;
+    }
+
+    known = otherwise;
+    if (blocks.size() > conditions.size() && known.reachable)
+        analyse(blocks.back());
+    known = join(after, known);
+}
+
+void range_analyzer::analyse_do(do_stmt& loop) {
+    loops.push_back(std::make_pair(loop.get_name(), facts(false)));
+
+    facts head = known;     // Before the condition, every time round.
+    for (std::size_t round = 0; ; ++round) {
+        known = head;
+        loops.back().second = facts(false);
+        evaluate(loop.get_condition(), loop);
+        facts const checked = known;
+
+        refine(loop.get_condition(), true);
+        if (known.reachable)
+            analyse(loop.get_body());
+
+        facts next = join(head, known);
+        if (round >= WIDENING_DELAY)
+            next = widen(head, next);
+        if (next == head) {
+            known = checked;
+            refine(loop.get_condition(), false);
+            break;
+        }
+        head = next;
+    }
+
+    known = join(known, loops.back().second);
+    loops.pop_back();
+}
+
+void range_analyzer::analyse_for(for_stmt& loop) {
+    symbol_id const variable = loop.get_variable_name();
+    assign(variable, evaluate(loop.get_initial_value(), loop));
+    range const step = evaluate(loop.get_step(), loop);
+    range const final_value = evaluate(loop.get_final_value(), loop);
+
+    loops.push_back(std::make_pair(loop.get_name(), facts(false)));
+
+    facts head = known;     // Before the variable is checked against the final value, every time round.
+    for (std::size_t round = 0; ; ++round) {
+        known = head;
+        loops.back().second = facts(false);
+
+        // The body is only run while the variable hasn't gone past the final value.
+        std::map<symbol_id, range>::iterator const value = known.variables.find(variable);
+        if (value != known.variables.end() && step.integral && final_value.integral) {
+            if (step.lowest > 0)
+                value->second.highest = std::min(value->second.highest, final_value.highest);
+            else if (step.highest < 0)
+                value->second.lowest = std::max(value->second.lowest, final_value.lowest);
+            known.reachable = settle(value->second);
+        }
+
+        if (known.reachable)
+            analyse(loop.get_body());
+        if (known.reachable) {
+            std::map<symbol_id, range>::const_iterator const last = known.variables.find(variable);
+            assign(variable, last != known.variables.end() ? add(last->second, step) : range());
+        }
+
+        facts next = join(head, known);
+        if (round >= WIDENING_DELAY)
+            next = widen(head, next);
+        if (next == head)
+            break;
+        head = next;
+    }
+
+    known = join(head, loops.back().second);
+    loops.pop_back();
+}
+
+range range_analyzer::evaluate(numeric_expr const& expr, statement const& owner) {
+    found_unchecked = false;
+    range const result = work_out(expr, true);
+    if (found_unchecked)
+        changed.insert(&owner);
+
+    for (std::vector<symbol_id>::const_iterator i = integers.begin(); i != integers.end(); ++i)
+        if (!known.variables.count(*i))
+            known.variables[*i] = range(LOWEST, HIGHEST);
+
+    for (std::vector<symbol_id>::const_iterator d = divisors.begin(); d != divisors.end(); ++d) {
+        std::map<symbol_id, range>::iterator const divisor = known.variables.find(*d);
+        if (divisor != known.variables.end()) {
+            divisor->second.nonzero = true;
+            if (!settle(divisor->second))
+                known.reachable = false;
+        }
+    }
+
+    integers.clear();
+    divisors.clear();
+    return result;
+}
+
+range range_analyzer::work_out(numeric_expr const& expr, bool record) {
+    recording = record;
+    pending.clear();
+    operand const first = { &expr, false, false };
+    pending.push_back(first);
+    while (!pending.empty()) {
+        numeric_expr const* const e = pending.back().expr;
+        operands_done = pending.back().operands_done;
+        conditional = pending.back().conditional;
+        pending.pop_back();
+        e->accept(*this);
+    }
+
+    if (!record) {
+        integers.clear();
+        divisors.clear();
+    }
+    return pop();
+}
+
+void range_analyzer::assign(symbol_id variable, range const& value) {
+    std::set<std::pair<symbol_id, symbol_id> >::iterator d = known.divisible.begin();
+    while (d != known.divisible.end())
+        if (d->first == variable || d->second == variable)
+            known.divisible.erase(d++);
+        else
+            ++d;
+
+    if (value.integral)
+        known.variables[variable] = value;
+    else
+        known.variables.erase(variable);
+}
+
+void range_analyzer::refine(numeric_expr const& condition, bool truth) {
+    std::vector<std::pair<numeric_expr const*, bool> > conditions(1, std::make_pair(&condition, truth));
+    while (!conditions.empty() && known.reachable) {
+        numeric_expr const* const c = conditions.back().first;
+        bool const value = conditions.back().second;
+        conditions.pop_back();
+
+        if (boolean_expr const* const b = dynamic_cast<boolean_expr const*>(c)) {
+            // Both operands of an AND that's true were worked out and true, and likewise of an OR that's false.
+            if (b->get_operator() == boolean_expr::operator_not)
+                conditions.push_back(std::make_pair(&b->get_left_side(), !value));
+            else if ((b->get_operator() == boolean_expr::operator_and) == value) {
+                conditions.push_back(std::make_pair(b->get_right_side(), value));
+                conditions.push_back(std::make_pair(&b->get_left_side(), value));
+            }
+        } else if (relational_expr const* const comparison = dynamic_cast<relational_expr const*>(c))
+            compare(*comparison, value);
+    }
+}
+
+void range_analyzer::compare(relational_expr const& comparison, bool truth) {
+    relational_expr::e_operator const op = truth ? comparison.get_operator() : negate(comparison.get_operator());
+    numeric_expr const& left = comparison.get_left_side();
+    numeric_expr const& right = comparison.get_right_side();
+    range const left_value = work_out(left, false);
+    range const right_value = work_out(right, false);
+
+    // Numbers that may not be integers are compared by their floating-point values, which the bounds aren't of.
+    if (!left_value.integral || !right_value.integral)
+        return;
+
+    if (op == relational_expr::operator_equals) {
+        arith_expr const* remainder = dynamic_cast<arith_expr const*>(&left);
+        range zero = right_value;
+        if (!remainder) {
+            remainder = dynamic_cast<arith_expr const*>(&right);
+            zero = left_value;
+        }
+
+        if (remainder && remainder->get_operator() == arith_expr::operator_modulo && zero.lowest == 0
+                && zero.highest == 0) {
+            boost::optional<symbol_id> const dividend = get_variable(remainder->get_left_side());
+            boost::optional<symbol_id> const divisor = get_variable(remainder->get_right_side());
+            if (dividend && divisor)
+                known.divisible.insert(std::make_pair(*dividend, *divisor));
+        }
+    }
+
+    if (boost::optional<symbol_id> const variable = get_variable(left))
+        constrain(*variable, op, right_value);
+    if (boost::optional<symbol_id> const variable = get_variable(right))
+        if (known.reachable)
+            constrain(*variable, mirror(op), work_out(left, false));
+}
+
+void range_analyzer::constrain(symbol_id variable, relational_expr::e_operator op, range const& other) {
+    range& value = known.variables[variable];
+    switch (op) {
+    case relational_expr::operator_equals:
+        value.lowest = std::max(value.lowest, other.lowest);
+        value.highest = std::min(value.highest, other.highest);
+        value.nonzero = value.nonzero || other.excludes_zero();
+        break;
+    case relational_expr::operator_doesnt_equal:
+        if (other.lowest == other.highest) {
+            if (value.lowest == other.lowest)
+                ++value.lowest;
+            if (value.highest == other.lowest)
+                --value.highest;
+            value.nonzero = value.nonzero || other.lowest == 0;
+        }
+        break;
+    case relational_expr::operator_less_than:
+        value.highest = std::min(value.highest, other.highest - 1);
+        break;
+    case relational_expr::operator_less_equal:
+        value.highest = std::min(value.highest, other.highest);
+        break;
+    case relational_expr::operator_greater_than:
+        value.lowest = std::max(value.lowest, other.lowest + 1);
+        break;
+    case relational_expr::operator_greater_equal:
+        value.lowest = std::max(value.lowest, other.lowest);
+        break;
+    }
+
+    if (!settle(value))
+        known.reachable = false;
+}
+
+bool range_analyzer::have_operands(numeric_expr const& expr, numeric_expr const& left, numeric_expr const* right,
+                                   bool right_conditional) {
+    if (operands_done)
+        return true;
+
+    operand const again = { &expr, true, conditional };
+    pending.push_back(again);
+    if (right) {
+        operand const second = { right, false, conditional || right_conditional };
+        pending.push_back(second);
+    }
+    operand const first = { &left, false, conditional };
+    pending.push_back(first);
+    return false;
+}
+
+range range_analyzer::pop() {
+    range const result = values.back();
+    values.pop_back();
+    return result;
+}
+
+void range_analyzer::record(arith_expr const& expr, bool unchecked) {
+    if (!recording)
+        return;
+
+    std::map<numeric_expr const*, bool>::iterator const verdict = verdicts.find(&expr);
+    if (verdict == verdicts.end())
+        verdicts.insert(std::make_pair(&expr, unchecked));
+    else
+        verdict->second = verdict->second && unchecked;
+    found_unchecked = found_unchecked || unchecked;
+}
+
+void range_analyzer::visit(arith_expr const& expr) {
+    if (!have_operands(expr, expr.get_left_side(), &expr.get_right_side(), false))
+        return;
+
+    range const right = pop();
+    range const left = pop();
+    bool const integers = left.integral && right.integral;
+    boost::optional<symbol_id> const dividend = get_variable(expr.get_left_side());
+    boost::optional<symbol_id> const divisor = get_variable(expr.get_right_side());
+
+    switch (expr.get_operator()) {
+    case arith_expr::operator_plus:
+        record(expr, integers);
+        values.push_back(add(left, right));
+        break;
+    case arith_expr::operator_minus:
+        record(expr, integers);
+        values.push_back(subtract(left, right));
+        break;
+    case arith_expr::operator_times:
+        record(expr, integers);
+        values.push_back(multiply(left, right));
+        break;
+    case arith_expr::operator_divides:
+        record(expr, integers && right.excludes_zero());
+        if (integers && right.excludes_zero() && dividend && divisor
+                && known.divisible.count(std::make_pair(*dividend, *divisor)))
+            values.push_back(divide(left, right));
+        else
+            values.push_back(range());
+        if (divisor && !conditional)
+            divisors.push_back(*divisor);
+        break;
+    case arith_expr::operator_modulo:
+        record(expr, integers);
+        values.push_back(modulo(left, right));
+        if (!conditional) {
+            if (dividend)
+                this->integers.push_back(*dividend);
+            if (divisor) {
+                this->integers.push_back(*divisor);
+                divisors.push_back(*divisor);
+            }
+        }
+        break;
+    }
+}
+
+void range_analyzer::visit(variable_expr const& expr) {
+    std::map<symbol_id, range>::const_iterator const value = known.variables.find(expr.get_name());
+    values.push_back(value != known.variables.end() ? value->second : range());
+}
+
+void range_analyzer::visit(constant_expr const& expr) {
+    number const& value = expr.get_value();
+    if (value.is_integral())
+        values.push_back(range(value.get_integral_value(), value.get_integral_value()));
+    else
+        values.push_back(range());
+}
+
+void range_analyzer::visit(relational_expr const& expr) {
+    if (!have_operands(expr, expr.get_left_side(), &expr.get_right_side(), false))
+        return;
+
+    pop();
+    pop();
+    values.push_back(range(0, 1));
+}
+
+void range_analyzer::visit(boolean_expr const& expr) {
+    if (!have_operands(expr, expr.get_left_side(), expr.get_right_side(), true))
+        return;
+
+    if (expr.get_right_side())
+        pop();
+    pop();
+    values.push_back(range(0, 1));
+}
+
+void range_analyzer::visit(save_expr const& expr) {
+    operand const same = { &expr.get_operand(), false, conditional };
+    pending.push_back(same);
+}
+
+void range_analyzer::visit(temporary_expr const& expr) {
+    operand const same = { &expr.get_original(), false, conditional };
+    pending.push_back(same);
+}
+
+std::auto_ptr<numeric_expr> range_analyzer::wrap(numeric_expr const& expr, std::auto_ptr<numeric_expr> copy) {
+    std::map<numeric_expr const*, bool>::const_iterator const verdict = verdicts.find(&expr);
+    if (verdict != verdicts.end() && verdict->second)
+        static_cast<arith_expr&>(*copy).set_unchecked(true);
+    return copy;
+}
+
+}
+
+void remove_unneeded_checks(block& program) {
+    range_analyzer analyzer;
+    analyzer.run(program);
+}
@@ -0,0 +1,13 @@
+#ifndef RANGE_ANALYZER_HH
+#define RANGE_ANALYZER_HH
+
+#include "parser.hh"
+
+// Mark the arithmetic operations of a wholly parsed program that can't fail or promote their operands, so that they
+// run without checking: those whose operands are certainly integers, and whose divisors are certainly not zero.  What
+// is known of every variable -- whether it's an integer, the bounds of its value, whether it can be zero -- is worked
+// out from constants, INPUTs, FOR bounds and the conditions of the branches and loops it's used in, with loops gone
+// round until nothing more changes.  A statement with a label may be jumped to from anywhere, so nothing is known there.
+void remove_unneeded_checks(block& program);
+
+#endif
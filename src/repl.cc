@@ -0,0 +1,235 @@
+#include "repl.hh"
+
+#include <iostream>
+#include <sstream>
+#include <iterator>
+#include <algorithm>
+#include <cctype>
+#include <limits>
+
+#include <boost/lexical_cast.hpp>
+
+#include "lexer.hh"
+
+namespace {
+
+std::string trim(std::string const& text) {
+    std::string::size_type const begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string::npos)
+        return std::string();
+    return text.substr(begin, text.find_last_not_of(" \t\r") - begin + 1);
+}
+
+std::string to_lower(std::string text) {
+    for (std::string::iterator c = text.begin(); c != text.end(); ++c)
+        *c = std::tolower(static_cast<unsigned char>(*c));
+    return text;
+}
+
+// Nesting change of a line, or 0 if it doesn't even lex; the error is reported when it's parsed.
+int get_nesting_change(std::string const& line) {
+    try {
+        return get_nesting_change(token_stream(line));
+    } catch (lexer_error const&) {
+        return 0;
+    }
+}
+
+// If the line is a numbered one, its number.
+bool get_line_number(std::string const& line, int& number) {
+    if (line.empty() || !std::isdigit(static_cast<unsigned char>(line[0])))
+        return false;
+    std::istringstream stream(line);
+    return static_cast<bool>(stream >> number);
+}
+
+}
+
+repl::repl()
+    : interpreter_(new interpreter)
+{ }
+
+void repl::run(std::istream& input, bool prompt) {
+    std::string pending;    // Immediate code waiting for the end of its block.
+    int depth = 0;
+    std::string line;
+
+    while ((prompt && std::cout << (pending.empty() ? "> " : "... ") << std::flush), std::getline(input, line)) {
+        line = trim(line);
+        int number;
+
+        if (pending.empty() && get_line_number(line, number)) {
+            std::string::size_type const rest = line.find_first_not_of("0123456789");
+            edit(number, rest == std::string::npos || trim(line.substr(rest)).empty() ? std::string() : line);
+            continue;
+        }
+
+        if (pending.empty()) {
+            std::string const command = to_lower(line);
+            if (command == "run") {
+                run_program();
+                continue;
+            } else if (command == "list") {
+                for (lines_t::const_iterator l = lines.begin(); l != lines.end(); ++l)
+                    std::cout << l->second << '\n';
+                continue;
+            } else if (command == "new") {
+                units.clear();
+                lines.clear();
+                program = block();
+                interpreter_.reset(new interpreter);
+                continue;
+            }
+        }
+
+        pending += line;
+        pending += '\n';
+        depth += get_nesting_change(line);
+        if (depth <= 0) {
+            run_immediate(pending);
+            pending.clear();
+            depth = 0;
+        }
+    }
+
+    if (!pending.empty())
+        run_immediate(pending);  // To report the block that was left open.
+}
+
+void repl::edit(int number, std::string const& text) {
+    if (text.empty())
+        lines.erase(number);
+    else
+        lines[number] = text;
+
+    // Start from the first line of the unit the line was part of, or from the line itself if it wasn't part of any.
+    units_t::iterator old = units.upper_bound(number);
+    int start = number;
+    if (old != units.begin()) {
+        units_t::iterator previous = old;
+        --previous;
+        if (previous->second.last_line >= number) {
+            old = previous;
+            start = previous->first;
+        }
+    }
+
+    // Split the lines into units again until the new units end where the old ones did.
+    int replaced = start;    // The last line of the old units replaced so far.
+    lines_t::const_iterator line = lines.lower_bound(start);
+    while (line != lines.end()) {
+        int const first_line = line->first;
+        int last_line = first_line;
+        std::string source;
+        int depth = 0;
+        do {
+            last_line = line->first;
+            source += line->second;
+            source += '\n';
+            depth += get_nesting_change(line->second);
+            ++line;
+        } while (depth > 0 && line != lines.end());
+
+        while (old != units.end() && old->first <= last_line) {
+            replaced = std::max(replaced, old->second.last_line);
+            remove_unit(old++);
+        }
+        add_unit(first_line, last_line, source, depth <= 0);
+
+        if (last_line >= number && last_line >= replaced)
+            break;
+    }
+
+    // If the lines ran out, the old units left were made of lines that are gone.
+    if (line == lines.end())
+        while (old != units.end())
+            remove_unit(old++);
+}
+
+void repl::add_unit(int first_line, int last_line, std::string const& source, bool complete) {
+    unit u;
+    u.last_line = complete ? last_line : std::numeric_limits<int>::max();  // An open block takes all lines after it.
+    u.first = program.statements.end();
+    u.statement_count = 0;
+
+    // Its statements go before those of the next unit that has any.
+    block::statement_list::iterator position = program.statements.end();
+    for (units_t::iterator next = units.upper_bound(last_line); next != units.end(); ++next)
+        if (next->second.statement_count > 0) {
+            position = next->second.first;
+            break;
+        }
+
+    try {
+        token_stream const tokens(source, "<line " + boost::lexical_cast<std::string>(first_line) + ">");
+        block code = parse(tokens);
+
+        for (block::jump_table_t::const_iterator label = code.jump_table.begin(); label != code.jump_table.end(); ++label)
+            if (program.jump_table.insert(*label).second)
+                u.labels.push_back(label->first);
+
+        if (!code.statements.empty()) {
+            u.first = code.statements.begin();
+            u.statement_count = code.statements.size();
+            program.statements.splice(position, code.statements);
+        }
+    } catch (lexer_error const& error) {
+        u.error = std::string("Lexer error: ") + error.what();
+    } catch (syntax_error const& error) {
+        u.error = std::string("Syntax error: ") + error.what();
+    }
+
+    // A block still being typed is only an error if it's still open when the program is run.
+    if (complete && !u.error.empty())
+        std::cerr << u.error << '\n';
+
+    units.insert(std::make_pair(first_line, u));
+}
+
+void repl::remove_unit(units_t::iterator u) {
+    for (std::vector<symbol_id>::const_iterator label = u->second.labels.begin(); label != u->second.labels.end();
+         ++label)
+        program.jump_table.erase(*label);
+
+    block::statement_list::iterator end = u->second.first;
+    std::advance(end, u->second.statement_count);
+    program.statements.erase(u->second.first, end);
+
+    units.erase(u);
+}
+
+void repl::run_program() {
+    for (units_t::const_iterator u = units.begin(); u != units.end(); ++u)
+        if (!u->second.error.empty()) {
+            std::cerr << u->second.error << '\n';
+            return;
+        }
+
+    run_code(program);
+}
+
+void repl::run_immediate(std::string const& source) {
+    try {
+        immediate = parse(token_stream(source));
+    } catch (lexer_error const& error) {
+        std::cerr << "Lexer error: " << error.what() << '\n';
+        return;
+    } catch (syntax_error const& error) {
+        std::cerr << "Syntax error: " << error.what() << '\n';
+        return;
+    }
+
+    run_code(immediate);
+}
+
+void repl::run_code(block& code) {
+    try {
+        interpreter_->run(code);
+    } catch (syntax_error const& error) {
+        std::cerr << "Syntax error: " << error.what() << '\n';
+    } catch (runtime_error const& error) {
+        std::cerr << "Runtime error: " << error.what() << '\n';
+    }
+
+    std::cout << std::flush;
+}
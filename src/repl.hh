@@ -0,0 +1,54 @@
+#ifndef REPL_HH
+#define REPL_HH
+
+#include <string>
+#include <map>
+#include <vector>
+#include <istream>
+
+#include <boost/utility.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "parser.hh"
+#include "interpreter.hh"
+
+// An interactive session.  A line that begins with a number is a line of the program, which is kept compiled one
+// top-level statement at a time: changing a line re-parses only the statement it is part of and patches the program's
+// jump table.  Other lines are run right away, at the top level of the same interpreter that runs the program, so
+// variables persist between them.  RUN runs the program, LIST shows it, and NEW forgets it and all variables.
+class repl : boost::noncopyable {
+public:
+    repl();
+
+    // Read lines from input and act on them until its end.  Prompts are written to standard output if asked for.
+    void run(std::istream& input, bool prompt);
+
+private:
+    // A top-level statement of the program, made of one line or, for a block, of all the lines to its end.
+    struct unit {
+        int                                 last_line;
+        block::statement_list::iterator     first;          // Its statements in program, if it has any.
+        std::size_t                         statement_count;
+        std::vector<symbol_id>              labels;         // The labels it added to program's jump table.
+        std::string                         error;          // Why it didn't compile, if it didn't.
+    };
+
+    typedef std::map<int, std::string> lines_t;
+    typedef std::map<int, unit> units_t;       // By their first line.
+
+    lines_t                         lines;
+    units_t                         units;
+    block                           program;
+    block                           immediate;      // What was last run right away.
+    boost::scoped_ptr<interpreter>  interpreter_;
+
+    void edit(int number, std::string const& text);
+    void add_unit(int first_line, int last_line, std::string const& source, bool complete);
+    void remove_unit(units_t::iterator u);
+
+    void run_program();
+    void run_immediate(std::string const& source);
+    void run_code(block& code);
+};
+
+#endif
@@ -0,0 +1,200 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <cstring>
+#include <cstdio>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "result_cache.hh"
+#include "program_cache.hh"
+#include "statements.hh"
+
+namespace {
+
+// Bump whenever the format changes.
+boost::uint32_t const FORMAT_VERSION = 1;
+
+char const MAGIC[4] = { 'B', 'A', 'S', 'R' };
+
+// A result is this header, then the output.
+struct result_header {
+    char            magic[4];
+    boost::uint32_t version;
+    boost::uint64_t key;
+    boost::uint64_t output_size;
+    boost::int32_t  exit_status;
+    boost::uint32_t reserved;
+};
+
+// Nothing in the language so far depends on anything but the program's input -- there are no random numbers, clocks or
+// files -- so only bodies that haven't been parsed make a program not deterministic.  A statement that does depend on
+// something else shall clear deterministic in its visit.
+class determinism_checker : private statement_visitor {
+public:
+    determinism_checker();
+
+    bool check(block const& b);
+
+private:
+    bool deterministic;
+
+    void check_block(block const& b);
+
+    virtual void visit(if_goto_stmt const&) { }
+    virtual void visit(if_block_stmt const& statement);
+    virtual void visit(do_stmt const& statement);
+    virtual void visit(for_stmt const& statement);
+    virtual void visit(print_stmt const&) { }
+    virtual void visit(input_stmt const&) { }
+    virtual void visit(let_stmt const&) { }
+    virtual void visit(goto_stmt const&) { }
+    virtual void visit(stop_stmt const&) { }
+    virtual void visit(exit_stmt const&) { }
+    virtual void visit(include_stmt const&) { }
+    virtual void visit(empty_stmt const&) { }
+};
+
+determinism_checker::determinism_checker()
+    : deterministic(true)
+{ }
+
+bool determinism_checker::check(block const& b) {
+    check_block(b);
+    return deterministic;
+}
+
+void determinism_checker::check_block(block const& b) {
+    if (!b.is_parsed())
+        deterministic = false;
+
+    for (block::statement_list::const_iterator s = b.statements.begin(); s != b.statements.end() && deterministic; ++s)
+        (*s)->accept(*this);
+}
+
+void determinism_checker::visit(if_block_stmt const& statement) {
+    for (std::vector<block>::const_iterator b = statement.get_blocks().begin(); b != statement.get_blocks().end(); ++b)
+        check_block(*b);
+}
+
+void determinism_checker::visit(do_stmt const& statement) {
+    check_block(statement.get_body());
+}
+
+void determinism_checker::visit(for_stmt const& statement) {
+    check_block(statement.get_body());
+}
+
+}
+
+bool is_deterministic(block const& program) {
+    return determinism_checker().check(program);
+}
+
+result_cache::result_cache(std::string const& directory)
+    : directory(directory)
+{ }
+
+boost::uint64_t result_cache::get_key(block const& program, std::string const& input) {
+    return hash_more(hash_program(program), input);
+}
+
+bool result_cache::load(boost::uint64_t key, std::string& output, int& exit_status) const {
+    std::ifstream in(get_path(key).c_str(), std::ios::binary);
+    std::string const contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    result_header header;
+    if (contents.size() < sizeof(header))
+        return false;
+    std::memcpy(&header, contents.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != FORMAT_VERSION || header.key != key
+        || header.output_size != contents.size() - sizeof(header))
+        return false;
+
+    output.assign(contents, sizeof(header), std::string::npos);
+    exit_status = header.exit_status;
+    return true;
+}
+
+bool result_cache::store(boost::uint64_t key, std::string const& output, int exit_status) const {
+    result_header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.key = key;
+    header.output_size = output.size();
+    header.exit_status = exit_status;
+    header.reserved = 0;
+
+    mkdir(directory.c_str(), 0777);  // Most likely it exists already.
+
+    std::string const path = get_path(key);
+    std::ostringstream temporary_path;
+    temporary_path << path << ".tmp" << getpid();
+
+    std::ofstream out(temporary_path.str().c_str(), std::ios::binary);
+    out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    out.write(output.data(), output.size());
+    out.close();
+
+    if (!out || std::rename(temporary_path.str().c_str(), path.c_str()) != 0) {
+        std::remove(temporary_path.str().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+std::string result_cache::get_path(boost::uint64_t key) const {
+    std::ostringstream os;
+    os << directory << '/';
+    os.width(16);
+    os.fill('0');
+    os << std::hex << key << ".basr";
+    return os.str();
+}
+
+recording_buffer::recording_buffer(std::streambuf* target)
+    : target(target)
+{ }
+
+std::string const& recording_buffer::get_recording() const {
+    return recording;
+}
+
+recording_buffer::int_type recording_buffer::overflow(int_type c) {
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+        return traits_type::not_eof(c);
+
+    recording += traits_type::to_char_type(c);
+    return target->sputc(traits_type::to_char_type(c));
+}
+
+std::streamsize recording_buffer::xsputn(char const* s, std::streamsize count) {
+    recording.append(s, count);
+    return target->sputn(s, count);
+}
+
+int recording_buffer::sync() {
+    return target->pubsync();
+}
+
+run_recorder::run_recorder(std::string const& input)
+    : input(input)
+    , output(std::cout.rdbuf())
+    , old_input(std::cin.rdbuf(this->input.rdbuf()))
+    , old_output(std::cout.rdbuf(&output))
+{ }
+
+run_recorder::~run_recorder() {
+    std::cout.flush();
+    std::cin.rdbuf(old_input);
+    std::cout.rdbuf(old_output);
+}
+
+std::string const& run_recorder::get_output() const {
+    return output.get_recording();
+}
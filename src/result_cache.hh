@@ -0,0 +1,70 @@
+#ifndef RESULT_CACHE_HH
+#define RESULT_CACHE_HH
+
+#include <string>
+#include <sstream>
+#include <streambuf>
+
+#include <boost/cstdint.hpp>
+#include <boost/utility.hpp>
+
+#include "parser.hh"
+
+// Whether every run of the program on the same input prints the same.  Bodies that haven't been parsed yet count as
+// not deterministic, since there's no telling what's in them.
+bool is_deterministic(block const& program);
+
+// A directory of the results of whole runs of deterministic programs -- what they printed and their exit status --
+// keyed by a hash of the compiled program and all of its input.  Results are written under a temporary name and
+// renamed, so that concurrent runs never see half of one.
+class result_cache {
+public:
+    explicit result_cache(std::string const& directory);
+
+    // The key of a run of program on input.  The program shall have been parsed whole.
+    static boost::uint64_t get_key(block const& program, std::string const& input);
+
+    // If the result of a run is in the cache, put it in output and exit_status and return true.
+    bool load(boost::uint64_t key, std::string& output, int& exit_status) const;
+
+    // Add the result of a run.  Return false if it couldn't be written.
+    bool store(boost::uint64_t key, std::string const& output, int exit_status) const;
+
+private:
+    std::string const directory;
+
+    std::string get_path(boost::uint64_t key) const;
+};
+
+// Passes everything written to it on to another buffer, keeping a copy.
+class recording_buffer : public std::streambuf {
+public:
+    explicit recording_buffer(std::streambuf* target);
+
+    std::string const& get_recording() const;
+
+private:
+    std::streambuf* const   target;
+    std::string             recording;
+
+    virtual int_type overflow(int_type c);
+    virtual std::streamsize xsputn(char const* s, std::streamsize count);
+    virtual int sync();
+};
+
+// While it lives, std::cin reads from the given input instead, and what's written to std::cout is recorded.
+class run_recorder : boost::noncopyable {
+public:
+    explicit run_recorder(std::string const& input);
+    ~run_recorder();
+
+    std::string const& get_output() const;
+
+private:
+    std::istringstream      input;
+    recording_buffer        output;
+    std::streambuf* const   old_input;
+    std::streambuf* const   old_output;
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/time.h>
+
+#include "sampler.hh"
+#include "statements.hh"
+
+namespace {
+
+sampling_profiler* volatile active_profiler = 0;
+
+extern "C" void handle_sigprof(int) {
+    if (active_profiler)
+        take_sample(*active_profiler);
+}
+
+}
+
+// Called from the signal handler: may only touch the volatile members.
+void take_sample(sampling_profiler& profiler) {
+    if (profiler.head - profiler.tail >= sampling_profiler::buffer_size) {
+        ++profiler.dropped;
+        return;
+    }
+
+    volatile sampling_profiler::sample& s = profiler.samples[profiler.head % sampling_profiler::buffer_size];
+    s.depth = profiler.depth;
+    for (int i = 0; i < s.depth && i < sampling_profiler::max_depth; ++i)
+        s.frames[i] = profiler.frames[i];
+
+    ++profiler.head;
+}
+
+sampling_profiler::sampling_profiler(unsigned frequency)
+    : frequency(frequency)
+    , running(false)
+    , depth(0)
+    , head(0)
+    , tail(0)
+    , dropped(0)
+    , truncated(0)
+{
+    if (frequency == 0 || frequency > 1000000)
+        throw std::invalid_argument("Sampling frequency must be between 1 and 1000000 Hz");
+}
+
+sampling_profiler::~sampling_profiler() {
+    stop();
+}
+
+void sampling_profiler::start() {
+    if (running)
+        return;
+    if (active_profiler)
+        throw std::logic_error("Another sampling profiler is already running");
+
+    active_profiler = this;
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = &handle_sigprof;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGPROF, &action, &old_action);
+
+    // At 1 Hz the interval is a whole second, which tv_usec can't hold.
+    itimerval timer;
+    timer.it_interval.tv_sec = 1 / frequency;
+    timer.it_interval.tv_usec = 1000000 / frequency % 1000000;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, 0) != 0) {
+        int const error = errno;
+        sigaction(SIGPROF, &old_action, 0);
+        active_profiler = 0;
+        throw std::runtime_error(std::string("Can't start the profiling timer: ") + std::strerror(error));
+    }
+
+    running = true;
+}
+
+void sampling_profiler::stop() {
+    if (!running)
+        return;
+
+    itimerval timer;
+    std::memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, 0);
+    sigaction(SIGPROF, &old_action, 0);
+
+    active_profiler = 0;
+    running = false;
+}
+
+void sampling_profiler::before_statement(interpreter& interpreter, statement& statement) {
+    std::size_t const current_depth = interpreter.get_block_depth();
+    if (current_depth > 0 && current_depth <= max_depth)
+        frames[current_depth - 1] = &statement;
+    depth = current_depth;
+
+    if (head - tail >= buffer_size / 2)
+        drain();
+}
+
+void sampling_profiler::write_folded(std::ostream& os) {
+    drain();
+
+    for (stacks_map_t::const_iterator s = stacks.begin(); s != stacks.end(); ++s) {
+        for (stack_t::const_iterator frame = s->first.begin(); frame != s->first.end(); ++frame) {
+            if (frame != s->first.begin())
+                os << ';';
+            source_location const& location = (*frame)->get_location();
+            os << location.filename << ':' << location.line;
+        }
+        os << ' ' << s->second << '\n';
+    }
+}
+
+unsigned long sampling_profiler::get_dropped() const {
+    return dropped;
+}
+
+unsigned long sampling_profiler::get_truncated() const {
+    return truncated;
+}
+
+void sampling_profiler::drain() {
+    sig_atomic_t const end = head;
+
+    stack_t stack;
+    for (; tail != end; ++tail) {
+        volatile sample const& s = samples[tail % buffer_size];
+        int const sample_depth = s.depth;
+        if (sample_depth == 0)
+            continue;  // Caught between statements with no block to run.
+
+        if (sample_depth > max_depth)
+            ++truncated;
+
+        stack.clear();
+        for (int i = 0; i < std::min<int>(sample_depth, max_depth); ++i)
+        {
+            statement const* const frame = s.frames[i];
+            stack.push_back(frame);
+        }
+        ++stacks[stack];
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef SAMPLER_HH
+#define SAMPLER_HH
+
+#include <map>
+#include <vector>
+#include <ostream>
+#include <csignal>
+
+#include <boost/utility.hpp>
+
+#include "interpreter.hh"
+
+// Statistical profiler.  A profiling timer interrupts the program at a fixed rate of CPU time and the signal handler
+// records what the interpreter is doing at the moment: the current statement and, for each enclosing block, the
+// statement that was running in it.  Samples go to a ring buffer that is emptied outside of the handler.
+//
+// Only one sampling_profiler can be running at a time.
+class sampling_profiler : public interpreter_observer, boost::noncopyable {
+public:
+    // frequency is in samples per second of CPU time.
+    explicit sampling_profiler(unsigned frequency = 1000);
+    ~sampling_profiler();
+
+    void start();
+    void stop();
+
+    virtual void before_statement(interpreter& interpreter, statement& statement);
+
+    // Write the samples collected so far as folded stacks -- "file:line;file:line count" per line, outermost frame
+    // first -- which is what flame graph tools eat.  Shall be called while the program is still alive.
+    void write_folded(std::ostream& os);
+
+    // Samples that didn't fit into the ring buffer or that had a deeper stack than we record.
+    unsigned long get_dropped() const;
+    unsigned long get_truncated() const;
+
+private:
+    enum { max_depth = 32, buffer_size = 4096 };
+
+    struct sample {
+        int                 depth;
+        statement const*    frames[max_depth];
+    };
+
+    typedef std::vector<statement const*> stack_t;
+    typedef std::map<stack_t, unsigned long> stacks_map_t;
+
+    unsigned const          frequency;
+    bool                    running;
+    struct sigaction        old_action;
+
+    // What the interpreter is doing right now, written by before_statement, read by the signal handler.
+    statement const* volatile   frames[max_depth];
+    volatile sig_atomic_t       depth;
+
+    // The ring buffer.  head is only written by the signal handler, tail only by drain().
+    volatile sample             samples[buffer_size];
+    volatile sig_atomic_t       head;
+    volatile sig_atomic_t       tail;
+    volatile sig_atomic_t       dropped;
+    unsigned long               truncated;
+
+    stacks_map_t            stacks;
+
+    // Move samples from the ring buffer to stacks.
+    void drain();
+
+    friend void take_sample(sampling_profiler& profiler);
+};
+
+#endif
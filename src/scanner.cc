@@ -0,0 +1,167 @@
+#if defined(__SSE2__) && defined(__GNUC__)
+#define SCANNER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <cstddef>
+
+#include "scanner.hh"
+
+namespace {
+
+bool is_blank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+bool is_digit(char c) {
+    return static_cast<unsigned char>(c - '0') < 10;
+}
+
+bool is_identifier_char(char c) {
+    return static_cast<unsigned char>((c | 0x20) - 'a') < 26 || is_digit(c) || c == '_' || c == '$';
+}
+
+#ifdef SCANNER_SSE2
+
+std::size_t const BLOCK_SIZE = 16;
+
+// SSE2 only compares signed bytes, so ranges are tested by shifting them down to start at -128: c is in
+// [first, first + size) if c + (-128 - first) < -128 + size.
+__m128i in_range(__m128i chars, char first, char size) {
+    __m128i const shifted = _mm_add_epi8(chars, _mm_set1_epi8(static_cast<char>(-128 - first)));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(-128 + size)));
+}
+
+__m128i blanks(__m128i chars) {
+    return _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chars, _mm_set1_epi8('\t')));
+}
+
+__m128i digits(__m128i chars) {
+    return in_range(chars, '0', 10);
+}
+
+__m128i identifier_chars(__m128i chars) {
+    __m128i const letters = in_range(_mm_or_si128(chars, _mm_set1_epi8(0x20)), 'a', 26);
+    __m128i const others = _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('_')),
+                                        _mm_cmpeq_epi8(chars, _mm_set1_epi8('$')));
+    return _mm_or_si128(_mm_or_si128(letters, digits(chars)), others);
+}
+
+__m128i string_ends(__m128i chars) {
+    return _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('"')), _mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')));
+}
+
+__m128i line_ends(__m128i chars) {
+    return _mm_cmpeq_epi8(chars, _mm_set1_epi8('\n'));
+}
+
+// Find the first character for which classify gives a match (or, if Skip, doesn't), 16 at a time while there are
+// that many left.
+template <bool Skip, typename Classify, typename Predicate>
+char const* scan(char const* begin, char const* end, Classify classify, Predicate predicate) {
+    while (static_cast<std::size_t>(end - begin) >= BLOCK_SIZE) {
+        __m128i const chars = _mm_loadu_si128(reinterpret_cast<__m128i const*>(begin));
+        int mask = _mm_movemask_epi8(classify(chars));
+        if (Skip)
+            mask = ~mask & 0xFFFF;
+        if (mask != 0)
+            return begin + __builtin_ctz(mask);
+        begin += BLOCK_SIZE;
+    }
+
+    while (begin != end && predicate(*begin) == Skip)
+        ++begin;
+    return begin;
+}
+
+#endif
+
+template <typename Predicate>
+char const* skip_scalar(char const* begin, char const* end, Predicate predicate) {
+    while (begin != end && predicate(*begin))
+        ++begin;
+    return begin;
+}
+
+bool is_string_end(char c) {
+    return c == '"' || c == '\n';
+}
+
+bool is_line_end(char c) {
+    return c == '\n';
+}
+
+template <typename Predicate>
+char const* find_scalar(char const* begin, char const* end, Predicate predicate) {
+    while (begin != end && !predicate(*begin))
+        ++begin;
+    return begin;
+}
+
+}
+
+#ifdef SCANNER_SSE2
+
+char const* skip_blanks(char const* begin, char const* end) {
+    return scan<true>(begin, end, &blanks, &is_blank);
+}
+
+char const* skip_identifier_chars(char const* begin, char const* end) {
+    return scan<true>(begin, end, &identifier_chars, &is_identifier_char);
+}
+
+char const* skip_digits(char const* begin, char const* end) {
+    return scan<true>(begin, end, &digits, &is_digit);
+}
+
+char const* find_string_end(char const* begin, char const* end) {
+    return scan<false>(begin, end, &string_ends, &is_string_end);
+}
+
+char const* find_line_end(char const* begin, char const* end) {
+    return scan<false>(begin, end, &line_ends, &is_line_end);
+}
+
+#else
+
+char const* skip_blanks(char const* begin, char const* end) {
+    return skip_blanks_scalar(begin, end);
+}
+
+char const* skip_identifier_chars(char const* begin, char const* end) {
+    return skip_identifier_chars_scalar(begin, end);
+}
+
+char const* skip_digits(char const* begin, char const* end) {
+    return skip_digits_scalar(begin, end);
+}
+
+char const* find_string_end(char const* begin, char const* end) {
+    return find_string_end_scalar(begin, end);
+}
+
+char const* find_line_end(char const* begin, char const* end) {
+    return find_line_end_scalar(begin, end);
+}
+
+#endif
+
+char const* skip_blanks_scalar(char const* begin, char const* end) {
+    return skip_scalar(begin, end, &is_blank);
+}
+
+char const* skip_identifier_chars_scalar(char const* begin, char const* end) {
+    return skip_scalar(begin, end, &is_identifier_char);
+}
+
+char const* skip_digits_scalar(char const* begin, char const* end) {
+    return skip_scalar(begin, end, &is_digit);
+}
+
+char const* find_string_end_scalar(char const* begin, char const* end) {
+    return find_scalar(begin, end, &is_string_end);
+}
+
+char const* find_line_end_scalar(char const* begin, char const* end) {
+    return find_scalar(begin, end, &is_line_end);
+}
@@ -0,0 +1,30 @@
+#ifndef SCANNER_HH
+#define SCANNER_HH
+
+// Scanning runs of characters of one class for the lexer.  Where SSE2 is available, 16 characters are classified at
+// once; everywhere else, and for the last few characters of the input, they're looked at one by one.
+//
+// The skip_ functions return the first character in [begin, end) that is not in the class, the find_ functions the
+// first that is; both return end if there is no such character.
+
+// Spaces and tabs.
+char const* skip_blanks(char const* begin, char const* end);
+
+// Letters, digits, _ and $.
+char const* skip_identifier_chars(char const* begin, char const* end);
+
+char const* skip_digits(char const* begin, char const* end);
+
+// The closing quote of a string literal, or the newline that makes it unterminated.
+char const* find_string_end(char const* begin, char const* end);
+
+char const* find_line_end(char const* begin, char const* end);
+
+// The character-at-a-time versions, for comparison.
+char const* skip_blanks_scalar(char const* begin, char const* end);
+char const* skip_identifier_chars_scalar(char const* begin, char const* end);
+char const* skip_digits_scalar(char const* begin, char const* end);
+char const* find_string_end_scalar(char const* begin, char const* end);
+char const* find_line_end_scalar(char const* begin, char const* end);
+
+#endif
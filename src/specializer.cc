@@ -0,0 +1,850 @@
+#include <map>
+#include <set>
+#include <string>
+#include <cassert>
+
+#include <boost/next_prior.hpp>
+
+#include "specializer.hh"
+#include "statements.hh"
+#include "interpreter.hh"
+#include "unparser.hh"
+#include "folder.hh"
+#include "eliminator.hh"
+
+namespace {
+
+// A loop is only unrolled if it's done within these many iterations, and its unrolled body within these many
+// statements -- of the block it's in, not counting those in blocks inside.
+std::size_t const MAX_UNROLLED_ITERATIONS = 256;
+std::size_t const MAX_UNROLLED_STATEMENTS = 4096;
+
+// Longer strings aren't worked out, nor put in place of the variables they're assigned to, so that a long chain of
+// concatenations isn't copied over and over.
+std::string::size_type const MAX_KNOWN_STRING_LENGTH = 256;
+
+// The values variables certainly have at a point of the program.  Only values that can be written as literals are
+// kept, so that they can be put in place of the variables.
+//
+// Variables are kept by name only, not by the block they're in: in a run that doesn't fail, reading a variable gets
+// what was last assigned to it, in whatever block.
+struct environment {
+    std::map<symbol_id, number>         numbers;
+    std::map<symbol_id, std::string>    strings;
+
+    void forget(symbol_id name);
+    void forget(std::set<symbol_id> const& names);
+
+    // Keep only what other knows the same.
+    void merge(environment const& other);
+};
+
+void environment::forget(symbol_id name) {
+    numbers.erase(name);
+    strings.erase(name);
+}
+
+void environment::forget(std::set<symbol_id> const& names) {
+    for (std::set<symbol_id>::const_iterator name = names.begin(); name != names.end(); ++name)
+        forget(*name);
+}
+
+void environment::merge(environment const& other) {
+    for (std::map<symbol_id, number>::iterator n = numbers.begin(); n != numbers.end(); ) {
+        std::map<symbol_id, number>::const_iterator const o = other.numbers.find(n->first);
+        if (o == other.numbers.end() || !is_identical(o->second, n->second))
+            numbers.erase(n++);
+        else
+            ++n;
+    }
+
+    for (std::map<symbol_id, std::string>::iterator s = strings.begin(); s != strings.end(); ) {
+        std::map<symbol_id, std::string>::const_iterator const o = other.strings.find(s->first);
+        if (o == other.strings.end() || o->second != s->second)
+            strings.erase(s++);
+        else
+            ++s;
+    }
+}
+
+bool has_any_label(block const& b, std::set<symbol_id> const& labels) {
+    for (block::jump_table_t::const_iterator label = b.jump_table.begin(); label != b.jump_table.end(); ++label)
+        if (labels.count(label->first))
+            return true;
+    return false;
+}
+
+// The variables a block and the blocks in it may assign, the labels they jump to, and whether control only enters the
+// block at its beginning and leaves it at its end or by STOP -- it has no jumps, EXITs or labels of the given jump
+// targets -- so that its statements can be taken out of it.
+class block_summary : private statement_visitor {
+public:
+    explicit block_summary(block const& b, std::set<symbol_id> const& targets = std::set<symbol_id>());
+
+    std::set<symbol_id> const& get_assigned() const { return assigned; }
+    std::set<symbol_id> const& get_jump_targets() const { return jump_targets; }
+    bool is_structured() const { return structured; }
+
+private:
+    std::set<symbol_id> assigned;
+    std::set<symbol_id> jump_targets;
+    bool                structured;
+    std::set<symbol_id> const& targets;
+
+    void add_block(block const& b);
+
+    virtual void visit(if_goto_stmt const& statement);
+    virtual void visit(if_block_stmt const& statement);
+    virtual void visit(do_stmt const& statement) { add_block(statement.get_body()); }
+    virtual void visit(for_stmt const& statement);
+    virtual void visit(print_stmt const&) { }
+    virtual void visit(input_stmt const& statement) { assigned.insert(statement.get_variable_name()); }
+    virtual void visit(let_stmt const& statement) { assigned.insert(statement.get_variable_name()); }
+    virtual void visit(goto_stmt const& statement);
+    virtual void visit(stop_stmt const&) { }
+    virtual void visit(exit_stmt const&) { structured = false; }
+    virtual void visit(include_stmt const&) { structured = false; }
+    virtual void visit(empty_stmt const&) { }
+};
+
+block_summary::block_summary(block const& b, std::set<symbol_id> const& targets)
+    : structured(true)
+    , targets(targets)
+{
+    add_block(b);
+}
+
+void block_summary::add_block(block const& b) {
+    assert(b.is_parsed());
+
+    if (has_any_label(b, targets))
+        structured = false;
+
+    for (block::statement_list::const_iterator s = b.statements.begin(); s != b.statements.end(); ++s)
+        (*s)->accept(*this);
+}
+
+void block_summary::visit(if_goto_stmt const& statement) {
+    jump_targets.insert(statement.get_then_label());
+    if (statement.get_else_label())
+        jump_targets.insert(*statement.get_else_label());
+    structured = false;
+}
+
+void block_summary::visit(if_block_stmt const& statement) {
+    for (std::vector<block>::const_iterator b = statement.get_blocks().begin(); b != statement.get_blocks().end(); ++b)
+        add_block(*b);
+}
+
+void block_summary::visit(for_stmt const& statement) {
+    assigned.insert(statement.get_variable_name());
+    add_block(statement.get_body());
+}
+
+void block_summary::visit(goto_stmt const& statement) {
+    jump_targets.insert(statement.get_label());
+    structured = false;
+}
+
+constant_expr const* as_constant(numeric_expr const& expr) {
+    return dynamic_cast<constant_expr const*>(&expr);
+}
+
+string_literal_expr const* as_literal(string_expr const& expr) {
+    return dynamic_cast<string_literal_expr const*>(&expr);
+}
+
+// Rebuilds expressions with the known variables replaced by their values, and operations whose operands are constants
+// done -- unless doing one fails or traps, which is left to the run, or gives a value that can't be written.
+class expr_specializer : private expr_visitor {
+public:
+    explicit expr_specializer(environment const& known);
+
+    std::auto_ptr<numeric_expr> specialize(numeric_expr const& expr);
+    std::auto_ptr<string_expr> specialize(string_expr const& expr);
+    std::auto_ptr<printable_expr> specialize(printable_expr const& expr);
+
+private:
+    environment const&  known;
+    constant_folder     folder;
+    interpreter         scratch;    // Strings are joined in it; that doesn't look at any variables.
+
+    // Like in program_writer, operands still to be specialized are kept on a stack, rather than recursed into, so that
+    // long chains of operators can be.  The results are kept on these.
+    std::vector<std::pair<printable_expr const*, bool> > pending;
+    bool                        operands_done;
+    expr_stack<numeric_expr>    numbers;
+    expr_stack<string_expr>     strings;
+
+    void run(printable_expr const& expr);
+
+    // If the operands of expr have been specialized, return true; otherwise queue them to be, before expr again.
+    bool have_operands(printable_expr const& expr, printable_expr const& left, printable_expr const* right);
+
+    // Push a rebuilt operation, or its value if it's to be done now.
+    void push(std::auto_ptr<numeric_expr> expr, bool constant);
+    void push(std::auto_ptr<string_expr> expr, bool constant);
+
+    virtual void visit(string_concat_expr const& expr);
+    virtual void visit(string_variable_expr const& expr);
+    virtual void visit(string_literal_expr const& expr);
+    virtual void visit(arith_expr const& expr);
+    virtual void visit(variable_expr const& expr);
+    virtual void visit(constant_expr const& expr);
+    virtual void visit(relational_expr const& expr);
+    virtual void visit(boolean_expr const& expr);
+    virtual void visit(save_expr const& expr);
+    virtual void visit(temporary_expr const& expr);
+};
+
+expr_specializer::expr_specializer(environment const& known)
+    : known(known)
+    , operands_done(false)
+{ }
+
+std::auto_ptr<numeric_expr> expr_specializer::specialize(numeric_expr const& expr) {
+    run(expr);
+    return numbers.pop();
+}
+
+std::auto_ptr<string_expr> expr_specializer::specialize(string_expr const& expr) {
+    run(expr);
+    return strings.pop();
+}
+
+std::auto_ptr<printable_expr> expr_specializer::specialize(printable_expr const& expr) {
+    run(expr);
+    if (!numbers.items.empty())
+        return std::auto_ptr<printable_expr>(numbers.pop());
+    else
+        return std::auto_ptr<printable_expr>(strings.pop());
+}
+
+void expr_specializer::run(printable_expr const& expr) {
+    pending.push_back(std::make_pair(&expr, false));
+    while (!pending.empty()) {
+        printable_expr const* const e = pending.back().first;
+        operands_done = pending.back().second;
+        pending.pop_back();
+        e->accept(*this);
+    }
+}
+
+bool expr_specializer::have_operands(printable_expr const& expr, printable_expr const& left,
+                                     printable_expr const* right) {
+    if (operands_done)
+        return true;
+
+    pending.push_back(std::make_pair(&expr, true));
+    if (right)
+        pending.push_back(std::make_pair(right, false));
+    pending.push_back(std::make_pair(&left, false));
+    return false;
+}
+
+void expr_specializer::push(std::auto_ptr<numeric_expr> expr, bool constant) {
+    if (constant) {
+        boost::optional<number> const value = folder.fold(*expr);
+        if (value && get_number_literal(*value)) {
+            numbers.push(std::auto_ptr<numeric_expr>(new constant_expr(*value)));
+            return;
+        }
+    }
+
+    numbers.push(expr);
+}
+
+void expr_specializer::push(std::auto_ptr<string_expr> expr, bool constant) {
+    if (constant) {
+        std::string const value = expr->evaluate(scratch);
+        if (get_string_literal(value)) {
+            strings.push(std::auto_ptr<string_expr>(new string_literal_expr(value)));
+            return;
+        }
+    }
+
+    strings.push(expr);
+}
+
+void expr_specializer::visit(string_concat_expr const& expr) {
+    if (!have_operands(expr, expr.get_left(), &expr.get_right()))
+        return;
+
+    std::auto_ptr<string_expr> right = strings.pop();
+    std::auto_ptr<string_expr> left = strings.pop();
+    string_literal_expr const* const left_literal = as_literal(*left);
+    string_literal_expr const* const right_literal = as_literal(*right);
+    bool const constant = left_literal && right_literal
+                          && left_literal->get_value().size() + right_literal->get_value().size()
+                             <= MAX_KNOWN_STRING_LENGTH;
+    push(std::auto_ptr<string_expr>(new string_concat_expr(left, right)), constant);
+}
+
+void expr_specializer::visit(string_variable_expr const& expr) {
+    std::map<symbol_id, std::string>::const_iterator const value = known.strings.find(expr.get_name());
+    if (value != known.strings.end())
+        strings.push(std::auto_ptr<string_expr>(new string_literal_expr(value->second)));
+    else
+        strings.push(std::auto_ptr<string_expr>(new string_variable_expr(expr.get_name())));
+}
+
+void expr_specializer::visit(string_literal_expr const& expr) {
+    strings.push(std::auto_ptr<string_expr>(new string_literal_expr(expr.get_value())));
+}
+
+void expr_specializer::visit(arith_expr const& expr) {
+    if (!have_operands(expr, expr.get_left_side(), &expr.get_right_side()))
+        return;
+
+    std::auto_ptr<numeric_expr> right = numbers.pop();
+    std::auto_ptr<numeric_expr> left = numbers.pop();
+    bool const constant = as_constant(*left) && as_constant(*right);
+    push(std::auto_ptr<numeric_expr>(new arith_expr(left, right, expr.get_operator())), constant);
+}
+
+void expr_specializer::visit(variable_expr const& expr) {
+    std::map<symbol_id, number>::const_iterator const value = known.numbers.find(expr.get_name());
+    if (value != known.numbers.end())
+        numbers.push(std::auto_ptr<numeric_expr>(new constant_expr(value->second)));
+    else
+        numbers.push(std::auto_ptr<numeric_expr>(new variable_expr(expr.get_name())));
+}
+
+void expr_specializer::visit(constant_expr const& expr) {
+    numbers.push(std::auto_ptr<numeric_expr>(new constant_expr(expr.get_value())));
+}
+
+void expr_specializer::visit(relational_expr const& expr) {
+    if (!have_operands(expr, expr.get_left_side(), &expr.get_right_side()))
+        return;
+
+    std::auto_ptr<numeric_expr> right = numbers.pop();
+    std::auto_ptr<numeric_expr> left = numbers.pop();
+    bool const constant = as_constant(*left) && as_constant(*right);
+    push(std::auto_ptr<numeric_expr>(new relational_expr(left, right, expr.get_operator())), constant);
+}
+
+void expr_specializer::visit(boolean_expr const& expr) {
+    if (!have_operands(expr, expr.get_left_side(), expr.get_right_side()))
+        return;
+
+    std::auto_ptr<numeric_expr> right;
+    if (expr.get_right_side())
+        right = numbers.pop();
+    std::auto_ptr<numeric_expr> left = numbers.pop();
+
+    // AND and OR don't look at the right operand if the left one decides.
+    constant_expr const* const left_value = as_constant(*left);
+    bool const decided = left_value && right.get()
+                         && (expr.get_operator() == boolean_expr::operator_and) != left_value->get_value().is_true();
+    bool const constant = decided || (left_value && (!right.get() || as_constant(*right)));
+    push(std::auto_ptr<numeric_expr>(new boolean_expr(left, right, expr.get_operator())), constant);
+}
+
+// Temporaries are specialized away: what they keep the value of is specialized in their place.
+void expr_specializer::visit(save_expr const& expr) {
+    pending.push_back(std::make_pair(&expr.get_operand(), false));
+}
+
+void expr_specializer::visit(temporary_expr const& expr) {
+    pending.push_back(std::make_pair(&expr.get_original(), false));
+}
+
+class partial_evaluator : private statement_visitor {
+public:
+    explicit partial_evaluator(std::vector<int> const& inputs);
+
+    block run(block const& program);
+
+    std::size_t get_inputs_used() const;
+
+private:
+    std::vector<int> const  inputs;
+    std::set<symbol_id>     jump_targets;   // Labels nothing jumps to are only names.
+    std::size_t             inputs_used;
+    environment             known;
+    expr_specializer        expressions;
+    block*                  out;            // Where residual statements go.
+    source_location const*  location;       // Of the statement being specialized, if any.
+
+    // Whether control can get to the current statement other than by a jump.  Statements it can't get to are left out.
+    bool                    reachable;
+
+    // Whether the INPUTs run before the current statement are certainly those given values, and in the same order.
+    bool                    in_order;
+
+    // How many of the blocks around the current statement may run any number of times, or not at all.
+    std::size_t             uncertain_depth;
+
+    // What unrolling a loop, which may be given up, changes.
+    struct state {
+        environment known;
+        bool        reachable;
+        bool        in_order;
+        std::size_t inputs_used;
+    };
+
+    state save() const;
+    void restore(state const& saved);
+
+    void emit(statement* s);  // Takes ownership.
+    void assign(symbol_id name, numeric_expr const& value);
+    void jump(symbol_id label);
+
+    // Specialize the statements of b onto the end of the residual block, or of the given one.
+    void specialize_block(block const& b);
+    void specialize_into(block const& b, block& residual);
+
+    // Specialize a block that certainly runs once.
+    void inline_block(block const& b);
+
+    // Specialize a block that may run any number of times, given what's known every time it begins.
+    void specialize_repeated(block const& b, block& residual);
+
+    // Put the body of a loop in its place as many times as the loop would run it.  Return false, changing nothing, if
+    // how many times that is isn't known, or it's too many.
+    bool unroll(do_stmt const& statement, bool structured);
+    bool unroll(for_stmt const& statement, bool structured, numeric_expr const& final_value,
+                numeric_expr const& step);
+    bool unrolled_too_far(std::size_t iterations, block const& unrolled) const;
+
+    virtual void visit(if_goto_stmt const& statement);
+    virtual void visit(if_block_stmt const& statement);
+    virtual void visit(do_stmt const& statement);
+    virtual void visit(for_stmt const& statement);
+    virtual void visit(print_stmt const& statement);
+    virtual void visit(input_stmt const& statement);
+    virtual void visit(let_stmt const& statement);
+    virtual void visit(goto_stmt const& statement);
+    virtual void visit(stop_stmt const& statement);
+    virtual void visit(exit_stmt const& statement);
+    virtual void visit(include_stmt const& statement);
+    virtual void visit(empty_stmt const& statement);
+};
+
+partial_evaluator::partial_evaluator(std::vector<int> const& inputs)
+    : inputs(inputs)
+    , inputs_used(0)
+    , expressions(known)
+    , out(0)
+    , location(0)
+    , reachable(true)
+    , in_order(true)
+    , uncertain_depth(0)
+{ }
+
+block partial_evaluator::run(block const& program) {
+    jump_targets = block_summary(program).get_jump_targets();
+    block residual;
+    specialize_into(program, residual);
+    return residual;
+}
+
+std::size_t partial_evaluator::get_inputs_used() const {
+    return inputs_used;
+}
+
+partial_evaluator::state partial_evaluator::save() const {
+    state const result = { known, reachable, in_order, inputs_used };
+    return result;
+}
+
+void partial_evaluator::restore(state const& saved) {
+    known = saved.known;
+    reachable = saved.reachable;
+    in_order = saved.in_order;
+    inputs_used = saved.inputs_used;
+}
+
+void partial_evaluator::emit(statement* s) {
+    boost::shared_ptr<statement> owned(s);
+    if (location)
+        s->set_location(*location);
+    out->statements.push_back(owned);
+}
+
+void partial_evaluator::assign(symbol_id name, numeric_expr const& value) {
+    if (constant_expr const* const constant = as_constant(value))
+        known.numbers[name] = constant->get_value();
+    else
+        known.forget(name);
+}
+
+void partial_evaluator::jump(symbol_id label) {
+    emit(new goto_stmt(label));
+    reachable = false;
+}
+
+void partial_evaluator::specialize_block(block const& b) {
+    assert(b.is_parsed());
+    source_location const* const outer_location = location;
+
+    // Labels by the statement they're at, or null for the end of the block.
+    std::map<statement const*, std::vector<symbol_id> > labels;
+    for (block::jump_table_t::const_iterator label = b.jump_table.begin(); label != b.jump_table.end(); ++label) {
+        if (!jump_targets.count(label->first))
+            continue;
+
+        statement const* const target = label->second == b.statements.end() ? 0 : label->second->get();
+        labels[target].push_back(label->first);
+    }
+
+    for (block::statement_list::const_iterator s = b.statements.begin(); ; ++s) {
+        std::map<statement const*, std::vector<symbol_id> >::const_iterator const at
+            = labels.find(s == b.statements.end() ? 0 : s->get());
+
+        if (at != labels.end()) {
+            // A jump may come here from anywhere, with anything set, any number of times.
+            reachable = true;
+            in_order = false;
+            known = environment();
+        }
+
+        if (s == b.statements.end() && at == labels.end())
+            break;
+        if (!reachable)
+            continue;
+
+        // The labels go to the first statement the labelled one turns into, or an empty one if it turns into none.
+        bool const was_empty = out->statements.empty();
+        block::statement_list::iterator const last
+            = was_empty ? out->statements.end() : boost::prior(out->statements.end());
+
+        if (s != b.statements.end()) {
+            location = &(*s)->get_location();
+            (*s)->accept(*this);
+        }
+
+        if (at != labels.end()) {
+            block::statement_list::iterator first = was_empty ? out->statements.begin() : boost::next(last);
+            if (first == out->statements.end()) {
+                emit(new empty_stmt);
+                first = boost::prior(out->statements.end());
+            }
+
+            for (std::vector<symbol_id>::const_iterator label = at->second.begin(); label != at->second.end(); ++label)
+                out->jump_table.insert(std::make_pair(*label, first));
+        }
+
+        if (s == b.statements.end())
+            break;
+    }
+
+    location = outer_location;
+}
+
+void partial_evaluator::specialize_into(block const& b, block& residual) {
+    block* const outer = out;
+    out = &residual;
+    specialize_block(b);
+    out = outer;
+}
+
+void partial_evaluator::inline_block(block const& b) {
+    // Jumps from inside a block look for its labels first, so a block with labels stays a block of its own.
+    if (!has_any_label(b, jump_targets)) {
+        specialize_block(b);
+        return;
+    }
+
+    block residual;
+    specialize_into(b, residual);
+
+    if_block_stmt::conditions_cont const always(1, boost::shared_ptr<numeric_expr>(new constant_expr(1)));
+    emit(new if_block_stmt(always, std::vector<block>(1, residual)));
+}
+
+void partial_evaluator::specialize_repeated(block const& b, block& residual) {
+    environment const before = known;
+
+    ++uncertain_depth;
+    reachable = true;
+    specialize_into(b, residual);
+    --uncertain_depth;
+
+    known = before;
+    reachable = true;
+}
+
+bool partial_evaluator::unroll(do_stmt const& statement, bool structured) {
+    state const saved = save();
+    block* const outer = out;
+    block unrolled;
+    out = &unrolled;
+
+    for (std::size_t iterations = 0; ; ++iterations) {
+        std::auto_ptr<numeric_expr> const condition = expressions.specialize(statement.get_condition());
+        constant_expr const* const value = as_constant(*condition);
+        if (value && !value->get_value().is_true())
+            break;
+
+        if (!value || !structured || unrolled_too_far(iterations, unrolled)) {
+            out = outer;
+            restore(saved);
+            return false;
+        }
+
+        specialize_block(statement.get_body());
+        if (!reachable)
+            break;  // It stopped.
+    }
+
+    out = outer;
+    out->statements.splice(out->statements.end(), unrolled.statements);
+    return true;
+}
+
+bool partial_evaluator::unroll(for_stmt const& statement, bool structured, numeric_expr const& final_value,
+                               numeric_expr const& step) {
+    constant_expr const* const final_constant = as_constant(final_value);
+    constant_expr const* const step_constant = as_constant(step);
+    symbol_id const variable = statement.get_variable_name();
+    if (!final_constant || !step_constant || !known.numbers.count(variable))
+        return false;
+
+    number const last = final_constant->get_value();
+    number const increment = step_constant->get_value();
+
+    state const saved = save();
+    block* const outer = out;
+    block unrolled;
+    out = &unrolled;
+
+    emit(new let_stmt(variable, std::auto_ptr<numeric_expr>(new constant_expr(known.numbers[variable]))));
+
+    for (std::size_t iterations = 0; ; ++iterations) {
+        // The body may have assigned the variable anything.
+        std::map<symbol_id, number>::const_iterator current = known.numbers.find(variable);
+        if (current == known.numbers.end()) {
+            out = outer;
+            restore(saved);
+            return false;
+        }
+
+        number const value = current->second;
+        if (!((increment > 0 && value <= last) || (increment < 0 && value >= last)))
+            break;
+
+        if (!structured || unrolled_too_far(iterations, unrolled)) {
+            out = outer;
+            restore(saved);
+            return false;
+        }
+
+        specialize_block(statement.get_body());
+        if (!reachable)
+            break;
+
+        current = known.numbers.find(variable);
+        number next = current != known.numbers.end() ? current->second : number();
+        next += increment;
+        if (current == known.numbers.end() || !get_number_literal(next)) {
+            out = outer;
+            restore(saved);
+            return false;
+        }
+
+        known.numbers[variable] = next;
+        emit(new let_stmt(variable, std::auto_ptr<numeric_expr>(new constant_expr(next))));
+    }
+
+    out = outer;
+    out->statements.splice(out->statements.end(), unrolled.statements);
+    return true;
+}
+
+bool partial_evaluator::unrolled_too_far(std::size_t iterations, block const& unrolled) const {
+    return iterations >= MAX_UNROLLED_ITERATIONS || unrolled.statements.size() > MAX_UNROLLED_STATEMENTS;
+}
+
+void partial_evaluator::visit(if_goto_stmt const& statement) {
+    std::auto_ptr<numeric_expr> condition = expressions.specialize(statement.get_condition());
+
+    if (constant_expr const* const value = as_constant(*condition)) {
+        if (value->get_value().is_true())
+            jump(statement.get_then_label());
+        else if (statement.get_else_label())
+            jump(*statement.get_else_label());
+    } else {
+        emit(new if_goto_stmt(
+            condition, statement.get_then_label(), statement.get_else_label()));
+        reachable = !statement.get_else_label();
+    }
+}
+
+void partial_evaluator::visit(if_block_stmt const& statement) {
+    if_block_stmt::conditions_cont const& conditions = statement.get_conditions();
+    std::vector<block> const& blocks = statement.get_blocks();
+
+    // The clauses that may be taken.  One whose condition is known to be true is taken if none before it is, so it's
+    // the ELSE of those, and those after it are never taken.
+    if_block_stmt::conditions_cont residual_conditions;
+    std::vector<block const*> taken;
+    bool has_else = false;
+
+    for (std::size_t i = 0; i < conditions.size() && !has_else; ++i) {
+        std::auto_ptr<numeric_expr> condition = expressions.specialize(*conditions[i]);
+        if (constant_expr const* const value = as_constant(*condition)) {
+            if (value->get_value().is_true()) {
+                taken.push_back(&blocks[i]);
+                has_else = true;
+            }
+        } else {
+            residual_conditions.push_back(boost::shared_ptr<numeric_expr>(condition));
+            taken.push_back(&blocks[i]);
+        }
+    }
+
+    if (!has_else && blocks.size() > conditions.size()) {
+        taken.push_back(&blocks.back());
+        has_else = true;
+    }
+
+    if (residual_conditions.empty()) {
+        if (has_else)
+            inline_block(*taken.back());
+        return;
+    }
+
+    // What's known after the IF is what's known the same at the ends of all the ways through it.
+    environment const before = known;
+    environment after;
+    bool any_way_through = false;
+    std::vector<block> residual_blocks(taken.size());
+
+    ++uncertain_depth;
+    for (std::size_t i = 0; i < taken.size(); ++i) {
+        known = before;
+        reachable = true;
+        specialize_into(*taken[i], residual_blocks[i]);
+
+        if (reachable) {
+            if (any_way_through)
+                after.merge(known);
+            else
+                after = known;
+            any_way_through = true;
+        }
+    }
+    --uncertain_depth;
+
+    if (!has_else) {
+        if (any_way_through)
+            after.merge(before);
+        else
+            after = before;
+        any_way_through = true;
+    }
+
+    known = after;
+    reachable = any_way_through;
+    emit(new if_block_stmt(residual_conditions, residual_blocks));
+}
+
+void partial_evaluator::visit(do_stmt const& statement) {
+    block_summary const body(statement.get_body(), jump_targets);
+    if (unroll(statement, body.is_structured()))
+        return;
+
+    known.forget(body.get_assigned());
+    std::auto_ptr<numeric_expr> condition = expressions.specialize(statement.get_condition());
+
+    block residual;
+    specialize_repeated(statement.get_body(), residual);
+    emit(new do_stmt(condition, residual));
+}
+
+void partial_evaluator::visit(for_stmt const& statement) {
+    symbol_id const variable = statement.get_variable_name();
+
+    // As when it's run, the variable is set before the final value and the step are worked out.
+    std::auto_ptr<numeric_expr> initial_value = expressions.specialize(statement.get_initial_value());
+    assign(variable, *initial_value);
+    std::auto_ptr<numeric_expr> step = expressions.specialize(statement.get_step());
+    std::auto_ptr<numeric_expr> final_value = expressions.specialize(statement.get_final_value());
+
+    block_summary const body(statement.get_body(), jump_targets);
+    if (unroll(statement, body.is_structured(), *final_value, *step))
+        return;
+
+    known.forget(variable);
+    known.forget(body.get_assigned());
+
+    block residual;
+    specialize_repeated(statement.get_body(), residual);
+    emit(new for_stmt(variable, initial_value, final_value, step, residual));
+}
+
+void partial_evaluator::visit(print_stmt const& statement) {
+    print_stmt::expressions_cont residual;
+    for (std::size_t i = 0; i < statement.get_expressions().size(); ++i)
+        residual.push_back(boost::shared_ptr<printable_expr>(expressions.specialize(*statement.get_expressions()[i])));
+
+    emit(new print_stmt(residual));
+}
+
+void partial_evaluator::visit(input_stmt const& statement) {
+    symbol_id const name = statement.get_variable_name();
+
+    if (uncertain_depth == 0 && in_order && inputs_used < inputs.size()
+        && get_number_literal(number(inputs[inputs_used]))) {
+        number const value(inputs[inputs_used++]);
+        known.numbers[name] = value;
+        emit(new let_stmt(name, std::auto_ptr<numeric_expr>(new constant_expr(value))));
+    } else {
+        // Whether this one is run or not, and how often, isn't known, so neither is which INPUT is run after it.
+        in_order = false;
+        known.forget(name);
+        emit(new input_stmt(name));
+    }
+}
+
+void partial_evaluator::visit(let_stmt const& statement) {
+    symbol_id const name = statement.get_variable_name();
+
+    if (numeric_expr const* const value = statement.get_numeric_value()) {
+        std::auto_ptr<numeric_expr> residual = expressions.specialize(*value);
+        assign(name, *residual);
+        emit(new let_stmt(name, residual));
+    } else {
+        std::auto_ptr<string_expr> residual = expressions.specialize(*statement.get_string_value());
+        string_literal_expr const* const literal = as_literal(*residual);
+        if (literal && literal->get_value().size() <= MAX_KNOWN_STRING_LENGTH)
+            known.strings[name] = literal->get_value();
+        else
+            known.forget(name);
+        emit(new let_stmt(name, residual));
+    }
+}
+
+void partial_evaluator::visit(goto_stmt const& statement) {
+    jump(statement.get_label());
+}
+
+void partial_evaluator::visit(stop_stmt const&) {
+    emit(new stop_stmt);
+    reachable = false;
+}
+
+void partial_evaluator::visit(exit_stmt const& statement) {
+    emit(new exit_stmt(statement.get_block_name()));
+    reachable = false;
+}
+
+void partial_evaluator::visit(include_stmt const& statement) {
+    emit(new include_stmt(statement.get_path()));
+}
+
+void partial_evaluator::visit(empty_stmt const&) { }
+
+}
+
+block specialize(block const& program, std::vector<int> const& inputs, std::size_t& inputs_used) {
+    partial_evaluator evaluator(inputs);
+    block residual = evaluator.run(program);
+    inputs_used = evaluator.get_inputs_used();
+
+    // Replacing variables by their values leaves many of the LETs that set them unread.
+    eliminate_dead_code(residual);
+    return residual;
+}
@@ -0,0 +1,21 @@
+#ifndef SPECIALIZER_HH
+#define SPECIALIZER_HH
+
+#include <vector>
+#include <cstddef>
+
+#include "parser.hh"
+
+// Partially evaluate a program for known values of its first INPUTs: those INPUTs become LETs of the values, variables
+// whose values are then known are replaced by them, operations on constants are done, IF blocks whose conditions are
+// known are replaced by the block taken, and loops whose conditions are known every time round are unrolled, as long
+// as that doesn't make the program much larger.  The residual program does what the program does when the values are
+// its first lines of input, without reading them or prompting for them.  What it's left doing in vain is then removed,
+// as eliminate_dead_code does.  Runs that fail may fail differently.
+//
+// An INPUT is only given a value if it's certainly the next to be run after those given values before it -- not in a
+// loop or an IF that's left in, nor after a label, where control may come back again.  inputs_used is set to how many
+// of the values were given.  The program shall have been parsed whole.
+block specialize(block const& program, std::vector<int> const& inputs, std::size_t& inputs_used);
+
+#endif
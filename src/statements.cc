@@ -5,16 +5,38 @@
 #include "parser.hh"
 #include "interpreter.hh"
 #include "statements.hh"
+#include "metrics.hh"
+
+statement::statement() {
+    location.line = 0;
+    location.column = 0;
+}
 
 void statement::execute(interpreter& interpreter) {
     do_execute(interpreter);
 }
 
-block_statement::block_statement(std::string const& name)
+source_location const& statement::get_location() const {
+    return location;
+}
+
+void statement::set_location(source_location const& location) {
+    this->location = location;
+}
+
+char const* statement::get_type_name() const {
+    return do_get_type_name();
+}
+
+void statement::accept(statement_visitor& visitor) const {
+    do_accept(visitor);
+}
+
+block_statement::block_statement(symbol_id name)
     : name(name)
 { }
 
-std::string block_statement::get_name() const {
+symbol_id block_statement::get_name() const {
     return name;
 }
 
@@ -26,36 +48,97 @@ std::string printable_expr::get_representation(interpreter& interpreter) const {
     return do_get_representation(interpreter);
 }
 
+void printable_expr::accept(expr_visitor& visitor) const {
+    do_accept(visitor);
+}
+
 std::string string_expr::evaluate(interpreter& interpreter) const {
-    return do_evaluate(interpreter);
+    std::string result = do_evaluate(interpreter);
+    metrics.string_bytes_allocated += result.size();
+    return result;
 }
 
 std::string string_expr::do_get_representation(interpreter& interpreter) const {
-    return do_evaluate(interpreter);
+    return evaluate(interpreter);
 }
 
 string_concat_expr::string_concat_expr(std::auto_ptr<string_expr> left, std::auto_ptr<string_expr> right)
     : left(left)
     , right(right)
+    , left_concat(dynamic_cast<string_concat_expr*>(this->left.get()))
+    , spine_parent(0)
 {
     assert(this->left.get());
     assert(this->right.get());
+
+    if (left_concat)
+        left_concat->spine_parent = this;
+}
+
+string_concat_expr::~string_concat_expr() {
+    // Unlink the left spine one node at a time, so that each deleted node has no spine of its own left.
+    while (left_concat) {
+        string_concat_expr* child = left_concat;
+        left.release();
+        left = child->left;
+        left_concat = child->left_concat;
+        child->left_concat = 0;
+        delete child;
+    }
 }
 
 std::string string_concat_expr::do_evaluate(interpreter& interpreter) const {
-    return left->evaluate(interpreter) + right->evaluate(interpreter);
+    string_concat_expr const* node = this;
+    while (node->left_concat)
+        node = node->left_concat;
+
+    std::string result = node->left->evaluate(interpreter);
+    for (;;) {
+        result += node->right->evaluate(interpreter);
+        if (node == this)
+            return result;
+        node = node->spine_parent;
+    }
+}
+
+string_expr const& string_concat_expr::get_left() const {
+    return *left;
+}
+
+string_expr const& string_concat_expr::get_right() const {
+    return *right;
 }
 
-string_variable_expr::string_variable_expr(std::string const& var_name)
+void string_concat_expr::do_accept(expr_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
+string_variable_expr::string_variable_expr(symbol_id var_name)
     : var_name(var_name)
 {
-    assert(is_string_identifier(var_name));
+    assert(is_string_identifier(symbols.get_name(var_name)));
 }
 
 std::string string_variable_expr::do_evaluate(interpreter& interpreter) const {
     return interpreter.get_var_string(var_name);
 }
 
+symbol_id variable_expr::get_name() const {
+    return name;
+}
+
+void variable_expr::do_accept(expr_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
+symbol_id string_variable_expr::get_name() const {
+    return var_name;
+}
+
+void string_variable_expr::do_accept(expr_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
 string_literal_expr::string_literal_expr(std::string const& value)
     : value(value)
 { }
@@ -64,6 +147,14 @@ std::string string_literal_expr::do_evaluate(interpreter&) const {
     return value;
 }
 
+std::string const& string_literal_expr::get_value() const {
+    return value;
+}
+
+void string_literal_expr::do_accept(expr_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
 number numeric_expr::evaluate(interpreter& interpreter) const {
     return do_evaluate(interpreter);
 }
@@ -78,26 +169,85 @@ arith_expr::arith_expr(std::auto_ptr<numeric_expr> left_side, std::auto_ptr<nume
     : left_side(left_side)
     , right_side(right_side)
     , op(op)
+    , unchecked(false)
+    , left_arith(dynamic_cast<arith_expr*>(this->left_side.get()))
+    , spine_parent(0)
 {
     assert(this->left_side.get());
     assert(this->right_side.get());
+
+    if (left_arith)
+        left_arith->spine_parent = this;
+}
+
+arith_expr::~arith_expr() {
+    while (left_arith) {
+        arith_expr* child = left_arith;
+        left_side.release();
+        left_side = child->left_side;
+        left_arith = child->left_arith;
+        child->left_arith = 0;
+        delete child;
+    }
 }
 
 number arith_expr::do_evaluate(interpreter& interpreter) const {
-    number result = left_side->evaluate(interpreter);
+    // Start at the bottom of the left spine and work up towards this.
+    arith_expr const* node = this;
+    while (node->left_arith)
+        node = node->left_arith;
 
-    switch (op) {
-    case operator_plus:     result += right_side->evaluate(interpreter); break;
-    case operator_minus:    result -= right_side->evaluate(interpreter); break;
-    case operator_times:    result *= right_side->evaluate(interpreter); break;
-    case operator_modulo:   result %= right_side->evaluate(interpreter); break;
-    case operator_divides:  result /= right_side->evaluate(interpreter); break;
+    number result = node->left_side->evaluate(interpreter);
+    for (;;) {
+        number const right = node->right_side->evaluate(interpreter);
+        if (node->unchecked)
+            switch (node->op) {
+            case operator_plus:     result.unchecked_add(right); break;
+            case operator_minus:    result.unchecked_subtract(right); break;
+            case operator_times:    result.unchecked_multiply(right); break;
+            case operator_modulo:   result.unchecked_modulo(right); break;
+            case operator_divides:  result.unchecked_divide(right); break;
+            }
+        else
+            switch (node->op) {
+            case operator_plus:     result += right; break;
+            case operator_minus:    result -= right; break;
+            case operator_times:    result *= right; break;
+            case operator_modulo:   result %= right; break;
+            case operator_divides:  result /= right; break;
+            }
+
+        if (node == this)
+            return result;
+        node = node->spine_parent;
     }
+}
 
-    return result;
+numeric_expr const& arith_expr::get_left_side() const {
+    return *left_side;
+}
+
+numeric_expr const& arith_expr::get_right_side() const {
+    return *right_side;
+}
+
+arith_expr::e_operator arith_expr::get_operator() const {
+    return op;
+}
+
+bool arith_expr::is_unchecked() const {
+    return unchecked;
 }
 
-variable_expr::variable_expr(std::string const& name)
+void arith_expr::set_unchecked(bool unchecked) {
+    this->unchecked = unchecked;
+}
+
+void arith_expr::do_accept(expr_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
+variable_expr::variable_expr(symbol_id name)
     : name(name)
 { }
 
@@ -113,6 +263,14 @@ number constant_expr::do_evaluate(interpreter&) const {
     return value;
 }
 
+number const& constant_expr::get_value() const {
+    return value;
+}
+
+void constant_expr::do_accept(expr_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
 relational_expr::relational_expr(
     std::auto_ptr<numeric_expr> left_side,
     std::auto_ptr<numeric_expr> right_side,
@@ -143,6 +301,22 @@ number relational_expr::do_evaluate(interpreter& interpreter) const {
     return 0;
 }
 
+numeric_expr const& relational_expr::get_left_side() const {
+    return *left_side;
+}
+
+numeric_expr const& relational_expr::get_right_side() const {
+    return *right_side;
+}
+
+relational_expr::e_operator relational_expr::get_operator() const {
+    return op;
+}
+
+void relational_expr::do_accept(expr_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
 boolean_expr::boolean_expr(
     std::auto_ptr<numeric_expr> left_side,
     std::auto_ptr<numeric_expr> right_side,
@@ -151,29 +325,156 @@ boolean_expr::boolean_expr(
     : left_side(left_side)
     , right_side(right_side)
     , op(op)
+    , left_boolean(dynamic_cast<boolean_expr*>(this->left_side.get()))
+    , right_boolean(dynamic_cast<boolean_expr*>(this->right_side.get()))
 {
     assert(this->left_side.get());
     assert(op == operator_not || this->right_side.get());
 }
 
+boolean_expr::~boolean_expr() {
+    // Each operand taken out is deleted with its own boolean operands taken out first, so none of them recurses.
+    std::vector<boolean_expr*> operands;
+    take_boolean_operands(operands);
+    while (!operands.empty()) {
+        boolean_expr* const operand = operands.back();
+        operands.pop_back();
+        operand->take_boolean_operands(operands);
+        delete operand;
+    }
+}
+
+void boolean_expr::take_boolean_operands(std::vector<boolean_expr*>& operands) {
+    if (left_boolean) {
+        left_side.release();
+        operands.push_back(left_boolean);
+        left_boolean = 0;
+    }
+    if (right_boolean) {
+        right_side.release();
+        operands.push_back(right_boolean);
+        right_boolean = 0;
+    }
+}
+
 number boolean_expr::do_evaluate(interpreter& interpreter) const {
-    switch (op) {
-    case operator_and:
-        return left_side->evaluate(interpreter).is_true() && right_side->evaluate(interpreter).is_true();
-    case operator_or:
-        return left_side->evaluate(interpreter).is_true() || right_side->evaluate(interpreter).is_true();
-    case operator_not:
-        return !left_side->evaluate(interpreter).is_true();
+    // The usual case, with no boolean operands, needs no stack.
+    if (!left_boolean && !right_boolean) {
+        switch (op) {
+        case operator_and:
+            return left_side->evaluate(interpreter).is_true() && right_side->evaluate(interpreter).is_true();
+        case operator_or:
+            return left_side->evaluate(interpreter).is_true() || right_side->evaluate(interpreter).is_true();
+        case operator_not:
+            return !left_side->evaluate(interpreter).is_true();
+        }
     }
 
-    assert(!"Never gets here");
-    return 0;  // Stupid, stupid compiler.
+    // The operations under way, innermost last, and whether their left operands have been worked out.
+    std::vector<std::pair<boolean_expr const*, bool> > pending;
+    boolean_expr const* node = this;
+    for (;;) {
+        // Go down the left operands to the first that isn't boolean.
+        pending.push_back(std::make_pair(node, false));
+        while (node->left_boolean) {
+            node = node->left_boolean;
+            pending.push_back(std::make_pair(node, false));
+        }
+        bool value = node->left_side->evaluate(interpreter).is_true();
+
+        // Go back up with it, until a right operand is needed that's boolean.
+        node = 0;
+        while (!node) {
+            std::pair<boolean_expr const*, bool>& top = pending.back();
+            boolean_expr const* const current = top.first;
+
+            if (!top.second && current->op != operator_not && (current->op == operator_and) == value) {
+                // The right operand decides.
+                top.second = true;
+                if (current->right_boolean) {
+                    node = current->right_boolean;
+                    continue;
+                }
+                value = current->right_side->evaluate(interpreter).is_true();
+            } else if (!top.second && current->op == operator_not)
+                value = !value;
+
+            // Otherwise the left operand decided, or value is the right one's.
+            pending.pop_back();
+            if (pending.empty())
+                return value;
+        }
+    }
+}
+
+numeric_expr const& boolean_expr::get_left_side() const {
+    return *left_side;
+}
+
+numeric_expr const* boolean_expr::get_right_side() const {
+    return right_side.get();
+}
+
+boolean_expr::e_operator boolean_expr::get_operator() const {
+    return op;
+}
+
+void boolean_expr::do_accept(expr_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
+save_expr::save_expr(std::auto_ptr<numeric_expr> operand, std::size_t slot)
+    : operand(operand)
+    , slot(slot)
+{
+    assert(this->operand.get());
+}
+
+number save_expr::do_evaluate(interpreter& interpreter) const {
+    number const value = operand->evaluate(interpreter);
+    interpreter.set_temporary(slot, value);
+    return value;
+}
+
+numeric_expr const& save_expr::get_operand() const {
+    return *operand;
+}
+
+std::size_t save_expr::get_slot() const {
+    return slot;
+}
+
+void save_expr::do_accept(expr_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
+temporary_expr::temporary_expr(std::size_t slot, std::auto_ptr<numeric_expr> original)
+    : slot(slot)
+    , original(original)
+{
+    assert(this->original.get());
+}
+
+number temporary_expr::do_evaluate(interpreter& interpreter) const {
+    return interpreter.get_temporary(slot);
+}
+
+std::size_t temporary_expr::get_slot() const {
+    return slot;
+}
+
+numeric_expr const& temporary_expr::get_original() const {
+    return *original;
+}
+
+void temporary_expr::do_accept(expr_visitor& visitor) const {
+    visitor.visit(*this);
 }
 
 if_goto_stmt::if_goto_stmt(
     std::auto_ptr<numeric_expr> condition,
-    std::string const& then_label,
-    std::string const& else_label)
+    symbol_id then_label,
+    boost::optional<symbol_id> else_label)
     : condition(condition)
     , then_label(then_label)
     , else_label(else_label)
@@ -184,8 +485,36 @@ if_goto_stmt::if_goto_stmt(
 void if_goto_stmt::do_execute(interpreter& interpreter) {
     if (condition->evaluate(interpreter).is_true())
         interpreter.jump(then_label);
-    else if (!else_label.empty())
-        interpreter.jump(else_label);
+    else if (else_label)
+        interpreter.jump(*else_label);
+}
+
+char const* if_goto_stmt::do_get_type_name() const {
+    return "if_goto_stmt";
+}
+
+symbol_id goto_stmt::get_label() const {
+    return label;
+}
+
+void goto_stmt::do_accept(statement_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
+numeric_expr const& if_goto_stmt::get_condition() const {
+    return *condition;
+}
+
+symbol_id if_goto_stmt::get_then_label() const {
+    return then_label;
+}
+
+boost::optional<symbol_id> const& if_goto_stmt::get_else_label() const {
+    return else_label;
+}
+
+void if_goto_stmt::do_accept(statement_visitor& visitor) const {
+    visitor.visit(*this);
 }
 
 if_block_stmt::if_block_stmt(conditions_cont const& conditions, std::vector<block> const& blocks)
@@ -208,8 +537,28 @@ void if_block_stmt::do_execute(interpreter& interpreter) {
         interpreter.enter_block(blocks[blocks.size() - 1]);
 }
 
+char const* if_block_stmt::do_get_type_name() const {
+    return "if_block_stmt";
+}
+
+if_block_stmt::conditions_cont const& if_block_stmt::get_conditions() const {
+    return conditions;
+}
+
+std::vector<block> const& if_block_stmt::get_blocks() const {
+    return blocks;
+}
+
+std::vector<block>& if_block_stmt::get_blocks() {
+    return blocks;
+}
+
+void if_block_stmt::do_accept(statement_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
 do_stmt::do_stmt(std::auto_ptr<numeric_expr> condition, block const& block)
-    : block_statement("do")
+    : block_statement(symbols.intern("do"))
     , condition(condition)
     , body(block)
 {
@@ -220,19 +569,39 @@ void do_stmt::do_execute(interpreter& interpreter) {
     do_iterate(interpreter);
 }
 
+char const* do_stmt::do_get_type_name() const {
+    return "do_stmt";
+}
+
 void do_stmt::do_iterate(interpreter& interpreter) {
     if (condition->evaluate(interpreter).is_true())
         interpreter.enter_block(body, this);
 }
 
+numeric_expr const& do_stmt::get_condition() const {
+    return *condition;
+}
+
+block const& do_stmt::get_body() const {
+    return body;
+}
+
+block& do_stmt::get_body() {
+    return body;
+}
+
+void do_stmt::do_accept(statement_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
 for_stmt::for_stmt(
-    std::string const& variable_name,
+    symbol_id variable_name,
     std::auto_ptr<numeric_expr> initial_value,
     std::auto_ptr<numeric_expr> final_value,
     std::auto_ptr<numeric_expr> step, block const& block
 )
 
-    : block_statement("for")
+    : block_statement(symbols.intern("for"))
     , variable_name(variable_name)
     , initial_expression(initial_value)
     , final_expression(final_value)
@@ -254,6 +623,10 @@ void for_stmt::do_execute(interpreter& interpreter) {
         interpreter.enter_block(body, this);
 }
 
+char const* for_stmt::do_get_type_name() const {
+    return "for_stmt";
+}
+
 void for_stmt::do_iterate(interpreter& interpreter) {
     number iterator_value = interpreter.get_var_numeric(variable_name);
     iterator_value += step;
@@ -264,25 +637,84 @@ void for_stmt::do_iterate(interpreter& interpreter) {
         interpreter.enter_block(body, this);
 }
 
+symbol_id for_stmt::get_variable_name() const {
+    return variable_name;
+}
+
+numeric_expr const& for_stmt::get_initial_value() const {
+    return *initial_expression;
+}
+
+numeric_expr const& for_stmt::get_final_value() const {
+    return *final_expression;
+}
+
+numeric_expr const& for_stmt::get_step() const {
+    return *step_expression;
+}
+
+block const& for_stmt::get_body() const {
+    return body;
+}
+
+block& for_stmt::get_body() {
+    return body;
+}
+
+number for_stmt::get_current_final_value() const {
+    return final_value;
+}
+
+number for_stmt::get_current_step() const {
+    return step;
+}
+
+void for_stmt::set_current_bounds(number final_value, number step) {
+    this->final_value = final_value;
+    this->step = step;
+}
+
+void for_stmt::do_accept(statement_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
 print_stmt::print_stmt(expressions_cont const& expressions)
     : expressions(expressions)
 { }
 
 void print_stmt::do_execute(interpreter& interpreter) {
     expressions_cont::const_iterator expr;
-    for (expr = expressions.begin(); expr != expressions.end(); ++expr)
-        std::cout << (*expr)->get_representation(interpreter);
+    for (expr = expressions.begin(); expr != expressions.end(); ++expr) {
+        std::string const representation = (*expr)->get_representation(interpreter);
+        std::cout << representation;
+        metrics.output_bytes += representation.size();
+    }
     std::cout << '\n';
+    ++metrics.output_bytes;
+}
+
+char const* print_stmt::do_get_type_name() const {
+    return "print_stmt";
+}
+
+print_stmt::expressions_cont const& print_stmt::get_expressions() const {
+    return expressions;
 }
 
-input_stmt::input_stmt(std::string const& var_name)
+void print_stmt::do_accept(statement_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
+input_stmt::input_stmt(symbol_id var_name)
     : var_name(var_name)
 { }
 
 void input_stmt::do_execute(interpreter& interpreter) {
     std::cout << "? ";
+    metrics.output_bytes += 2;
     std::string input_line;
     std::getline(std::cin, input_line);
+    metrics.input_bytes += input_line.size() + (std::cin.eof() ? 0 : 1);
 
     int input;
     std::istringstream is(input_line);
@@ -292,18 +724,30 @@ void input_stmt::do_execute(interpreter& interpreter) {
         throw runtime_error("User input error: expected an integer");
 }
 
-let_stmt::let_stmt(std::string const& var_name, std::auto_ptr<numeric_expr> value)
+char const* input_stmt::do_get_type_name() const {
+    return "input_stmt";
+}
+
+symbol_id input_stmt::get_variable_name() const {
+    return var_name;
+}
+
+void input_stmt::do_accept(statement_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
+let_stmt::let_stmt(symbol_id var_name, std::auto_ptr<numeric_expr> value)
     : var_name(var_name)
     , value_numeric(value)
 {
-    assert(!is_string_identifier(var_name));
+    assert(!is_string_identifier(symbols.get_name(var_name)));
 }
 
-let_stmt::let_stmt(std::string const& var_name, std::auto_ptr<string_expr> value)
+let_stmt::let_stmt(symbol_id var_name, std::auto_ptr<string_expr> value)
     : var_name(var_name)
     , value_string(value)
 {
-    assert(is_string_identifier(var_name));
+    assert(is_string_identifier(symbols.get_name(var_name)));
 }
 
 void let_stmt::do_execute(interpreter& interpreter) {
@@ -314,7 +758,27 @@ void let_stmt::do_execute(interpreter& interpreter) {
     }
 }
 
-goto_stmt::goto_stmt(std::string const& label)
+char const* let_stmt::do_get_type_name() const {
+    return "let_stmt";
+}
+
+symbol_id let_stmt::get_variable_name() const {
+    return var_name;
+}
+
+numeric_expr const* let_stmt::get_numeric_value() const {
+    return value_numeric.get();
+}
+
+string_expr const* let_stmt::get_string_value() const {
+    return value_string.get();
+}
+
+void let_stmt::do_accept(statement_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
+goto_stmt::goto_stmt(symbol_id label)
     : label(label)
 { }
 
@@ -322,13 +786,25 @@ void goto_stmt::do_execute(interpreter& interpreter) {
     interpreter.jump(label);
 }
 
+char const* goto_stmt::do_get_type_name() const {
+    return "goto_stmt";
+}
+
 stop_stmt::stop_stmt() { }
 
 void stop_stmt::do_execute(interpreter& interpreter) {
     interpreter.stop();
 }
 
-exit_stmt::exit_stmt(std::string const& what)
+char const* stop_stmt::do_get_type_name() const {
+    return "stop_stmt";
+}
+
+void stop_stmt::do_accept(statement_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
+exit_stmt::exit_stmt(symbol_id what)
     : what(what)
 { }
 
@@ -336,6 +812,327 @@ void exit_stmt::do_execute(interpreter& interpreter) {
     interpreter.exit_block(what);
 }
 
+char const* exit_stmt::do_get_type_name() const {
+    return "exit_stmt";
+}
+
+symbol_id exit_stmt::get_block_name() const {
+    return what;
+}
+
+void exit_stmt::do_accept(statement_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
+include_stmt::include_stmt(std::string const& path)
+    : path(path)
+{ }
+
+void include_stmt::do_execute(interpreter&) {
+    throw runtime_error("INCLUDE \"" + path + "\" is only allowed at the top level of a program");
+}
+
+char const* include_stmt::do_get_type_name() const {
+    return "include_stmt";
+}
+
+std::string const& include_stmt::get_path() const {
+    return path;
+}
+
+void include_stmt::do_accept(statement_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
 empty_stmt::empty_stmt() { }
 
 void empty_stmt::do_execute(interpreter&) { }
+
+char const* empty_stmt::do_get_type_name() const {
+    return "empty_stmt";
+}
+
+void empty_stmt::do_accept(statement_visitor& visitor) const {
+    visitor.visit(*this);
+}
+
+
+namespace {
+
+// Copies operands before the operations on them, from a stack rather than by recursion.
+class expr_cloner : private expr_visitor {
+public:
+    explicit expr_cloner(expr_substitution* substitution = 0);
+
+    void run(printable_expr const& expr);
+
+    expr_stack<numeric_expr>    numbers;
+    expr_stack<string_expr>     strings;
+
+private:
+    expr_substitution* const substitution;
+    std::vector<std::pair<printable_expr const*, bool> > pending;
+    bool operands_done;
+
+    // If the operands of expr have been copied, return true; otherwise queue them to be, before expr again.
+    bool have_operands(printable_expr const& expr, printable_expr const& left, printable_expr const* right);
+
+    // Push the copy of expr, or what the substitution puts in its place.
+    void push(numeric_expr const& expr, std::auto_ptr<numeric_expr> copy);
+
+    virtual void visit(string_concat_expr const& expr);
+    virtual void visit(string_variable_expr const& expr);
+    virtual void visit(string_literal_expr const& expr);
+    virtual void visit(arith_expr const& expr);
+    virtual void visit(variable_expr const& expr);
+    virtual void visit(constant_expr const& expr);
+    virtual void visit(relational_expr const& expr);
+    virtual void visit(boolean_expr const& expr);
+    virtual void visit(save_expr const& expr);
+    virtual void visit(temporary_expr const& expr);
+};
+
+expr_cloner::expr_cloner(expr_substitution* substitution)
+    : substitution(substitution)
+    , operands_done(false)
+{ }
+
+void expr_cloner::run(printable_expr const& expr) {
+    pending.push_back(std::make_pair(&expr, false));
+    while (!pending.empty()) {
+        printable_expr const* const e = pending.back().first;
+        operands_done = pending.back().second;
+        pending.pop_back();
+
+        if (substitution && !operands_done)
+            if (numeric_expr const* const number = dynamic_cast<numeric_expr const*>(e)) {
+                std::auto_ptr<numeric_expr> replacement = substitution->replace(*number);
+                if (replacement.get()) {
+                    numbers.push(replacement);
+                    continue;
+                }
+            }
+
+        e->accept(*this);
+    }
+}
+
+void expr_cloner::push(numeric_expr const& expr, std::auto_ptr<numeric_expr> copy) {
+    if (substitution)
+        numbers.push(substitution->wrap(expr, copy));
+    else
+        numbers.push(copy);
+}
+
+bool expr_cloner::have_operands(printable_expr const& expr, printable_expr const& left, printable_expr const* right) {
+    if (operands_done)
+        return true;
+
+    pending.push_back(std::make_pair(&expr, true));
+    if (right)
+        pending.push_back(std::make_pair(right, false));
+    pending.push_back(std::make_pair(&left, false));
+    return false;
+}
+
+void expr_cloner::visit(string_concat_expr const& expr) {
+    if (!have_operands(expr, expr.get_left(), &expr.get_right()))
+        return;
+
+    std::auto_ptr<string_expr> right = strings.pop();
+    std::auto_ptr<string_expr> left = strings.pop();
+    strings.push(std::auto_ptr<string_expr>(new string_concat_expr(left, right)));
+}
+
+void expr_cloner::visit(string_variable_expr const& expr) {
+    strings.push(std::auto_ptr<string_expr>(new string_variable_expr(expr.get_name())));
+}
+
+void expr_cloner::visit(string_literal_expr const& expr) {
+    strings.push(std::auto_ptr<string_expr>(new string_literal_expr(expr.get_value())));
+}
+
+void expr_cloner::visit(arith_expr const& expr) {
+    if (!have_operands(expr, expr.get_left_side(), &expr.get_right_side()))
+        return;
+
+    std::auto_ptr<numeric_expr> right = numbers.pop();
+    std::auto_ptr<numeric_expr> left = numbers.pop();
+    std::auto_ptr<arith_expr> copy(new arith_expr(left, right, expr.get_operator()));
+    copy->set_unchecked(expr.is_unchecked());
+    push(expr, std::auto_ptr<numeric_expr>(copy));
+}
+
+void expr_cloner::visit(variable_expr const& expr) {
+    push(expr, std::auto_ptr<numeric_expr>(new variable_expr(expr.get_name())));
+}
+
+void expr_cloner::visit(constant_expr const& expr) {
+    push(expr, std::auto_ptr<numeric_expr>(new constant_expr(expr.get_value())));
+}
+
+void expr_cloner::visit(relational_expr const& expr) {
+    if (!have_operands(expr, expr.get_left_side(), &expr.get_right_side()))
+        return;
+
+    std::auto_ptr<numeric_expr> right = numbers.pop();
+    std::auto_ptr<numeric_expr> left = numbers.pop();
+    push(expr, std::auto_ptr<numeric_expr>(new relational_expr(left, right, expr.get_operator())));
+}
+
+void expr_cloner::visit(boolean_expr const& expr) {
+    if (!have_operands(expr, expr.get_left_side(), expr.get_right_side()))
+        return;
+
+    std::auto_ptr<numeric_expr> right;
+    if (expr.get_right_side())
+        right = numbers.pop();
+    std::auto_ptr<numeric_expr> left = numbers.pop();
+    push(expr, std::auto_ptr<numeric_expr>(new boolean_expr(left, right, expr.get_operator())));
+}
+
+void expr_cloner::visit(save_expr const& expr) {
+    if (!have_operands(expr, expr.get_operand(), 0))
+        return;
+
+    push(expr, std::auto_ptr<numeric_expr>(new save_expr(numbers.pop(), expr.get_slot())));
+}
+
+void expr_cloner::visit(temporary_expr const& expr) {
+    push(expr, std::auto_ptr<numeric_expr>(new temporary_expr(expr.get_slot(), clone(expr.get_original()))));
+}
+
+}
+
+std::auto_ptr<numeric_expr> clone(numeric_expr const& expr) {
+    expr_cloner cloner;
+    cloner.run(expr);
+    return cloner.numbers.pop();
+}
+
+std::auto_ptr<string_expr> clone(string_expr const& expr) {
+    expr_cloner cloner;
+    cloner.run(expr);
+    return cloner.strings.pop();
+}
+
+std::auto_ptr<numeric_expr> clone(numeric_expr const& expr, expr_substitution& substitution) {
+    expr_cloner cloner(&substitution);
+    cloner.run(expr);
+    return cloner.numbers.pop();
+}
+
+std::auto_ptr<string_expr> clone(string_expr const& expr, expr_substitution& substitution) {
+    expr_cloner cloner(&substitution);
+    cloner.run(expr);
+    return cloner.strings.pop();
+}
+
+namespace {
+
+class statement_cloner : private statement_visitor {
+public:
+    explicit statement_cloner(expr_substitution& substitution);
+
+    boost::shared_ptr<statement> run(statement const& s);
+
+private:
+    expr_substitution&              substitution;
+    boost::shared_ptr<statement>    result;
+
+    virtual void visit(if_goto_stmt const& statement);
+    virtual void visit(if_block_stmt const& statement);
+    virtual void visit(do_stmt const& statement);
+    virtual void visit(for_stmt const& statement);
+    virtual void visit(print_stmt const& statement);
+    virtual void visit(input_stmt const& statement);
+    virtual void visit(let_stmt const& statement);
+    virtual void visit(goto_stmt const& statement);
+    virtual void visit(stop_stmt const& statement);
+    virtual void visit(exit_stmt const& statement);
+    virtual void visit(include_stmt const& statement);
+    virtual void visit(empty_stmt const& statement);
+};
+
+statement_cloner::statement_cloner(expr_substitution& substitution)
+    : substitution(substitution)
+{ }
+
+boost::shared_ptr<statement> statement_cloner::run(statement const& s) {
+    s.accept(*this);
+    result->set_location(s.get_location());
+    return result;
+}
+
+void statement_cloner::visit(if_goto_stmt const& statement) {
+    result.reset(new if_goto_stmt(clone(statement.get_condition(), substitution), statement.get_then_label(),
+                                  statement.get_else_label()));
+}
+
+void statement_cloner::visit(if_block_stmt const& statement) {
+    if_block_stmt::conditions_cont conditions;
+    if_block_stmt::conditions_cont::const_iterator c;
+    for (c = statement.get_conditions().begin(); c != statement.get_conditions().end(); ++c)
+        conditions.push_back(boost::shared_ptr<numeric_expr>(clone(**c, substitution).release()));
+    result.reset(new if_block_stmt(conditions, statement.get_blocks()));
+}
+
+void statement_cloner::visit(do_stmt const& statement) {
+    result.reset(new do_stmt(clone(statement.get_condition(), substitution), statement.get_body()));
+}
+
+void statement_cloner::visit(for_stmt const& statement) {
+    result.reset(new for_stmt(statement.get_variable_name(), clone(statement.get_initial_value(), substitution),
+                              clone(statement.get_final_value(), substitution),
+                              clone(statement.get_step(), substitution), statement.get_body()));
+}
+
+void statement_cloner::visit(print_stmt const& statement) {
+    print_stmt::expressions_cont expressions;
+    print_stmt::expressions_cont::const_iterator e;
+    for (e = statement.get_expressions().begin(); e != statement.get_expressions().end(); ++e)
+        if (numeric_expr const* const number = dynamic_cast<numeric_expr const*>(e->get()))
+            expressions.push_back(boost::shared_ptr<printable_expr>(clone(*number, substitution).release()));
+        else
+            expressions.push_back(boost::shared_ptr<printable_expr>(
+                clone(static_cast<string_expr const&>(**e), substitution).release()));
+    result.reset(new print_stmt(expressions));
+}
+
+void statement_cloner::visit(input_stmt const& statement) {
+    result.reset(new input_stmt(statement.get_variable_name()));
+}
+
+void statement_cloner::visit(let_stmt const& statement) {
+    if (statement.get_numeric_value())
+        result.reset(new let_stmt(statement.get_variable_name(), clone(*statement.get_numeric_value(), substitution)));
+    else
+        result.reset(new let_stmt(statement.get_variable_name(), clone(*statement.get_string_value(), substitution)));
+}
+
+void statement_cloner::visit(goto_stmt const& statement) {
+    result.reset(new goto_stmt(statement.get_label()));
+}
+
+void statement_cloner::visit(stop_stmt const&) {
+    result.reset(new stop_stmt);
+}
+
+void statement_cloner::visit(exit_stmt const& statement) {
+    result.reset(new exit_stmt(statement.get_block_name()));
+}
+
+void statement_cloner::visit(include_stmt const& statement) {
+    result.reset(new include_stmt(statement.get_path()));
+}
+
+void statement_cloner::visit(empty_stmt const&) {
+    result.reset(new empty_stmt);
+}
+
+}
+
+boost::shared_ptr<statement> clone(statement const& s, expr_substitution& substitution) {
+    statement_cloner cloner(substitution);
+    return cloner.run(s);
+}
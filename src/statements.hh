@@ -11,30 +11,53 @@
 
 #include "number.hh"
 #include "parser.hh"
+#include "lexer.hh"
+#include "symbols.hh"
 
 struct interpreter;
+class statement_visitor;
+class expr_visitor;
 
 class statement : boost::noncopyable {
 public:
     virtual ~statement() { }
     void execute(interpreter& interpreter);
 
+    // Where in the source the statement begins.  Set by the parser; statements created otherwise have an empty
+    // filename and line 0.
+    source_location const& get_location() const;
+    void set_location(source_location const& location);
+
+    // Name of the node type, such as "print_stmt".  Used to label statements in diagnostic output.
+    char const* get_type_name() const;
+
+    // Call the visitor's visit for the statement's type.
+    void accept(statement_visitor& visitor) const;
+
+protected:
+    statement();
+
 private:
+    source_location location;
+
     virtual void do_execute(interpreter& interpreter) = 0;
+    virtual char const* do_get_type_name() const = 0;
+    virtual void do_accept(statement_visitor& visitor) const = 0;
 };
 
 // Statement with a body, like for, or while.
 class block_statement : public statement {
 public:
-    explicit block_statement(std::string const& name);
+    explicit block_statement(symbol_id name);
 
-    std::string get_name() const;
+    // The keyword that begins the statement, which EXIT uses to name it.
+    symbol_id get_name() const;
 
     // Perform next iteration of the implied block.
     void iterate(interpreter& interpreter);
 
 private:
-    std::string name;
+    symbol_id name;
 
     virtual void do_iterate(interpreter& interpreter) = 0;
 };
@@ -45,8 +68,12 @@ public:
 
     std::string get_representation(interpreter& interpreter) const;
 
+    // Call the visitor's visit for the expression's type.
+    void accept(expr_visitor& visitor) const;
+
 private:
     virtual std::string do_get_representation(interpreter& interpreter) const = 0;
+    virtual void do_accept(expr_visitor& visitor) const = 0;
 };
 
 class string_expr : public printable_expr {
@@ -61,29 +88,45 @@ private:
 class string_concat_expr : public string_expr {
 public:
     string_concat_expr(std::auto_ptr<string_expr> left, std::auto_ptr<string_expr> right);
+    ~string_concat_expr();
+
+    string_expr const& get_left() const;
+    string_expr const& get_right() const;
 
 private:
     virtual std::string do_evaluate(interpreter& interpreter) const;
+    virtual void do_accept(expr_visitor& visitor) const;
 
     std::auto_ptr<string_expr> left, right;
+
+    // Concatenations are left-associative, so long chains of them nest to the left.  These link the left spine both
+    // ways so it can be evaluated and destroyed without recursion.
+    string_concat_expr* left_concat;
+    string_concat_expr const* spine_parent;
 };
 
 class string_variable_expr : public string_expr {
 public:
-    explicit string_variable_expr(std::string const& var_name);
+    explicit string_variable_expr(symbol_id var_name);
+
+    symbol_id get_name() const;
 
 private:
     virtual std::string do_evaluate(interpreter& interpreter) const;
+    virtual void do_accept(expr_visitor& visitor) const;
 
-    std::string var_name;
+    symbol_id var_name;
 };
 
 class string_literal_expr : public string_expr {
 public:
     explicit string_literal_expr(std::string const& value);
 
+    std::string const& get_value() const;
+
 private:
     virtual std::string do_evaluate(interpreter&) const;
+    virtual void do_accept(expr_visitor& visitor) const;
 
     std::string value;
 };
@@ -103,32 +146,54 @@ public:
     enum e_operator { operator_plus, operator_minus, operator_times, operator_divides, operator_modulo };
 
     arith_expr(std::auto_ptr<numeric_expr> left_side, std::auto_ptr<numeric_expr> right_side, e_operator op);
+    ~arith_expr();
 
     number evaluate(interpreter& interpreter) const;
 
+    numeric_expr const& get_left_side() const;
+    numeric_expr const& get_right_side() const;
+    e_operator get_operator() const;
+
+    // Whether the operands are known to be integers, and a divisor not to be zero, so that the operation needn't check;
+    // see number::unchecked_add and the like.  Only the optimizer sets it, where it has proven that.
+    bool is_unchecked() const;
+    void set_unchecked(bool unchecked);
+
 private:
     virtual number do_evaluate(interpreter& interpreter) const;
+    virtual void do_accept(expr_visitor& visitor) const;
 
     std::auto_ptr<numeric_expr> left_side, right_side;
     e_operator op;
+    bool unchecked;
+
+    // Left spine links, like in string_concat_expr: a - b - c - ... nests to the left.
+    arith_expr* left_arith;
+    arith_expr const* spine_parent;
 };
 
 class variable_expr : public numeric_expr {
 public:
-    explicit variable_expr(std::string const& name);
+    explicit variable_expr(symbol_id name);
+
+    symbol_id get_name() const;
 
 private:
     virtual number do_evaluate(interpreter& interpreter) const;
+    virtual void do_accept(expr_visitor& visitor) const;
 
-    std::string const name;
+    symbol_id const name;
 };
 
 class constant_expr : public numeric_expr {
 public:
     explicit constant_expr(number value);
 
+    number const& get_value() const;
+
 private:
     virtual number do_evaluate(interpreter& interpreter) const;
+    virtual void do_accept(expr_visitor& visitor) const;
 
     number const value;
 };
@@ -141,8 +206,13 @@ public:
     };
     relational_expr(std::auto_ptr<numeric_expr> left_side, std::auto_ptr<numeric_expr> right_side, e_operator op);
 
+    numeric_expr const& get_left_side() const;
+    numeric_expr const& get_right_side() const;
+    e_operator get_operator() const;
+
 private:
     virtual number do_evaluate(interpreter&) const;
+    virtual void do_accept(expr_visitor& visitor) const;
 
     std::auto_ptr<numeric_expr> left_side, right_side;
     e_operator op;
@@ -154,27 +224,128 @@ public:
 
     // right_side is null if and only if op == operator_not.
     boolean_expr(std::auto_ptr<numeric_expr> left_side, std::auto_ptr<numeric_expr> right_side, e_operator op);
+    ~boolean_expr();
+
+    numeric_expr const& get_left_side() const;
+    numeric_expr const* get_right_side() const;    // Null for NOT.
+    e_operator get_operator() const;
 
 private:
     virtual number do_evaluate(interpreter& interpreter) const;
+    virtual void do_accept(expr_visitor& visitor) const;
+
+    // Move the operands that are boolean_exprs themselves out to operands.
+    void take_boolean_operands(std::vector<boolean_expr*>& operands);
 
     std::auto_ptr<numeric_expr> left_side, right_side;
     e_operator op;
+
+    // The operands, if they're boolean_exprs too.  NOTs, ANDs and ORs nest on either side, as deeply as a program
+    // nests them, so they're evaluated and destroyed with a stack rather than by recursion.
+    boolean_expr* left_boolean;
+    boolean_expr* right_boolean;
+};
+
+// Works out an expression and keeps its value in one of the interpreter's temporaries, so that temporary_exprs after it
+// can use it rather than work it out again.
+class save_expr : public numeric_expr {
+public:
+    save_expr(std::auto_ptr<numeric_expr> operand, std::size_t slot);
+
+    numeric_expr const& get_operand() const;
+    std::size_t get_slot() const;
+
+private:
+    virtual number do_evaluate(interpreter& interpreter) const;
+    virtual void do_accept(expr_visitor& visitor) const;
+
+    std::auto_ptr<numeric_expr> operand;
+    std::size_t slot;
+};
+
+// The value a save_expr has kept.  original is an expression it's the value of, for tools that write programs out or
+// work on them as written.
+class temporary_expr : public numeric_expr {
+public:
+    temporary_expr(std::size_t slot, std::auto_ptr<numeric_expr> original);
+
+    std::size_t get_slot() const;
+    numeric_expr const& get_original() const;
+
+private:
+    virtual number do_evaluate(interpreter& interpreter) const;
+    virtual void do_accept(expr_visitor& visitor) const;
+
+    std::size_t slot;
+    std::auto_ptr<numeric_expr> original;
 };
 
+// Owns the expressions on a stack of operands, so that they are freed if building an expression fails half-way.
+template <typename ExprT>
+struct expr_stack : boost::noncopyable {
+    std::vector<ExprT*> items;
+
+    ~expr_stack() {
+        for (typename std::vector<ExprT*>::iterator e = items.begin(); e != items.end(); ++e)
+            delete *e;
+    }
+
+    void push(std::auto_ptr<ExprT> expr) {
+        items.push_back(0);  // Make room first, so that a failing push_back can't leak expr.
+        items.back() = expr.release();
+    }
+
+    std::auto_ptr<ExprT> pop() {
+        std::auto_ptr<ExprT> result(items.back());
+        items.pop_back();
+        return result;
+    }
+};
+
+// Decides what goes in place of parts of an expression being copied.
+class expr_substitution {
+public:
+    virtual ~expr_substitution() { }
+
+    // What to put in place of expr rather than a copy of it, or null for a copy.  Its operands aren't looked at then.
+    virtual std::auto_ptr<numeric_expr> replace(numeric_expr const& expr) = 0;
+
+    // What to put in place of copy, the copy of expr made otherwise.
+    virtual std::auto_ptr<numeric_expr> wrap(numeric_expr const& expr, std::auto_ptr<numeric_expr> copy) = 0;
+};
+
+// A copy of an expression, operands and all, for passes that rewrite a program.
+std::auto_ptr<numeric_expr> clone(numeric_expr const& expr);
+std::auto_ptr<string_expr> clone(string_expr const& expr);
+
+// Likewise, but with the numeric expressions in it substituted as substitution decides.
+std::auto_ptr<numeric_expr> clone(numeric_expr const& expr, expr_substitution& substitution);
+std::auto_ptr<string_expr> clone(string_expr const& expr, expr_substitution& substitution);
+
+// A copy of a statement, at the same location, with its numeric expressions copied as substitution decides.  The blocks
+// of the copy share their statements with the original's, like copies of blocks do.
+boost::shared_ptr<statement> clone(statement const& s, expr_substitution& substitution);
+
 // A statement of the form "IF <condition> THEN <label> [ELSE label]"
 class if_goto_stmt : public statement {
 public:
     if_goto_stmt(
         std::auto_ptr<numeric_expr> condition,
-        std::string const& then_label,
-        std::string const& else_label = "");
+        symbol_id then_label,
+        boost::optional<symbol_id> else_label = boost::optional<symbol_id>());
+
+    numeric_expr const& get_condition() const;
+    symbol_id get_then_label() const;
+    boost::optional<symbol_id> const& get_else_label() const;
 
 private:
     virtual void do_execute(interpreter& interpreter);
+    virtual char const* do_get_type_name() const;
+    virtual void do_accept(statement_visitor& visitor) const;
 
     std::auto_ptr<numeric_expr> condition;
-    std::string const then_label, else_label;
+    symbol_id const then_label;
+    boost::optional<symbol_id> const else_label;
 };
 
 // A statement of the form "IF <condition> THEN <block> [ELSEIF <condition> <block> [ ...]] [ELSE <block>]
@@ -188,8 +359,14 @@ public:
     // apropriate block.  blocks[labels.size()], if valid, is the block of the ELSE clause.
     if_block_stmt(conditions_cont const& conditions, std::vector<block> const& blocks);
 
+    conditions_cont const& get_conditions() const;
+    std::vector<block> const& get_blocks() const;
+    std::vector<block>& get_blocks();
+
 private:
     virtual void do_execute(interpreter& interpreter);
+    virtual char const* do_get_type_name() const;
+    virtual void do_accept(statement_visitor& visitor) const;
 
     conditions_cont conditions;
     std::vector<block> blocks;
@@ -199,9 +376,15 @@ class do_stmt : public block_statement {
 public:
     do_stmt(std::auto_ptr<numeric_expr> condition, block const& block);
 
+    numeric_expr const& get_condition() const;
+    block const& get_body() const;
+    block& get_body();
+
 private:
     virtual void do_execute(interpreter& interpreter);
+    virtual char const* do_get_type_name() const;
     virtual void do_iterate(interpreter& interpreter);
+    virtual void do_accept(statement_visitor& visitor) const;
 
     std::auto_ptr<numeric_expr> condition;
     block body;
@@ -210,15 +393,29 @@ private:
 class for_stmt : public block_statement {
 public:
     for_stmt(
-        std::string const& variable_name,
+        symbol_id variable_name,
         std::auto_ptr<numeric_expr> initial_value, std::auto_ptr<numeric_expr> final_value,
         std::auto_ptr<numeric_expr> step, block const& block);
 
+    symbol_id get_variable_name() const;
+    numeric_expr const& get_initial_value() const;
+    numeric_expr const& get_final_value() const;
+    numeric_expr const& get_step() const;
+    block const& get_body() const;
+    block& get_body();
+
+    // The final value and step of the loop being run, as evaluated when it began.
+    number get_current_final_value() const;
+    number get_current_step() const;
+    void set_current_bounds(number final_value, number step);
+
 private:
     virtual void do_execute(interpreter& interpreter);
+    virtual char const* do_get_type_name() const;
     virtual void do_iterate(interpreter& interpreter);
+    virtual void do_accept(statement_visitor& visitor) const;
 
-    std::string const variable_name;
+    symbol_id const variable_name;
     std::auto_ptr<numeric_expr> initial_expression;
     std::auto_ptr<numeric_expr> final_expression;
     std::auto_ptr<numeric_expr> step_expression;
@@ -234,31 +431,47 @@ public:
 
     explicit print_stmt(expressions_cont const& expressions);
 
+    expressions_cont const& get_expressions() const;
+
 private:
     virtual void do_execute(interpreter& interpreter);
+    virtual char const* do_get_type_name() const;
+    virtual void do_accept(statement_visitor& visitor) const;
 
     expressions_cont expressions;
 };
 
 class input_stmt : public statement {
 public:
-    explicit input_stmt(std::string const& var_name);
+    explicit input_stmt(symbol_id var_name);
+
+    symbol_id get_variable_name() const;
 
 private:
     virtual void do_execute(interpreter& interpreter);
+    virtual char const* do_get_type_name() const;
+    virtual void do_accept(statement_visitor& visitor) const;
 
-    std::string const var_name;
+    symbol_id const var_name;
 };
 
 class let_stmt : public statement {
 public:
-    let_stmt(std::string const& var_name, std::auto_ptr<numeric_expr> value);
-    let_stmt(std::string const& var_name, std::auto_ptr<string_expr> value);
+    let_stmt(symbol_id var_name, std::auto_ptr<numeric_expr> value);
+    let_stmt(symbol_id var_name, std::auto_ptr<string_expr> value);
+
+    symbol_id get_variable_name() const;
+
+    // One of these is null.
+    numeric_expr const* get_numeric_value() const;
+    string_expr const* get_string_value() const;
 
 private:
     virtual void do_execute(interpreter& interpreter);
+    virtual char const* do_get_type_name() const;
+    virtual void do_accept(statement_visitor& visitor) const;
 
-    std::string const var_name;
+    symbol_id const var_name;
 
     // One and exactly one of these two shall be null.
     std::auto_ptr<numeric_expr> value_numeric;
@@ -267,12 +480,16 @@ private:
 
 class goto_stmt : public statement {
 public:
-    explicit goto_stmt(std::string const& label);
+    explicit goto_stmt(symbol_id label);
+
+    symbol_id get_label() const;
 
 private:
     virtual void do_execute(interpreter& interpreter);
+    virtual char const* do_get_type_name() const;
+    virtual void do_accept(statement_visitor& visitor) const;
 
-    std::string const label;
+    symbol_id const label;
 };
 
 class stop_stmt : public statement {
@@ -281,16 +498,38 @@ public:
 
 private:
     virtual void do_execute(interpreter& interpreter);
+    virtual void do_accept(statement_visitor& visitor) const;
+    virtual char const* do_get_type_name() const;
 };
 
 class exit_stmt : public statement {
 public:
-    explicit exit_stmt(std::string const& what);
+    explicit exit_stmt(symbol_id what);
+
+    symbol_id get_block_name() const;
 
 private:
     virtual void do_execute(interpreter& interpreter);
+    virtual char const* do_get_type_name() const;
+    virtual void do_accept(statement_visitor& visitor) const;
 
-    std::string const what;
+    symbol_id const what;
+};
+
+// INCLUDE "file".  Linking the program puts the statements of the file in its place; see linker.hh.  Only those at the
+// top level are linked, and running one is an error.
+class include_stmt : public statement {
+public:
+    explicit include_stmt(std::string const& path);
+
+    std::string const& get_path() const;
+
+private:
+    virtual void do_execute(interpreter& interpreter);
+    virtual char const* do_get_type_name() const;
+    virtual void do_accept(statement_visitor& visitor) const;
+
+    std::string const path;
 };
 
 class empty_stmt : public statement {
@@ -299,6 +538,46 @@ public:
 
 private:
     virtual void do_execute(interpreter&);
+    virtual void do_accept(statement_visitor& visitor) const;
+    virtual char const* do_get_type_name() const;
+};
+
+// An operation on statements of every type, such as writing them out.  Statements with blocks don't visit their blocks'
+// statements; the visitor decides whether to.
+class statement_visitor {
+public:
+    virtual ~statement_visitor() { }
+
+    virtual void visit(if_goto_stmt const& statement) = 0;
+    virtual void visit(if_block_stmt const& statement) = 0;
+    virtual void visit(do_stmt const& statement) = 0;
+    virtual void visit(for_stmt const& statement) = 0;
+    virtual void visit(print_stmt const& statement) = 0;
+    virtual void visit(input_stmt const& statement) = 0;
+    virtual void visit(let_stmt const& statement) = 0;
+    virtual void visit(goto_stmt const& statement) = 0;
+    virtual void visit(stop_stmt const& statement) = 0;
+    virtual void visit(exit_stmt const& statement) = 0;
+    virtual void visit(include_stmt const& statement) = 0;
+    virtual void visit(empty_stmt const& statement) = 0;
+};
+
+// An operation on expressions of every type.  Like statement_visitor, it's up to the visitor to go into operands --
+// without recursion, if it's to survive the long operator chains the parser accepts.
+class expr_visitor {
+public:
+    virtual ~expr_visitor() { }
+
+    virtual void visit(string_concat_expr const& expr) = 0;
+    virtual void visit(string_variable_expr const& expr) = 0;
+    virtual void visit(string_literal_expr const& expr) = 0;
+    virtual void visit(arith_expr const& expr) = 0;
+    virtual void visit(variable_expr const& expr) = 0;
+    virtual void visit(constant_expr const& expr) = 0;
+    virtual void visit(relational_expr const& expr) = 0;
+    virtual void visit(boolean_expr const& expr) = 0;
+    virtual void visit(save_expr const& expr) = 0;
+    virtual void visit(temporary_expr const& expr) = 0;
 };
 
 #endif
@@ -0,0 +1,836 @@
+#include <map>
+#include <set>
+#include <vector>
+#include <limits>
+#include <iterator>
+#include <algorithm>
+
+#include <boost/next_prior.hpp>
+
+#include "structurer.hh"
+#include "statements.hh"
+
+namespace {
+
+typedef block::statement_list::iterator iterator;
+
+// What a statement does, as far as the block it's in is concerned.
+struct statement_summary {
+    std::set<symbol_id> targets;        // Labels of the block it may jump to.
+    std::set<symbol_id> assigned;       // Variables it sets in the block itself, rather than in blocks of its own.
+    std::set<symbol_id> read;           // Variables it, or any statement in its blocks, may read.
+    bool                falls_through;  // Whether control may go on to the statement after it.
+    bool                exits_do;       // Whether it may EXIT a DO around it.
+
+    statement_summary() : falls_through(true), exits_do(false) { }
+};
+
+// Summarizes the statements of a block, blocks of their own and all.
+class summarizer : private statement_visitor, private expr_visitor {
+public:
+    explicit summarizer(block const& b);
+
+    statement_summary summarize(statement const& s);
+
+private:
+    block const&                        b;
+    symbol_id const                     do_name;
+    statement_summary                   result;
+    std::vector<block const*>           scopes;     // Blocks of the statement being summarized gone into.
+    std::size_t                         do_depth;   // How many of them are DOs.
+    std::vector<printable_expr const*>  pending;
+
+    bool is_top_level() const { return scopes.empty(); }
+
+    void add_block(block const& body);
+    void add_jump(symbol_id label);
+    void add_reads(printable_expr const& expr);
+
+    virtual void visit(if_goto_stmt const& statement);
+    virtual void visit(if_block_stmt const& statement);
+    virtual void visit(do_stmt const& statement);
+    virtual void visit(for_stmt const& statement);
+    virtual void visit(print_stmt const& statement);
+    virtual void visit(input_stmt const& statement);
+    virtual void visit(let_stmt const& statement);
+    virtual void visit(goto_stmt const& statement);
+    virtual void visit(stop_stmt const& statement);
+    virtual void visit(exit_stmt const& statement);
+    virtual void visit(include_stmt const&) { }
+    virtual void visit(empty_stmt const&) { }
+
+    virtual void visit(string_concat_expr const& expr);
+    virtual void visit(string_variable_expr const& expr);
+    virtual void visit(string_literal_expr const&) { }
+    virtual void visit(arith_expr const& expr);
+    virtual void visit(variable_expr const& expr);
+    virtual void visit(constant_expr const&) { }
+    virtual void visit(relational_expr const& expr);
+    virtual void visit(boolean_expr const& expr);
+    virtual void visit(save_expr const& expr);
+    virtual void visit(temporary_expr const& expr);
+};
+
+summarizer::summarizer(block const& b)
+    : b(b)
+    , do_name(symbols.intern("do"))
+    , do_depth(0)
+{ }
+
+statement_summary summarizer::summarize(statement const& s) {
+    result = statement_summary();
+    s.accept(*this);
+    return result;
+}
+
+void summarizer::add_block(block const& body) {
+    scopes.push_back(&body);
+    for (block::statement_list::const_iterator s = body.statements.begin(); s != body.statements.end(); ++s)
+        (*s)->accept(*this);
+    scopes.pop_back();
+}
+
+void summarizer::add_jump(symbol_id label) {
+    // Jumps look for the label in the innermost block first.
+    for (std::vector<block const*>::const_iterator scope = scopes.begin(); scope != scopes.end(); ++scope)
+        if ((*scope)->jump_table.count(label))
+            return;
+
+    if (b.jump_table.count(label))
+        result.targets.insert(label);
+}
+
+void summarizer::add_reads(printable_expr const& expr) {
+    pending.push_back(&expr);
+    while (!pending.empty()) {
+        printable_expr const* const e = pending.back();
+        pending.pop_back();
+        e->accept(*this);
+    }
+}
+
+void summarizer::visit(if_goto_stmt const& statement) {
+    add_reads(statement.get_condition());
+    add_jump(statement.get_then_label());
+    if (statement.get_else_label()) {
+        add_jump(*statement.get_else_label());
+        if (is_top_level())
+            result.falls_through = false;
+    }
+}
+
+void summarizer::visit(if_block_stmt const& statement) {
+    if_block_stmt::conditions_cont const& conditions = statement.get_conditions();
+    for (if_block_stmt::conditions_cont::const_iterator c = conditions.begin(); c != conditions.end(); ++c)
+        add_reads(**c);
+
+    for (std::vector<block>::const_iterator body = statement.get_blocks().begin(); body != statement.get_blocks().end();
+         ++body)
+        add_block(*body);
+}
+
+void summarizer::visit(do_stmt const& statement) {
+    add_reads(statement.get_condition());
+    ++do_depth;
+    add_block(statement.get_body());
+    --do_depth;
+}
+
+void summarizer::visit(for_stmt const& statement) {
+    // NEXT reads the variable back.
+    result.read.insert(statement.get_variable_name());
+    if (is_top_level())
+        result.assigned.insert(statement.get_variable_name());
+
+    add_reads(statement.get_initial_value());
+    add_reads(statement.get_final_value());
+    add_reads(statement.get_step());
+    add_block(statement.get_body());
+}
+
+void summarizer::visit(print_stmt const& statement) {
+    print_stmt::expressions_cont const& expressions = statement.get_expressions();
+    for (print_stmt::expressions_cont::const_iterator e = expressions.begin(); e != expressions.end(); ++e)
+        add_reads(**e);
+}
+
+void summarizer::visit(input_stmt const& statement) {
+    if (is_top_level())
+        result.assigned.insert(statement.get_variable_name());
+}
+
+void summarizer::visit(let_stmt const& statement) {
+    if (statement.get_numeric_value())
+        add_reads(*statement.get_numeric_value());
+    else
+        add_reads(*statement.get_string_value());
+
+    if (is_top_level())
+        result.assigned.insert(statement.get_variable_name());
+}
+
+void summarizer::visit(goto_stmt const& statement) {
+    add_jump(statement.get_label());
+    if (is_top_level())
+        result.falls_through = false;
+}
+
+void summarizer::visit(stop_stmt const&) {
+    if (is_top_level())
+        result.falls_through = false;
+}
+
+void summarizer::visit(exit_stmt const& statement) {
+    if (statement.get_block_name() == do_name && do_depth == 0)
+        result.exits_do = true;
+    if (is_top_level())
+        result.falls_through = false;
+}
+
+void summarizer::visit(string_concat_expr const& expr) {
+    pending.push_back(&expr.get_right());
+    pending.push_back(&expr.get_left());
+}
+
+void summarizer::visit(string_variable_expr const& expr) {
+    result.read.insert(expr.get_name());
+}
+
+void summarizer::visit(arith_expr const& expr) {
+    pending.push_back(&expr.get_right_side());
+    pending.push_back(&expr.get_left_side());
+}
+
+void summarizer::visit(variable_expr const& expr) {
+    result.read.insert(expr.get_name());
+}
+
+void summarizer::visit(relational_expr const& expr) {
+    pending.push_back(&expr.get_right_side());
+    pending.push_back(&expr.get_left_side());
+}
+
+void summarizer::visit(boolean_expr const& expr) {
+    if (expr.get_right_side())
+        pending.push_back(expr.get_right_side());
+    pending.push_back(&expr.get_left_side());
+}
+
+void summarizer::visit(save_expr const& expr) {
+    pending.push_back(&expr.get_operand());
+}
+
+// A temporary reads what the expression it stands for does.
+void summarizer::visit(temporary_expr const& expr) {
+    pending.push_back(&expr.get_original());
+}
+
+// The opposite of a condition: the complementary comparison, if it's one, as they're exact complements of one another.
+std::auto_ptr<numeric_expr> negate(numeric_expr const& condition) {
+    if (relational_expr const* const comparison = dynamic_cast<relational_expr const*>(&condition)) {
+        relational_expr::e_operator op = relational_expr::operator_equals;
+        switch (comparison->get_operator()) {
+        case relational_expr::operator_equals:          op = relational_expr::operator_doesnt_equal; break;
+        case relational_expr::operator_doesnt_equal:    op = relational_expr::operator_equals; break;
+        case relational_expr::operator_less_than:       op = relational_expr::operator_greater_equal; break;
+        case relational_expr::operator_less_equal:      op = relational_expr::operator_greater_than; break;
+        case relational_expr::operator_greater_than:    op = relational_expr::operator_less_equal; break;
+        case relational_expr::operator_greater_equal:   op = relational_expr::operator_less_than; break;
+        }
+
+        return std::auto_ptr<numeric_expr>(new relational_expr(
+            clone(comparison->get_left_side()), clone(comparison->get_right_side()), op));
+    }
+
+    return std::auto_ptr<numeric_expr>(new boolean_expr(clone(condition), std::auto_ptr<numeric_expr>(),
+                                                        boolean_expr::operator_not));
+}
+
+// Where variables certainly have been set in a block, and where they may still be read, at the beginning of a
+// statement.
+struct flow_facts {
+    std::set<symbol_id> defined;
+    std::set<symbol_id> live;
+};
+
+// Statements rewritten into one.
+struct region {
+    statement const*                front;      // The first of them.
+    std::vector<symbol_id>          labels;     // Labels at the first, which go to the new statement.
+    std::vector<statement const*>   kept;       // Those moved into its blocks.
+    std::vector<statement const*>   removed;    // Those it does the work of.
+};
+
+// Rewrites the jumps of one block.
+class block_structurer : boost::noncopyable {
+public:
+    explicit block_structurer(block& b);
+
+    // With nested, structure the blocks of the statements first.
+    void run(bool nested);
+
+private:
+    block&                                                  b;
+    std::map<statement const*, statement_summary>           summaries;
+    std::map<statement const*, flow_facts>                  facts;
+    std::map<statement const*, std::size_t>                 order;      // Increases along the block.
+    std::map<statement const*, std::vector<symbol_id> >     labels;     // Labels at each statement.
+    std::map<symbol_id, std::set<statement const*> >        sources;    // Statements that may jump to each label.
+
+    // Variables that may have come to be set in blocks that have been made since the facts were worked out, rather
+    // than in this one, so that they're no longer certainly set after them.
+    std::set<symbol_id>                                     forgotten;
+
+    void analyse();
+
+    std::size_t position(iterator s) const;
+    bool is_jumped_to(iterator s) const;
+
+    // Whether the labels of [labelled_first, labelled_last) are only jumped to from [inside_first, inside_last) and
+    // by also.
+    bool is_only_entered_from(iterator labelled_first, iterator labelled_last, iterator inside_first,
+                              iterator inside_last, statement const* also) const;
+
+    // Whether variables set in [first, last), when it's made a block of its own, may be used after it -- or at again,
+    // where control may come back to.  If not, put in relied those that are only safe because they won't be.
+    bool loses_variables(std::set<symbol_id> const& assigned, iterator first, iterator last, iterator again,
+                         std::set<symbol_id>& relied) const;
+
+    // Try rewriting a jump back as a loop, or a jump forward as an IF block.  On success, set s to the statement after
+    // the rewritten ones.
+    bool structure_loop(iterator& s);
+    bool structure_branch(iterator& s);
+
+    // Move the statements [first, last) to the end of into, with their labels.
+    void move(iterator first, iterator last, block& into);
+
+    // Remove a statement.  Its labels go to the end of into, if anything jumps to them.
+    void remove(iterator s, block& into);
+
+    // Put a statement made of a region in place of [first, last), what's left of it, and account for it.
+    iterator replace(iterator first, iterator last, region const& r, statement* made);
+};
+
+block_structurer::block_structurer(block& b)
+    : b(b)
+{ }
+
+void block_structurer::run(bool nested) {
+    if (nested) {
+        for (iterator s = b.statements.begin(); s != b.statements.end(); ++s) {
+            if (if_block_stmt* const if_block = dynamic_cast<if_block_stmt*>(s->get())) {
+                std::vector<block>& blocks = if_block->get_blocks();
+                for (std::vector<block>::iterator body = blocks.begin(); body != blocks.end(); ++body)
+                    block_structurer(*body).run(true);
+            } else if (do_stmt* const loop = dynamic_cast<do_stmt*>(s->get()))
+                block_structurer(loop->get_body()).run(true);
+            else if (for_stmt* const loop = dynamic_cast<for_stmt*>(s->get()))
+                block_structurer(loop->get_body()).run(true);
+        }
+    }
+
+    if (b.jump_table.empty())
+        return;
+
+    analyse();
+
+    // Loops first, so that their exit tests aren't taken for branches.  Every rewrite takes a jump away, and may let
+    // another one be rewritten.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (iterator s = b.statements.begin(); s != b.statements.end(); )
+            if (structure_loop(s))
+                changed = true;
+            else
+                ++s;
+
+        for (iterator s = b.statements.begin(); s != b.statements.end(); )
+            if (structure_branch(s))
+                changed = true;
+            else
+                ++s;
+    }
+}
+
+void block_structurer::analyse() {
+    std::vector<statement const*> nodes;
+    std::vector<statement_summary const*> node_summaries;
+    summarizer summary_of(b);
+    for (iterator s = b.statements.begin(); s != b.statements.end(); ++s) {
+        order[s->get()] = nodes.size() * 2;  // Room for a statement in between.
+        statement_summary& summary = summaries[s->get()];
+        summary = summary_of.summarize(**s);
+        nodes.push_back(s->get());
+        node_summaries.push_back(&summary);
+    }
+
+    for (block::jump_table_t::const_iterator label = b.jump_table.begin(); label != b.jump_table.end(); ++label)
+        if (label->second != b.statements.end())
+            labels[label->second->get()].push_back(label->first);
+
+    // Successors of each statement by index; nodes.size() stands for the end of the block, and for anywhere outside it.
+    std::size_t const end = nodes.size();
+    std::vector<std::vector<std::size_t> > successors(end);
+    for (std::size_t i = 0; i < end; ++i) {
+        statement_summary const& summary = *node_summaries[i];
+        for (std::set<symbol_id>::const_iterator l = summary.targets.begin(); l != summary.targets.end(); ++l) {
+            sources[*l].insert(nodes[i]);
+            iterator const target = b.jump_table[*l];
+            successors[i].push_back(target == b.statements.end() ? end : order[target->get()] / 2);
+        }
+        if (summary.falls_through)
+            successors[i].push_back(i + 1);
+    }
+
+    // Variables certainly set, forwards from the beginning of the block, where nothing is.  Those in outer blocks may
+    // be, but that isn't known here.
+    std::vector<std::set<symbol_id> > defined(end);
+    std::vector<bool> reached(end, false);
+    if (end)
+        reached[0] = true;
+
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (std::size_t i = 0; i < end; ++i) {
+            if (!reached[i])
+                continue;
+
+            std::set<symbol_id> out = defined[i];
+            std::set<symbol_id> const& assigned = node_summaries[i]->assigned;
+            out.insert(assigned.begin(), assigned.end());
+
+            for (std::vector<std::size_t>::const_iterator s = successors[i].begin(); s != successors[i].end(); ++s) {
+                if (*s == end)
+                    continue;
+
+                if (!reached[*s]) {
+                    reached[*s] = true;
+                    defined[*s] = out;
+                    changed = true;
+                } else if (!std::includes(out.begin(), out.end(), defined[*s].begin(), defined[*s].end())) {
+                    std::set<symbol_id> both;
+                    std::set_intersection(defined[*s].begin(), defined[*s].end(), out.begin(), out.end(),
+                                          std::inserter(both, both.begin()));
+                    defined[*s].swap(both);
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // Variables that may be read before they're set again, backwards from the end of the block, where the variables
+    // set in it are gone.
+    std::vector<std::set<symbol_id> > live(end);
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (std::size_t i = end; i-- > 0; ) {
+            statement_summary const& summary = *node_summaries[i];
+
+            std::set<symbol_id> after;
+            for (std::vector<std::size_t>::const_iterator s = successors[i].begin(); s != successors[i].end(); ++s)
+                if (*s != end)
+                    after.insert(live[*s].begin(), live[*s].end());
+            for (std::set<symbol_id>::const_iterator v = summary.assigned.begin(); v != summary.assigned.end(); ++v)
+                after.erase(*v);
+            after.insert(summary.read.begin(), summary.read.end());
+
+            if (after.size() != live[i].size()) {
+                live[i].swap(after);
+                changed = true;
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i < end; ++i) {
+        flow_facts& f = facts[nodes[i]];
+        f.defined.swap(defined[i]);
+        f.live.swap(live[i]);
+    }
+}
+
+std::size_t block_structurer::position(iterator s) const {
+    if (s == b.statements.end())
+        return std::numeric_limits<std::size_t>::max();
+    return order.find(s->get())->second;
+}
+
+bool block_structurer::is_jumped_to(iterator s) const {
+    std::map<statement const*, std::vector<symbol_id> >::const_iterator const at = labels.find(s->get());
+    if (at == labels.end())
+        return false;
+
+    for (std::vector<symbol_id>::const_iterator l = at->second.begin(); l != at->second.end(); ++l) {
+        std::map<symbol_id, std::set<statement const*> >::const_iterator const from = sources.find(*l);
+        if (from != sources.end() && !from->second.empty())
+            return true;
+    }
+    return false;
+}
+
+bool block_structurer::is_only_entered_from(iterator labelled_first, iterator labelled_last, iterator inside_first,
+                                             iterator inside_last, statement const* also) const {
+    std::size_t const first = position(inside_first);
+    std::size_t const last = position(inside_last);
+
+    for (iterator s = labelled_first; s != labelled_last; ++s) {
+        std::map<statement const*, std::vector<symbol_id> >::const_iterator const at = labels.find(s->get());
+        if (at == labels.end())
+            continue;
+
+        for (std::vector<symbol_id>::const_iterator l = at->second.begin(); l != at->second.end(); ++l) {
+            std::map<symbol_id, std::set<statement const*> >::const_iterator const from = sources.find(*l);
+            if (from == sources.end())
+                continue;
+
+            for (std::set<statement const*>::const_iterator source = from->second.begin();
+                 source != from->second.end(); ++source) {
+                std::size_t const p = order.find(*source)->second;
+                if (*source != also && (p < first || p >= last))
+                    return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool block_structurer::loses_variables(std::set<symbol_id> const& assigned, iterator first, iterator last,
+                                       iterator again, std::set<symbol_id>& relied) const {
+    if (assigned.empty())
+        return false;
+
+    // Where control may go on to once out of the region, and what may be read there.  Jumping back to its first
+    // statement counts: an IF stays outside the blocks made of what follows it, and a loop's head is again anyway.
+    std::vector<iterator> exits(1, again);
+    for (iterator s = first; s != last; ++s) {
+        statement_summary const& summary = summaries.find(s->get())->second;
+        for (std::set<symbol_id>::const_iterator l = summary.targets.begin(); l != summary.targets.end(); ++l) {
+            iterator const target = b.jump_table.find(*l)->second;
+            if (position(target) <= position(first) || position(target) >= position(last))
+                exits.push_back(target);
+        }
+    }
+    if (summaries.find(boost::prior(last)->get())->second.falls_through)
+        exits.push_back(last);
+
+    std::set<symbol_id> live;
+    for (std::vector<iterator>::const_iterator e = exits.begin(); e != exits.end(); ++e) {
+        if (*e == b.statements.end())
+            continue;  // What's set in the block is gone after it.
+
+        std::map<statement const*, flow_facts>::const_iterator const at = facts.find((*e)->get());
+        if (at == facts.end())
+            return true;
+        live.insert(at->second.live.begin(), at->second.live.end());
+    }
+
+    std::map<statement const*, flow_facts>::const_iterator const before = facts.find(first->get());
+    for (std::set<symbol_id>::const_iterator v = assigned.begin(); v != assigned.end(); ++v) {
+        if (before != facts.end() && before->second.defined.count(*v) && !forgotten.count(*v))
+            continue;   // It's set in this block already, and stays so.
+        if (live.count(*v))
+            return true;
+        relied.insert(*v);
+    }
+
+    return false;
+}
+
+bool block_structurer::structure_loop(iterator& s) {
+    iterator const jump = s;
+    symbol_id label;
+    numeric_expr const* bottom_test = 0;
+
+    if (goto_stmt const* const g = dynamic_cast<goto_stmt const*>(jump->get()))
+        label = g->get_label();
+    else if (if_goto_stmt const* const branch = dynamic_cast<if_goto_stmt const*>(jump->get())) {
+        if (branch->get_else_label())
+            return false;
+        label = branch->get_then_label();
+        bottom_test = &branch->get_condition();
+    } else
+        return false;
+
+    block::jump_table_t::const_iterator const header_label = b.jump_table.find(label);
+    if (header_label == b.jump_table.end() || position(header_label->second) > position(jump))
+        return false;
+
+    iterator const header = header_label->second;
+    iterator const after = boost::next(jump);
+
+    // Only the header may be jumped to from outside, and a DO around the statements mustn't catch their EXIT DOs.
+    if (!is_only_entered_from(boost::next(header), after, header, after, 0))
+        return false;
+    for (iterator i = header; i != after; ++i)
+        if (summaries[i->get()].exits_do)
+            return false;
+
+    // A loop that begins by jumping out of it unless a condition holds is a DO WHILE of that condition.
+    if_goto_stmt const* top_test = 0;
+    iterator exit_target = b.statements.end();
+    if (!bottom_test && header != jump) {
+        top_test = dynamic_cast<if_goto_stmt const*>(header->get());
+        if (top_test && top_test->get_else_label())
+            top_test = 0;
+        if (top_test) {
+            block::jump_table_t::const_iterator const target = b.jump_table.find(top_test->get_then_label());
+            if (target != b.jump_table.end()) {
+                exit_target = target->second;
+                if (position(exit_target) >= position(header) && position(exit_target) < position(after))
+                    top_test = 0;
+            }
+        }
+    }
+
+    std::set<symbol_id> assigned;
+    region r;
+    r.front = header->get();
+    for (iterator i = header; i != after; ++i) {
+        assigned.insert(summaries[i->get()].assigned.begin(), summaries[i->get()].assigned.end());
+        (i == jump || (top_test && i == header) ? r.removed : r.kept).push_back(i->get());
+    }
+
+    // Every time round, the body's variables are made anew.
+    std::set<symbol_id> relied;
+    if (loses_variables(assigned, header, after, header, relied))
+        return false;
+
+    std::auto_ptr<numeric_expr> condition(top_test ? negate(top_test->get_condition())
+                                                   : std::auto_ptr<numeric_expr>(new constant_expr(1)));
+    symbol_id const exit_label = top_test ? top_test->get_then_label() : label;
+    bool const goto_exit = top_test && (exit_target != after || !b.jump_table.count(exit_label));
+    do_stmt* const loop = new do_stmt(condition, block());
+    loop->set_location((*header)->get_location());
+
+    // The header's labels stay out here, with the loop.
+    r.labels.swap(labels[header->get()]);
+    labels.erase(header->get());
+
+    block& body = loop->get_body();
+    move(top_test ? boost::next(header) : header, jump, body);
+    if (bottom_test) {
+        // Go round again if the condition holds, which is what jumps to the test did too.
+        if_block_stmt::conditions_cont const conditions(1, boost::shared_ptr<numeric_expr>(negate(*bottom_test)));
+        block exit;
+        exit.statements.push_back(boost::shared_ptr<statement>(new exit_stmt(symbols.intern("do"))));
+        exit.statements.back()->set_location((*jump)->get_location());
+        body.statements.push_back(boost::shared_ptr<statement>(
+            new if_block_stmt(conditions, std::vector<block>(1, exit))));
+        body.statements.back()->set_location((*jump)->get_location());
+
+        std::vector<symbol_id> const& test_labels = labels[jump->get()];
+        for (std::vector<symbol_id>::const_iterator l = test_labels.begin(); l != test_labels.end(); ++l) {
+            b.jump_table.erase(*l);
+            body.jump_table[*l] = boost::prior(body.statements.end());
+        }
+        labels.erase(jump->get());
+        b.statements.erase(jump);
+    } else
+        remove(jump, body);
+
+    iterator const made = replace(top_test ? header : after, after, r, loop);
+    s = boost::next(made);
+
+    if (goto_exit) {
+        // The loop ends where the jump out of it went.
+        iterator const jump_out = b.statements.insert(s, boost::shared_ptr<statement>(new goto_stmt(exit_label)));
+        (*jump_out)->set_location((*made)->get_location());
+        order[jump_out->get()] = order[made->get()] + 1;
+
+        statement_summary& summary = summaries[jump_out->get()];
+        flow_facts& jump_out_facts = facts[jump_out->get()];
+        summary.falls_through = false;
+        if (b.jump_table.count(exit_label)) {
+            summary.targets.insert(exit_label);
+            sources[exit_label].insert(jump_out->get());
+            if (exit_target != b.statements.end())
+                jump_out_facts.live = facts[exit_target->get()].live;
+        }
+    }
+
+    forgotten.insert(relied.begin(), relied.end());
+    block_structurer(body).run(false);
+    return true;
+}
+
+bool block_structurer::structure_branch(iterator& s) {
+    iterator const branch = s;
+    if_goto_stmt const* const test = dynamic_cast<if_goto_stmt const*>(branch->get());
+    if (!test || test->get_else_label())
+        return false;
+
+    block::jump_table_t::const_iterator const target_label = b.jump_table.find(test->get_then_label());
+    if (target_label == b.jump_table.end())
+        return false;
+
+    iterator const skipped_first = boost::next(branch);
+    iterator const target = target_label->second;
+    if (position(target) <= position(skipped_first))
+        return false;
+
+    // The statements jumped over must only be jumped to from among themselves.
+    if (!is_only_entered_from(skipped_first, target, skipped_first, target, 0))
+        return false;
+
+    region r;
+    r.front = branch->get();
+    r.removed.push_back(branch->get());
+    std::set<symbol_id> assigned;
+    for (iterator i = skipped_first; i != target; ++i) {
+        assigned.insert(summaries[i->get()].assigned.begin(), summaries[i->get()].assigned.end());
+        r.kept.push_back(i->get());
+    }
+
+    std::set<symbol_id> relied;
+    iterator const skipped_last = boost::prior(target);
+    if (!summaries[skipped_last->get()].falls_through && target != b.statements.end()) {
+        // The skipped statements jump away at their end, so what the branch jumps to may be an ELSE to them: the
+        // statements from the target to the next one jumped to from anywhere, if they're only jumped into from among
+        // themselves or by the branch.
+        iterator join = boost::next(target);
+        while (join != b.statements.end() && !is_jumped_to(join))
+            ++join;
+
+        std::set<symbol_id> both = assigned;
+        for (iterator i = target; i != join; ++i)
+            both.insert(summaries[i->get()].assigned.begin(), summaries[i->get()].assigned.end());
+
+        if (is_only_entered_from(target, join, target, join, branch->get())
+            && !loses_variables(both, branch, join, b.statements.end(), relied)) {
+            // A jump at the end of the skipped statements to where the IF block ends anyway is taken by it.
+            goto_stmt const* const jump = dynamic_cast<goto_stmt const*>(skipped_last->get());
+            bool const drop_jump = jump && b.jump_table.count(jump->get_label())
+                                   && b.jump_table[jump->get_label()] == join;
+            if (drop_jump) {
+                r.kept.pop_back();
+                r.removed.push_back(jump);
+            }
+            for (iterator i = target; i != join; ++i)
+                r.kept.push_back(i->get());
+
+            if_block_stmt::conditions_cont const conditions(1, boost::shared_ptr<numeric_expr>(
+                clone(test->get_condition())));
+            if_block_stmt* const if_block = new if_block_stmt(conditions, std::vector<block>(2));
+            if_block->set_location((*branch)->get_location());
+
+            std::vector<block>& blocks = if_block->get_blocks();
+            move(skipped_first, drop_jump ? skipped_last : target, blocks[1]);
+            if (drop_jump)
+                remove(skipped_last, blocks[1]);
+            move(target, join, blocks[0]);
+
+            r.labels.swap(labels[branch->get()]);
+            labels.erase(branch->get());
+            s = boost::next(replace(branch, boost::next(branch), r, if_block));
+
+            forgotten.insert(relied.begin(), relied.end());
+            block_structurer(blocks[0]).run(false);
+            block_structurer(blocks[1]).run(false);
+            return true;
+        }
+
+        relied.clear();
+    }
+
+    // Otherwise the jumped over statements are done unless the condition holds.
+    if (loses_variables(assigned, branch, target, b.statements.end(), relied))
+        return false;
+
+    if_block_stmt::conditions_cont const conditions(1, boost::shared_ptr<numeric_expr>(
+        negate(test->get_condition())));
+    if_block_stmt* const if_block = new if_block_stmt(conditions, std::vector<block>(1));
+    if_block->set_location((*branch)->get_location());
+    move(skipped_first, target, if_block->get_blocks()[0]);
+
+    r.labels.swap(labels[branch->get()]);
+    labels.erase(branch->get());
+    s = boost::next(replace(branch, boost::next(branch), r, if_block));
+
+    forgotten.insert(relied.begin(), relied.end());
+    block_structurer(if_block->get_blocks()[0]).run(false);
+    return true;
+}
+
+void block_structurer::move(iterator first, iterator last, block& into) {
+    for (iterator s = first; s != last; ++s) {
+        std::map<statement const*, std::vector<symbol_id> >::iterator const at = labels.find(s->get());
+        if (at == labels.end())
+            continue;
+
+        for (std::vector<symbol_id>::const_iterator l = at->second.begin(); l != at->second.end(); ++l) {
+            b.jump_table.erase(*l);
+            into.jump_table.insert(std::make_pair(*l, s));    // Splicing leaves s pointing at the statement.
+        }
+        labels.erase(at);
+    }
+
+    into.statements.splice(into.statements.end(), b.statements, first, last);
+}
+
+void block_structurer::remove(iterator s, block& into) {
+    std::map<statement const*, std::vector<symbol_id> >::iterator const at = labels.find(s->get());
+    if (at != labels.end()) {
+        if (is_jumped_to(s)) {
+            // A label can't point past the end of a block that may be copied, so it gets a statement to point at.
+            into.statements.push_back(boost::shared_ptr<statement>(new empty_stmt));
+            into.statements.back()->set_location((*s)->get_location());
+            for (std::vector<symbol_id>::const_iterator l = at->second.begin(); l != at->second.end(); ++l)
+                into.jump_table[*l] = boost::prior(into.statements.end());
+        }
+
+        for (std::vector<symbol_id>::const_iterator l = at->second.begin(); l != at->second.end(); ++l)
+            b.jump_table.erase(*l);
+        labels.erase(at);
+    }
+
+    b.statements.erase(s);
+}
+
+iterator block_structurer::replace(iterator first, iterator last, region const& r, statement* made) {
+    iterator const result = b.statements.insert(first, boost::shared_ptr<statement>(made));
+    b.statements.erase(first, last);
+    for (std::vector<symbol_id>::const_iterator l = r.labels.begin(); l != r.labels.end(); ++l)
+        b.jump_table[*l] = result;
+    if (!r.labels.empty())
+        labels[made] = r.labels;
+
+    order[made] = order[r.front];
+    facts[made] = facts[r.front];
+
+    // The new statement jumps wherever the statements in its blocks jumped to out of them.
+    statement_summary& summary = summaries[made];
+    for (std::vector<statement const*>::const_iterator k = r.kept.begin(); k != r.kept.end(); ++k) {
+        statement_summary const& old = summaries[*k];
+        for (std::set<symbol_id>::const_iterator l = old.targets.begin(); l != old.targets.end(); ++l) {
+            sources[*l].erase(*k);
+            if (b.jump_table.count(*l)) {
+                sources[*l].insert(made);
+                summary.targets.insert(*l);
+            }
+        }
+        summary.read.insert(old.read.begin(), old.read.end());
+        summary.exits_do = summary.exits_do || old.exits_do;
+    }
+
+    // The statements that are gone could be read from as well.
+    for (std::vector<statement const*>::const_iterator d = r.removed.begin(); d != r.removed.end(); ++d) {
+        statement_summary const& old = summaries[*d];
+        for (std::set<symbol_id>::const_iterator l = old.targets.begin(); l != old.targets.end(); ++l)
+            sources[*l].erase(*d);
+        summary.read.insert(old.read.begin(), old.read.end());
+    }
+
+    for (std::vector<statement const*>::const_iterator k = r.kept.begin(); k != r.kept.end(); ++k)
+        summaries.erase(*k), order.erase(*k), facts.erase(*k);
+    for (std::vector<statement const*>::const_iterator d = r.removed.begin(); d != r.removed.end(); ++d)
+        summaries.erase(*d), order.erase(*d), facts.erase(*d);
+
+    return result;
+}
+
+}
+
+void structure_jumps(block& program) {
+    block_structurer(program).run(true);
+}
@@ -0,0 +1,20 @@
+#ifndef STRUCTURER_HH
+#define STRUCTURER_HH
+
+#include "parser.hh"
+
+// Rewrite loops and branches made of jumps into DO and IF blocks, in every block of a wholly parsed program:
+//
+//  - A backward GOTO, or IF ... THEN to a label before it, and the statements from the label to it become a DO.  If
+//    the loop begins with an IF ... THEN out of it, that's the DO's condition; otherwise the DO runs until one of the
+//    jumps out of it is taken, or the conditional jump back fails, which becomes an EXIT DO.
+//  - An IF ... THEN forward over some statements becomes an IF block around them.  If they end with a jump, and the
+//    statements jumped to run only after the IF ... THEN, those become the IF block's THEN clause and the skipped ones
+//    its ELSE.
+//
+// Only regions that are entered at their first statement are rewritten, so irreducible flow stays as jumps.  So do
+// regions that set variables that would no longer outlive them, now that they are blocks of their own: ones that may
+// not have been set before and may be read after.
+void structure_jumps(block& program);
+
+#endif
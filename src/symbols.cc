@@ -0,0 +1,134 @@
+#include <cassert>
+#include <cctype>
+
+#include "symbols.hh"
+
+symbol_table symbols;
+
+namespace {
+
+std::size_t const INITIAL_SLOTS = 256;  // Power of two.
+
+char to_lower(char c) {
+    return static_cast<char>(tolower(static_cast<unsigned char>(c)));
+}
+
+// FNV-1a of the lowercase name.
+boost::uint32_t hash(char const* begin, char const* end) {
+    boost::uint32_t result = 2166136261u;
+    for (char const* c = begin; c != end; ++c) {
+        result ^= static_cast<unsigned char>(to_lower(*c));
+        result *= 16777619u;
+    }
+    return result;
+}
+
+bool equals_lowercase(char const* begin, char const* end, std::string const& lowercase) {
+    if (static_cast<std::size_t>(end - begin) != lowercase.size())
+        return false;
+
+    for (std::size_t i = 0; begin != end; ++begin, ++i)
+        if (to_lower(*begin) != lowercase[i])
+            return false;
+
+    return true;
+}
+
+}
+
+symbol_table_frozen::symbol_table_frozen(std::string const& name)
+    : std::logic_error("Symbol " + name + " interned while the symbol table is frozen")
+{ }
+
+symbol_table::symbol_table()
+    : slots(INITIAL_SLOTS)
+    , frozen(false)
+{
+    pthread_mutex_init(&mutex, 0);
+}
+
+symbol_table::~symbol_table() {
+    pthread_mutex_destroy(&mutex);
+}
+
+symbol_id symbol_table::intern(char const* begin, char const* end) {
+    std::size_t const mask = slots.size() - 1;
+
+    std::size_t slot = hash(begin, end) & mask;
+    while (slots[slot] != 0) {
+        if (equals_lowercase(begin, end, names[slots[slot] - 1]))
+            return slots[slot] - 1;
+        slot = (slot + 1) & mask;
+    }
+
+    if (frozen)
+        throw symbol_table_frozen(std::string(begin, end));
+
+    pthread_mutex_lock(&mutex);
+    symbol_id const symbol = add(begin, end, slot);
+    pthread_mutex_unlock(&mutex);
+    return symbol;
+}
+
+// Add the name [begin, end), which isn't in the table, at the empty slot it hashes to.
+symbol_id symbol_table::add(char const* begin, char const* end, std::size_t slot) {
+    symbol_id const symbol = static_cast<symbol_id>(names.size());
+    names.push_back(std::string(begin, end));
+    for (std::string::iterator c = names.back().begin(); c != names.back().end(); ++c)
+        *c = to_lower(*c);
+    slots[slot] = symbol + 1;
+
+    // Keep the table at most half full.
+    if (names.size() * 2 > slots.size())
+        grow();
+
+    return symbol;
+}
+
+symbol_id symbol_table::intern(std::string const& name) {
+    return intern(name.data(), name.data() + name.size());
+}
+
+std::string const& symbol_table::get_name(symbol_id symbol) const {
+    assert(symbol < names.size());
+    return names[symbol];
+}
+
+std::size_t symbol_table::size() const {
+    return names.size();
+}
+
+void symbol_table::freeze() {
+    assert(!frozen);
+    frozen = true;
+}
+
+void symbol_table::thaw() {
+    assert(frozen);
+    frozen = false;
+}
+
+symbol_table::freezer::freezer(symbol_table& table)
+    : table(table)
+{
+    table.freeze();
+}
+
+symbol_table::freezer::~freezer() {
+    table.thaw();
+}
+
+void symbol_table::grow() {
+    std::vector<symbol_id> new_slots(slots.size() * 2);
+    std::size_t const mask = new_slots.size() - 1;
+
+    for (symbol_id symbol = 0; symbol < names.size(); ++symbol) {
+        std::string const& name = names[symbol];
+        std::size_t slot = hash(name.data(), name.data() + name.size()) & mask;
+        while (new_slots[slot] != 0)
+            slot = (slot + 1) & mask;
+        new_slots[slot] = symbol + 1;
+    }
+
+    slots.swap(new_slots);
+}
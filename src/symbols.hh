@@ -0,0 +1,66 @@
+#ifndef SYMBOLS_HH
+#define SYMBOLS_HH
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+#include <boost/cstdint.hpp>
+#include <boost/utility.hpp>
+
+// Identifiers and labels are interned: each distinct name gets a small integer, and the parser and the interpreter
+// compare those instead of strings.
+typedef boost::uint32_t symbol_id;
+
+// Thrown when a new name is interned while the table is frozen.
+class symbol_table_frozen : public std::logic_error {
+public:
+    explicit symbol_table_frozen(std::string const& name);
+};
+
+class symbol_table : boost::noncopyable {
+public:
+    symbol_table();
+    ~symbol_table();
+
+    // Return the symbol of the name [begin, end), adding it if it's new.  Names are case-insensitive.  While the table
+    // is frozen, only names already in it may be interned; a new one makes this throw symbol_table_frozen.
+    symbol_id intern(char const* begin, char const* end);
+    symbol_id intern(std::string const& name);
+
+    // The name of a symbol, in lowercase.
+    std::string const& get_name(symbol_id symbol) const;
+
+    std::size_t size() const;
+
+    // Freeze the table while several threads intern at once: it's only looked up then, so needs no locking.  Adding
+    // symbols is locked too, but that doesn't make looking them up while another thread adds one safe.
+    void freeze();
+    void thaw();
+
+    // Freezes a table for as long as it lives.
+    class freezer : boost::noncopyable {
+    public:
+        explicit freezer(symbol_table& table);
+        ~freezer();
+
+    private:
+        symbol_table& table;
+    };
+
+private:
+    std::vector<std::string>    names;
+    std::vector<symbol_id>      slots;  // Open-addressed hash table of symbol + 1, or 0 for an empty slot.
+    bool                        frozen;
+    pthread_mutex_t             mutex;  // Held while adding a symbol.
+
+    symbol_id add(char const* begin, char const* end, std::size_t slot);
+    void grow();
+};
+
+// The symbols of the program.
+extern symbol_table symbols;
+
+#endif
@@ -0,0 +1,21 @@
+#include <time.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "timer.hh"
+
+boost::uint64_t read_ticks() {
+#if defined(__i386__) || defined(__x86_64__)
+    return __rdtsc();
+#else
+    return read_nanoseconds();
+#endif
+}
+
+boost::uint64_t read_nanoseconds() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<boost::uint64_t>(now.tv_sec) * 1000000000u + now.tv_nsec;
+}
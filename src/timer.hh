@@ -0,0 +1,13 @@
+#ifndef TIMER_HH
+#define TIMER_HH
+
+#include <boost/cstdint.hpp>
+
+// Cheap, monotonically increasing tick counter for measuring short intervals.  On x86 this is the time-stamp counter,
+// elsewhere it's nanoseconds from the monotonic clock -- either way only differences are meaningful.
+boost::uint64_t read_ticks();
+
+// Nanoseconds from the monotonic clock.
+boost::uint64_t read_nanoseconds();
+
+#endif
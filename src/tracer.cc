@@ -0,0 +1,152 @@
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
+
+#include "tracer.hh"
+#include "statements.hh"
+#include "timer.hh"
+
+namespace {
+
+// Write s as the contents of a JSON string.
+void write_json_string(std::ostream& os, std::string const& s) {
+    for (std::string::const_iterator c = s.begin(); c != s.end(); ++c) {
+        switch (*c) {
+        case '"':   os << "\\\""; break;
+        case '\\':  os << "\\\\"; break;
+        case '\n':  os << "\\n"; break;
+        case '\t':  os << "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(*c) < 0x20) {
+                os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(*c)
+                   << std::dec << std::setfill(' ');
+            } else
+                os << *c;
+        }
+    }
+}
+
+std::string describe(statement const* statement) {
+    if (!statement)
+        return "program";
+
+    std::ostringstream os;
+    os << statement->get_type_name() << ' ' << statement->get_location().filename << ':'
+       << statement->get_location().line;
+    return os.str();
+}
+
+}
+
+tracer::tracer(std::size_t capacity)
+    : events(capacity ? capacity : 1)
+    , next(0)
+    , wrapped(false)
+    , overwritten(0)
+    , current_statement(0)
+    , statement_start(0)
+    , origin(read_nanoseconds())
+{ }
+
+void tracer::before_statement(interpreter&, statement& statement) {
+    current_statement = &statement;
+    statement_start = read_nanoseconds();
+}
+
+void tracer::after_statement(interpreter&, statement& statement) {
+    e_event type;
+    if (dynamic_cast<print_stmt*>(&statement))
+        type = event_print;
+    else if (dynamic_cast<input_stmt*>(&statement))
+        type = event_input;
+    else
+        return;
+
+    boost::uint64_t const start = statement_start;
+    event& e = record(type, &statement);
+    e.duration = e.timestamp - start;
+    e.timestamp = start;
+}
+
+void tracer::entered_block(interpreter&, block&, block_statement* statement) {
+    // IF blocks have no statement of their own, but it's the IF that's being executed as they are entered.
+    record(event_enter, statement ? statement : current_statement);
+}
+
+void tracer::exited_block(interpreter&, block&) {
+    record(event_exit, 0);
+}
+
+void tracer::jumped(interpreter&, symbol_id label) {
+    record(event_jump, current_statement).label = label;
+}
+
+void tracer::write_chrome_json(std::ostream& os) const {
+    long const pid = getpid();
+    std::size_t const count = wrapped ? events.size() : next;
+    std::size_t const first = wrapped ? next : 0;
+
+    std::ios::fmtflags const flags = os.flags();
+    os << std::fixed << std::setprecision(3);
+
+    os << "{\"traceEvents\":[\n";
+    for (std::size_t i = 0; i < count; ++i) {
+        event const& e = events[(first + i) % events.size()];
+        double const ts = (e.timestamp - origin) / 1000.0;
+
+        if (i > 0)
+            os << ",\n";
+        os << "{\"pid\":" << pid << ",\"tid\":" << pid << ",\"ts\":" << ts << ',';
+
+        switch (e.type) {
+        case event_enter:
+            os << "\"ph\":\"B\",\"cat\":\"block\",\"name\":\"";
+            write_json_string(os, describe(e.subject));
+            os << '"';
+            break;
+        case event_exit:
+            os << "\"ph\":\"E\",\"cat\":\"block\"";
+            break;
+        case event_jump:
+            os << "\"ph\":\"i\",\"s\":\"t\",\"cat\":\"jump\",\"name\":\"jump\",\"args\":{\"label\":\"";
+            write_json_string(os, symbols.get_name(e.label));
+            os << "\",\"from\":\"";
+            write_json_string(os, describe(e.subject));
+            os << "\"}";
+            break;
+        case event_print:
+        case event_input:
+            os << "\"ph\":\"X\",\"cat\":\"io\",\"dur\":" << e.duration / 1000.0 << ",\"name\":\""
+               << (e.type == event_print ? "print" : "input") << "\",\"args\":{\"statement\":\"";
+            write_json_string(os, describe(e.subject));
+            os << "\"}";
+            break;
+        }
+
+        os << '}';
+    }
+    os << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    os.flags(flags);
+}
+
+boost::uint64_t tracer::get_overwritten() const {
+    return overwritten;
+}
+
+tracer::event& tracer::record(e_event type, statement const* subject) {
+    if (next == events.size()) {
+        next = 0;
+        wrapped = true;
+    }
+    if (wrapped)
+        ++overwritten;
+
+    event& e = events[next++];
+    e.timestamp = read_nanoseconds();
+    e.duration = 0;
+    e.subject = subject;
+    e.label = 0;
+    e.type = type;
+    return e;
+}
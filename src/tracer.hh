@@ -0,0 +1,54 @@
+#ifndef TRACER_HH
+#define TRACER_HH
+
+#include <vector>
+#include <string>
+#include <ostream>
+
+#include <boost/cstdint.hpp>
+
+#include "interpreter.hh"
+
+// Records block entries and exits, jumps, and PRINT and INPUT statements with timestamps, to be viewed in a trace
+// viewer.  Events are stored in binary form in a ring buffer; when it fills up, the oldest events are overwritten.
+// The interpreter runs in a single thread, so one buffer per tracer is one buffer per thread.
+class tracer : public interpreter_observer {
+public:
+    explicit tracer(std::size_t capacity = 1 << 20);
+
+    virtual void before_statement(interpreter&, statement& statement);
+    virtual void after_statement(interpreter&, statement& statement);
+    virtual void entered_block(interpreter&, block&, block_statement* statement);
+    virtual void exited_block(interpreter&, block&);
+    virtual void jumped(interpreter&, symbol_id label);
+
+    // Write the recorded events in the Chrome trace-event JSON format.  Shall be called while the program is still
+    // alive.
+    void write_chrome_json(std::ostream& os) const;
+
+    // Number of events lost to overwriting.
+    boost::uint64_t get_overwritten() const;
+
+private:
+    enum e_event { event_enter, event_exit, event_jump, event_print, event_input };
+
+    struct event {
+        boost::uint64_t     timestamp;      // Nanoseconds.
+        boost::uint64_t     duration;       // Nanoseconds, for PRINT and INPUT.
+        statement const*    subject;        // The statement that opened a block, or the PRINT or INPUT; may be 0.
+        symbol_id           label;          // For jumps.
+        e_event             type;
+    };
+
+    std::vector<event>  events;
+    std::size_t         next;               // Where the next event goes.
+    bool                wrapped;            // Whether next has gone round the buffer yet.
+    boost::uint64_t     overwritten;
+    statement const*    current_statement;
+    boost::uint64_t     statement_start;
+    boost::uint64_t     origin;             // Timestamp of tracer creation; trace timestamps are relative to this.
+
+    event& record(e_event type, statement const* subject);
+};
+
+#endif
@@ -0,0 +1,488 @@
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <set>
+#include <climits>
+#include <cmath>
+#include <cctype>
+#include <cassert>
+
+#include "unparser.hh"
+#include "statements.hh"
+#include "lexer.hh"
+
+namespace {
+
+// How strongly an expression binds, as in the parser; variables and constants bind strongest.  Concatenation is the
+// only operator of string expressions.
+int const PRECEDENCE_CONCAT = 1;
+int const PRECEDENCE_NOT = 0;
+int const PRECEDENCE_OR = 1;
+int const PRECEDENCE_AND = 2;
+int const PRECEDENCE_RELATIONAL = 4;
+int const PRECEDENCE_ADDITIVE = 5;
+int const PRECEDENCE_MULTIPLICATIVE = 6;
+int const PRECEDENCE_OPERAND = 8;
+
+std::size_t const INDENTATION = 4;
+
+// Floating-point literals are written in fixed notation, which gets long for very large or very small numbers.
+std::size_t const MAX_LITERAL_LENGTH = 64;
+
+class precedence_finder : private expr_visitor {
+public:
+    int find(printable_expr const& expr);
+
+private:
+    int precedence;
+
+    virtual void visit(string_concat_expr const&) { precedence = PRECEDENCE_CONCAT; }
+    virtual void visit(string_variable_expr const&) { precedence = PRECEDENCE_OPERAND; }
+    virtual void visit(string_literal_expr const&) { precedence = PRECEDENCE_OPERAND; }
+    virtual void visit(arith_expr const& expr);
+    virtual void visit(variable_expr const&) { precedence = PRECEDENCE_OPERAND; }
+    virtual void visit(constant_expr const&) { precedence = PRECEDENCE_OPERAND; }
+    virtual void visit(relational_expr const&) { precedence = PRECEDENCE_RELATIONAL; }
+    virtual void visit(boolean_expr const& expr);
+    virtual void visit(save_expr const& expr) { expr.get_operand().accept(*this); }
+    virtual void visit(temporary_expr const& expr) { expr.get_original().accept(*this); }
+};
+
+int precedence_finder::find(printable_expr const& expr) {
+    expr.accept(*this);
+    return precedence;
+}
+
+void precedence_finder::visit(arith_expr const& expr) {
+    bool const additive = expr.get_operator() == arith_expr::operator_plus
+                          || expr.get_operator() == arith_expr::operator_minus;
+    precedence = additive ? PRECEDENCE_ADDITIVE : PRECEDENCE_MULTIPLICATIVE;
+}
+
+void precedence_finder::visit(boolean_expr const& expr) {
+    switch (expr.get_operator()) {
+    case boolean_expr::operator_and:    precedence = PRECEDENCE_AND; break;
+    case boolean_expr::operator_or:     precedence = PRECEDENCE_OR; break;
+    case boolean_expr::operator_not:    precedence = PRECEDENCE_NOT; break;
+    }
+}
+
+// Add the labels defined in b and the blocks in it, and those jumped to from them, to labels.
+void collect_labels(block const& b, std::set<symbol_id>& labels) {
+    for (block::jump_table_t::const_iterator label = b.jump_table.begin(); label != b.jump_table.end(); ++label)
+        labels.insert(label->first);
+
+    for (block::statement_list::const_iterator s = b.statements.begin(); s != b.statements.end(); ++s) {
+        if (goto_stmt const* const jump = dynamic_cast<goto_stmt const*>(s->get()))
+            labels.insert(jump->get_label());
+        else if (if_goto_stmt const* const branch = dynamic_cast<if_goto_stmt const*>(s->get())) {
+            labels.insert(branch->get_then_label());
+            if (branch->get_else_label())
+                labels.insert(*branch->get_else_label());
+        } else if (if_block_stmt const* const choice = dynamic_cast<if_block_stmt const*>(s->get())) {
+            for (std::size_t i = 0; i < choice->get_blocks().size(); ++i)
+                collect_labels(choice->get_blocks()[i], labels);
+        } else if (do_stmt const* const loop = dynamic_cast<do_stmt const*>(s->get()))
+            collect_labels(loop->get_body(), labels);
+        else if (for_stmt const* const loop = dynamic_cast<for_stmt const*>(s->get()))
+            collect_labels(loop->get_body(), labels);
+    }
+}
+
+// Whether a label can be written as it's named: as a number, or as a word that isn't a keyword.
+bool is_writable_label(std::string const& name) {
+    try {
+        token_stream const tokens(name);
+        return tokens.size() == 3
+               && (tokens.get_kind(0) == token_number || tokens.get_kind(0) == token_identifier)
+               && tokens.get_text(0) == name;
+    } catch (lexer_error const&) {
+        return false;
+    }
+}
+
+class source_writer : private statement_visitor, private expr_visitor {
+public:
+    source_writer(block const& program, std::ostream& out);
+
+    void write_block(block const& b);
+
+private:
+    std::ostream&                       out;
+    std::size_t                         depth;
+    std::map<symbol_id, std::string>    label_names;
+    std::set<std::string>               used_names;
+    int                                 last_number;
+    precedence_finder                   precedences;
+
+    // What's left to write of the current expression, last first: expressions, or text where expr is null.
+    struct piece {
+        printable_expr const*   expr;
+        char const*             text;
+    };
+    std::vector<piece> pending;
+
+    std::string const& get_label_name(symbol_id label);
+
+    void begin_line();
+    void write_label(symbol_id label);
+    void write_expr(printable_expr const& expr);
+    void queue(char const* text);
+    void queue(printable_expr const& expr, bool parenthesized);
+    void queue_operation(printable_expr const& left, char const* op, printable_expr const& right, int precedence);
+
+    virtual void visit(if_goto_stmt const& statement);
+    virtual void visit(if_block_stmt const& statement);
+    virtual void visit(do_stmt const& statement);
+    virtual void visit(for_stmt const& statement);
+    virtual void visit(print_stmt const& statement);
+    virtual void visit(input_stmt const& statement);
+    virtual void visit(let_stmt const& statement);
+    virtual void visit(goto_stmt const& statement);
+    virtual void visit(stop_stmt const& statement);
+    virtual void visit(exit_stmt const& statement);
+    virtual void visit(include_stmt const& statement);
+    virtual void visit(empty_stmt const& statement);
+
+    virtual void visit(string_concat_expr const& expr);
+    virtual void visit(string_variable_expr const& expr);
+    virtual void visit(string_literal_expr const& expr);
+    virtual void visit(arith_expr const& expr);
+    virtual void visit(variable_expr const& expr);
+    virtual void visit(constant_expr const& expr);
+    virtual void visit(relational_expr const& expr);
+    virtual void visit(boolean_expr const& expr);
+    virtual void visit(save_expr const& expr);
+    virtual void visit(temporary_expr const& expr);
+};
+
+source_writer::source_writer(block const& program, std::ostream& out)
+    : out(out)
+    , depth(0)
+    , last_number(0)
+{
+    // Names that can be written are kept, so the new numbers have to be told apart from all of them.
+    std::set<symbol_id> labels;
+    collect_labels(program, labels);
+    for (std::set<symbol_id>::const_iterator label = labels.begin(); label != labels.end(); ++label) {
+        std::string const& name = symbols.get_name(*label);
+        if (is_writable_label(name)) {
+            label_names.insert(std::make_pair(*label, name));
+            used_names.insert(name);
+        }
+    }
+}
+
+void source_writer::write_block(block const& b) {
+    assert(b.is_parsed());
+
+    // Labels by the statement they're at; null for the end of the block, which an included file that's empty leaves
+    // its INCLUDE's labels at.
+    std::map<statement const*, std::vector<symbol_id> > labels;
+    for (block::jump_table_t::const_iterator label = b.jump_table.begin(); label != b.jump_table.end(); ++label) {
+        statement const* const target = label->second == b.statements.end() ? 0 : label->second->get();
+        labels[target].push_back(label->first);
+    }
+
+    for (block::statement_list::const_iterator s = b.statements.begin(); s != b.statements.end(); ++s) {
+        std::map<statement const*, std::vector<symbol_id> >::const_iterator const at = labels.find(s->get());
+
+        // A line has one label; more go on empty lines of their own before it.
+        if (at != labels.end())
+            for (std::size_t i = 0; i + 1 < at->second.size(); ++i) {
+                begin_line();
+                write_label(at->second[i]);
+                out << "rem\n";
+            }
+
+        begin_line();
+        if (at != labels.end())
+            write_label(at->second.back());
+        (*s)->accept(*this);
+    }
+
+    std::map<statement const*, std::vector<symbol_id> >::const_iterator const at_end = labels.find(0);
+    if (at_end != labels.end())
+        for (std::size_t i = 0; i < at_end->second.size(); ++i) {
+            begin_line();
+            write_label(at_end->second[i]);
+            out << "rem\n";
+        }
+}
+
+std::string const& source_writer::get_label_name(symbol_id label) {
+    std::map<symbol_id, std::string>::iterator name = label_names.find(label);
+    if (name == label_names.end()) {
+        std::string number;
+        do {
+            std::ostringstream os;
+            os << ++last_number;
+            number = os.str();
+        } while (used_names.count(number));
+
+        name = label_names.insert(std::make_pair(label, number)).first;
+        used_names.insert(number);
+    }
+
+    return name->second;
+}
+
+void source_writer::begin_line() {
+    out << std::string(depth * INDENTATION, ' ');
+}
+
+void source_writer::write_label(symbol_id label) {
+    std::string const& name = get_label_name(label);
+    out << name << (std::isdigit(static_cast<unsigned char>(name[0])) ? " " : ": ");
+}
+
+// The pieces of an expression are kept on a stack, rather than recursed into, so that long chains of operators can be
+// written.
+void source_writer::write_expr(printable_expr const& expr) {
+    queue(expr, false);
+    while (!pending.empty()) {
+        piece const next = pending.back();
+        pending.pop_back();
+
+        if (next.expr)
+            next.expr->accept(*this);
+        else
+            out << next.text;
+    }
+}
+
+void source_writer::queue(char const* text) {
+    piece const p = { 0, text };
+    pending.push_back(p);
+}
+
+void source_writer::queue(printable_expr const& expr, bool parenthesized) {
+    if (parenthesized)
+        queue(")");
+
+    piece const p = { &expr, 0 };
+    pending.push_back(p);
+
+    if (parenthesized)
+        queue("(");
+}
+
+// Operators are left-associative, so the right operand needs parentheses if it binds no stronger than the operator,
+// and the left only if it binds looser.
+void source_writer::queue_operation(printable_expr const& left, char const* op, printable_expr const& right,
+                                    int precedence) {
+    queue(right, precedences.find(right) <= precedence);
+    queue(op);
+    queue(left, precedences.find(left) < precedence);
+}
+
+void source_writer::visit(if_goto_stmt const& statement) {
+    out << "if ";
+    write_expr(statement.get_condition());
+    out << " then " << get_label_name(statement.get_then_label());
+    if (statement.get_else_label())
+        out << " else " << get_label_name(*statement.get_else_label());
+    out << '\n';
+}
+
+void source_writer::visit(if_block_stmt const& statement) {
+    if_block_stmt::conditions_cont const& conditions = statement.get_conditions();
+    std::vector<block> const& blocks = statement.get_blocks();
+
+    for (std::size_t i = 0; i < blocks.size(); ++i) {
+        if (i > 0)
+            begin_line();
+
+        if (i == 0 || i < conditions.size()) {
+            out << (i == 0 ? "if " : "elseif ");
+            write_expr(*conditions[i]);
+            out << " then\n";
+        } else
+            out << "else\n";
+
+        ++depth;
+        write_block(blocks[i]);
+        --depth;
+    }
+
+    begin_line();
+    out << "end if\n";
+}
+
+void source_writer::visit(do_stmt const& statement) {
+    out << "do while ";
+    write_expr(statement.get_condition());
+    out << '\n';
+
+    ++depth;
+    write_block(statement.get_body());
+    --depth;
+
+    begin_line();
+    out << "loop\n";
+}
+
+void source_writer::visit(for_stmt const& statement) {
+    std::string const& variable = symbols.get_name(statement.get_variable_name());
+    out << "for " << variable << " = ";
+    write_expr(statement.get_initial_value());
+    out << " to ";
+    write_expr(statement.get_final_value());
+
+    // A FOR without a STEP steps by one.
+    constant_expr const* const step = dynamic_cast<constant_expr const*>(&statement.get_step());
+    if (!step || !is_identical(step->get_value(), number(1))) {
+        out << " step ";
+        write_expr(statement.get_step());
+    }
+    out << '\n';
+
+    ++depth;
+    write_block(statement.get_body());
+    --depth;
+
+    begin_line();
+    out << "next " << variable << '\n';
+}
+
+void source_writer::visit(print_stmt const& statement) {
+    out << "print";
+    for (std::size_t i = 0; i < statement.get_expressions().size(); ++i) {
+        out << (i == 0 ? " " : ", ");
+        write_expr(*statement.get_expressions()[i]);
+    }
+    out << '\n';
+}
+
+void source_writer::visit(input_stmt const& statement) {
+    out << "input " << symbols.get_name(statement.get_variable_name()) << '\n';
+}
+
+void source_writer::visit(let_stmt const& statement) {
+    out << "let " << symbols.get_name(statement.get_variable_name()) << " = ";
+    if (statement.get_numeric_value())
+        write_expr(*statement.get_numeric_value());
+    else
+        write_expr(*statement.get_string_value());
+    out << '\n';
+}
+
+void source_writer::visit(goto_stmt const& statement) {
+    out << "goto " << get_label_name(statement.get_label()) << '\n';
+}
+
+void source_writer::visit(stop_stmt const&) {
+    out << "stop\n";
+}
+
+void source_writer::visit(exit_stmt const& statement) {
+    out << "exit " << symbols.get_name(statement.get_block_name()) << '\n';
+}
+
+void source_writer::visit(include_stmt const& statement) {
+    out << "include \"" << statement.get_path() << "\"\n";
+}
+
+void source_writer::visit(empty_stmt const&) {
+    out << "rem\n";
+}
+
+void source_writer::visit(string_concat_expr const& expr) {
+    queue_operation(expr.get_left(), " & ", expr.get_right(), PRECEDENCE_CONCAT);
+}
+
+void source_writer::visit(string_variable_expr const& expr) {
+    out << symbols.get_name(expr.get_name());
+}
+
+void source_writer::visit(string_literal_expr const& expr) {
+    out << get_string_literal(expr.get_value()).get_value_or('"' + expr.get_value() + '"');
+}
+
+void source_writer::visit(arith_expr const& expr) {
+    char const* const OPERATORS[] = { " + ", " - ", " * ", " / ", " mod " };
+    int const precedence = precedences.find(expr);
+    queue_operation(expr.get_left_side(), OPERATORS[expr.get_operator()], expr.get_right_side(), precedence);
+}
+
+void source_writer::visit(variable_expr const& expr) {
+    out << symbols.get_name(expr.get_name());
+}
+
+void source_writer::visit(constant_expr const& expr) {
+    if (boost::optional<std::string> const literal = get_number_literal(expr.get_value()))
+        out << *literal;
+    else
+        out << expr.get_value();  // The nearest there is.
+}
+
+void source_writer::visit(relational_expr const& expr) {
+    char const* const OPERATORS[] = { " = ", " <> ", " < ", " <= ", " > ", " >= " };
+    queue_operation(expr.get_left_side(), OPERATORS[expr.get_operator()], expr.get_right_side(),
+                    PRECEDENCE_RELATIONAL);
+}
+
+void source_writer::visit(boolean_expr const& expr) {
+    if (expr.get_operator() == boolean_expr::operator_not) {
+        queue(expr.get_left_side(), precedences.find(expr.get_left_side()) < PRECEDENCE_NOT);
+        queue("not ");
+    } else {
+        char const* const op = expr.get_operator() == boolean_expr::operator_and ? " and " : " or ";
+        queue_operation(expr.get_left_side(), op, *expr.get_right_side(), precedences.find(expr));
+    }
+}
+
+// Temporaries are written as the expressions they keep the values of.
+void source_writer::visit(save_expr const& expr) {
+    queue(expr.get_operand(), false);
+}
+
+void source_writer::visit(temporary_expr const& expr) {
+    queue(expr.get_original(), false);
+}
+
+}
+
+boost::optional<std::string> get_number_literal(number const& value) {
+    if (value.is_integral()) {
+        // The literal of the smallest integer would be one more than the largest.
+        int const integral_value = value.get_integral_value();
+        if (integral_value == INT_MIN || !is_identical(number(integral_value), value))
+            return boost::optional<std::string>();
+
+        std::ostringstream os;
+        os << integral_value;
+        return os.str();
+    }
+
+    double const floating_point_value = value.get_floating_point_value();
+    if (floating_point_value != floating_point_value || floating_point_value - floating_point_value != 0)
+        return boost::optional<std::string>();  // Not a number, or infinite.
+
+    // A minus before a literal is part of it; the parser negates what follows.
+    bool const negative = floating_point_value < 0 || (floating_point_value == 0 && 1 / floating_point_value < 0);
+    for (int precision = 1; ; ++precision) {
+        std::ostringstream os;
+        os << std::fixed << std::setprecision(precision) << std::fabs(floating_point_value);
+        if (os.str().size() >= MAX_LITERAL_LENGTH)
+            return boost::optional<std::string>();
+
+        std::istringstream is(os.str());
+        double magnitude;
+        is >> magnitude;
+        if (is_identical(number(negative ? -magnitude : magnitude), value))
+            return (negative ? "-" : "") + os.str();
+    }
+}
+
+boost::optional<std::string> get_string_literal(std::string const& value) {
+    if (value.find_first_of("\"\n") != std::string::npos)
+        return boost::optional<std::string>();
+    else
+        return '"' + value + '"';
+}
+
+void unparse(block const& program, std::ostream& out) {
+    source_writer(program, out).write_block(program);
+}
@@ -0,0 +1,24 @@
+#ifndef UNPARSER_HH
+#define UNPARSER_HH
+
+#include <ostream>
+#include <string>
+
+#include <boost/optional.hpp>
+
+#include "parser.hh"
+#include "number.hh"
+
+// The literal that parses to exactly the given number, if there is one.  There isn't for integers that have wrapped
+// around, nor for floating-point numbers whose digits don't fit in a literal of reasonable length -- literals have no
+// exponent.
+boost::optional<std::string> get_number_literal(number const& value);
+
+// The literal, quotes included, of a string.  Literals can't have quotes or line breaks in them.
+boost::optional<std::string> get_string_literal(std::string const& value);
+
+// Write a parsed program out as source that parses back to the same statements.  Labels that can't be written as they
+// are named -- those of included files, which carry the file's path -- are numbered anew.
+void unparse(block const& program, std::ostream& out);
+
+#endif
@@ -0,0 +1,641 @@
+#include <map>
+#include <set>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+#include <boost/cstdint.hpp>
+#include <boost/optional.hpp>
+#include <boost/next_prior.hpp>
+
+#include "unroller.hh"
+#include "statements.hh"
+#include "folder.hh"
+
+namespace {
+
+typedef block::statement_list::iterator iterator;
+
+// A loop is unrolled whole if it's done within these many iterations, and unrolled at all only if its unrolled body is
+// within these many statements, counting those in blocks inside.
+std::size_t const MAX_WHOLLY_UNROLLED_ITERATIONS = 8;
+std::size_t const MAX_UNROLLED_STATEMENTS = 64;
+
+boost::int64_t const LOWEST = std::numeric_limits<int>::min();
+boost::int64_t const HIGHEST = std::numeric_limits<int>::max();
+
+// Whether a number is an integer whose integral value hasn't wrapped around, so that adding to it in int gets what
+// adding to it in boost::int64_t does, as long as that doesn't leave the range of int either.
+bool is_exact_integer(number const& value) {
+    return value.is_integral() && value.get_floating_point_value() == value.get_integral_value();
+}
+
+// How many times each variable is read in what's added, in blocks inside too.
+class read_counter : private statement_visitor, private expr_visitor {
+public:
+    std::map<symbol_id, std::size_t> counts;
+
+    void add(printable_expr const& expr);
+    void add(statement const& s);
+    void add(block const& b);
+
+private:
+    std::vector<printable_expr const*> pending;
+
+    virtual void visit(if_goto_stmt const& statement) { add(statement.get_condition()); }
+    virtual void visit(if_block_stmt const& statement);
+    virtual void visit(do_stmt const& statement);
+    virtual void visit(for_stmt const& statement);
+    virtual void visit(print_stmt const& statement);
+    virtual void visit(input_stmt const&) { }
+    virtual void visit(let_stmt const& statement);
+    virtual void visit(goto_stmt const&) { }
+    virtual void visit(stop_stmt const&) { }
+    virtual void visit(exit_stmt const&) { }
+    virtual void visit(include_stmt const&) { }
+    virtual void visit(empty_stmt const&) { }
+
+    virtual void visit(string_concat_expr const& expr);
+    virtual void visit(string_variable_expr const& expr) { ++counts[expr.get_name()]; }
+    virtual void visit(string_literal_expr const&) { }
+    virtual void visit(arith_expr const& expr);
+    virtual void visit(variable_expr const& expr) { ++counts[expr.get_name()]; }
+    virtual void visit(constant_expr const&) { }
+    virtual void visit(relational_expr const& expr);
+    virtual void visit(boolean_expr const& expr);
+    virtual void visit(save_expr const& expr) { pending.push_back(&expr.get_operand()); }
+    virtual void visit(temporary_expr const& expr) { pending.push_back(&expr.get_original()); }
+};
+
+void read_counter::add(printable_expr const& expr) {
+    pending.push_back(&expr);
+    while (!pending.empty()) {
+        printable_expr const* const e = pending.back();
+        pending.pop_back();
+        e->accept(*this);
+    }
+}
+
+void read_counter::add(statement const& s) {
+    s.accept(*this);
+}
+
+void read_counter::add(block const& b) {
+    for (block::statement_list::const_iterator s = b.statements.begin(); s != b.statements.end(); ++s)
+        (*s)->accept(*this);
+}
+
+void read_counter::visit(if_block_stmt const& statement) {
+    if_block_stmt::conditions_cont const& conditions = statement.get_conditions();
+    for (if_block_stmt::conditions_cont::const_iterator c = conditions.begin(); c != conditions.end(); ++c)
+        add(**c);
+
+    std::vector<block> const& blocks = statement.get_blocks();
+    for (std::vector<block>::const_iterator b = blocks.begin(); b != blocks.end(); ++b)
+        add(*b);
+}
+
+void read_counter::visit(do_stmt const& statement) {
+    add(statement.get_condition());
+    add(statement.get_body());
+}
+
+void read_counter::visit(for_stmt const& statement) {
+    add(statement.get_initial_value());
+    add(statement.get_final_value());
+    add(statement.get_step());
+    add(statement.get_body());
+}
+
+void read_counter::visit(print_stmt const& statement) {
+    print_stmt::expressions_cont const& expressions = statement.get_expressions();
+    for (print_stmt::expressions_cont::const_iterator e = expressions.begin(); e != expressions.end(); ++e)
+        add(**e);
+}
+
+void read_counter::visit(let_stmt const& statement) {
+    if (statement.get_numeric_value())
+        add(*statement.get_numeric_value());
+    else
+        add(*statement.get_string_value());
+}
+
+void read_counter::visit(string_concat_expr const& expr) {
+    pending.push_back(&expr.get_right());
+    pending.push_back(&expr.get_left());
+}
+
+void read_counter::visit(arith_expr const& expr) {
+    pending.push_back(&expr.get_right_side());
+    pending.push_back(&expr.get_left_side());
+}
+
+void read_counter::visit(relational_expr const& expr) {
+    pending.push_back(&expr.get_right_side());
+    pending.push_back(&expr.get_left_side());
+}
+
+void read_counter::visit(boolean_expr const& expr) {
+    if (expr.get_right_side())
+        pending.push_back(expr.get_right_side());
+    pending.push_back(&expr.get_left_side());
+}
+
+// The variable a statement sets in the block it's in, if any: that block is where it's made, if it isn't in an outer
+// one already.
+boost::optional<symbol_id> get_set_variable(statement const& s) {
+    if (let_stmt const* const assignment = dynamic_cast<let_stmt const*>(&s))
+        return assignment->get_variable_name();
+    if (input_stmt const* const input = dynamic_cast<input_stmt const*>(&s))
+        return input->get_variable_name();
+    if (for_stmt const* const loop = dynamic_cast<for_stmt const*>(&s))
+        return loop->get_variable_name();
+    return boost::optional<symbol_id>();
+}
+
+// What a loop's body does that keeps it from being unrolled, and how large it is.
+//
+// Variables a body sets that aren't set outside it are made anew each time round, and gone after the loop.  Once the
+// body is unrolled, they last from one copy of it to the next -- and after the loop, if it's unrolled whole -- so
+// where such a variable may be read while it isn't set, the loop can only be unrolled if it's certainly set outside.
+class body_summary : private statement_visitor {
+public:
+    body_summary(block const& body, symbol_id variable);
+
+    bool is_unrollable() const { return unrollable; }
+    std::size_t get_size() const { return size; }
+
+    std::map<symbol_id, std::size_t> const& get_reads() const { return reads.counts; }
+
+    // Variables the body sets in itself, and those of them that may be read before being set each time round.
+    std::set<symbol_id> const& get_assigned() const { return assigned; }
+    std::set<symbol_id> const& get_read_unset() const { return read_unset; }
+
+private:
+    symbol_id const         variable;
+    std::vector<symbol_id>  names;      // Of the loops inside the body the statement looked at is in.
+    std::size_t             size;
+    bool                    unrollable;
+    read_counter            reads;
+    std::set<symbol_id>     assigned;
+    std::set<symbol_id>     read_unset;
+
+    void add_block(block const& b);
+    void add_loop(block_statement const& statement, block const& body);
+
+    // Count the reads of expr, or s, noting those of variables the body hasn't set yet.
+    template <typename T>
+    void add_reads(T const& read);
+
+    virtual void visit(if_goto_stmt const&) { unrollable = false; }
+    virtual void visit(if_block_stmt const& statement);
+    virtual void visit(do_stmt const& statement) { add_loop(statement, statement.get_body()); }
+    virtual void visit(for_stmt const& statement);
+    virtual void visit(print_stmt const&) { }
+    virtual void visit(input_stmt const& statement);
+    virtual void visit(let_stmt const& statement);
+    virtual void visit(goto_stmt const&) { unrollable = false; }
+    virtual void visit(stop_stmt const&) { }
+    virtual void visit(exit_stmt const& statement);
+    virtual void visit(include_stmt const&) { unrollable = false; }
+    virtual void visit(empty_stmt const&) { }
+};
+
+body_summary::body_summary(block const& body, symbol_id variable)
+    : variable(variable)
+    , size(0)
+    , unrollable(true)
+{
+    // Labels in blocks inside can only be jumped to from those blocks, but the body's own would end up in the block
+    // the loop is in, or twice in the unrolled body.
+    if (!body.jump_table.empty())
+        unrollable = false;
+
+    add_block(body);
+
+    // With no labels, and no jumps, the body's own statements are run in order.
+    for (block::statement_list::const_iterator s = body.statements.begin(); s != body.statements.end(); ++s) {
+        if (for_stmt const* const loop = dynamic_cast<for_stmt const*>(s->get())) {
+            // Its variable is set before the rest of it is worked out.
+            add_reads(loop->get_initial_value());
+            assigned.insert(loop->get_variable_name());
+            add_reads(loop->get_final_value());
+            add_reads(loop->get_step());
+            add_reads(loop->get_body());
+        } else {
+            add_reads(**s);
+            if (boost::optional<symbol_id> const v = get_set_variable(**s))
+                assigned.insert(*v);
+        }
+    }
+}
+
+template <typename T>
+void body_summary::add_reads(T const& read) {
+    read_counter counter;
+    counter.add(read);
+
+    for (std::map<symbol_id, std::size_t>::const_iterator v = counter.counts.begin(); v != counter.counts.end(); ++v) {
+        reads.counts[v->first] += v->second;
+        if (!assigned.count(v->first))
+            read_unset.insert(v->first);
+    }
+}
+
+void body_summary::add_block(block const& b) {
+    for (block::statement_list::const_iterator s = b.statements.begin(); s != b.statements.end() && unrollable; ++s) {
+        ++size;
+        (*s)->accept(*this);
+    }
+}
+
+void body_summary::add_loop(block_statement const& statement, block const& body) {
+    names.push_back(statement.get_name());
+    add_block(body);
+    names.pop_back();
+}
+
+void body_summary::visit(if_block_stmt const& statement) {
+    std::vector<block> const& blocks = statement.get_blocks();
+    for (std::vector<block>::const_iterator b = blocks.begin(); b != blocks.end(); ++b)
+        add_block(*b);
+}
+
+void body_summary::visit(for_stmt const& statement) {
+    if (statement.get_variable_name() == variable)
+        unrollable = false;
+    add_loop(statement, statement.get_body());
+}
+
+void body_summary::visit(input_stmt const& statement) {
+    if (statement.get_variable_name() == variable)
+        unrollable = false;
+}
+
+void body_summary::visit(let_stmt const& statement) {
+    if (statement.get_variable_name() == variable)
+        unrollable = false;
+}
+
+// An EXIT out of the loop would leave the copy of the body it's in, but not the rest.
+void body_summary::visit(exit_stmt const& statement) {
+    if (std::find(names.begin(), names.end(), statement.get_block_name()) == names.end())
+        unrollable = false;
+}
+
+// Copies expressions with the operations on constants in them done.  Those that fail or trap are left to the run.
+class folding_substitution : public expr_substitution {
+public:
+    explicit folding_substitution(constant_folder& folder);
+
+    virtual std::auto_ptr<numeric_expr> replace(numeric_expr const&);
+    virtual std::auto_ptr<numeric_expr> wrap(numeric_expr const&, std::auto_ptr<numeric_expr> copy);
+
+private:
+    constant_folder& folder;
+};
+
+folding_substitution::folding_substitution(constant_folder& folder)
+    : folder(folder)
+{ }
+
+std::auto_ptr<numeric_expr> folding_substitution::replace(numeric_expr const&) {
+    return std::auto_ptr<numeric_expr>();
+}
+
+std::auto_ptr<numeric_expr> folding_substitution::wrap(numeric_expr const&, std::auto_ptr<numeric_expr> copy) {
+    // Operands are copied before what they're operands of, so a constant expression is folded from the bottom up.
+    bool foldable = false;
+    if (arith_expr const* const arith = dynamic_cast<arith_expr const*>(copy.get()))
+        foldable = dynamic_cast<constant_expr const*>(&arith->get_left_side())
+                   && dynamic_cast<constant_expr const*>(&arith->get_right_side());
+    else if (relational_expr const* const relation = dynamic_cast<relational_expr const*>(copy.get()))
+        foldable = dynamic_cast<constant_expr const*>(&relation->get_left_side())
+                   && dynamic_cast<constant_expr const*>(&relation->get_right_side());
+    else if (boolean_expr const* const boolean = dynamic_cast<boolean_expr const*>(copy.get()))
+        foldable = dynamic_cast<constant_expr const*>(&boolean->get_left_side())
+                   && (!boolean->get_right_side() || dynamic_cast<constant_expr const*>(boolean->get_right_side()));
+
+    if (!foldable)
+        return copy;
+
+    if (boost::optional<number> const value = folder.fold(*copy))
+        return std::auto_ptr<numeric_expr>(new constant_expr(*value));
+    return copy;
+}
+
+// Copies the body of a loop for one time round it: its variable is replaced by its value then, if that's known, or by
+// the variable plus how far on from it the copy is.
+class iteration_substitution : public folding_substitution {
+public:
+    iteration_substitution(constant_folder& folder, symbol_id variable);
+
+    void set_value(number const& value);
+    void set_offset(number const& offset);
+
+    virtual std::auto_ptr<numeric_expr> replace(numeric_expr const& expr);
+
+private:
+    symbol_id const variable;
+    number          value;
+    bool            offset;     // Whether value is added to the variable rather than put in place of it.
+};
+
+iteration_substitution::iteration_substitution(constant_folder& folder, symbol_id variable)
+    : folding_substitution(folder)
+    , variable(variable)
+    , offset(false)
+{ }
+
+void iteration_substitution::set_value(number const& value) {
+    this->value = value;
+    offset = false;
+}
+
+void iteration_substitution::set_offset(number const& offset) {
+    value = offset;
+    this->offset = true;
+}
+
+std::auto_ptr<numeric_expr> iteration_substitution::replace(numeric_expr const& expr) {
+    variable_expr const* const read = dynamic_cast<variable_expr const*>(&expr);
+    if (!read || read->get_name() != variable)
+        return std::auto_ptr<numeric_expr>();
+
+    if (!offset)
+        return std::auto_ptr<numeric_expr>(new constant_expr(value));
+
+    if (!value.is_true())
+        return std::auto_ptr<numeric_expr>();
+
+    return std::auto_ptr<numeric_expr>(new arith_expr(
+        std::auto_ptr<numeric_expr>(new variable_expr(variable)),
+        std::auto_ptr<numeric_expr>(new constant_expr(value)), arith_expr::operator_plus));
+}
+
+// A copy of a statement with its expressions substituted, and of the statements in its blocks too, so that it shares
+// nothing with the original; later passes rewrite the statements of blocks in place.
+boost::shared_ptr<statement> copy(statement const& s, expr_substitution& substitution);
+
+void copy_statements(block& b, expr_substitution& substitution) {
+    for (iterator s = b.statements.begin(); s != b.statements.end(); ++s)
+        *s = copy(**s, substitution);
+}
+
+boost::shared_ptr<statement> copy(statement const& s, expr_substitution& substitution) {
+    boost::shared_ptr<statement> const result = clone(s, substitution);
+
+    if (if_block_stmt* const if_block = dynamic_cast<if_block_stmt*>(result.get())) {
+        std::vector<block>& blocks = if_block->get_blocks();
+        for (std::vector<block>::iterator b = blocks.begin(); b != blocks.end(); ++b)
+            copy_statements(*b, substitution);
+    } else if (do_stmt* const loop = dynamic_cast<do_stmt*>(result.get()))
+        copy_statements(loop->get_body(), substitution);
+    else if (for_stmt* const loop = dynamic_cast<for_stmt*>(result.get()))
+        copy_statements(loop->get_body(), substitution);
+
+    return result;
+}
+
+// The values a loop's bounds are certain to have.
+struct loop_bounds {
+    number initial_value, final_value, step;
+};
+
+class loop_unroller : boost::noncopyable {
+public:
+    explicit loop_unroller(std::size_t factor);
+
+    void run(block& program);
+
+private:
+    std::size_t const                   factor;
+    constant_folder                     folder;
+    std::map<symbol_id, std::size_t>    reads;      // In the whole program, as it is so far.
+
+    // Blocks the statement being looked at is in, outermost first, with the statement of each it's in.
+    std::vector<std::pair<block*, iterator> > scopes;
+
+    void unroll(block& b);
+
+    // Whether unrolling a loop with the body lets its variables outlive it, or one copy of it, where that may be seen.
+    bool keeps_variables(body_summary const& body) const;
+
+    // Whether a variable is certainly set, in an outer block, before the statement being looked at.
+    bool is_set_before(symbol_id variable) const;
+
+    bool get_bounds(for_stmt const& loop, loop_bounds& bounds);
+
+    // Append the statements that do what a loop does to unrolled, if it's unrolled that way.
+    bool unroll_wholly(for_stmt const& loop, loop_bounds const& bounds, std::size_t body_size,
+                       block::statement_list& unrolled);
+    bool unroll_partly(for_stmt const& loop, loop_bounds const& bounds, std::size_t body_size,
+                       block::statement_list& unrolled);
+};
+
+loop_unroller::loop_unroller(std::size_t factor)
+    : factor(factor)
+{ }
+
+void loop_unroller::run(block& program) {
+    read_counter counter;
+    counter.add(program);
+    reads.swap(counter.counts);
+
+    unroll(program);
+}
+
+void loop_unroller::unroll(block& b) {
+    scopes.push_back(std::make_pair(&b, b.statements.begin()));
+
+    for (iterator s = b.statements.begin(); s != b.statements.end(); ) {
+        iterator const next = boost::next(s);
+        scopes.back().second = s;
+
+        if (if_block_stmt* const if_block = dynamic_cast<if_block_stmt*>(s->get())) {
+            std::vector<block>& blocks = if_block->get_blocks();
+            for (std::vector<block>::iterator body = blocks.begin(); body != blocks.end(); ++body)
+                unroll(*body);
+        } else if (do_stmt* const loop = dynamic_cast<do_stmt*>(s->get()))
+            unroll(loop->get_body());
+        else if (for_stmt* const loop = dynamic_cast<for_stmt*>(s->get())) {
+            unroll(loop->get_body());
+
+            loop_bounds bounds;
+            body_summary const body(loop->get_body(), loop->get_variable_name());
+            block::statement_list unrolled;
+            if (body.is_unrollable() && keeps_variables(body) && get_bounds(*loop, bounds)
+                && (unroll_wholly(*loop, bounds, body.get_size(), unrolled)
+                    || unroll_partly(*loop, bounds, body.get_size(), unrolled))) {
+                read_counter before, after;
+                before.add(*loop);
+                for (block::statement_list::const_iterator u = unrolled.begin(); u != unrolled.end(); ++u)
+                    after.add(**u);
+
+                std::map<symbol_id, std::size_t>::const_iterator v;
+                for (v = before.counts.begin(); v != before.counts.end(); ++v)
+                    reads[v->first] -= v->second;
+                for (v = after.counts.begin(); v != after.counts.end(); ++v)
+                    reads[v->first] += v->second;
+
+                // The first statement takes the loop's place in the list, so that its labels still lead there.
+                *s = unrolled.front();
+                unrolled.pop_front();
+                b.statements.splice(next, unrolled);
+            }
+        }
+
+        s = next;
+    }
+
+    scopes.pop_back();
+}
+
+bool loop_unroller::keeps_variables(body_summary const& body) const {
+    std::set<symbol_id> const& assigned = body.get_assigned();
+    for (std::set<symbol_id>::const_iterator v = assigned.begin(); v != assigned.end(); ++v) {
+        std::map<symbol_id, std::size_t>::const_iterator const total = reads.find(*v);
+        std::map<symbol_id, std::size_t>::const_iterator const inside = body.get_reads().find(*v);
+        bool const read_outside = total != reads.end()
+                                  && total->second > (inside != body.get_reads().end() ? inside->second : 0);
+
+        if ((read_outside || body.get_read_unset().count(*v)) && !is_set_before(*v))
+            return false;
+    }
+
+    return true;
+}
+
+bool loop_unroller::is_set_before(symbol_id variable) const {
+    typedef std::vector<std::pair<block*, iterator> >::const_reverse_iterator scope_iterator;
+    for (scope_iterator scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+        block const& b = *scope->first;
+
+        std::set<statement const*> labelled;
+        for (block::jump_table_t::const_iterator l = b.jump_table.begin(); l != b.jump_table.end(); ++l)
+            if (l->second != b.statements.end())
+                labelled.insert(l->second->get());
+
+        // Going back from the statement, up to one that may be jumped to, the statements before it have been run.
+        for (iterator s = scope->second; !labelled.count(s->get()) && s != b.statements.begin(); ) {
+            --s;
+            boost::optional<symbol_id> const assigned = get_set_variable(**s);
+            if (assigned && *assigned == variable)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+bool loop_unroller::get_bounds(for_stmt const& loop, loop_bounds& bounds) {
+    boost::optional<number> const initial_value = folder.fold(loop.get_initial_value());
+    boost::optional<number> const final_value = folder.fold(loop.get_final_value());
+    boost::optional<number> const step = folder.fold(loop.get_step());
+    if (!initial_value || !final_value || !step)
+        return false;
+
+    bounds.initial_value = *initial_value;
+    bounds.final_value = *final_value;
+    bounds.step = *step;
+    return true;
+}
+
+bool loop_unroller::unroll_wholly(for_stmt const& loop, loop_bounds const& bounds, std::size_t body_size,
+                                  block::statement_list& unrolled) {
+    // Go round the loop as running it would, so that the values are the same to the last bit.
+    std::vector<number> values;
+    number value = bounds.initial_value;
+    while ((bounds.step > 0 && value <= bounds.final_value) || (bounds.step < 0 && value >= bounds.final_value)) {
+        if (values.size() == MAX_WHOLLY_UNROLLED_ITERATIONS || (values.size() + 1) * body_size > MAX_UNROLLED_STATEMENTS)
+            return false;
+        values.push_back(value);
+        value += bounds.step;
+    }
+
+    block const& body = loop.get_body();
+    iteration_substitution substitution(folder, loop.get_variable_name());
+    for (std::vector<number>::const_iterator v = values.begin(); v != values.end(); ++v) {
+        substitution.set_value(*v);
+        for (block::statement_list::const_iterator s = body.statements.begin(); s != body.statements.end(); ++s)
+            unrolled.push_back(copy(**s, substitution));
+    }
+
+    // The variable is left as the loop leaves it.
+    boost::shared_ptr<statement> const assignment(
+        new let_stmt(loop.get_variable_name(), std::auto_ptr<numeric_expr>(new constant_expr(value))));
+    assignment->set_location(loop.get_location());
+    unrolled.push_back(assignment);
+    return true;
+}
+
+bool loop_unroller::unroll_partly(for_stmt const& loop, loop_bounds const& bounds, std::size_t body_size,
+                                  block::statement_list& unrolled) {
+    if (factor < 2 || body_size * factor > MAX_UNROLLED_STATEMENTS || !is_exact_integer(bounds.initial_value)
+        || !is_exact_integer(bounds.step) || !bounds.step.is_true())
+        return false;
+
+    boost::int64_t const initial_value = bounds.initial_value.get_integral_value();
+    boost::int64_t const step = bounds.step.get_integral_value();
+    bool const ascending = step > 0;
+
+    // The last value the variable can take, whether or not it gets there.
+    boost::int64_t last;
+    if (bounds.final_value.is_integral())
+        last = bounds.final_value.get_integral_value();
+    else {
+        double const bound = bounds.final_value.get_floating_point_value();
+        double const rounded = ascending ? std::floor(bound) : std::ceil(bound);
+        if (!(rounded >= LOWEST && rounded <= HIGHEST))
+            return false;
+        last = static_cast<boost::int64_t>(rounded);
+    }
+
+    if (ascending ? last < initial_value : last > initial_value)
+        return false;   // It isn't gone round at all.
+
+    // Every value the variable goes through, up to the one it's left with, must be an int for it not to wrap around.
+    boost::int64_t const iterations = (last - initial_value) / step + 1;
+    boost::int64_t const chunks = iterations / static_cast<boost::int64_t>(factor);
+    boost::int64_t const chunk_step = step * static_cast<boost::int64_t>(factor);
+    boost::int64_t const end = initial_value + iterations * step;
+    if (chunks == 0 || end < LOWEST || end > HIGHEST || chunk_step < LOWEST || chunk_step > HIGHEST)
+        return false;
+
+    symbol_id const variable = loop.get_variable_name();
+    block const& body = loop.get_body();
+
+    block chunk;
+    iteration_substitution substitution(folder, variable);
+    for (std::size_t i = 0; i < factor; ++i) {
+        substitution.set_offset(static_cast<int>(static_cast<boost::int64_t>(i) * step));
+        for (block::statement_list::const_iterator s = body.statements.begin(); s != body.statements.end(); ++s)
+            chunk.statements.push_back(copy(**s, substitution));
+    }
+
+    boost::shared_ptr<statement> const unrolled_loop(new for_stmt(
+        variable,
+        std::auto_ptr<numeric_expr>(new constant_expr(static_cast<int>(initial_value))),
+        std::auto_ptr<numeric_expr>(new constant_expr(static_cast<int>(initial_value + (chunks - 1) * chunk_step))),
+        std::auto_ptr<numeric_expr>(new constant_expr(static_cast<int>(chunk_step))), chunk));
+    unrolled_loop->set_location(loop.get_location());
+    unrolled.push_back(unrolled_loop);
+
+    // The original body is done with, so the loop over the iterations left over can have it.
+    loop_bounds rest = bounds;
+    rest.initial_value = static_cast<int>(initial_value + chunks * chunk_step);
+    boost::shared_ptr<statement> const remainder(new for_stmt(
+        variable, std::auto_ptr<numeric_expr>(new constant_expr(rest.initial_value)), clone(loop.get_final_value()),
+        clone(loop.get_step()), body));
+    remainder->set_location(loop.get_location());
+    if (!unroll_wholly(static_cast<for_stmt const&>(*remainder), rest, body_size, unrolled))
+        unrolled.push_back(remainder);
+    return true;
+}
+
+}
+
+void unroll_loops(block& program, std::size_t factor) {
+    loop_unroller(factor).run(program);
+}
@@ -0,0 +1,24 @@
+#ifndef UNROLLER_HH
+#define UNROLLER_HH
+
+#include <cstddef>
+
+#include "parser.hh"
+
+// Unroll the FOR loops of a wholly parsed program whose initial value, final value and step are constants, innermost
+// first:
+//
+//  - A loop done within a few iterations is replaced by a copy of its body for each of them, with its variable replaced
+//    by its value then and the operations on constants that makes done, as constant_folder does them, followed by a LET
+//    of the value it's left with.
+//  - Otherwise, a loop over integers is replaced by one whose body is factor copies of its body, with its variable
+//    replaced by the variable plus how far on each copy is, going factor times as far each time round; and one for the
+//    iterations left over, unrolled like the above if there are few enough of them.  A factor of 1 leaves such loops
+//    be.
+//
+// Loops whose bodies would get too large, or that jump, EXIT out of them, set their variable or have labels, are left
+// as they are.  So are those whose bodies set variables of their own that, outliving a copy of the body, may be read
+// where they wouldn't be set otherwise.
+void unroll_loops(block& program, std::size_t factor);
+
+#endif
@@ -0,0 +1,393 @@
+#include <map>
+#include <set>
+#include <vector>
+#include <cstring>
+#include <utility>
+
+#include <boost/cstdint.hpp>
+
+#include "value_numberer.hh"
+#include "statements.hh"
+
+namespace {
+
+typedef block::statement_list::iterator iterator;
+typedef std::size_t value_number;   // Zero for none.
+
+// What a value is worked out from, which it's looked up by: the kind of expression, and what tells values of that kind
+// apart -- an operator and the value numbers of the operands, a variable's name and version, or a constant's bits.
+struct value_key {
+    enum e_kind { kind_constant, kind_variable, kind_arith, kind_relational, kind_boolean };
+
+    value_key(e_kind kind, int op, boost::int64_t first, boost::int64_t second)
+        : kind(kind)
+        , op(op)
+        , first(first)
+        , second(second)
+    { }
+
+    e_kind          kind;
+    int             op;
+    boost::int64_t  first, second;
+};
+
+bool operator < (value_key const& lhs, value_key const& rhs) {
+    if (lhs.kind != rhs.kind)
+        return lhs.kind < rhs.kind;
+    if (lhs.op != rhs.op)
+        return lhs.op < rhs.op;
+    if (lhs.first != rhs.first)
+        return lhs.first < rhs.first;
+    return lhs.second < rhs.second;
+}
+
+// An operation of the expression being numbered.  Only operations are worth keeping the values of; working out a
+// variable or a constant is as cheap as reading a temporary.
+struct operation {
+    value_number        value;
+    numeric_expr const* left;
+    numeric_expr const* right;              // Null for NOT.
+    bool                right_conditional;  // Whether the right operand may not be worked out, as in AND and OR.
+};
+
+// Where a value is first worked out in a run.  Contexts are where operations are sure to be worked out: the run's own,
+// or the right operand of an AND or OR within another context.
+struct definition {
+    numeric_expr const* expr;
+    std::size_t         context;
+    std::size_t         owner;      // The statement of the run it's in.
+};
+
+class common_subexpression_eliminator : private expr_visitor, private expr_substitution {
+public:
+    common_subexpression_eliminator();
+
+    void run(block& b);
+
+private:
+    // Value numbers of the run so far, and the versions of the variables set in it: a new value number each time.
+    std::map<value_key, value_number>   values;
+    std::map<symbol_id, value_number>   versions;
+    value_number                        next_value;
+
+    // The operations of the expression being numbered.  Like elsewhere, operands are numbered from a stack rather than
+    // by recursion, so that long chains of operators can be.
+    std::map<numeric_expr const*, operation>                operations;
+    std::vector<std::pair<numeric_expr const*, bool> >      pending;
+    bool                                                    operands_done;
+    std::vector<value_number>                               numbered;
+
+    std::map<value_number, definition>  definitions;
+    std::vector<std::size_t>            context_parents;    // Context 0, the run's, is its own parent.
+
+    // What's to become of the operations of the run: those that keep their values, and those that take them, by the
+    // temporary they're in.
+    std::map<numeric_expr const*, std::size_t>  saved;
+    std::map<numeric_expr const*, std::size_t>  replaced;
+    std::size_t                                 next_slot;
+
+    std::vector<iterator>   members;    // The statements of the run.
+    std::set<std::size_t>   touched;    // Indices of the members to be rebuilt.
+
+    // Number the expression, then decide which of its operations take values worked out before, in the order they're
+    // worked out.
+    void add(numeric_expr const& expr);
+    void number_values(numeric_expr const& expr);
+    void reuse(numeric_expr const& expr);
+
+    void set(symbol_id variable);
+    value_number get_value(value_key const& key);
+    void push(numeric_expr const& expr, value_number value, numeric_expr const* left, numeric_expr const* right,
+              bool right_conditional);
+    bool have_operands(numeric_expr const& expr, numeric_expr const& left, numeric_expr const* right);
+    bool encloses(std::size_t outer, std::size_t inner) const;
+
+    // Rebuild the statements of the run that change, and begin a new one.
+    void end_run();
+
+    virtual void visit(string_concat_expr const&) { }  // Numeric expressions have no string operands.
+    virtual void visit(string_variable_expr const&) { }
+    virtual void visit(string_literal_expr const&) { }
+    virtual void visit(arith_expr const& expr);
+    virtual void visit(variable_expr const& expr);
+    virtual void visit(constant_expr const& expr);
+    virtual void visit(relational_expr const& expr);
+    virtual void visit(boolean_expr const& expr);
+    virtual void visit(save_expr const& expr);
+    virtual void visit(temporary_expr const& expr);
+
+    virtual std::auto_ptr<numeric_expr> replace(numeric_expr const& expr);
+    virtual std::auto_ptr<numeric_expr> wrap(numeric_expr const& expr, std::auto_ptr<numeric_expr> copy);
+};
+
+common_subexpression_eliminator::common_subexpression_eliminator()
+    : next_value(1)
+    , operands_done(false)
+    , context_parents(1, 0)
+    , next_slot(0)
+{ }
+
+void common_subexpression_eliminator::run(block& b) {
+    // Control gets to a statement with a label other than from the one before it.
+    std::set<statement const*> labelled;
+    for (block::jump_table_t::const_iterator label = b.jump_table.begin(); label != b.jump_table.end(); ++label)
+        if (label->second != b.statements.end())
+            labelled.insert(label->second->get());
+
+    for (iterator s = b.statements.begin(); s != b.statements.end(); ++s) {
+        if (labelled.count(s->get()))
+            end_run();
+
+        statement const* const current = s->get();
+        if (let_stmt const* const let = dynamic_cast<let_stmt const*>(current)) {
+            members.push_back(s);
+            if (let->get_numeric_value())
+                add(*let->get_numeric_value());
+            set(let->get_variable_name());
+        } else if (print_stmt const* const print = dynamic_cast<print_stmt const*>(current)) {
+            members.push_back(s);
+            print_stmt::expressions_cont const& expressions = print->get_expressions();
+            for (print_stmt::expressions_cont::const_iterator e = expressions.begin(); e != expressions.end(); ++e)
+                if (numeric_expr const* const expr = dynamic_cast<numeric_expr const*>(e->get()))
+                    add(*expr);
+        } else if (if_goto_stmt const* const branch = dynamic_cast<if_goto_stmt const*>(current)) {
+            members.push_back(s);
+            add(branch->get_condition());
+        } else if (input_stmt const* const input = dynamic_cast<input_stmt const*>(current))
+            set(input->get_variable_name());
+        else if (dynamic_cast<empty_stmt const*>(current))
+            continue;
+        else if (if_block_stmt const* const if_block = dynamic_cast<if_block_stmt const*>(current)) {
+            // Each ELSEIF's condition is only worked out after the ones before it.
+            members.push_back(s);
+            if_block_stmt::conditions_cont const& conditions = if_block->get_conditions();
+            for (if_block_stmt::conditions_cont::const_iterator c = conditions.begin(); c != conditions.end(); ++c)
+                add(**c);
+            end_run();
+
+            std::vector<block>& blocks = static_cast<if_block_stmt&>(**s).get_blocks();
+            for (std::vector<block>::iterator body = blocks.begin(); body != blocks.end(); ++body)
+                run(*body);
+        } else if (for_stmt const* const loop = dynamic_cast<for_stmt const*>(current)) {
+            members.push_back(s);
+            add(loop->get_initial_value());
+            set(loop->get_variable_name());
+            add(loop->get_step());
+            add(loop->get_final_value());
+            end_run();
+            run(static_cast<for_stmt&>(**s).get_body());
+        } else if (dynamic_cast<do_stmt const*>(current)) {
+            // The condition is worked out again before every time round, after the body has used the temporaries.
+            end_run();
+            members.push_back(s);
+            add(static_cast<do_stmt const&>(**s).get_condition());
+            end_run();
+            run(static_cast<do_stmt&>(**s).get_body());
+        } else
+            end_run();  // GOTO, STOP and EXIT don't go on to the next statement.
+    }
+
+    end_run();
+}
+
+void common_subexpression_eliminator::add(numeric_expr const& expr) {
+    number_values(expr);
+    reuse(expr);
+    operations.clear();
+}
+
+void common_subexpression_eliminator::number_values(numeric_expr const& expr) {
+    pending.push_back(std::make_pair(&expr, false));
+    while (!pending.empty()) {
+        numeric_expr const* const e = pending.back().first;
+        operands_done = pending.back().second;
+        pending.pop_back();
+        e->accept(*this);
+    }
+    numbered.clear();
+}
+
+void common_subexpression_eliminator::reuse(numeric_expr const& expr) {
+    std::size_t const owner = members.size() - 1;
+    std::vector<std::pair<numeric_expr const*, std::size_t> > walk(1, std::make_pair(&expr, 0));
+    while (!walk.empty()) {
+        numeric_expr const* const e = walk.back().first;
+        std::size_t const context = walk.back().second;
+        walk.pop_back();
+
+        std::map<numeric_expr const*, operation>::const_iterator const found = operations.find(e);
+        if (found == operations.end())
+            continue;
+        operation const& op = found->second;
+
+        // A value worked out before is taken if it's sure to have been; the operands aren't worked out then.
+        std::map<value_number, definition>::const_iterator const earlier = definitions.find(op.value);
+        if (earlier != definitions.end() && encloses(earlier->second.context, context)) {
+            std::map<numeric_expr const*, std::size_t>::iterator slot = saved.find(earlier->second.expr);
+            if (slot == saved.end())
+                slot = saved.insert(std::make_pair(earlier->second.expr, next_slot++)).first;
+            replaced[e] = slot->second;
+            touched.insert(earlier->second.owner);
+            touched.insert(owner);
+            continue;
+        }
+
+        definition const here = { e, context, owner };
+        definitions[op.value] = here;
+
+        if (op.right) {
+            std::size_t right_context = context;
+            if (op.right_conditional) {
+                right_context = context_parents.size();
+                context_parents.push_back(context);
+            }
+            walk.push_back(std::make_pair(op.right, right_context));
+        }
+        walk.push_back(std::make_pair(op.left, context));
+    }
+}
+
+void common_subexpression_eliminator::set(symbol_id variable) {
+    versions[variable] = next_value++;
+}
+
+value_number common_subexpression_eliminator::get_value(value_key const& key) {
+    std::pair<std::map<value_key, value_number>::iterator, bool> const value
+        = values.insert(std::make_pair(key, next_value));
+    if (value.second)
+        ++next_value;
+    return value.first->second;
+}
+
+void common_subexpression_eliminator::push(numeric_expr const& expr, value_number value, numeric_expr const* left,
+                                           numeric_expr const* right, bool right_conditional) {
+    operation const op = { value, left, right, right_conditional };
+    operations[&expr] = op;
+    numbered.push_back(value);
+}
+
+bool common_subexpression_eliminator::have_operands(numeric_expr const& expr, numeric_expr const& left,
+                                                    numeric_expr const* right) {
+    if (operands_done)
+        return true;
+
+    pending.push_back(std::make_pair(&expr, true));
+    if (right)
+        pending.push_back(std::make_pair(right, false));
+    pending.push_back(std::make_pair(&left, false));
+    return false;
+}
+
+bool common_subexpression_eliminator::encloses(std::size_t outer, std::size_t inner) const {
+    while (inner != outer && inner != 0)
+        inner = context_parents[inner];
+    return inner == outer;
+}
+
+void common_subexpression_eliminator::end_run() {
+    // Statements are replaced where they are in the list, so that their labels still lead to them.
+    for (std::set<std::size_t>::const_iterator member = touched.begin(); member != touched.end(); ++member)
+        *members[*member] = clone(**members[*member], *this);
+
+    values.clear();
+    versions.clear();
+    next_value = 1;
+    definitions.clear();
+    context_parents.assign(1, 0);
+    saved.clear();
+    replaced.clear();
+    next_slot = 0;
+    members.clear();
+    touched.clear();
+}
+
+void common_subexpression_eliminator::visit(arith_expr const& expr) {
+    if (!have_operands(expr, expr.get_left_side(), &expr.get_right_side()))
+        return;
+
+    value_number right = numbered.back();
+    numbered.pop_back();
+    value_number left = numbered.back();
+    numbered.pop_back();
+
+    // Adding and multiplying are done on both of a number's values alike, so the order of the operands doesn't matter.
+    arith_expr::e_operator const op = expr.get_operator();
+    if ((op == arith_expr::operator_plus || op == arith_expr::operator_times) && right < left)
+        std::swap(left, right);
+
+    push(expr, get_value(value_key(value_key::kind_arith, op, left, right)), &expr.get_left_side(),
+         &expr.get_right_side(), false);
+}
+
+void common_subexpression_eliminator::visit(variable_expr const& expr) {
+    std::map<symbol_id, value_number>::const_iterator const version = versions.find(expr.get_name());
+    value_key const key(value_key::kind_variable, 0, expr.get_name(), version != versions.end() ? version->second : 0);
+    numbered.push_back(get_value(key));
+}
+
+void common_subexpression_eliminator::visit(constant_expr const& expr) {
+    number const& value = expr.get_value();
+    double const floating_point_value = value.get_floating_point_value();
+    boost::int64_t bits;
+    std::memcpy(&bits, &floating_point_value, sizeof bits);
+    value_key const key(value_key::kind_constant, value.is_integral(), value.get_integral_value(), bits);
+    numbered.push_back(get_value(key));
+}
+
+void common_subexpression_eliminator::visit(relational_expr const& expr) {
+    if (!have_operands(expr, expr.get_left_side(), &expr.get_right_side()))
+        return;
+
+    value_number const right = numbered.back();
+    numbered.pop_back();
+    value_number const left = numbered.back();
+    numbered.pop_back();
+    push(expr, get_value(value_key(value_key::kind_relational, expr.get_operator(), left, right)),
+         &expr.get_left_side(), &expr.get_right_side(), false);
+}
+
+void common_subexpression_eliminator::visit(boolean_expr const& expr) {
+    if (!have_operands(expr, expr.get_left_side(), expr.get_right_side()))
+        return;
+
+    value_number right = 0;
+    if (expr.get_right_side()) {
+        right = numbered.back();
+        numbered.pop_back();
+    }
+    value_number const left = numbered.back();
+    numbered.pop_back();
+    push(expr, get_value(value_key(value_key::kind_boolean, expr.get_operator(), left, right)),
+         &expr.get_left_side(), expr.get_right_side(), expr.get_operator() != boolean_expr::operator_not);
+}
+
+// Temporaries already made are left as they are, with values like no other.
+void common_subexpression_eliminator::visit(save_expr const&) {
+    numbered.push_back(next_value++);
+}
+
+void common_subexpression_eliminator::visit(temporary_expr const&) {
+    numbered.push_back(next_value++);
+}
+
+std::auto_ptr<numeric_expr> common_subexpression_eliminator::replace(numeric_expr const& expr) {
+    std::map<numeric_expr const*, std::size_t>::const_iterator const slot = replaced.find(&expr);
+    if (slot == replaced.end())
+        return std::auto_ptr<numeric_expr>();
+    return std::auto_ptr<numeric_expr>(new temporary_expr(slot->second, clone(expr)));
+}
+
+std::auto_ptr<numeric_expr> common_subexpression_eliminator::wrap(numeric_expr const& expr,
+                                                                  std::auto_ptr<numeric_expr> copy) {
+    std::map<numeric_expr const*, std::size_t>::const_iterator const slot = saved.find(&expr);
+    if (slot == saved.end())
+        return copy;
+    return std::auto_ptr<numeric_expr>(new save_expr(copy, slot->second));
+}
+
+}
+
+void eliminate_common_subexpressions(block& program) {
+    common_subexpression_eliminator eliminator;
+    eliminator.run(program);
+}
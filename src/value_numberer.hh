@@ -0,0 +1,14 @@
+#ifndef VALUE_NUMBERER_HH
+#define VALUE_NUMBERER_HH
+
+#include "parser.hh"
+
+// Work out operations whose values are sure to be the same only once, in every block of a wholly parsed program.  Runs
+// of statements that control goes through in order -- up to a label, a jump or a block -- are numbered as a whole: an
+// operation on the same values as one before it, with the variables it reads not set since, takes the value the first
+// one kept in a temporary.  Operations that aren't sure to have been worked out before, such as the right operand of
+// an AND, aren't taken the values of.  Only operations that have already been worked out are left out, so runs that
+// fail fail at the same operation.
+void eliminate_common_subexpressions(block& program);
+
+#endif
@@ -0,0 +1,9 @@
+#!/bin/sh
+# NOT, AND and OR nested far deeper than the C stack would allow recursing into.
+awk 'BEGIN {
+    depth = 50000
+    printf "print "; for (i = 0; i < depth; ++i) printf "not "; print "0"
+    printf "print "; for (i = 0; i < depth; ++i) printf "(not "; printf "1"; for (i = 0; i < depth; ++i) printf ")"; print ""
+    printf "print 1"; for (i = 0; i < depth; ++i) printf " and 1"; print ""
+    printf "print "; for (i = 0; i < depth; ++i) printf "(0 or "; printf "1"; for (i = 0; i < depth; ++i) printf ")"; print ""
+}'
@@ -0,0 +1,5 @@
+print 1
+stop
+if (4 mod 0) = 1 then
+    print 2
+end if
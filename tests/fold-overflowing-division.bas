@@ -0,0 +1,5 @@
+let n = 1
+if n = 99 then
+    let x = (0 - 2147483647 - 1) / (0 - 1)
+end if
+print n
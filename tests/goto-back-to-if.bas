@@ -0,0 +1,7 @@
+10 let i = 0
+20 if i = 3 then 60
+30 let t = i * 2
+40 let i = i + 1
+50 goto 20
+60 print t
+70 print i
@@ -0,0 +1,4 @@
+print 1
+if 0 then
+    include "missing.bas"
+end if
@@ -0,0 +1,14 @@
+let step = 2
+print step
+let do = 4
+print do * step
+for to = 1 to 5 step step
+    print to
+next to
+let i = 0
+loop:
+let i = i + 1
+if i < 3 then
+    goto loop
+end if
+print i
@@ -0,0 +1,7 @@
+REM NOT takes the rest of the expression, or of the parentheses it's in.
+print not 0 and 0
+print not 1 or 1
+print not 1 = 2 and 3 = 3
+print (not 0) and 0
+print 1 and (not 0 or 1)
+print not not 1 or 0
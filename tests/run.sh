@@ -0,0 +1,41 @@
+#!/bin/sh
+# Run the regression tests: every tests/NAME.bas is run with and without --optimize, with tests/NAME.in as its input
+# if there is one, and what it writes to standard output and standard error, followed by its exit status, must be
+# tests/NAME.expected both times.  A test may be tests/NAME.sh instead, which writes the program to run to standard
+# output, for programs too large to keep.
+#
+# To make or update the expected output of a test, run it and check it by hand: ./basic tests/NAME.bas.
+
+BASIC=${BASIC:-./basic}
+TESTS=$(dirname "$0")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+failures=0
+for expected in "$TESTS"/*.expected; do
+    name=$(basename "$expected" .expected)
+    if [ -f "$TESTS/$name.sh" ]; then
+        sh "$TESTS/$name.sh" > "$WORK/$name.bas" || exit 1
+        program="$WORK/$name.bas"
+    else
+        program="$TESTS/$name.bas"
+    fi
+    input=/dev/null
+    [ -f "$TESTS/$name.in" ] && input="$TESTS/$name.in"
+
+    for flags in "" --optimize; do
+        "$BASIC" $flags "$program" < "$input" > "$WORK/actual" 2>&1
+        echo "exit $?" >> "$WORK/actual"
+        if ! cmp -s "$expected" "$WORK/actual"; then
+            echo "FAIL: $name ${flags:-(default)}"
+            diff "$expected" "$WORK/actual" | head -n 10
+            failures=$((failures + 1))
+        fi
+    done
+done
+
+if [ "$failures" -gt 0 ]; then
+    echo "$failures failed"
+    exit 1
+fi
+echo "All tests passed"
@@ -0,0 +1,5 @@
+for k = 0 to 2
+    if k > 0 then
+        print 10 mod k
+    end if
+next k
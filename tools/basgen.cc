@@ -0,0 +1,331 @@
+// Generator of synthetic BASIC programs for scaling tests.
+//
+// The programs are valid and terminate: all variables are defined up front, GOTOs only jump forward within their
+// block, loops have small constant trip counts, and numeric variables are kept in range with MOD so that no
+// arithmetic can fail.  The output is deterministic for a given set of options.
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+
+#include <boost/lexical_cast.hpp>
+
+namespace {
+
+struct options {
+    unsigned long   lines;          // Approximate number of lines to generate.
+    unsigned        depth;          // Maximum nesting of IF/FOR/DO.
+    double          label_density;  // Probability of a statement being labelled.
+    double          goto_density;   // Probability of a labelled statement being jumped to from earlier.
+    unsigned        expr_depth;     // Maximum nesting of parenthesised sub-expressions.
+    unsigned        expr_width;     // Maximum number of terms at each level of an expression.
+    unsigned        variables;      // Numeric variables; there are half as many string variables.
+    double          strings;        // Probability of a statement working with strings.
+    double          prints;         // Probability of a statement being a PRINT.
+    double          blocks;         // Probability of a statement opening a block.
+    unsigned        trips;          // Iterations of each loop.
+    unsigned long   seed;
+
+    options()
+        : lines(1000)
+        , depth(3)
+        , label_density(0.05)
+        , goto_density(0.5)
+        , expr_depth(2)
+        , expr_width(4)
+        , variables(26)
+        , strings(0.1)
+        , prints(0.05)
+        , blocks(0.1)
+        , trips(2)
+        , seed(1)
+    { }
+};
+
+class generator {
+public:
+    generator(options const& opts, std::ostream& os);
+
+    void generate();
+
+private:
+    options const&  opts;
+    std::ostream&   os;
+    unsigned long   lines;
+    unsigned long   next_label;
+    unsigned long   next_loop;
+    unsigned long   random_state;
+
+    double random();                            // [0, 1)
+    unsigned random(unsigned n);                // [0, n)
+    bool chance(double probability);
+
+    void emit(unsigned indent, std::string const& text);
+    std::string numeric_variable();
+    std::string string_variable();
+    std::string numeric_expr(unsigned depth);
+    std::string string_expr();
+    std::string condition();
+
+    // Generate statements at the given nesting depth until budget lines have been produced.
+    void block(unsigned depth, unsigned long budget);
+    void simple_statement(unsigned indent, std::string const& label, unsigned long& pending_goto);
+    void compound_statement(unsigned depth, std::string const& label, unsigned long budget);
+};
+
+generator::generator(options const& opts, std::ostream& os)
+    : opts(opts)
+    , os(os)
+    , lines(0)
+    , next_label(0)
+    , next_loop(0)
+    , random_state(opts.seed * 2654435761ul + 1)
+{ }
+
+void generator::generate() {
+    emit(0, "REM Generated by basgen");
+    for (unsigned i = 0; i < opts.variables; ++i)
+        emit(0, "let v" + boost::lexical_cast<std::string>(i) + " = " + boost::lexical_cast<std::string>(i + 1));
+    for (unsigned i = 0; i < (opts.variables + 1) / 2; ++i)
+        emit(0, "let s" + boost::lexical_cast<std::string>(i) + "$ = \"s" + boost::lexical_cast<std::string>(i) + "\"");
+
+    block(0, opts.lines > lines ? opts.lines - lines : 1);
+}
+
+double generator::random() {
+    // xorshift; plenty for picking statements.
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (random_state >> 11) % 1000000 / 1000000.0;
+}
+
+unsigned generator::random(unsigned n) {
+    return n ? static_cast<unsigned>(random() * n) : 0;
+}
+
+bool generator::chance(double probability) {
+    return random() < probability;
+}
+
+void generator::emit(unsigned indent, std::string const& text) {
+    os << std::string(indent * 4, ' ') << text << '\n';
+    ++lines;
+}
+
+std::string generator::numeric_variable() {
+    return "v" + boost::lexical_cast<std::string>(random(opts.variables));
+}
+
+std::string generator::string_variable() {
+    return "s" + boost::lexical_cast<std::string>(random((opts.variables + 1) / 2)) + "$";
+}
+
+std::string generator::numeric_expr(unsigned depth) {
+    unsigned const width = 1 + random(opts.expr_width);
+    std::string result;
+
+    for (unsigned i = 0; i < width; ++i) {
+        if (i > 0)
+            result += chance(0.5) ? " + " : " - ";
+
+        std::string term;
+        if (depth > 0 && chance(0.3)) {
+            term = "(" + numeric_expr(depth - 1) + ")";
+        } else {
+            term = chance(0.6) ? numeric_variable() : boost::lexical_cast<std::string>(random(100));
+
+            // Only leaves are multiplied, to keep the values well within the range of int.  Products are
+            // parenthesised so that they can be arbitrarily long.
+            if (chance(0.3))
+                term = "(" + term + " * " + numeric_variable() + ")";
+        }
+
+        if (chance(0.1))
+            term = "(" + term + " mod " + boost::lexical_cast<std::string>(1 + random(50)) + ")";
+        result += term;
+    }
+
+    return result;
+}
+
+std::string generator::string_expr() {
+    std::string result = chance(0.5) ? string_variable() : "\"t" + boost::lexical_cast<std::string>(random(100)) + "\"";
+    if (chance(0.5))
+        result += " & " + string_variable();
+    return result;
+}
+
+std::string generator::condition() {
+    static char const* const OPERATORS[] = { "=", "<>", "<", "<=", ">", ">=" };
+    return "(" + numeric_expr(opts.expr_depth) + ") mod 10 " + OPERATORS[random(6)] + ' '
+        + boost::lexical_cast<std::string>(random(10));
+}
+
+void generator::block(unsigned depth, unsigned long budget) {
+    unsigned long const end = lines + budget;
+    unsigned long pending_goto = 0;  // Label of a forward jump that still needs its target, or 0.
+
+    while (lines < end) {
+        std::string label;
+        if (pending_goto && (chance(0.3) || lines + 1 >= end)) {
+            label = "l" + boost::lexical_cast<std::string>(pending_goto) + ": ";
+            pending_goto = 0;
+        } else if (chance(opts.label_density))
+            label = "l" + boost::lexical_cast<std::string>(++next_label) + ": ";
+
+        unsigned long const remaining = end - lines;
+        if (depth < opts.depth && remaining >= 4 && chance(opts.blocks))
+            compound_statement(depth, label, std::min<unsigned long>(remaining - 3, 1 + random(opts.lines / 10 + 8)));
+        else
+            simple_statement(depth, label, pending_goto);
+    }
+
+    // A jump still in flight needs somewhere to land.
+    if (pending_goto)
+        emit(depth, "l" + boost::lexical_cast<std::string>(pending_goto) + ": rem landing");
+}
+
+void generator::simple_statement(unsigned indent, std::string const& label, unsigned long& pending_goto) {
+    if (!pending_goto && chance(opts.label_density * opts.goto_density)) {
+        pending_goto = ++next_label;
+        std::string const target = "l" + boost::lexical_cast<std::string>(pending_goto);
+        if (chance(0.5))
+            emit(indent, label + "goto " + target);
+        else
+            emit(indent, label + "if " + condition() + " then " + target);
+    } else if (chance(opts.prints)) {
+        if (chance(opts.strings))
+            emit(indent, label + "print " + string_expr());
+        else
+            emit(indent, label + "print " + numeric_expr(opts.expr_depth) + ", \" \", (" + numeric_variable() + ") / 7");
+    } else if (chance(opts.strings)) {
+        emit(indent, label + "let " + string_variable() + " = " + string_expr());
+    } else if (chance(0.02)) {
+        emit(indent, label + "rem comment " + boost::lexical_cast<std::string>(lines));
+    } else {
+        emit(indent, label + "let " + numeric_variable() + " = (" + numeric_expr(opts.expr_depth) + ") mod 1000");
+    }
+}
+
+void generator::compound_statement(unsigned depth, std::string const& label, unsigned long budget) {
+    std::string const trips = boost::lexical_cast<std::string>(opts.trips);
+
+    switch (random(3)) {
+    case 0: {
+        std::string const var = "f" + boost::lexical_cast<std::string>(depth);
+        emit(depth, label + "for " + var + " = 1 to " + trips);
+        block(depth + 1, budget);
+        emit(depth, "next " + var);
+        break;
+    }
+    case 1: {
+        std::string const counter = "d" + boost::lexical_cast<std::string>(next_loop++);
+        emit(depth, label + "let " + counter + " = 0");
+        emit(depth, "do while " + counter + " < " + trips);
+        block(depth + 1, budget > 1 ? budget - 1 : 1);
+        emit(depth + 1, "let " + counter + " = " + counter + " + 1");
+        emit(depth, "loop");
+        break;
+    }
+    default: {
+        emit(depth, label + "if " + condition() + " then");
+        unsigned const clauses = 1 + random(3);
+        for (unsigned i = 0; i < clauses; ++i) {
+            block(depth + 1, std::max<unsigned long>(1, budget / clauses));
+            if (i + 1 < clauses) {
+                if (i + 2 == clauses && chance(0.5))
+                    emit(depth, "else");
+                else
+                    emit(depth, "elseif " + condition() + " then");
+            }
+        }
+        emit(depth, "end if");
+        break;
+    }
+    }
+}
+
+template <typename T>
+bool get_value(std::string const& value, T& result) {
+    try {
+        result = boost::lexical_cast<T>(value);
+        return true;
+    } catch (boost::bad_lexical_cast const&) {
+        return false;
+    }
+}
+
+void print_usage(std::string const& program_name) {
+    std::cerr << "Usage: " << program_name << " [options]\n"
+              << '\n'
+              << "Write a synthetic BASIC program to standard output.\n"
+              << '\n'
+              << "Options:\n"
+              << "\t--lines=N\t\tApproximate number of lines (default 1000)\n"
+              << "\t--depth=N\t\tMaximum nesting of IF/FOR/DO (default 3)\n"
+              << "\t--blocks=P\t\tProbability of a statement opening a block (default 0.1)\n"
+              << "\t--label-density=P\tProbability of a statement having a label (default 0.05)\n"
+              << "\t--goto-density=P\tProbability of a label being jumped to (default 0.5)\n"
+              << "\t--expr-depth=N\t\tNesting of parenthesised sub-expressions (default 2)\n"
+              << "\t--expr-width=N\t\tMaximum terms per expression level (default 4)\n"
+              << "\t--variables=N\t\tNumber of numeric variables (default 26)\n"
+              << "\t--strings=P\t\tProbability of a statement using strings (default 0.1)\n"
+              << "\t--prints=P\t\tProbability of a statement being a PRINT (default 0.05)\n"
+              << "\t--trips=N\t\tIterations of every loop (default 2)\n"
+              << "\t--seed=N\t\tRandom seed (default 1)\n";
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> parameters(argv, argv + argc);
+    options opts;
+
+    for (std::size_t i = 1; i < parameters.size(); ++i) {
+        std::string const& p = parameters[i];
+        std::string::size_type const equals = p.find('=');
+        std::string const name = p.substr(0, equals);
+        std::string const value = equals == std::string::npos ? std::string() : p.substr(equals + 1);
+
+        bool ok;
+        if (name == "--lines")
+            ok = get_value(value, opts.lines);
+        else if (name == "--depth")
+            ok = get_value(value, opts.depth);
+        else if (name == "--blocks")
+            ok = get_value(value, opts.blocks);
+        else if (name == "--label-density")
+            ok = get_value(value, opts.label_density);
+        else if (name == "--goto-density")
+            ok = get_value(value, opts.goto_density);
+        else if (name == "--expr-depth")
+            ok = get_value(value, opts.expr_depth);
+        else if (name == "--expr-width")
+            ok = get_value(value, opts.expr_width) && opts.expr_width > 0;
+        else if (name == "--variables")
+            ok = get_value(value, opts.variables) && opts.variables > 0;
+        else if (name == "--strings")
+            ok = get_value(value, opts.strings);
+        else if (name == "--prints")
+            ok = get_value(value, opts.prints);
+        else if (name == "--trips")
+            ok = get_value(value, opts.trips);
+        else if (name == "--seed")
+            ok = get_value(value, opts.seed);
+        else {
+            print_usage(parameters[0]);
+            return name == "-h" || name == "--help" ? 0 : 1;
+        }
+
+        if (!ok) {
+            std::cerr << "Invalid value for " << name << ": " << value << '\n';
+            return 1;
+        }
+    }
+
+    std::ios::sync_with_stdio(false);
+    generator(opts, std::cout).generate();
+}